@@ -0,0 +1,360 @@
+#include <unistd.h>
+
+#include "bench.h"
+
+/*
+ * Time moves BENCH_LINES_PER_SECOND lines a second from BENCH_EPOCH, so
+ * output never depends on the clock. Syslog lines carry no year and the
+ * analyzer dates them in the current one.
+ */
+#define BENCH_EPOCH 1709567308L /* 2024-03-04 15:48:28 UTC */
+#define BENCH_LINES_PER_SECOND 20
+#define BENCH_MAX_LINE 512
+
+static const char *const format_names[BENCH_FORMATS] = {"syslog", "iso8601",
+                                                        "epoch", "json"};
+
+static const char *const severity_names[LOG_SEVERITY_LEVELS] = {
+    "emerg", "alert", "crit", "error", "warn", "notice", "info", "debug"};
+
+static const char *const severity_keywords[LOG_SEVERITY_LEVELS] = {
+    "EMERG", "ALERT", "CRIT", "ERROR", "WARN", "NOTICE", "INFO", "DEBUG"};
+
+static const char *const months[] = {"Jan", "Feb", "Mar", "Apr",
+                                     "May", "Jun", "Jul", "Aug",
+                                     "Sep", "Oct", "Nov", "Dec"};
+
+static const char *const apps[] = {"api", "worker", "sshd",
+                                   "cron", "nginx", "db"};
+
+/* Each matches one of the default patterns */
+static const char *const hit_messages[] = {
+    "connection timed out to 10.0.%u.%u",
+    "disk full on /dev/sda%u (%u inodes free)",
+    "out of memory: killed process %u after %u restarts",
+    "query timeout after %ums on table orders%u",
+    "cpu usage at 9%u%% on core %u",
+    "packet loss of %u%% on eth%u",
+    "deadlock detected in transaction %u on shard %u",
+    "too many open files in worker %u (limit %u)",
+};
+
+/* None matches a default pattern */
+static const char *const miss_messages[] = {
+    "request %u served in %ums",
+    "session opened for user app%u by uid %u",
+    "GET /api/v1/items/%u 200 %u",
+    "cache miss for key user:%u shard %u",
+    "job %u finished in %ums",
+    "heartbeat from node-%u seq %u",
+    "config reloaded from /etc/app/%u.conf in %ums",
+    "accepted connection from 192.168.%u.%u",
+};
+
+#define COUNT(array) ((int)(sizeof(array) / sizeof((array)[0])))
+
+void bench_options_init(BenchOptions *options) {
+  memset(options, 0, sizeof(BenchOptions));
+  options->lines = 200000;
+  options->format_weights[0] = 60; /* syslog */
+  options->format_weights[1] = 25; /* iso8601 */
+  options->format_weights[2] = 5;  /* epoch */
+  options->format_weights[3] = 10; /* json */
+  options->severity_weights[3] = 5;  /* error */
+  options->severity_weights[4] = 10; /* warn */
+  options->severity_weights[6] = 80; /* info */
+  options->severity_weights[7] = 5;  /* debug */
+  options->hit_rate = 0.05;
+  options->seed = 1;
+}
+
+/* Parses "name:weight,name:weight"; names left out weigh nothing */
+static bool parse_weights(const char *spec, const char *const *names,
+                          int count, int *weights) {
+  const char *colon;
+  char *end;
+  long weight, total = 0;
+  int index;
+
+  memset(weights, 0, count * sizeof(int));
+  while (*spec) {
+    colon = strchr(spec, ':');
+    if (!colon) return false;
+    for (index = 0; index < count; index++)
+      if (strlen(names[index]) == (size_t)(colon - spec) &&
+          strncmp(spec, names[index], (size_t)(colon - spec)) == 0)
+        break;
+    if (index == count) return false;
+
+    weight = strtol(colon + 1, &end, 10);
+    if (end == colon + 1 || weight < 0 || weight > 1000000 ||
+        (*end != ',' && *end != '\0'))
+      return false;
+    weights[index] = (int)weight;
+    total += weight;
+    spec = *end == ',' ? end + 1 : end;
+  }
+  return total > 0;
+}
+
+bool bench_options_parse(BenchOptions *options, int argc, char **argv) {
+  char *end;
+  int option;
+
+  while ((option = getopt(argc, argv, "n:f:s:p:S:")) != -1) {
+    switch (option) {
+      case 'n':
+        options->lines = strtol(optarg, &end, 10);
+        if (*end != '\0' || options->lines <= 0) return false;
+        break;
+      case 'f':
+        if (!parse_weights(optarg, format_names, BENCH_FORMATS,
+                           options->format_weights))
+          return false;
+        break;
+      case 's':
+        if (!parse_weights(optarg, severity_names, LOG_SEVERITY_LEVELS,
+                           options->severity_weights))
+          return false;
+        break;
+      case 'p':
+        options->hit_rate = strtod(optarg, &end);
+        if (*end != '\0' || options->hit_rate < 0 || options->hit_rate > 1)
+          return false;
+        break;
+      case 'S':
+        options->seed = strtoull(optarg, &end, 10);
+        if (*end != '\0') return false;
+        break;
+      default:
+        return false;
+    }
+  }
+  return optind == argc;
+}
+
+void bench_options_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [-n LINES] [-f FORMATS] [-s SEVERITIES] [-p RATE] "
+          "[-S SEED]\n"
+          "  -n LINES       lines to generate (default: 200000)\n"
+          "  -f FORMATS     format mix (default: "
+          "syslog:60,iso8601:25,epoch:5,json:10)\n"
+          "  -s SEVERITIES  severity mix over emerg, alert, crit, error, "
+          "warn,\n"
+          "                 notice, info, debug (default: "
+          "info:80,warn:10,error:5,debug:5)\n"
+          "  -p RATE        share of messages a default pattern matches "
+          "(default: 0.05)\n"
+          "  -S SEED        random seed (default: 1)\n",
+          program);
+}
+
+void bench_generator_init(BenchGenerator *generator,
+                          const BenchOptions *options) {
+  generator->options = *options;
+  generator->state = options->seed;
+  generator->line = 0;
+}
+
+/* splitmix64: small, fast and the same on every platform */
+static uint64_t next_random(BenchGenerator *generator) {
+  uint64_t z = (generator->state += 0x9e3779b97f4a7c15ull);
+
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+static int pick_weighted(BenchGenerator *generator, const int *weights,
+                         int count) {
+  long total = 0, pick;
+  int i;
+
+  for (i = 0; i < count; i++) total += weights[i];
+  pick = (long)(next_random(generator) % (uint64_t)total);
+  for (i = 0; i < count - 1; i++) {
+    if (pick < weights[i]) break;
+    pick -= weights[i];
+  }
+  return i;
+}
+
+/* Writes the next line, without a newline, and returns its length */
+size_t bench_generator_next(BenchGenerator *generator, char *buffer,
+                            size_t size) {
+  const BenchOptions *options = &generator->options;
+  char message[160];
+  const char *text, *app;
+  time_t timestamp;
+  struct tm tm;
+  unsigned a, b, host, pid;
+  int format, severity, length;
+  bool hit;
+
+  timestamp = (time_t)(BENCH_EPOCH + generator->line / BENCH_LINES_PER_SECOND);
+  gmtime_r(&timestamp, &tm);
+  format = pick_weighted(generator, options->format_weights, BENCH_FORMATS);
+  severity = pick_weighted(generator, options->severity_weights,
+                           LOG_SEVERITY_LEVELS);
+  hit = (double)(next_random(generator) % 1000000) <
+        options->hit_rate * 1000000;
+  text = hit ? hit_messages[next_random(generator) % COUNT(hit_messages)]
+             : miss_messages[next_random(generator) % COUNT(miss_messages)];
+  app = apps[next_random(generator) % COUNT(apps)];
+  host = (unsigned)(next_random(generator) % 4) + 1;
+  pid = (unsigned)(next_random(generator) % 500) + 1000;
+  a = (unsigned)(next_random(generator) % 10);
+  b = (unsigned)(next_random(generator) % 1000);
+  snprintf(message, sizeof(message), text, a, b);
+  generator->line++;
+
+  switch (format) {
+    case 0:
+      length = snprintf(buffer, size, "%s %2d %02d:%02d:%02d host%u %s[%u]: "
+                        "%s %s", months[tm.tm_mon], tm.tm_mday, tm.tm_hour,
+                        tm.tm_min, tm.tm_sec, host, app, pid,
+                        severity_keywords[severity], message);
+      break;
+    case 1:
+      length = snprintf(buffer, size, "%04d-%02d-%02dT%02d:%02d:%02d.%06u"
+                        "+00:00 host%u %s[%u]: %s %s", tm.tm_year + 1900,
+                        tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min,
+                        tm.tm_sec, b * 1000, host, app, pid,
+                        severity_keywords[severity], message);
+      break;
+    case 2:
+      length = snprintf(buffer, size, "%lld host%u %s[%u]: %s %s",
+                        (long long)timestamp, host, app, pid,
+                        severity_keywords[severity], message);
+      break;
+    default:
+      length = snprintf(buffer, size, "{\"time\":\"%04d-%02d-%02dT%02d:%02d:"
+                        "%02dZ\",\"level\":\"%s\",\"host\":\"host%u\","
+                        "\"app\":\"%s\",\"pid\":%u,\"msg\":\"%s\"}",
+                        tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+                        tm.tm_hour, tm.tm_min, tm.tm_sec,
+                        severity_names[severity], host, app, pid, message);
+      break;
+  }
+  if (length < 0) return 0;
+  return (size_t)length < size ? (size_t)length : size - 1;
+}
+
+bool bench_corpus_build(BenchCorpus *corpus, const BenchOptions *options) {
+  BenchGenerator generator;
+  size_t capacity, used = 0, length, *offsets;
+  char *grown;
+
+  memset(corpus, 0, sizeof(BenchCorpus));
+  capacity = (size_t)options->lines * 128;
+  corpus->text = (char *)malloc(capacity);
+  corpus->lines = (char **)malloc(options->lines * sizeof(char *));
+  corpus->lengths = (size_t *)malloc(options->lines * sizeof(size_t));
+  offsets = (size_t *)malloc(options->lines * sizeof(size_t));
+  if (!corpus->text || !corpus->lines || !corpus->lengths || !offsets) {
+    free(offsets);
+    bench_corpus_free(corpus);
+    return false;
+  }
+
+  /* Lines are placed by offset while the buffer may still move */
+  bench_generator_init(&generator, options);
+  for (long i = 0; i < options->lines; i++) {
+    if (capacity - used < BENCH_MAX_LINE) {
+      grown = (char *)realloc(corpus->text, capacity * 2);
+      if (!grown) {
+        free(offsets);
+        bench_corpus_free(corpus);
+        return false;
+      }
+      corpus->text = grown;
+      capacity *= 2;
+    }
+    length = bench_generator_next(&generator, corpus->text + used,
+                                  BENCH_MAX_LINE);
+    corpus->lengths[i] = length;
+    offsets[i] = used;
+    used += length + 1;
+  }
+
+  for (long i = 0; i < options->lines; i++)
+    corpus->lines[i] = corpus->text + offsets[i];
+  free(offsets);
+  corpus->count = options->lines;
+  corpus->bytes = used;
+  return true;
+}
+
+bool bench_corpus_write(const BenchCorpus *corpus, const char *path) {
+  FILE *fp = fopen(path, "w");
+
+  if (!fp) {
+    perror("Failed to write benchmark log");
+    return false;
+  }
+  for (long i = 0; i < corpus->count; i++) {
+    fwrite(corpus->lines[i], 1, corpus->lengths[i], fp);
+    fputc('\n', fp);
+  }
+  if (fclose(fp) != 0) {
+    perror("Failed to write benchmark log");
+    return false;
+  }
+  return true;
+}
+
+void bench_corpus_free(BenchCorpus *corpus) {
+  free(corpus->text);
+  free(corpus->lines);
+  free(corpus->lengths);
+  memset(corpus, 0, sizeof(BenchCorpus));
+}
+
+double bench_now_ns(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+/* Counted by the analyzer's own stand-ins for malloc; -1 if it has none */
+long bench_allocations(void) { return log_allocation_count(); }
+
+static void print_weights(const char *label, const char *const *names,
+                          const int *weights, int count) {
+  const char *separator = "";
+
+  printf(" %s=", label);
+  for (int i = 0; i < count; i++) {
+    if (weights[i] == 0) continue;
+    printf("%s%s:%d", separator, names[i], weights[i]);
+    separator = ",";
+  }
+}
+
+/*
+ * One "#" line describing the input, a column header, then one row per
+ * benchmark from bench_print_result(). Columns are separated by spaces
+ * and never change order, so runs can be compared with awk or diff.
+ */
+void bench_print_header(const BenchOptions *options,
+                        const BenchCorpus *corpus) {
+  printf("# lines=%ld bytes=%zu seed=%llu hit_rate=%.3f", corpus->count,
+         corpus->bytes, (unsigned long long)options->seed, options->hit_rate);
+  print_weights("formats", format_names, options->format_weights,
+                BENCH_FORMATS);
+  print_weights("severities", severity_names, options->severity_weights,
+                LOG_SEVERITY_LEVELS);
+  printf("\n%-16s %10s %12s %10s %10s %12s\n", "benchmark", "lines", "bytes",
+         "ns/line", "MB/s", "allocs/line");
+}
+
+/* allocations is -1 when they cannot be counted */
+void bench_print_result(const char *name, long lines, size_t bytes,
+                        double ns, long allocations) {
+  printf("%-16s %10ld %12zu %10.1f %10.1f %12.3f\n", name, lines, bytes,
+         ns / lines, bytes * 1e3 / ns,
+         allocations < 0 ? -1.0 : (double)allocations / lines);
+  fflush(stdout);
+}
@@ -0,0 +1,58 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/*
+ * Support shared by the benchmarks: a deterministic synthetic log
+ * generator, a clock, allocation counts and one result format.
+ */
+
+#include "log_analyzer.h"
+
+#define BENCH_FORMATS 4 /* syslog, iso8601, epoch, json */
+
+typedef struct {
+  long lines;
+  int format_weights[BENCH_FORMATS];
+  int severity_weights[LOG_SEVERITY_LEVELS]; /* emerg .. debug */
+  double hit_rate; /* share of messages a default pattern matches */
+  uint64_t seed;
+} BenchOptions;
+
+/* The same options and seed always yield the same lines */
+typedef struct {
+  BenchOptions options;
+  uint64_t state;
+  long line;
+} BenchGenerator;
+
+/* A generated log held in memory, one NUL-terminated string per line */
+typedef struct {
+  char *text;
+  char **lines;
+  size_t *lengths;
+  long count;
+  size_t bytes; /* including a newline per line, as on disk */
+} BenchCorpus;
+
+void bench_options_init(BenchOptions *options);
+bool bench_options_parse(BenchOptions *options, int argc, char **argv);
+void bench_options_usage(const char *program);
+
+void bench_generator_init(BenchGenerator *generator,
+                          const BenchOptions *options);
+size_t bench_generator_next(BenchGenerator *generator, char *buffer,
+                            size_t size);
+
+bool bench_corpus_build(BenchCorpus *corpus, const BenchOptions *options);
+bool bench_corpus_write(const BenchCorpus *corpus, const char *path);
+void bench_corpus_free(BenchCorpus *corpus);
+
+double bench_now_ns(void);
+long bench_allocations(void);
+
+void bench_print_header(const BenchOptions *options,
+                        const BenchCorpus *corpus);
+void bench_print_result(const char *name, long lines, size_t bytes,
+                        double ns, long allocations);
+
+#endif  // !BENCH_H
@@ -0,0 +1,116 @@
+/*
+ * Memory per entry and severity-scan time for the LogEntry array versus
+ * the columnar store. Each layout is built in a forked child so resident
+ * set growth is measured from a clean heap.
+ */
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "log_analyzer.h"
+
+#define BENCH_ENTRIES 500000
+#define BENCH_SOURCES 300
+#define BENCH_PROCESSES 500
+
+static const char *const levels[] = {"INFO", "INFO", "INFO", "WARN",
+                                     "ERROR", "DEBUG"};
+
+static void make_line(long i, char *buffer, size_t size) {
+  snprintf(buffer, size, "app%ld[%ld]: %s request %ld served in %ldms",
+           i % BENCH_SOURCES, 1000 + i % BENCH_PROCESSES, levels[i % 6], i,
+           i % 997);
+}
+
+static long resident_bytes(void) {
+  long pages = 0, resident = 0;
+  FILE *fp = fopen("/proc/self/statm", "r");
+
+  if (!fp) return 0;
+  if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) resident = 0;
+  fclose(fp);
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+static double elapsed_ns(const struct timespec *start,
+                         const struct timespec *end) {
+  return (end->tv_sec - start->tv_sec) * 1e9 +
+         (end->tv_nsec - start->tv_nsec);
+}
+
+static void report(const char *layout, long before, double scan_ns,
+                   const long *counts) {
+  printf("%-8s %14.1f %16.2f %8ld\n", layout,
+         (double)(resident_bytes() - before) / BENCH_ENTRIES,
+         scan_ns / BENCH_ENTRIES, counts[3]);
+}
+
+static void bench_entries(void) {
+  LogAnalyzerContext *ctx = log_analyzer_init(NULL, NULL, NULL);
+  LogEntry **entries;
+  long counts[LOG_SEVERITY_LEVELS] = {0};
+  struct timespec start, end;
+  char line[128];
+  long before = resident_bytes();
+
+  entries = (LogEntry **)malloc(BENCH_ENTRIES * sizeof(LogEntry *));
+  for (long i = 0; i < BENCH_ENTRIES; i++) {
+    make_line(i, line, sizeof(line));
+    entries[i] = log_parser_parse_line(ctx, line);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (long i = 0; i < BENCH_ENTRIES; i++) counts[entries[i]->severity]++;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  report("entries", before, elapsed_ns(&start, &end), counts);
+  free(entries);
+  log_analyzer_cleanup(ctx);
+}
+
+static void bench_columns(void) {
+  LogAnalyzerContext *ctx = log_analyzer_init(NULL, NULL, NULL);
+  LogColumns *columns;
+  LogRecord record;
+  long counts[LOG_SEVERITY_LEVELS];
+  struct timespec start, end;
+  char line[128];
+  long before = resident_bytes();
+
+  columns = log_columns_create();
+  for (long i = 0; i < BENCH_ENTRIES; i++) {
+    make_line(i, line, sizeof(line));
+    log_parser_parse_record(ctx, line, strlen(line), &record);
+    log_columns_append(columns, &record);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  log_columns_count_severities(columns, counts);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  report("columns", before, elapsed_ns(&start, &end), counts);
+  printf("# %d sources, %d process ids interned\n",
+         log_string_table_count(columns->source_table),
+         log_string_table_count(columns->process_id_table));
+  log_columns_free(columns);
+  log_analyzer_cleanup(ctx);
+}
+
+static void run_child(void (*bench)(void)) {
+  pid_t pid = fork();
+
+  if (pid == 0) {
+    bench();
+    fflush(stdout);
+    _exit(0);
+  }
+  if (pid > 0) waitpid(pid, NULL, 0);
+}
+
+int main(void) {
+  printf("%-8s %14s %16s %8s\n", "layout", "bytes/entry", "severity ns/row",
+         "errors");
+  fflush(stdout);
+  run_child(bench_entries);
+  run_child(bench_columns);
+  return 0;
+}
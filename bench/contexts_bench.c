@@ -0,0 +1,155 @@
+/*
+ * Many analyzers in one process, as an embedding program runs them: one
+ * context analyzes the log alone, then CONTEXT_COUNT contexts analyze it
+ * at once on their own threads. Each thread feeds the text through
+ * log_analyzer_feed() in pieces of its own random sizes, so lines are cut
+ * anywhere, and every context must end with the lone context's counts.
+ * Links the static library and takes the options of bench/loggen:
+ *
+ *   bench/contexts_bench -n 20000 -p 0.5
+ */
+#include <pthread.h>
+
+#include "bench.h"
+
+#define CONTEXT_COUNT 64
+#define CONTEXT_LINES 20000 /* per context, unless -n says otherwise */
+#define MAX_FEED 8192       /* largest piece fed at once */
+
+typedef struct {
+  const char *text; /* the corpus as it would be on disk */
+  size_t length;
+  uint64_t seed; /* picks the piece sizes */
+  long *frequencies; /* by pattern ID */
+  int pattern_count;
+  long entry_count;
+  int recommendation_count;
+  bool success;
+} ContextRun;
+
+static uint64_t next_random(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static void *run_context(void *argument) {
+  ContextRun *run = (ContextRun *)argument;
+  LogAnalyzerContext *ctx = log_analyzer_init(NULL, NULL, NULL);
+  Pattern *patterns;
+  size_t offset = 0, piece;
+  int count;
+
+  run->success = ctx && log_analyzer_begin(ctx);
+  while (run->success && offset < run->length) {
+    piece = run->seed == 0 ? run->length - offset
+                           : 1 + next_random(&run->seed) % MAX_FEED;
+    if (piece > run->length - offset) piece = run->length - offset;
+    run->success = log_analyzer_feed(ctx, run->text + offset, piece);
+    offset += piece;
+  }
+  run->success = run->success && log_analyzer_finish(ctx);
+
+  if (run->success) {
+    patterns = pattern_detector_get_patterns(ctx, &count);
+    run->frequencies = (long *)calloc(count + 1, sizeof(long));
+    run->success = run->frequencies != NULL;
+    for (int i = 0; run->success && i < count; i++)
+      run->frequencies[patterns[i].id] = patterns[i].frequency;
+    run->pattern_count = count;
+    run->entry_count = ctx->entry_count;
+    recommendation_generator_get_recommendations(ctx,
+                                                 &run->recommendation_count);
+  }
+  log_analyzer_cleanup(ctx);
+  return NULL;
+}
+
+static bool same_results(const ContextRun *run, const ContextRun *expected) {
+  if (!run->success || run->pattern_count != expected->pattern_count ||
+      run->entry_count != expected->entry_count ||
+      run->recommendation_count != expected->recommendation_count)
+    return false;
+  for (int i = 0; i < run->pattern_count; i++) {
+    if (run->frequencies[i] != expected->frequencies[i]) return false;
+  }
+  return true;
+}
+
+/* The corpus with a newline after every line, as log_analyzer_feed() takes */
+static char *join_lines(const BenchCorpus *corpus) {
+  char *text = (char *)malloc(corpus->bytes + 1), *out = text;
+
+  for (long i = 0; text && i < corpus->count; i++) {
+    memcpy(out, corpus->lines[i], corpus->lengths[i]);
+    out += corpus->lengths[i];
+    *out++ = '\n';
+  }
+  return text;
+}
+
+int main(int argc, char **argv) {
+  ContextRun expected, runs[CONTEXT_COUNT];
+  pthread_t threads[CONTEXT_COUNT];
+  BenchOptions options;
+  BenchCorpus corpus;
+  int started = 0, failed = 0;
+  double start, ns;
+  char *text;
+
+  bench_options_init(&options);
+  options.lines = CONTEXT_LINES;
+  if (!bench_options_parse(&options, argc, argv) ||
+      options.lines > 10000000) {
+    bench_options_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (!bench_corpus_build(&corpus, &options) ||
+      !(text = join_lines(&corpus))) {
+    fprintf(stderr, "Out of memory generating %ld lines\n", options.lines);
+    return EXIT_FAILURE;
+  }
+  bench_print_header(&options, &corpus);
+
+  /* Whole text in one feed, on this thread */
+  memset(&expected, 0, sizeof(expected));
+  expected.text = text;
+  expected.length = corpus.bytes;
+  start = bench_now_ns();
+  run_context(&expected);
+  ns = bench_now_ns() - start;
+  if (!expected.success) {
+    fprintf(stderr, "Benchmark contexts_1 failed\n");
+    return EXIT_FAILURE;
+  }
+  bench_print_result("contexts_1", corpus.count, corpus.bytes, ns, -1);
+
+  memset(runs, 0, sizeof(runs));
+  start = bench_now_ns();
+  for (int i = 0; i < CONTEXT_COUNT; i++) {
+    runs[i].text = text;
+    runs[i].length = corpus.bytes;
+    runs[i].seed = 0x9e3779b97f4a7c15ull * (uint64_t)(i + 1);
+    if (pthread_create(&threads[i], NULL, run_context, &runs[i]) != 0) break;
+    started++;
+  }
+  for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+  ns = bench_now_ns() - start;
+
+  for (int i = 0; i < CONTEXT_COUNT; i++) {
+    if (i >= started || !same_results(&runs[i], &expected)) failed++;
+    free(runs[i].frequencies);
+  }
+  if (failed == 0)
+    bench_print_result("contexts_64", corpus.count * CONTEXT_COUNT,
+                       corpus.bytes * CONTEXT_COUNT, ns, -1);
+  else
+    fprintf(stderr, "%d of %d contexts disagreed with a lone context\n",
+            failed, CONTEXT_COUNT);
+
+  free(expected.frequencies);
+  free(text);
+  bench_corpus_free(&corpus);
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,236 @@
+/*
+ * Throughput of JSON lines of 1 to 2 KB, as services write them: a few
+ * top-level members the analyzer reads, around nested request, user and
+ * context objects, arrays and escaped strings it skips. The lines are read
+ * by the generic parser, as they were before the json format, and by the
+ * json format's parser, which must find every level and message; each
+ * runs BENCH_ROUNDS times and the fastest round is reported in GB/s.
+ *
+ *   bench/json_bench -n 100000
+ */
+#include <unistd.h>
+
+#include "bench.h"
+
+#define BENCH_ROUNDS 5
+#define BENCH_LINES 50000
+#define MAX_JSON_LINE 2560
+
+static const char *const levels[] = {"debug", "info", "info", "info",
+                                     "info",  "warn", "error"};
+static const int level_severities[] = {7, 6, 6, 6, 6, 4, 3};
+
+static const char *const services[] = {"checkout", "inventory", "payments",
+                                       "search", "gateway", "notifier"};
+
+static const char *const messages[] = {
+    "request completed",
+    "cache miss for cart \\\"%u\\\", loading from store",
+    "upstream returned 503 after %u ms, retrying",
+    "order %u placed",
+    "slow query on orders_%u: full scan",
+    "token refresh failed: invalid_grant",
+};
+
+static const char *const paths[] = {"/api/v2/cart/items", "/api/v2/orders",
+                                    "/api/v2/search?q=shoes&page=2",
+                                    "/healthz", "/api/v2/payments/confirm"};
+
+typedef struct {
+  char *text;
+  char **lines;
+  size_t *lengths;
+  int *severities;
+  size_t *messages; /* where each message starts */
+  long count;
+  size_t bytes;
+} JsonCorpus;
+
+static uint64_t next_random(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+/* Appends a hex string of count digits */
+static int put_hex(char *out, uint64_t *state, int count) {
+  static const char digits[] = "0123456789abcdef";
+
+  for (int i = 0; i < count; i++) out[i] = digits[next_random(state) % 16];
+  return count;
+}
+
+static void put_message(char *out, int *n, const char *message,
+                        size_t *offset, const char *separator) {
+  *n += sprintf(out + *n, "\"msg\":\"");
+  *offset = (size_t)*n;
+  *n += sprintf(out + *n, "%s\"%s", message, separator);
+}
+
+/*
+ * One line; the message comes first, last or in between, so some lines
+ * make the parser skip the nested objects before it finds it.
+ */
+static size_t make_line(uint64_t *state, long number, char *out,
+                        int *severity, size_t *message_offset) {
+  int level = (int)(next_random(state) % 7), tags, n = 0;
+  unsigned a = (unsigned)(next_random(state) % 10000);
+  char message[160], trace[33], span[17];
+  int place = (int)(next_random(state) % 3);
+
+  snprintf(message, sizeof(message),
+           messages[next_random(state) % 6], a);
+  trace[put_hex(trace, state, 32)] = '\0';
+  span[put_hex(span, state, 16)] = '\0';
+  *severity = level_severities[level];
+
+  n += sprintf(out + n,
+               "{\"timestamp\":\"2024-03-04T15:%02ld:%02ld.%03ldZ\","
+               "\"level\":\"%s\",\"service\":\"%s\",\"pid\":%ld,",
+               number / 60000 % 60, number / 1000 % 60, number % 1000,
+               levels[level], services[number % 6], 1000 + number % 50);
+  if (place == 0) put_message(out, &n, message, message_offset, ",");
+  n += sprintf(out + n,
+               "\"trace_id\":\"%s\",\"span_id\":\"%s\",\"http\":{"
+               "\"method\":\"GET\",\"path\":\"%s\",\"status\":%d,"
+               "\"duration_ms\":%u.%u,\"request_headers\":{"
+               "\"user-agent\":\"Mozilla/5.0 (X11; Linux x86_64) "
+               "AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0 "
+               "Safari/537.36\",\"accept\":\"application/json, text/plain, "
+               "*/*\",\"accept-language\":\"en-US,en;q=0.9\","
+               "\"x-request-id\":\"%s\"}},",
+               trace, span, paths[next_random(state) % 5],
+               level == 6 ? 503 : 200, a % 900, a % 10, span);
+  if (place == 1) put_message(out, &n, message, message_offset, ",");
+  n += sprintf(out + n,
+               "\"user\":{\"id\":%u,\"tenant\":\"acme-%u\",\"roles\":"
+               "[\"viewer\",\"buyer\"],\"flags\":{\"beta\":true,"
+               "\"region\":\"eu-west-1\"}},\"tags\":[",
+               a * 7, a % 40);
+  tags = 4 + (int)(next_random(state) % 24);
+  for (int i = 0; i < tags; i++)
+    n += sprintf(out + n, "%s\"%.*s\"", i ? "," : "", 12 + i % 20,
+                 "feature-rollout-cohort-b-canary-experiment");
+  n += sprintf(out + n, "],\"context\":{\"build\":\"%.*s\",\"zone\":\"b\","
+               "\"retries\":%u,\"cache\":null}", 12, trace, a % 4);
+  if (level >= 5)
+    n += sprintf(out + n,
+                 ",\"stack\":\"Error: %s\\n    at Client.request "
+                 "(/srv/app/node_modules/http/client.js:812:15)\\n    at "
+                 "Cart.load (/srv/app/src/cart.js:44:9)\\n    at "
+                 "processTicksAndRejections (node:internal/process/"
+                 "task_queues:95:5)\"",
+                 message);
+  if (place == 2) {
+    out[n++] = ',';
+    put_message(out, &n, message, message_offset, "");
+  }
+  out[n++] = '}';
+  return (size_t)n;
+}
+
+static bool build_corpus(JsonCorpus *corpus, long count) {
+  uint64_t state = 0x9e3779b97f4a7c15ull;
+  size_t used = 0;
+
+  memset(corpus, 0, sizeof(JsonCorpus));
+  corpus->text = (char *)malloc((size_t)count * MAX_JSON_LINE);
+  corpus->lines = (char **)malloc(count * sizeof(char *));
+  corpus->lengths = (size_t *)malloc(count * sizeof(size_t));
+  corpus->severities = (int *)malloc(count * sizeof(int));
+  corpus->messages = (size_t *)malloc(count * sizeof(size_t));
+  if (!corpus->text || !corpus->lines || !corpus->lengths ||
+      !corpus->severities || !corpus->messages)
+    return false;
+
+  for (long i = 0; i < count; i++) {
+    corpus->lines[i] = corpus->text + used;
+    corpus->lengths[i] =
+        make_line(&state, i, corpus->text + used, &corpus->severities[i],
+                  &corpus->messages[i]);
+    used += corpus->lengths[i];
+    corpus->text[used++] = '\n';
+  }
+  corpus->count = count;
+  corpus->bytes = used;
+  return true;
+}
+
+static void free_corpus(JsonCorpus *corpus) {
+  free(corpus->text);
+  free(corpus->lines);
+  free(corpus->lengths);
+  free(corpus->severities);
+  free(corpus->messages);
+}
+
+static volatile long sink;
+
+/* The fastest of BENCH_ROUNDS passes; false if a line was misread */
+static bool run(const char *name, const LogFormat *format,
+                const JsonCorpus *corpus, bool check) {
+  LogTimestampCache cache;
+  LogRecord record;
+  double best = 0, start, ns;
+
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    log_timestamp_cache_init(&cache);
+    start = bench_now_ns();
+    for (long i = 0; i < corpus->count; i++) {
+      if (!log_parser_parse_record_as(format, &cache, corpus->lines[i],
+                                      corpus->lengths[i], &record))
+        return false;
+      if (check && (record.severity != corpus->severities[i] ||
+                    record.message.offset != corpus->messages[i] ||
+                    record.fields.length != corpus->lengths[i])) {
+        fprintf(stderr, "%s misread line %ld\n", name, i + 1);
+        return false;
+      }
+      sink += (long)record.message.length + record.severity;
+    }
+    ns = bench_now_ns() - start;
+    if (round == 0 || ns < best) best = ns;
+  }
+
+  printf("%-16s %10ld %12zu %10.1f %10.2f\n", name, corpus->count,
+         corpus->bytes, best / corpus->count, corpus->bytes / best);
+  fflush(stdout);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  JsonCorpus corpus;
+  long lines = BENCH_LINES;
+  char *end;
+  int option;
+
+  while ((option = getopt(argc, argv, "n:")) != -1) {
+    if (option != 'n' || (lines = strtol(optarg, &end, 10)) <= 0 ||
+        *end != '\0' || lines > 10000000) {
+      fprintf(stderr, "Usage: %s [-n LINES]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (optind != argc) {
+    fprintf(stderr, "Usage: %s [-n LINES]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (!build_corpus(&corpus, lines)) {
+    fprintf(stderr, "Out of memory generating %ld lines\n", lines);
+    free_corpus(&corpus);
+    return EXIT_FAILURE;
+  }
+
+  printf("# lines=%ld bytes=%zu average=%zu bytes/line\n", corpus.count,
+         corpus.bytes, corpus.bytes / corpus.count);
+  printf("%-16s %10s %12s %10s %10s\n", "benchmark", "lines", "bytes",
+         "ns/line", "GB/s");
+  if (!run("json_generic", log_format_find("generic"), &corpus, false) ||
+      !run("json_format", log_format_find("json"), &corpus, true)) {
+    free_corpus(&corpus);
+    return EXIT_FAILURE;
+  }
+  free_corpus(&corpus);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,31 @@
+/*
+ * Writes a synthetic log to stdout, the same one bench/stage_bench
+ * measures for the same options:
+ *
+ *   bench/loggen -n 1000000 -f syslog:100 -p 0.2 > synthetic.log
+ */
+#include "bench.h"
+
+int main(int argc, char **argv) {
+  BenchOptions options;
+  BenchGenerator generator;
+  char line[MAX_LINE_LENGTH];
+  size_t length;
+
+  bench_options_init(&options);
+  if (!bench_options_parse(&options, argc, argv)) {
+    bench_options_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  bench_generator_init(&generator, &options);
+  for (long i = 0; i < options.lines; i++) {
+    length = bench_generator_next(&generator, line, sizeof(line) - 1);
+    line[length++] = '\n';
+    if (fwrite(line, 1, length, stdout) != length) {
+      perror("Failed to write log");
+      return EXIT_FAILURE;
+    }
+  }
+  return fflush(stdout) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
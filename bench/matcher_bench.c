@@ -0,0 +1,206 @@
+/*
+ * The pattern set against regexec(): a table of patterns like the default
+ * ones, with escaped metacharacters and the GNU escapes (\<, \>, \` and
+ * \') the automaton leaves to regexec(), is run over a synthetic log and
+ * a few lines written for those escapes. Every line must get the same
+ * matches from pattern_set_scan() as from regexec() on each pattern, both
+ * for the table alone and for one large enough to index its literals.
+ * Takes the options of bench/loggen:
+ *
+ *   bench/matcher_bench -n 100000 -p 0.5
+ */
+#include <regex.h>
+
+#include "bench.h"
+
+#define INDEXED_EXTRA 100 /* patterns added to make the set index */
+
+static const char *const table[] = {
+    ".*connection timed out.*",
+    ".*disk full.*",
+    ".*out of memory.*",
+    ".*query timeout.*",
+    ".*cpu usage.*[9][0-9]%.*",
+    "packet loss of [0-9]+%",
+    "deadlock detected",
+    "too many open files",
+    "\\(limit [0-9]+\\)",
+    "\\[[0-9]+\\]",
+    "\\/api\\/v1\\/items\\/[0-9]+ 200",
+    "\\.conf in",
+    "cpu usage at [0-9]+\\% on",
+    "\\<timed out\\>",
+    "\\<error\\>",
+    "\\<orders[0-9]\\>",
+    "worker\\>",
+    "\\<ker",
+    "ms\\'",
+    "[0-9]\\'",
+    "\\`<[0-9]+>",
+    "\\`20[0-9][0-9]-",
+    "\\`\\{",
+    "a\\'",
+    "\\bfull\\b",
+};
+
+/* Lines the synthetic log never has, at the edges of the escapes */
+static const char *const edge_lines[] = {
+    "an error occurred",
+    "error",
+    "terror in the errors",
+    "errors, error, errorerror",
+    "sa",
+    "a",
+    "saa ",
+    "{\"msg\":\"x\"}",
+    " {\"msg\":\"x\"}",
+    "<13>Mar  4 15:48:28 host app[12]: disk fuller than ever",
+    "2024-03-04 query timeout after 12ms on table orders7",
+    "worker",
+    "workers of the world",
+    "timed outward",
+    "the connection timed out",
+    "cpu usage at 95% on core 1 while the worker9 kernel ran 100ms",
+    "a long line that keeps going past the prefilter threshold of "
+    "sixty-four bytes before it finally ends with an error",
+    "a long line that keeps going past the prefilter threshold of "
+    "sixty-four bytes before it finally ends with errors",
+    "",
+};
+
+#define COUNT(array) ((int)(sizeof(array) / sizeof((array)[0])))
+
+typedef struct {
+  Pattern *patterns;
+  regex_t *regexes;
+  int count;
+  PatternSet *set;
+} Table;
+
+static void free_table(Table *t) {
+  for (int i = 0; t->patterns && i < t->count; i++) {
+    free(t->patterns[i].pattern);
+    if (t->regexes) regfree(&t->regexes[i]);
+  }
+  free(t->patterns);
+  free(t->regexes);
+  pattern_set_free(t->set);
+}
+
+/* The table, then extra patterns like "shard 7\>" when extra > 0 */
+static bool build_table(Table *t, int extra) {
+  char text[32];
+
+  memset(t, 0, sizeof(Table));
+  t->patterns = (Pattern *)calloc(COUNT(table) + extra, sizeof(Pattern));
+  t->regexes = (regex_t *)calloc(COUNT(table) + extra, sizeof(regex_t));
+  if (!t->patterns || !t->regexes) return false;
+
+  for (int i = 0; i < COUNT(table) + extra; i++) {
+    if (i < COUNT(table))
+      snprintf(text, sizeof(text), "%s", table[i]);
+    else
+      snprintf(text, sizeof(text), "shard %d\\>", i - COUNT(table));
+    t->patterns[i].pattern = strdup(text);
+    t->patterns[i].id = i;
+    t->patterns[i].prefilter_hits = -1;
+    if (!t->patterns[i].pattern) return false;
+    t->count++;
+    if (regcomp(&t->regexes[i], text, REG_EXTENDED | REG_NOSUB) != 0) {
+      fprintf(stderr, "Invalid pattern %s\n", text);
+      return false;
+    }
+  }
+  t->set = pattern_set_compile(t->patterns, t->count);
+  return t->set != NULL;
+}
+
+/* False, after saying where, if the set and regexec() disagree on line */
+static bool same_matches(Table *t, const char *line, size_t length,
+                         int *matches, bool *found) {
+  int n = pattern_set_scan(t->set, line, length, matches, t->count);
+  bool expected;
+
+  memset(found, 0, t->count * sizeof(bool));
+  for (int i = 0; i < n; i++) found[matches[i]] = true;
+  for (int i = 0; i < t->count; i++) {
+    expected = regexec(&t->regexes[i], line, 0, NULL, 0) == 0;
+    if (found[i] != expected) {
+      fprintf(stderr, "Pattern %s %s \"%s\" but regexec() %s\n",
+              t->patterns[i].pattern, found[i] ? "matched" : "missed", line,
+              expected ? "matches" : "does not");
+      return false;
+    }
+  }
+  return true;
+}
+
+static volatile long sink;
+
+/* Checks every line, then times the set and regexec() over the corpus */
+static bool run(const char *name, int extra, const BenchCorpus *corpus) {
+  int matches[COUNT(table) + INDEXED_EXTRA];
+  bool found[COUNT(table) + INDEXED_EXTRA];
+  char label[32];
+  double start;
+  bool ok;
+  Table t;
+
+  ok = build_table(&t, extra);
+  for (int i = 0; ok && i < COUNT(edge_lines); i++)
+    ok = same_matches(&t, edge_lines[i], strlen(edge_lines[i]), matches,
+                      found);
+  for (long i = 0; ok && i < corpus->count; i++)
+    ok = same_matches(&t, corpus->lines[i], corpus->lengths[i], matches,
+                      found);
+  if (!ok) {
+    fprintf(stderr, "Benchmark %s failed\n", name);
+    free_table(&t);
+    return false;
+  }
+
+  start = bench_now_ns();
+  for (long i = 0; i < corpus->count; i++)
+    sink += pattern_set_scan(t.set, corpus->lines[i], corpus->lengths[i],
+                             matches, t.count);
+  snprintf(label, sizeof(label), "%s_scan", name);
+  bench_print_result(label, corpus->count, corpus->bytes,
+                     bench_now_ns() - start, -1);
+
+  start = bench_now_ns();
+  for (long i = 0; i < corpus->count; i++) {
+    for (int j = 0; j < t.count; j++)
+      sink += regexec(&t.regexes[j], corpus->lines[i], 0, NULL, 0) == 0;
+  }
+  snprintf(label, sizeof(label), "%s_regexec", name);
+  bench_print_result(label, corpus->count, corpus->bytes,
+                     bench_now_ns() - start, -1);
+
+  free_table(&t);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  BenchOptions options;
+  BenchCorpus corpus;
+  bool ok;
+
+  bench_options_init(&options);
+  options.lines = 50000;
+  options.hit_rate = 0.5;
+  if (!bench_options_parse(&options, argc, argv) ||
+      options.lines > 10000000) {
+    bench_options_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (!bench_corpus_build(&corpus, &options)) {
+    fprintf(stderr, "Out of memory generating %ld lines\n", options.lines);
+    return EXIT_FAILURE;
+  }
+  bench_print_header(&options, &corpus);
+
+  ok = run("table", 0, &corpus) &&
+       run("indexed", INDEXED_EXTRA, &corpus);
+  bench_corpus_free(&corpus);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
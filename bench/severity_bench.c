@@ -0,0 +1,100 @@
+/*
+ * Compares log_parser_classify_severity() with the strstr cascade it
+ * replaced, on lines with no level keyword and on typical leveled lines.
+ * Both must read every line at the same level.
+ */
+#include "log_analyzer.h"
+
+#define BENCH_ROUNDS 20000
+
+static const char *const plain_lines[] = {
+    "Mar  4 15:48:28 host2 sshd[6319]: session opened for user root uid 13",
+    "Mar  4 15:48:29 host1 kernel: eth0: link up, 1000Mbps, full duplex",
+    "Mar  4 15:48:30 host3 cron[812]: (root) CMD (run-parts /etc/cron.daily)",
+    "Mar  4 15:48:31 host1 nginx: GET /index.html 200 5123 \"curl/8.4.0\"",
+};
+
+static const char *const leveled_lines[] = {
+    "Mar  4 15:48:28 host2 app[6319]: INFO request served in 12ms",
+    "Mar  4 15:48:29 host1 app[6319]: WARN slow query: 812ms",
+    "Mar  4 15:48:30 host3 app[6319]: ERROR connection refused by upstream",
+    "Mar  4 15:48:31 host1 app[6319]: DEBUG cache miss for key user:42",
+};
+
+static const char *legacy_find(const char *line, const char *needle) {
+  return strstr(line, needle);
+}
+
+static int legacy_extract_severity(const char *line) {
+#define HAS(word) (legacy_find(line, word) != NULL)
+  if (HAS("EMERGENCY") || HAS("EMERG") || HAS("fatal"))
+    return 0;
+  else if (HAS("ALERT"))
+    return 1;
+  else if (HAS("CRITICAL") || HAS("CRIT"))
+    return 2;
+  else if (HAS("ERROR") || HAS("ERR"))
+    return 3;
+  else if (HAS("WARNING") || HAS("WARN"))
+    return 4;
+  else if (HAS("NOTICE"))
+    return 5;
+  else if (HAS("INFO") || HAS("information"))
+    return 6;
+  else if (HAS("DEBUG"))
+    return 7;
+#undef HAS
+
+  return 6;
+}
+
+static double elapsed_ns(const struct timespec *start,
+                         const struct timespec *end) {
+  return (end->tv_sec - start->tv_sec) * 1e9 +
+         (end->tv_nsec - start->tv_nsec);
+}
+
+/* False if the two disagree on a line */
+static bool run(const char *name, const char *const *lines, int count) {
+  struct timespec start, end;
+  volatile int sink = 0;
+  size_t lengths[8];
+  double legacy_ns, fast_ns;
+  long calls = (long)BENCH_ROUNDS * count;
+
+  for (int i = 0; i < count; i++) {
+    lengths[i] = strlen(lines[i]);
+    if (log_parser_classify_severity(lines[i], lengths[i]) !=
+        legacy_extract_severity(lines[i])) {
+      fprintf(stderr, "Severity differs from the cascade on: %s\n",
+              lines[i]);
+      return false;
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int r = 0; r < BENCH_ROUNDS; r++)
+    for (int i = 0; i < count; i++) sink += legacy_extract_severity(lines[i]);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  legacy_ns = elapsed_ns(&start, &end) / calls;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int r = 0; r < BENCH_ROUNDS; r++)
+    for (int i = 0; i < count; i++)
+      sink += log_parser_classify_severity(lines[i], lengths[i]);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  fast_ns = elapsed_ns(&start, &end) / calls;
+
+  printf("%-10s %12.1f %12.1f %9.1fx\n", name, legacy_ns, fast_ns,
+         legacy_ns / fast_ns);
+  (void)sink;
+  return true;
+}
+
+int main(void) {
+  printf("%-10s %12s %12s %10s\n", "lines", "legacy ns", "single ns",
+         "speedup");
+  if (!run("no-level", plain_lines, 4) || !run("leveled", leveled_lines, 4))
+    return EXIT_FAILURE;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,261 @@
+/*
+ * Cost of each stage of the analyzer on a synthetic log: the timestamp
+ * and severity scans, both parsers, the parser of the format sampled from
+ * the log, detection, the two report writers and a whole run from file to
+ * reports. Each stage runs BENCH_ROUNDS
+ * times and the fastest round is reported with the allocations it made.
+ * Takes the options of bench/loggen, so any mix can be measured:
+ *
+ *   bench/stage_bench -n 1000000 -f json:100 -p 0.5
+ */
+#include <unistd.h>
+
+#include "bench.h"
+
+#define BENCH_ROUNDS 5
+
+typedef struct {
+  const BenchCorpus *corpus;
+  LogAnalyzerContext *parser;   /* owns the entries below */
+  const LogFormat *format;      /* sampled from the first lines */
+  LogEntry **entries;           /* from the parse_line stage */
+  LogAnalyzerContext *analyzed; /* detection done, for the report writers */
+  char log_path[MAX_PATH_LENGTH - 8];
+  char output_path[MAX_PATH_LENGTH];
+} StageState;
+
+typedef bool (*StageFunction)(StageState *state);
+
+static volatile long sink;
+
+static bool stage_timestamp(StageState *state) {
+  const BenchCorpus *corpus = state->corpus;
+  LogTimestampCache cache;
+
+  log_timestamp_cache_init(&cache);
+  for (long i = 0; i < corpus->count; i++)
+    sink += (long)log_timestamp_parse(&cache, corpus->lines[i],
+                                      corpus->lengths[i]);
+  return true;
+}
+
+static bool stage_severity(StageState *state) {
+  const BenchCorpus *corpus = state->corpus;
+
+  for (long i = 0; i < corpus->count; i++)
+    sink += log_parser_classify_severity(corpus->lines[i],
+                                         corpus->lengths[i]);
+  return true;
+}
+
+static bool stage_parse_record(StageState *state) {
+  const BenchCorpus *corpus = state->corpus;
+  LogRecord record;
+
+  for (long i = 0; i < corpus->count; i++) {
+    if (!log_parser_parse_record(state->parser, corpus->lines[i],
+                                 corpus->lengths[i], &record))
+      return false;
+    sink += (long)record.message.length;
+  }
+  return true;
+}
+
+static bool stage_parse_format(StageState *state) {
+  const BenchCorpus *corpus = state->corpus;
+  LogTimestampCache cache;
+  LogRecord record;
+
+  log_timestamp_cache_init(&cache);
+  for (long i = 0; i < corpus->count; i++) {
+    if (!log_parser_parse_record_as(state->format, &cache, corpus->lines[i],
+                                    corpus->lengths[i], &record))
+      return false;
+    sink += (long)record.message.length;
+  }
+  return true;
+}
+
+/* Samples the corpus as the analyzer samples an input */
+static bool sample_format(StageState *state) {
+  const BenchCorpus *corpus = state->corpus;
+  size_t length = 0;
+  char *text;
+  long count = corpus->count < LOG_FORMAT_SAMPLE ? corpus->count
+                                                 : LOG_FORMAT_SAMPLE;
+
+  for (long i = 0; i < count; i++) length += corpus->lengths[i] + 1;
+  text = (char *)malloc(length + 1);
+  if (!text) return false;
+  length = 0;
+  for (long i = 0; i < count; i++) {
+    memcpy(text + length, corpus->lines[i], corpus->lengths[i]);
+    length += corpus->lengths[i];
+    text[length++] = '\n';
+  }
+  state->format = log_format_detect(text, length);
+  free(text);
+  printf("# sampled format: %s\n",
+         state->format ? state->format->name : "none");
+  return true;
+}
+
+static bool stage_parse_line(StageState *state) {
+  const BenchCorpus *corpus = state->corpus;
+
+  log_parser_reset(state->parser);
+  for (long i = 0; i < corpus->count; i++) {
+    state->entries[i] = log_parser_parse_line(state->parser,
+                                              corpus->lines[i]);
+    if (!state->entries[i]) return false;
+  }
+  return true;
+}
+
+static bool stage_detect(StageState *state) {
+  LogAnalyzerContext *ctx = log_analyzer_init(NULL, NULL, NULL);
+  bool success;
+
+  success = ctx && pattern_detector_analyze(ctx, state->entries,
+                                            (int)state->corpus->count);
+  log_analyzer_cleanup(ctx);
+  return success;
+}
+
+static bool stage_report_summary(StageState *state) {
+  return report_generator_write_summary(state->analyzed);
+}
+
+static bool stage_report_detailed(StageState *state) {
+  return report_generator_write_detailed(state->analyzed);
+}
+
+/* The steps main() takes for a single input, without its progress output */
+static bool stage_end_to_end(StageState *state) {
+  char *argv[] = {"log_analyzer", "-o", state->output_path, state->log_path};
+  LogAnalyzerContext *ctx = log_analyzer_init("", "", "");
+  bool success;
+
+  success = ctx && cli_parse_arguments(4, argv, ctx) &&
+            log_collector_open_file(ctx) && pattern_detector_begin(ctx) &&
+            pattern_detector_process_input(ctx);
+  log_collector_close_file(ctx);
+  success = success && pattern_detector_finalize(ctx) &&
+            recommendation_generator_analyze(ctx) &&
+            report_generator_write_summary(ctx) &&
+            report_generator_write_detailed(ctx);
+  log_analyzer_cleanup(ctx);
+  return success;
+}
+
+static bool run_stage(const char *name, StageFunction stage,
+                      StageState *state) {
+  double start, ns, best_ns = 0;
+  long allocations, best_allocations = 0;
+
+  for (int r = 0; r < BENCH_ROUNDS; r++) {
+    allocations = bench_allocations();
+    start = bench_now_ns();
+    if (!stage(state)) {
+      fprintf(stderr, "Benchmark %s failed\n", name);
+      return false;
+    }
+    ns = bench_now_ns() - start;
+    if (allocations >= 0) allocations = bench_allocations() - allocations;
+
+    if (r == 0 || ns < best_ns) {
+      best_ns = ns;
+      best_allocations = allocations;
+    }
+  }
+  bench_print_result(name, state->corpus->count, state->corpus->bytes,
+                     best_ns, best_allocations);
+  return true;
+}
+
+/* Detection for the report writers, which only read its results */
+static bool prepare_reports(StageState *state) {
+  state->analyzed = log_analyzer_init(NULL, state->output_path, NULL);
+  return state->analyzed &&
+         pattern_detector_analyze(state->analyzed, state->entries,
+                                  (int)state->corpus->count) &&
+         recommendation_generator_analyze(state->analyzed);
+}
+
+/* A log file for the end-to-end run and a path for its reports */
+static bool make_paths(StageState *state) {
+  const char *dir = getenv("TMPDIR");
+  int fd;
+
+  if (!dir || strlen(dir) == 0) dir = "/tmp";
+  if (snprintf(state->log_path, sizeof(state->log_path),
+               "%s/log_analyzer_bench.XXXXXX",
+               dir) >= (int)sizeof(state->log_path)) {
+    fprintf(stderr, "TMPDIR is too long: %s\n", dir);
+    return false;
+  }
+  fd = mkstemp(state->log_path);
+  if (fd < 0) {
+    perror("Failed to create benchmark log");
+    return false;
+  }
+  close(fd);
+  snprintf(state->output_path, sizeof(state->output_path), "%s.out",
+           state->log_path);
+  return bench_corpus_write(state->corpus, state->log_path);
+}
+
+static void remove_paths(const StageState *state) {
+  char detailed_path[MAX_PATH_LENGTH + 16];
+
+  if (strlen(state->output_path) == 0) return;
+  snprintf(detailed_path, sizeof(detailed_path), "%s.detailed",
+           state->output_path);
+  remove(detailed_path);
+  remove(state->output_path);
+  remove(state->log_path);
+}
+
+int main(int argc, char **argv) {
+  BenchOptions options;
+  BenchCorpus corpus;
+  StageState state;
+  bool success;
+
+  bench_options_init(&options);
+  if (!bench_options_parse(&options, argc, argv) ||
+      options.lines > 100000000) {
+    bench_options_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (!bench_corpus_build(&corpus, &options)) {
+    fprintf(stderr, "Out of memory generating %ld lines\n", options.lines);
+    return EXIT_FAILURE;
+  }
+
+  memset(&state, 0, sizeof(state));
+  state.corpus = &corpus;
+  state.parser = log_analyzer_init(NULL, NULL, NULL);
+  state.entries = (LogEntry **)malloc(corpus.count * sizeof(LogEntry *));
+  success = state.parser && state.entries && make_paths(&state);
+
+  if (success) bench_print_header(&options, &corpus);
+  success = success && run_stage("timestamp", stage_timestamp, &state) &&
+            run_stage("severity", stage_severity, &state) &&
+            run_stage("parse_record", stage_parse_record, &state) &&
+            sample_format(&state) &&
+            run_stage("parse_format", stage_parse_format, &state) &&
+            run_stage("parse_line", stage_parse_line, &state) &&
+            run_stage("detect", stage_detect, &state) &&
+            prepare_reports(&state) &&
+            run_stage("report_summary", stage_report_summary, &state) &&
+            run_stage("report_detailed", stage_report_detailed, &state) &&
+            run_stage("end_to_end", stage_end_to_end, &state);
+
+  remove_paths(&state);
+  log_analyzer_cleanup(state.analyzed);
+  log_analyzer_cleanup(state.parser);
+  free(state.entries);
+  bench_corpus_free(&corpus);
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,111 @@
+/*
+ * Cost of mining templates next to the cost of parsing the same lines:
+ * each line is parsed, then parsed and mined, as the detector does, and
+ * the difference is the miner's. Run on a log of a few message shapes
+ * and on one where a tenth of the messages start with a unique word and
+ * keep the miner evicting. The shapes must come out as one template each,
+ * and the evictions must not cost the most common shape its count.
+ */
+#include "log_analyzer.h"
+
+#define BENCH_LINES 200000
+#define BENCH_ROUNDS 5
+
+static const char *const shapes[] = {
+    "INFO request %ld served in %ldms",
+    "WARN slow query on table orders: %ldms",
+    "ERROR connection refused by upstream 10.0.%ld.%ld:8080",
+    "INFO session opened for user root uid %ld by (uid=%ld)",
+    "DEBUG cache miss for key user:%ld shard %ld",
+    "INFO GET /api/v1/items/%ld 200 %ld \"curl/8.4.0\"",
+    "INFO Accepted publickey for deploy from 192.168.%ld.%ld port 22 ssh2",
+    "WARN disk usage on /var at %ld%% (%ld inodes free)",
+};
+
+static double elapsed_ns(const struct timespec *start,
+                         const struct timespec *end) {
+  return (end->tv_sec - start->tv_sec) * 1e9 +
+         (end->tv_nsec - start->tv_nsec);
+}
+
+static char **make_lines(bool long_tail) {
+  char **lines = (char **)malloc(BENCH_LINES * sizeof(char *));
+  char message[160], line[256];
+  int shape_count = (int)(sizeof(shapes) / sizeof(shapes[0]));
+
+  for (long i = 0; i < BENCH_LINES; i++) {
+    if (long_tail && i % 10 == 0)
+      snprintf(message, sizeof(message), "job-%c%c%c%c: finished ok",
+               'a' + (int)(i % 26), 'a' + (int)(i / 26 % 26),
+               'a' + (int)(i / 676 % 26), 'a' + (int)(i / 17576 % 26));
+    else
+      snprintf(message, sizeof(message), shapes[i % shape_count], i % 977,
+               i % 251);
+    snprintf(line, sizeof(line), "Mar  4 15:%02ld:%02ld host%ld app[%ld]: %s",
+             i / 60 % 60, i % 60, i % 3, 1000 + i % 500, message);
+    lines[i] = strdup(line);
+  }
+  return lines;
+}
+
+/* False if the miner lost a shape or its count */
+static bool run(const char *name, bool long_tail) {
+  LogAnalyzerContext *ctx = log_analyzer_init(NULL, NULL, NULL);
+  LogTemplateMiner *miner = NULL;
+  LogTemplate top;
+  LogRecord record;
+  struct timespec start, end;
+  char **lines = make_lines(long_tail);
+  int shape_count = (int)(sizeof(shapes) / sizeof(shapes[0]));
+  double parse_ns = 0, both_ns = 0, mine_ns;
+  size_t *lengths;
+  bool ok;
+
+  lengths = (size_t *)malloc(BENCH_LINES * sizeof(size_t));
+  for (long i = 0; i < BENCH_LINES; i++) lengths[i] = strlen(lines[i]);
+
+  for (int r = 0; r < BENCH_ROUNDS; r++) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < BENCH_LINES; i++)
+      log_parser_parse_record(ctx, lines[i], lengths[i], &record);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    parse_ns += elapsed_ns(&start, &end);
+
+    log_template_miner_free(miner);
+    miner = log_template_miner_create(LOG_TEMPLATE_CAPACITY);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < BENCH_LINES; i++) {
+      log_parser_parse_record(ctx, lines[i], lengths[i], &record);
+      log_template_add(miner, record.line + record.message.offset,
+                       record.message.length);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    both_ns += elapsed_ns(&start, &end);
+  }
+
+  parse_ns /= (double)BENCH_LINES * BENCH_ROUNDS;
+  mine_ns = both_ns / ((double)BENCH_LINES * BENCH_ROUNDS) - parse_ns;
+  log_template_top(miner, &top, 1);
+  printf("%-10s %10.1f %10.1f %10d  %s\n", name, parse_ns, mine_ns,
+         log_template_count(miner), top.text);
+  ok = long_tail ? top.count >= BENCH_LINES / 10
+                 : log_template_count(miner) == shape_count &&
+                       top.count == BENCH_LINES / shape_count;
+  if (!ok)
+    fprintf(stderr, "Benchmark %s mined %d templates, the top %ld times\n",
+            name, log_template_count(miner), top.count);
+
+  for (long i = 0; i < BENCH_LINES; i++) free(lines[i]);
+  free(lines);
+  free(lengths);
+  log_template_miner_free(miner);
+  log_analyzer_cleanup(ctx);
+  return ok;
+}
+
+int main(void) {
+  printf("%-10s %10s %10s %10s  %s\n", "log", "parse ns", "mine ns",
+         "templates", "top template");
+  if (!run("shapes", false) || !run("long-tail", true)) return EXIT_FAILURE;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,140 @@
+/*
+ * Compares log_timestamp_parse() with the sscanf/mktime parser it replaced.
+ * The legacy copy below has its ISO format string corrected so both sides
+ * parse every corpus.
+ */
+#include "log_analyzer.h"
+
+#define BENCH_LINES 200000
+#define BENCH_LINE_LENGTH 64
+
+static time_t legacy_extract_timestamp(const char *line) {
+  struct tm tm_time;
+  char month_str[4];
+  char *timestamp_str = strdup(line);
+  char *end_ptr;
+
+  memset(&tm_time, 0, sizeof(struct tm));
+
+  if (sscanf(timestamp_str, "%3s %d %d:%d:%d", month_str, &tm_time.tm_mday,
+             &tm_time.tm_hour, &tm_time.tm_min, &tm_time.tm_sec) == 5) {
+    if (strcmp(month_str, "Jan") == 0)
+      tm_time.tm_mon = 0;
+    else if (strcmp(month_str, "Feb") == 0)
+      tm_time.tm_mon = 1;
+    else if (strcmp(month_str, "Mar") == 0)
+      tm_time.tm_mon = 2;
+    else if (strcmp(month_str, "Apr") == 0)
+      tm_time.tm_mon = 3;
+    else if (strcmp(month_str, "May") == 0)
+      tm_time.tm_mon = 4;
+    else if (strcmp(month_str, "Jun") == 0)
+      tm_time.tm_mon = 5;
+    else if (strcmp(month_str, "Jul") == 0)
+      tm_time.tm_mon = 6;
+    else if (strcmp(month_str, "Aug") == 0)
+      tm_time.tm_mon = 7;
+    else if (strcmp(month_str, "Sep") == 0)
+      tm_time.tm_mon = 8;
+    else if (strcmp(month_str, "Oct") == 0)
+      tm_time.tm_mon = 9;
+    else if (strcmp(month_str, "Nov") == 0)
+      tm_time.tm_mon = 10;
+    else if (strcmp(month_str, "Dec") == 0)
+      tm_time.tm_mon = 11;
+
+    tm_time.tm_year = time(NULL) / 31536000 + 70;
+    free(timestamp_str);
+    return mktime(&tm_time);
+  }
+
+  if (sscanf(timestamp_str, "%d-%d-%dT%d:%d:%d", &tm_time.tm_year,
+             &tm_time.tm_mon, &tm_time.tm_mday, &tm_time.tm_hour,
+             &tm_time.tm_min, &tm_time.tm_sec) == 6) {
+    tm_time.tm_year -= 1900;
+    tm_time.tm_mon--;
+
+    free(timestamp_str);
+    return mktime(&tm_time);
+  }
+
+  long timestamp = strtol(timestamp_str, &end_ptr, 10);
+  if (end_ptr != timestamp_str) {
+    free(timestamp_str);
+    return (time_t)timestamp;
+  }
+
+  free(timestamp_str);
+  return time(NULL);
+}
+
+static char lines[BENCH_LINES][BENCH_LINE_LENGTH];
+static size_t lengths[BENCH_LINES];
+
+/* Each second repeats on `per_second` consecutive lines */
+static void build_corpus(const char *format, int per_second) {
+  static const char *months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                 "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+  long second;
+
+  for (int i = 0; i < BENCH_LINES; i++) {
+    second = 1700000000L + i / per_second;
+    if (strcmp(format, "syslog") == 0)
+      snprintf(lines[i], BENCH_LINE_LENGTH,
+               "%s %2ld %02ld:%02ld:%02ld host sshd[42]: message",
+               months[(second / 2678400) % 12], (second / 86400) % 28 + 1,
+               (second / 3600) % 24, (second / 60) % 60, second % 60);
+    else if (strcmp(format, "iso8601") == 0)
+      snprintf(lines[i], BENCH_LINE_LENGTH,
+               "2024-%02ld-%02ldT%02ld:%02ld:%02ld.%06d+02:00 host message",
+               (second / 2678400) % 12 + 1, (second / 86400) % 28 + 1,
+               (second / 3600) % 24, (second / 60) % 60, second % 60,
+               i % 1000000);
+    else
+      snprintf(lines[i], BENCH_LINE_LENGTH, "%ld host message", second);
+    lengths[i] = strlen(lines[i]);
+  }
+}
+
+static double elapsed_ns(const struct timespec *start,
+                         const struct timespec *end) {
+  return (end->tv_sec - start->tv_sec) * 1e9 +
+         (end->tv_nsec - start->tv_nsec);
+}
+
+static void run(const char *format, int per_second) {
+  LogTimestampCache cache;
+  struct timespec start, end;
+  volatile time_t sink = 0;
+  double legacy_ns, fast_ns;
+
+  build_corpus(format, per_second);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < BENCH_LINES; i++)
+    sink += legacy_extract_timestamp(lines[i]);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  legacy_ns = elapsed_ns(&start, &end) / BENCH_LINES;
+
+  log_timestamp_cache_init(&cache);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < BENCH_LINES; i++)
+    sink += log_timestamp_parse(&cache, lines[i], lengths[i]);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  fast_ns = elapsed_ns(&start, &end) / BENCH_LINES;
+
+  printf("%-8s %10d %12.1f %12.1f %9.1fx\n", format, per_second, legacy_ns,
+         fast_ns, legacy_ns / fast_ns);
+  (void)sink;
+}
+
+int main(void) {
+  printf("%-8s %10s %12s %12s %10s\n", "format", "lines/sec", "legacy ns",
+         "parser ns", "speedup");
+  run("syslog", 1);
+  run("syslog", 10);
+  run("iso8601", 1);
+  run("iso8601", 10);
+  run("epoch", 1);
+  return 0;
+}
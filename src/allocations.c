@@ -0,0 +1,53 @@
+#include <errno.h>
+
+#include "include/log_analyzer.h"
+
+#if defined(__GLIBC__) && defined(LOG_ANALYZER_COUNT_ALLOCATIONS)
+/*
+ * Counts heap allocations by standing in for malloc, calloc, realloc and
+ * posix_memalign; glibc's own allocations (strdup, fopen) go through them
+ * too. Only the benchmarks, and binaries built with COUNT_ALLOCATIONS=1,
+ * compile this: it hands out glibc memory to whatever free() is linked,
+ * so it breaks sanitizers and preloaded allocators.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static long allocation_count;
+
+void *malloc(size_t size) {
+  __atomic_fetch_add(&allocation_count, 1, __ATOMIC_RELAXED);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  __atomic_fetch_add(&allocation_count, 1, __ATOMIC_RELAXED);
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  __atomic_fetch_add(&allocation_count, 1, __ATOMIC_RELAXED);
+  return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+  void *memory;
+
+  if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+    return EINVAL;
+  __atomic_fetch_add(&allocation_count, 1, __ATOMIC_RELAXED);
+  memory = __libc_memalign(alignment, size);
+  if (!memory) return ENOMEM;
+  *ptr = memory;
+  return 0;
+}
+
+long log_allocation_count(void) {
+  return __atomic_load_n(&allocation_count, __ATOMIC_RELAXED);
+}
+#else
+/* Otherwise allocations are not counted */
+long log_allocation_count(void) { return -1; }
+#endif
@@ -0,0 +1,115 @@
+#include <stdlib.h>
+
+#include "include/log_analyzer.h"
+
+/* Enough for any scalar or pointer field of a LogEntry */
+#define LOG_ARENA_ALIGNMENT 16
+
+typedef struct LogArenaBlock {
+  struct LogArenaBlock *next;
+  size_t capacity;
+  size_t used;
+  /* payload follows the header */
+} LogArenaBlock;
+
+/*
+ * A bump allocator: allocations are carved from large blocks and are never
+ * freed one by one. Resetting rewinds the first block and releases the rest.
+ */
+struct LogArena {
+  LogArenaBlock *head;
+  LogArenaBlock *current;
+  size_t block_size;
+  long allocations;
+  long block_allocations;
+};
+
+static size_t header_size(void) {
+  return (sizeof(LogArenaBlock) + LOG_ARENA_ALIGNMENT - 1) &
+         ~(size_t)(LOG_ARENA_ALIGNMENT - 1);
+}
+
+static LogArenaBlock *new_block(LogArena *arena, size_t min_size) {
+  size_t capacity = min_size > arena->block_size ? min_size : arena->block_size;
+  LogArenaBlock *block = (LogArenaBlock *)malloc(header_size() + capacity);
+
+  if (!block) return NULL;
+  block->next = NULL;
+  block->capacity = capacity;
+  block->used = 0;
+  arena->block_allocations++;
+  return block;
+}
+
+LogArena *log_arena_create(size_t block_size) {
+  LogArena *arena = (LogArena *)calloc(1, sizeof(LogArena));
+
+  if (!arena) return NULL;
+  arena->block_size = block_size > 0 ? block_size : LOG_ARENA_BLOCK_SIZE;
+  arena->head = new_block(arena, arena->block_size);
+  if (!arena->head) {
+    free(arena);
+    return NULL;
+  }
+  arena->current = arena->head;
+  return arena;
+}
+
+void *log_arena_alloc(LogArena *arena, size_t size) {
+  LogArenaBlock *block;
+  void *ptr;
+
+  if (!arena) return NULL;
+
+  size = (size + LOG_ARENA_ALIGNMENT - 1) & ~(size_t)(LOG_ARENA_ALIGNMENT - 1);
+  block = arena->current;
+  if (block->capacity - block->used < size) {
+    block = new_block(arena, size);
+    if (!block) return NULL;
+    arena->current->next = block;
+    arena->current = block;
+  }
+
+  ptr = (char *)block + header_size() + block->used;
+  block->used += size;
+  arena->allocations++;
+  return ptr;
+}
+
+char *log_arena_strndup(LogArena *arena, const char *str, size_t length) {
+  char *copy = (char *)log_arena_alloc(arena, length + 1);
+
+  if (!copy) return NULL;
+  memcpy(copy, str, length);
+  copy[length] = '\0';
+  return copy;
+}
+
+void log_arena_reset(LogArena *arena) {
+  LogArenaBlock *block, *next;
+
+  if (!arena) return;
+
+  for (block = arena->head->next; block; block = next) {
+    next = block->next;
+    free(block);
+  }
+  arena->head->next = NULL;
+  arena->head->used = 0;
+  arena->current = arena->head;
+}
+
+void log_arena_stats(const LogArena *arena, long *allocations,
+                     long *block_allocations) {
+  if (!arena) return;
+  if (allocations) *allocations = arena->allocations;
+  if (block_allocations) *block_allocations = arena->block_allocations;
+}
+
+void log_arena_destroy(LogArena *arena) {
+  if (!arena) return;
+
+  log_arena_reset(arena);
+  free(arena->head);
+  free(arena);
+}
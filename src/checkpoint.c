@@ -0,0 +1,330 @@
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "include/log_analyzer.h"
+
+#define CHECKPOINT_MAGIC "log_analyzer checkpoint 4"
+#define CHECKPOINT_HEAD_SIZE 4096 /* bytes of the input fingerprinted */
+
+/*
+ * A checkpoint is a small text file:
+ *
+ *   log_analyzer checkpoint 4
+ *   offset <bytes processed>
+ *   file <st_dev> <st_ino> <head length> <head hash>
+ *   patterns <count> <hash>
+ *   entries <count>
+ *   lines <count>
+ *   range <valid> <first epoch> <last epoch>
+ *   frequency <pattern index> <count>   (one per pattern)
+ *   histograms <count>
+ *   histogram <pattern index> <width> <buckets>
+ *   bucket <start epoch> <count>         (one per bucket)
+ *   templates <count>
+ *   template <count> <error> <text>      (text runs to the end of line)
+ *
+ * Frequencies are stored in pattern table order, which the pattern hash
+ * pins down, so they must be written before the detector ranks them.
+ */
+typedef struct {
+  off_t offset;
+  uintmax_t device;
+  uintmax_t inode;
+  size_t head_length;
+  uint64_t head_hash;
+  int pattern_count;
+  uint64_t pattern_hash;
+  long entry_count;
+  long line_count;
+  LogTimeRange time_range;
+} CheckpointHeader;
+
+static uint64_t hash_update(uint64_t hash, const void *data, size_t length) {
+  const unsigned char *bytes = (const unsigned char *)data;
+
+  for (size_t i = 0; i < length; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+/* Hashes the first `length` bytes of the input; false if they are short */
+static bool hash_head(const char *path, size_t length, uint64_t *hash) {
+  char head[CHECKPOINT_HEAD_SIZE];
+  ssize_t got = 0, n;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0) return false;
+  while ((size_t)got < length) {
+    n = read(fd, head + got, length - (size_t)got);
+    if (n <= 0) break;
+    got += n;
+  }
+  close(fd);
+
+  if ((size_t)got != length) return false;
+  *hash = hash_update(14695981039346656037ull, head, length);
+  return true;
+}
+
+static bool read_header(FILE *fp, CheckpointHeader *header) {
+  char magic[64];
+  long long offset, first, last;
+  int valid;
+
+  if (!fgets(magic, sizeof(magic), fp) ||
+      strncmp(magic, CHECKPOINT_MAGIC, strlen(CHECKPOINT_MAGIC)) != 0)
+    return false;
+
+  if (fscanf(fp, " offset %lld", &offset) != 1 ||
+      fscanf(fp, " file %" SCNuMAX " %" SCNuMAX " %zu %" SCNu64,
+             &header->device, &header->inode, &header->head_length,
+             &header->head_hash) != 4 ||
+      fscanf(fp, " patterns %d %" SCNu64, &header->pattern_count,
+             &header->pattern_hash) != 2 ||
+      fscanf(fp, " entries %ld", &header->entry_count) != 1 ||
+      fscanf(fp, " lines %ld", &header->line_count) != 1 ||
+      fscanf(fp, " range %d %lld %lld", &valid, &first, &last) != 3)
+    return false;
+
+  header->offset = (off_t)offset;
+  header->time_range.first = (time_t)first;
+  header->time_range.last = (time_t)last;
+  header->time_range.valid = valid != 0;
+  return offset >= 0 && header->head_length <= CHECKPOINT_HEAD_SIZE;
+}
+
+/* Whether the checkpoint describes a prefix of the current input */
+static bool matches_input(const LogAnalyzerContext *ctx,
+                          const CheckpointHeader *header) {
+  struct stat st;
+  uint64_t head_hash;
+
+  if (header->pattern_count != ctx->pattern_count ||
+      header->pattern_hash != pattern_detector_hash(ctx)) {
+    fprintf(stderr, "Checkpoint was made with other patterns\n");
+    return false;
+  }
+
+  if (stat(ctx->input_path, &st) != 0) return false;
+  if ((uintmax_t)st.st_dev != header->device ||
+      (uintmax_t)st.st_ino != header->inode || st.st_size < header->offset ||
+      !hash_head(ctx->input_path, header->head_length, &head_hash) ||
+      head_hash != header->head_hash) {
+    fprintf(stderr, "Input was rotated or rewritten since the checkpoint\n");
+    return false;
+  }
+  return true;
+}
+
+/* Reads the histogram section into histograms, one slot per pattern */
+static bool read_histograms(FILE *fp, int pattern_count,
+                            LogHistogram **histograms) {
+  int count, index, width;
+  long long start;
+  long matches;
+  size_t buckets;
+
+  if (fscanf(fp, " histograms %d", &count) != 1) return false;
+  while (count-- > 0) {
+    if (fscanf(fp, " histogram %d %d %zu", &index, &width, &buckets) != 3 ||
+        index < 0 || index >= pattern_count || histograms[index])
+      return false;
+    histograms[index] = log_histogram_create();
+    if (!histograms[index]) return false;
+
+    while (buckets-- > 0) {
+      if (fscanf(fp, " bucket %lld %ld", &start, &matches) != 2 ||
+          !log_histogram_add_bucket(histograms[index], width, (time_t)start,
+                                    matches))
+        return false;
+    }
+  }
+  return true;
+}
+
+static void write_histograms(FILE *fp, const LogAnalyzerContext *ctx) {
+  const LogHistogram *histogram;
+  size_t cursor;
+  time_t start;
+  long count;
+  int total = 0;
+
+  for (int i = 0; i < ctx->pattern_count; i++)
+    if (ctx->patterns[i].histogram) total++;
+
+  fprintf(fp, "histograms %d\n", total);
+  for (int i = 0; i < ctx->pattern_count; i++) {
+    histogram = ctx->patterns[i].histogram;
+    if (!histogram) continue;
+
+    fprintf(fp, "histogram %d %d %zu\n", i, log_histogram_width(histogram),
+            log_histogram_bucket_count(histogram));
+    cursor = 0;
+    while (log_histogram_next_bucket(histogram, &cursor, &start, &count))
+      fprintf(fp, "bucket %lld %ld\n", (long long)start, count);
+  }
+}
+
+/* Reads the template section into miner; template text has no newline */
+static bool read_templates(FILE *fp, LogTemplateMiner *miner) {
+  size_t size = MAX_LINE_LENGTH * 2, length;
+  long count, error;
+  char *text;
+  int total;
+  bool valid = true;
+
+  if (fscanf(fp, " templates %d", &total) != 1) return false;
+  text = (char *)malloc(size);
+  if (!text) return false;
+
+  while (valid && total-- > 0) {
+    valid = fscanf(fp, " template %ld %ld", &count, &error) == 2 &&
+            fgetc(fp) == ' ' && fgets(text, (int)size, fp) != NULL;
+    length = valid ? strlen(text) : 0;
+    valid = valid && length > 1 && text[length - 1] == '\n' &&
+            error >= 0 &&
+            log_template_add_counted(miner, text, length - 1, count, error);
+  }
+  free(text);
+  return valid;
+}
+
+static void write_templates(FILE *fp, const LogAnalyzerContext *ctx) {
+  LogTemplate template;
+  int cursor = 0;
+
+  fprintf(fp, "templates %d\n", log_template_count(ctx->template_miner));
+  while (log_template_next(ctx->template_miner, &cursor, &template))
+    fprintf(fp, "template %ld %ld %s\n", template.count, template.error,
+            template.text);
+}
+
+/*
+ * Restores frequencies from ctx->checkpoint_path and seeks the collector
+ * past the prefix they cover. Returns false, leaving the context
+ * untouched, when there is no usable checkpoint; the caller then does a
+ * full run.
+ */
+bool log_checkpoint_resume(LogAnalyzerContext *ctx) {
+  CheckpointHeader header;
+  LogHistogram **histograms;
+  LogTemplateMiner *templates;
+  Pattern *pattern;
+  long *frequencies;
+  long frequency;
+  int index;
+  bool valid;
+  FILE *fp;
+
+  if (!ctx || strlen(ctx->checkpoint_path) == 0) return false;
+
+  fp = fopen(ctx->checkpoint_path, "r");
+  if (!fp) return false;
+
+  memset(&header, 0, sizeof(header));
+  frequencies = (long *)calloc(ctx->pattern_count + 1, sizeof(long));
+  histograms = (LogHistogram **)calloc(ctx->pattern_count + 1,
+                                       sizeof(LogHistogram *));
+  templates = log_template_miner_create(LOG_TEMPLATE_CAPACITY);
+  valid = frequencies && histograms && templates &&
+          read_header(fp, &header) && matches_input(ctx, &header);
+
+  for (int i = 0; valid && i < ctx->pattern_count; i++) {
+    valid = fscanf(fp, " frequency %d %ld", &index, &frequency) == 2 &&
+            index == i && frequency >= 0;
+    if (valid) frequencies[i] = frequency;
+  }
+  valid = valid && read_histograms(fp, ctx->pattern_count, histograms) &&
+          read_templates(fp, templates);
+  fclose(fp);
+
+  valid = valid && log_collector_seek(ctx, header.offset);
+  for (int i = 0; valid && i < ctx->pattern_count; i++) {
+    pattern = &ctx->patterns[i];
+    if (histograms[i] && pattern->histogram)
+      valid = log_histogram_merge(pattern->histogram, histograms[i]);
+  }
+  valid = valid && log_template_merge(ctx->template_miner, templates);
+  if (valid) {
+    for (int i = 0; i < ctx->pattern_count; i++) {
+      pattern = &ctx->patterns[i];
+      pattern->frequency += frequencies[i];
+      if (!pattern->histogram) {
+        pattern->histogram = histograms[i];
+        histograms[i] = NULL;
+      }
+    }
+    ctx->entry_count += header.entry_count;
+    ctx->line_count += header.line_count;
+    log_time_range_merge(&ctx->time_range, &header.time_range);
+    if (ctx->verbose)
+      printf("Resuming at byte %lld with %ld entries from %s\n",
+             (long long)header.offset, header.entry_count,
+             ctx->checkpoint_path);
+  }
+
+  for (int i = 0; histograms && i < ctx->pattern_count; i++)
+    log_histogram_free(histograms[i]);
+  free(histograms);
+  free(frequencies);
+  log_template_miner_free(templates);
+  return valid;
+}
+
+/* Records how far the input was processed; call before ranking */
+bool log_checkpoint_save(LogAnalyzerContext *ctx) {
+  char temp_path[MAX_PATH_LENGTH + 8];
+  struct stat st;
+  uint64_t head_hash;
+  size_t head_length;
+  off_t offset;
+  FILE *fp;
+
+  if (!ctx || strlen(ctx->checkpoint_path) == 0) return false;
+
+  offset = log_collector_offset(ctx);
+  if (offset < 0 || stat(ctx->input_path, &st) != 0) {
+    fprintf(stderr, "Cannot checkpoint input: %s\n", ctx->input_path);
+    return false;
+  }
+
+  head_length = (size_t)(st.st_size < CHECKPOINT_HEAD_SIZE
+                             ? st.st_size
+                             : CHECKPOINT_HEAD_SIZE);
+  if (!hash_head(ctx->input_path, head_length, &head_hash)) return false;
+
+  /* Write a sibling file and rename it, so a crash never leaves half */
+  snprintf(temp_path, sizeof(temp_path), "%s.tmp", ctx->checkpoint_path);
+  fp = fopen(temp_path, "w");
+  if (!fp) {
+    perror("Failed to write checkpoint");
+    return false;
+  }
+
+  fprintf(fp, "%s\n", CHECKPOINT_MAGIC);
+  fprintf(fp, "offset %lld\n", (long long)offset);
+  fprintf(fp, "file %" PRIuMAX " %" PRIuMAX " %zu %" PRIu64 "\n",
+          (uintmax_t)st.st_dev, (uintmax_t)st.st_ino, head_length, head_hash);
+  fprintf(fp, "patterns %d %" PRIu64 "\n", ctx->pattern_count,
+          pattern_detector_hash(ctx));
+  fprintf(fp, "entries %ld\n", ctx->entry_count);
+  fprintf(fp, "lines %ld\n", ctx->line_count);
+  fprintf(fp, "range %d %lld %lld\n", ctx->time_range.valid ? 1 : 0,
+          (long long)ctx->time_range.first, (long long)ctx->time_range.last);
+  for (int i = 0; i < ctx->pattern_count; i++)
+    fprintf(fp, "frequency %d %ld\n", i, ctx->patterns[i].frequency);
+  write_histograms(fp, ctx);
+  write_templates(fp, ctx);
+
+  if (fclose(fp) != 0 || rename(temp_path, ctx->checkpoint_path) != 0) {
+    perror("Failed to write checkpoint");
+    remove(temp_path);
+    return false;
+  }
+  return true;
+}
@@ -1,39 +1,594 @@
+#include <fcntl.h>
+#include <libgen.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "include/log_analyzer.h"
 
-static FILE *input_file = NULL;
+#ifdef __linux__
+#include <sys/inotify.h>
+#define HAVE_INOTIFY 1
+#endif
+
+/* Without inotify, a followed file is re-checked this often */
+#define FOLLOW_POLL_MS 1000
+
+/*
+ * Regular files are mapped and handed out as views straight into the
+ * mapping. Gzip files are inflated block by block and handed out as views
+ * into the current block. Pipes, character devices and stdin ("-") go
+ * through stdio.
+ */
+struct LogCollector {
+  char *map;
+  size_t map_size;
+  LogChunk remaining; /* unread part of the mapping */
+
+  LogGzipReader *gzip;
+  int gzip_fd;
+  LogChunk block; /* unread part of the current inflated block */
+
+  FILE *file;
+  char *buffer;
+  size_t buffer_capacity;
+  LogChunk ahead; /* lines read early to sample the format, not yet used */
+  char *ahead_buffer;
+  size_t ahead_capacity;
+
+  /*
+   * When following or checkpointing, an unterminated last line is held
+   * back until its newline arrives (or left for the next run).
+   */
+  bool follow;
+  bool hold_partial;
+  char *partial;
+  size_t partial_length;
+  size_t partial_capacity;
+  int watch_fd;
+  int file_watch;
+};
+
+static bool map_file(LogCollector *collector, int fd) {
+  struct stat st;
+  void *map;
+
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+    return false;
+
+  map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) return false;
+
+  posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+  collector->map = (char *)map;
+  collector->map_size = (size_t)st.st_size;
+  collector->remaining.data = collector->map;
+  collector->remaining.length = collector->map_size;
+  collector->remaining.offset = 0;
+
+  if (collector->hold_partial) {
+    while (collector->remaining.length > 0 &&
+           collector->map[collector->remaining.length - 1] != '\n')
+      collector->remaining.length--;
+  }
+  return true;
+}
+
+bool log_chunk_next_line(LogChunk *chunk, LogLine *line) {
+  const char *start, *newline;
+  size_t remaining;
+
+  if (!chunk || !line || chunk->offset >= chunk->length) return false;
+
+  start = chunk->data + chunk->offset;
+  remaining = chunk->length - chunk->offset;
+  newline = (const char *)memchr(start, '\n', remaining);
+
+  line->data = start;
+  line->length = newline ? (size_t)(newline - start) : remaining;
+  chunk->offset += line->length + (newline ? 1 : 0);
+  return true;
+}
+
+int log_collector_split(LogAnalyzerContext *ctx, LogChunk *chunks,
+                        int max_chunks) {
+  LogCollector *collector;
+  const char *start, *end, *cut, *newline;
+  int count = 0;
+
+  if (!ctx || !ctx->collector || !chunks || max_chunks <= 0) return 0;
+  collector = ctx->collector;
+  if (!collector->map) return 0;
+
+  start = collector->remaining.data + collector->remaining.offset;
+  end = collector->remaining.data + collector->remaining.length;
+
+  /* Cut near equal byte offsets, moved forward past the next newline */
+  for (int i = 1; i <= max_chunks && start < end; i++) {
+    cut = i == max_chunks
+              ? end
+              : start + (size_t)(end - start) / (size_t)(max_chunks - i + 1);
+    if (cut < end) {
+      newline = (const char *)memchr(cut, '\n', (size_t)(end - cut));
+      cut = newline ? newline + 1 : end;
+    }
+    chunks[count].data = start;
+    chunks[count].length = (size_t)(cut - start);
+    chunks[count].offset = 0;
+    count++;
+    start = cut;
+  }
+
+  collector->remaining.offset = collector->remaining.length;
+  return count;
+}
 
 bool log_collector_open_file(LogAnalyzerContext *ctx) {
+  LogCollector *collector;
+  int fd;
+
   if (!ctx || strlen(ctx->input_path) == 0) return false;
 
-  input_file = fopen(ctx->input_path, "r");
-  if (!input_file) {
+  log_collector_close_file(ctx);
+  collector = (LogCollector *)calloc(1, sizeof(LogCollector));
+  if (!collector) return false;
+  collector->follow = ctx->follow;
+  collector->hold_partial = ctx->follow || strlen(ctx->checkpoint_path) > 0;
+  collector->watch_fd = -1;
+  collector->file_watch = -1;
+  collector->gzip_fd = -1;
+
+  if (strcmp(ctx->input_path, "-") == 0) {
+    collector->file = stdin;
+    ctx->collector = collector;
+    return true;
+  }
+
+  fd = open(ctx->input_path, O_RDONLY);
+  if (fd < 0) {
     perror("Failed to open input file");
+    free(collector);
+    return false;
+  }
+
+  if (log_gzip_is_compressed(fd)) {
+    if (collector->follow) {
+      fprintf(stderr, "Compressed input cannot be followed\n");
+      close(fd);
+      free(collector);
+      return false;
+    }
+    collector->gzip = log_gzip_open(fd, ctx->thread_count > 1);
+    if (!collector->gzip) {
+      fprintf(stderr, "Failed to set up decompression\n");
+      close(fd);
+      free(collector);
+      return false;
+    }
+    collector->gzip_fd = fd;
+    ctx->collector = collector;
+    return true;
+  }
+
+  /* A followed file grows past any mapping, so it is always read */
+  if (!collector->follow && map_file(collector, fd)) {
+    close(fd);
+  } else {
+    collector->file = fdopen(fd, "r");
+    if (!collector->file) {
+      perror("Failed to open input file");
+      close(fd);
+      free(collector);
+      return false;
+    }
+  }
+
+  ctx->collector = collector;
+  return true;
+}
+
+static bool append_partial(LogCollector *collector, const char *data,
+                           size_t length) {
+  size_t needed = collector->partial_length + length;
+  char *partial;
+
+  if (needed > collector->partial_capacity) {
+    partial = (char *)realloc(collector->partial, needed);
+    if (!partial) return false;
+    collector->partial = partial;
+    collector->partial_capacity = needed;
+  }
+  memcpy(collector->partial + collector->partial_length, data, length);
+  collector->partial_length = needed;
+  return true;
+}
+
+/*
+ * In follow mode the writer may be mid-line at EOF. The fragment is kept
+ * and prefixed to what getline() returns once the newline arrives.
+ */
+static bool complete_line(LogCollector *collector, ssize_t length,
+                          LogLine *line) {
+  bool terminated = length > 0 && collector->buffer[length - 1] == '\n';
+
+  if (!terminated) {
+    if (!append_partial(collector, collector->buffer, (size_t)length))
+      perror("Failed to buffer partial line");
+    clearerr(collector->file);
+    return false;
+  }
+
+  length--;
+  if (collector->partial_length == 0) {
+    line->data = collector->buffer;
+    line->length = (size_t)length;
+    return true;
+  }
+
+  if (!append_partial(collector, collector->buffer, (size_t)length)) {
+    perror("Failed to buffer partial line");
+    collector->partial_length = 0;
+    return false;
+  }
+  line->data = collector->partial;
+  line->length = collector->partial_length;
+  collector->partial_length = 0;
+  return true;
+}
+
+/* Lines that straddle two inflated blocks are joined in the partial buffer */
+static bool next_gzip_line(LogCollector *collector, LogLine *line) {
+  LogChunk *block = &collector->block;
+  const char *start, *newline, *data;
+  size_t remaining, length;
+
+  for (;;) {
+    if (block->offset < block->length) {
+      start = block->data + block->offset;
+      remaining = block->length - block->offset;
+      newline = (const char *)memchr(start, '\n', remaining);
+      if (!newline) {
+        if (!append_partial(collector, start, remaining)) return false;
+        block->offset = block->length;
+        continue;
+      }
+
+      length = (size_t)(newline - start);
+      block->offset += length + 1;
+      if (collector->partial_length == 0) {
+        line->data = start;
+        line->length = length;
+        return true;
+      }
+      if (!append_partial(collector, start, length)) return false;
+      break;
+    }
+
+    if (!log_gzip_read_block(collector->gzip, &data, &length)) {
+      if (collector->partial_length == 0) return false;
+      break;
+    }
+    block->data = data;
+    block->length = length;
+    block->offset = 0;
+  }
+
+  line->data = collector->partial;
+  line->length = collector->partial_length;
+  collector->partial_length = 0;
+  return true;
+}
+
+static bool append_ahead(LogCollector *collector, const LogLine *line) {
+  size_t needed = collector->ahead.length + line->length + 1;
+  size_t capacity = collector->ahead_capacity ? collector->ahead_capacity
+                                              : MAX_LINE_LENGTH;
+  char *buffer;
+
+  if (needed > collector->ahead_capacity) {
+    while (capacity < needed) capacity *= 2;
+    buffer = (char *)realloc(collector->ahead_buffer, capacity);
+    if (!buffer) return false;
+    collector->ahead_buffer = buffer;
+    collector->ahead_capacity = capacity;
+  }
+  memcpy(collector->ahead_buffer + collector->ahead.length, line->data,
+         line->length);
+  collector->ahead_buffer[needed - 1] = '\n';
+  collector->ahead.data = collector->ahead_buffer;
+  collector->ahead.length = needed;
+  return true;
+}
+
+/*
+ * Reads up to LOG_FORMAT_SAMPLE lines from a stream, which cannot be
+ * looked at without consuming it, to be handed out again before the
+ * stream is read further. End of input and errors are left for
+ * log_collector_next_line() to find.
+ */
+static bool read_ahead(LogCollector *collector) {
+  ssize_t length;
+  LogLine line;
+
+  collector->ahead.length = collector->ahead.offset = 0;
+  for (int i = 0; i < LOG_FORMAT_SAMPLE; i++) {
+    length = getline(&collector->buffer, &collector->buffer_capacity,
+                     collector->file);
+    if (length < 0) break;
+    if (collector->hold_partial) {
+      if (!complete_line(collector, length, &line)) break;
+    } else {
+      if (length > 0 && collector->buffer[length - 1] == '\n') length--;
+      line.data = collector->buffer;
+      line.length = (size_t)length;
+    }
+    if (!append_ahead(collector, &line)) {
+      perror("Failed to buffer input");
+      break;
+    }
+  }
+  return collector->ahead.length > 0;
+}
+
+/*
+ * The unread input from the current position, left unread: the rest of
+ * a mapping, the current inflated block, or lines read ahead from a
+ * stream. False when there is nothing to look at.
+ */
+bool log_collector_peek(LogAnalyzerContext *ctx, const char **data,
+                        size_t *length) {
+  LogCollector *collector;
+  LogChunk *view;
+
+  if (!ctx || !ctx->collector || !data || !length) return false;
+  collector = ctx->collector;
+
+  if (collector->map) {
+    view = &collector->remaining;
+  } else if (collector->gzip) {
+    view = &collector->block;
+    if (view->offset >= view->length && collector->partial_length == 0) {
+      if (!log_gzip_read_block(collector->gzip, &view->data, &view->length))
+        return false;
+      view->offset = 0;
+    }
+  } else {
+    view = &collector->ahead;
+    if (view->offset >= view->length && !read_ahead(collector)) return false;
+  }
+
+  *data = view->data + view->offset;
+  *length = view->length - view->offset;
+  return *length > 0;
+}
+
+/* Whether input ended on an error rather than at its end */
+bool log_collector_failed(const LogAnalyzerContext *ctx) {
+  if (!ctx || !ctx->collector) return false;
+  return log_gzip_failed(ctx->collector->gzip);
+}
+
+bool log_collector_next_line(LogAnalyzerContext *ctx, LogLine *line) {
+  LogCollector *collector;
+  ssize_t length;
+
+  if (!ctx || !ctx->collector || !line) return false;
+  collector = ctx->collector;
+
+  if (collector->map) return log_chunk_next_line(&collector->remaining, line);
+  if (collector->gzip) return next_gzip_line(collector, line);
+  if (collector->ahead.offset < collector->ahead.length)
+    return log_chunk_next_line(&collector->ahead, line);
+
+  length = getline(&collector->buffer, &collector->buffer_capacity,
+                   collector->file);
+  if (length < 0) {
+    if (ferror(collector->file)) perror("Error reading input file.");
+    if (collector->follow) clearerr(collector->file);
     return false;
   }
+  if (collector->hold_partial) return complete_line(collector, length, line);
+  if (length > 0 && collector->buffer[length - 1] == '\n') length--;
+
+  line->data = collector->buffer;
+  line->length = (size_t)length;
   return true;
 }
 
+/* Bytes consumed up to the end of the last complete line handed out */
+off_t log_collector_offset(LogAnalyzerContext *ctx) {
+  LogCollector *collector;
+  off_t position;
+
+  if (!ctx || !ctx->collector) return -1;
+  collector = ctx->collector;
+
+  if (collector->map) return (off_t)collector->remaining.offset;
+  if (collector->gzip || collector->file == stdin) return -1;
+
+  position = ftello(collector->file);
+  return position < 0 ? -1
+                      : position - (off_t)collector->partial_length -
+                            (off_t)(collector->ahead.length -
+                                    collector->ahead.offset);
+}
+
+/* Skips an already processed prefix of the input */
+bool log_collector_seek(LogAnalyzerContext *ctx, off_t offset) {
+  LogCollector *collector;
+
+  if (!ctx || !ctx->collector || offset < 0) return false;
+  collector = ctx->collector;
+
+  if (collector->map) {
+    if ((size_t)offset > collector->remaining.length) return false;
+    collector->remaining.offset = (size_t)offset;
+    return true;
+  }
+  if (collector->gzip || collector->file == stdin) return false;
+
+  collector->partial_length = 0;
+  collector->ahead.length = collector->ahead.offset = 0;
+  return fseeko(collector->file, offset, SEEK_SET) == 0;
+}
+
 bool log_collector_read_line(LogAnalyzerContext *ctx, char *buffer,
                              size_t buffer_size) {
-  if (!ctx || !buffer || buffer_size == 0 || !input_file) return false;
+  LogCollector *collector;
+  LogLine line;
+  size_t len;
 
-  if (fgets(buffer, buffer_size, input_file) == NULL) {
-    if (feof(input_file))
+  if (!ctx || !ctx->collector || !buffer || buffer_size == 0) return false;
+  collector = ctx->collector;
+
+  /* Mapped, inflated and read-ahead lines longer than the buffer are cut */
+  if (collector->map || collector->gzip ||
+      collector->ahead.offset < collector->ahead.length) {
+    if (!log_collector_next_line(ctx, &line)) return false;
+    len = line.length < buffer_size - 1 ? line.length : buffer_size - 1;
+    memcpy(buffer, line.data, len);
+    buffer[len] = '\0';
+    return true;
+  }
+
+  if (fgets(buffer, buffer_size, collector->file) == NULL) {
+    if (feof(collector->file))
       return false;
     else {
       perror("Error reading input file.");
       return false;
     }
   }
-  size_t len = strlen(buffer);
+  len = strlen(buffer);
   if (len > 0 && buffer[len - 1] == '\n') buffer[len - 1] = '\0';
 
   return true;
 }
 
 void log_collector_close_file(LogAnalyzerContext *ctx) {
-  if (input_file) {
-    fclose(input_file);
-    input_file = NULL;
+  LogCollector *collector;
+
+  if (!ctx || !ctx->collector) return;
+  collector = ctx->collector;
+
+  if (collector->map) munmap(collector->map, collector->map_size);
+  if (collector->gzip) log_gzip_close(collector->gzip);
+  if (collector->gzip_fd >= 0) close(collector->gzip_fd);
+  if (collector->file && collector->file != stdin) fclose(collector->file);
+  if (collector->watch_fd >= 0) close(collector->watch_fd);
+  free(collector->buffer);
+  free(collector->ahead_buffer);
+  free(collector->partial);
+  free(collector);
+  ctx->collector = NULL;
+}
+
+#ifdef HAVE_INOTIFY
+static void watch_file(LogCollector *collector, const char *path) {
+  if (collector->file_watch >= 0)
+    inotify_rm_watch(collector->watch_fd, collector->file_watch);
+  collector->file_watch =
+      inotify_add_watch(collector->watch_fd, path,
+                        IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+}
+#endif
+
+/*
+ * Starts watching the input for appends, and its directory for a file
+ * being created under the same name after rotation.
+ */
+bool log_collector_watch(LogAnalyzerContext *ctx) {
+  LogCollector *collector;
+
+  if (!ctx || !ctx->collector || !ctx->collector->file) return false;
+  collector = ctx->collector;
+  if (collector->file == stdin) {
+    fprintf(stderr, "Following requires a named input file\n");
+    return false;
+  }
+
+#ifdef HAVE_INOTIFY
+  char directory[MAX_PATH_LENGTH];
+
+  collector->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (collector->watch_fd < 0) {
+    perror("inotify_init1");
+    return true; /* fall back to periodic checks */
+  }
+  watch_file(collector, ctx->input_path);
+
+  strncpy(directory, ctx->input_path, sizeof(directory) - 1);
+  directory[sizeof(directory) - 1] = '\0';
+  inotify_add_watch(collector->watch_fd, dirname(directory),
+                    IN_CREATE | IN_MOVED_TO);
+#endif
+  return true;
+}
+
+/* Blocks until the input may have changed or timeout_ms passes */
+int log_collector_wait(LogAnalyzerContext *ctx, int timeout_ms) {
+  LogCollector *collector;
+  struct pollfd pfd;
+  int ready;
+
+  if (!ctx || !ctx->collector) return -1;
+  collector = ctx->collector;
+
+  if (collector->watch_fd < 0) {
+    if (timeout_ms < 0 || timeout_ms > FOLLOW_POLL_MS)
+      timeout_ms = FOLLOW_POLL_MS;
+    ready = poll(NULL, 0, timeout_ms);
+    return ready < 0 ? -1 : 1;
+  }
+
+  pfd.fd = collector->watch_fd;
+  pfd.events = POLLIN;
+  ready = poll(&pfd, 1, timeout_ms);
+  if (ready <= 0) return ready;
+
+#ifdef HAVE_INOTIFY
+  /* The events only wake us; what changed is checked on the file itself */
+  char events[4096];
+  while (read(collector->watch_fd, events, sizeof(events)) > 0) continue;
+#endif
+  return 1;
+}
+
+/*
+ * Rewinds a truncated input and reopens one that was rotated away. The
+ * caller drains the old file first so no appended lines are lost.
+ */
+bool log_collector_check_rotation(LogAnalyzerContext *ctx) {
+  LogCollector *collector;
+  struct stat current, named;
+  off_t position;
+  FILE *file;
+
+  if (!ctx || !ctx->collector || !ctx->collector->file) return false;
+  collector = ctx->collector;
+  if (fstat(fileno(collector->file), &current) != 0) return false;
+
+  if (stat(ctx->input_path, &named) == 0 &&
+      (named.st_ino != current.st_ino || named.st_dev != current.st_dev)) {
+    file = fopen(ctx->input_path, "r");
+    if (!file) return false;
+    fclose(collector->file);
+    collector->file = file;
+    collector->partial_length = 0;
+    collector->ahead.length = collector->ahead.offset = 0;
+#ifdef HAVE_INOTIFY
+    if (collector->watch_fd >= 0) watch_file(collector, ctx->input_path);
+#endif
+    return true;
+  }
+
+  position = ftello(collector->file);
+  if (position >= 0 && current.st_size < position) {
+    fseeko(collector->file, 0, SEEK_SET);
+    collector->partial_length = 0;
+    collector->ahead.length = collector->ahead.offset = 0;
+    return true;
   }
+  return false;
 }
@@ -0,0 +1,157 @@
+#include "include/log_analyzer.h"
+
+#define COLUMNS_INITIAL_CAPACITY 1024
+#define COLUMNS_INITIAL_TEXT (64 * 1024)
+
+static bool grow_rows(LogColumns *columns) {
+  long capacity = columns->capacity * 2;
+  time_t *timestamps;
+  unsigned char *severities;
+  int *source_ids, *process_ids;
+  size_t *message_offsets;
+
+  timestamps = (time_t *)realloc(columns->timestamps,
+                                 capacity * sizeof(time_t));
+  if (!timestamps) return false;
+  columns->timestamps = timestamps;
+
+  severities = (unsigned char *)realloc(columns->severities, capacity);
+  if (!severities) return false;
+  columns->severities = severities;
+
+  source_ids = (int *)realloc(columns->source_ids, capacity * sizeof(int));
+  if (!source_ids) return false;
+  columns->source_ids = source_ids;
+
+  process_ids = (int *)realloc(columns->process_ids, capacity * sizeof(int));
+  if (!process_ids) return false;
+  columns->process_ids = process_ids;
+
+  message_offsets = (size_t *)realloc(columns->message_offsets,
+                                      (capacity + 1) * sizeof(size_t));
+  if (!message_offsets) return false;
+  columns->message_offsets = message_offsets;
+
+  columns->capacity = capacity;
+  return true;
+}
+
+static bool reserve_text(LogColumns *columns, size_t length) {
+  size_t used = columns->message_offsets[columns->count];
+  size_t capacity = columns->text_capacity;
+  char *text;
+
+  if (capacity - used >= length) return true;
+  while (capacity - used < length) capacity *= 2;
+
+  text = (char *)realloc(columns->text, capacity);
+  if (!text) return false;
+  columns->text = text;
+  columns->text_capacity = capacity;
+  return true;
+}
+
+LogColumns *log_columns_create(void) {
+  LogColumns *columns = (LogColumns *)calloc(1, sizeof(LogColumns));
+
+  if (!columns) return NULL;
+
+  columns->capacity = COLUMNS_INITIAL_CAPACITY / 2;
+  columns->text_capacity = COLUMNS_INITIAL_TEXT;
+  columns->text = (char *)malloc(columns->text_capacity);
+  columns->source_table = log_string_table_create();
+  columns->process_id_table = log_string_table_create();
+  if (!columns->text || !columns->source_table || !columns->process_id_table ||
+      !grow_rows(columns)) {
+    log_columns_free(columns);
+    return NULL;
+  }
+
+  columns->message_offsets[0] = 0;
+  return columns;
+}
+
+/* Copies the record's message and interns its source and process id */
+bool log_columns_append(LogColumns *columns, const LogRecord *record) {
+  const LogSpan *message;
+  size_t used;
+  long row;
+
+  if (!columns || !record) return false;
+  if (columns->count == columns->capacity && !grow_rows(columns))
+    return false;
+
+  row = columns->count;
+  message = &record->message;
+  used = columns->message_offsets[row];
+  if (message->offset != LOG_SPAN_NONE) {
+    if (!reserve_text(columns, message->length)) return false;
+    memcpy(columns->text + used, record->line + message->offset,
+           message->length);
+    used += message->length;
+  }
+
+  columns->source_ids[row] =
+      record->source.offset != LOG_SPAN_NONE
+          ? log_string_table_intern(columns->source_table,
+                                    record->line + record->source.offset,
+                                    record->source.length)
+          : log_string_table_intern(columns->source_table, "unknown", 7);
+  columns->process_ids[row] =
+      record->process_id.offset != LOG_SPAN_NONE
+          ? log_string_table_intern(columns->process_id_table,
+                                    record->line + record->process_id.offset,
+                                    record->process_id.length)
+          : LOG_STRING_NONE;
+  if (columns->source_ids[row] == LOG_STRING_NONE) return false;
+
+  columns->timestamps[row] = record->timestamp;
+  columns->severities[row] = (unsigned char)record->severity;
+  columns->message_offsets[row + 1] = used;
+  columns->count++;
+  return true;
+}
+
+const char *log_columns_message(const LogColumns *columns, long row,
+                                size_t *length) {
+  if (!columns || row < 0 || row >= columns->count) return NULL;
+
+  if (length)
+    *length = columns->message_offsets[row + 1] - columns->message_offsets[row];
+  return columns->text + columns->message_offsets[row];
+}
+
+void log_columns_count_severities(const LogColumns *columns,
+                                  long counts[LOG_SEVERITY_LEVELS]) {
+  if (!columns || !counts) return;
+
+  memset(counts, 0, LOG_SEVERITY_LEVELS * sizeof(long));
+  for (long row = 0; row < columns->count; row++) {
+    if (columns->severities[row] < LOG_SEVERITY_LEVELS)
+      counts[columns->severities[row]]++;
+  }
+}
+
+/* counts must hold one slot per interned source */
+void log_columns_count_by_source(const LogColumns *columns, long *counts) {
+  if (!columns || !counts) return;
+
+  memset(counts, 0,
+         log_string_table_count(columns->source_table) * sizeof(long));
+  for (long row = 0; row < columns->count; row++)
+    counts[columns->source_ids[row]]++;
+}
+
+void log_columns_free(LogColumns *columns) {
+  if (!columns) return;
+
+  free(columns->timestamps);
+  free(columns->severities);
+  free(columns->source_ids);
+  free(columns->process_ids);
+  free(columns->message_offsets);
+  free(columns->text);
+  log_string_table_free(columns->source_table);
+  log_string_table_free(columns->process_id_table);
+  free(columns);
+}
@@ -1,124 +1,782 @@
-#include <regex.h>
+#include <pthread.h>
 
 #include "include/log_analyzer.h"
 
-static bool string_matches_pattern(const char *string, const char *pattern) {
-  regex_t regex;
-  int result;
+#define CACHE_LINE_SIZE 64
 
-  if (regcomp(&regex, pattern, REG_EXTENDED | REG_NOSUB) != 0) {
-    return false;
-  }
+/* Files not yet claimed by a worker, handed out largest first */
+typedef struct {
+  const LogInputList *inputs;
+  int next;
+  int failed_count;
+  const LogFormat *format; /* shared by the sampled files, NULL if mixed */
+  bool sampled;            /* some file's format was sampled */
+  pthread_mutex_t lock;
+} InputQueue;
 
-  result = regexec(&regex, string, 0, NULL, 0);
-  regfree(&regex);
+/*
+ * Each worker owns a compiled set (the DFA cache is mutated by scans) and
+ * a private, cache-line padded frequency array so threads never share a
+ * written line. Results are summed into the context after the join.
+ * A worker reads either one chunk of a mapped file or whole files taken
+ * from a queue.
+ */
+typedef struct {
+  const LogAnalyzerContext *ctx;
+  LogChunk chunk;
+  InputQueue *queue;
+  PatternSet *pattern_set;
+  const LogFormat *format; /* of the file being read */
+  LogTimestampCache timestamp_cache;
+  int *matches;
+  long *frequencies;
+  LogHistogram **histograms; /* one per pattern, created on first use */
+  LogTemplateMiner *templates;
+  long entry_count;
+  long line_count;
+  LogTimeRange time_range;
+  bool profile; /* --stats: count into stats, summed after the join */
+  LogStats stats;
+  bool success;
+} DetectorWorker;
 
-  return (result == 0);
-}
+/* Appends a pattern to the table, growing it; false if out of memory */
+bool pattern_detector_add(LogAnalyzerContext *ctx, const char *pattern_str,
+                          const char *description, const char *category,
+                          int severity) {
+  Pattern *pattern, *patterns;
+  int capacity;
 
-static void add_pattern(LogAnalyzerContext *ctx, const char *pattern_str,
-                        const char *description, const char *category,
-                        int severity) {
-  Pattern *pattern;
-  if (!ctx || !pattern_str || ctx->pattern_count >= MAX_PATTERNS) return;
+  if (!ctx || !pattern_str || !description || !category) return false;
 
+  if (ctx->pattern_count == ctx->pattern_capacity) {
+    capacity = ctx->pattern_capacity ? ctx->pattern_capacity * 2 : 32;
+    patterns =
+        (Pattern *)realloc(ctx->patterns, capacity * sizeof(Pattern));
+    if (!patterns) return false;
+    ctx->patterns = patterns;
+    ctx->pattern_capacity = capacity;
+  }
   pattern = &ctx->patterns[ctx->pattern_count];
 
   /* initialize the patterns */
+  memset(pattern, 0, sizeof(Pattern));
   pattern->pattern = strdup(pattern_str);
   pattern->description = strdup(description);
   pattern->category = strdup(category);
+  if (!pattern->pattern || !pattern->description || !pattern->category) {
+    free(pattern->pattern);
+    free(pattern->description);
+    free(pattern->category);
+    return false;
+  }
+  pattern->id = ctx->pattern_count;
   pattern->severity = severity;
-  pattern->frequency = 0;
+  pattern->prefilter_hits = -1;
 
   ctx->pattern_count++;
+  return true;
 }
 
 static void detect_common_patterns(LogAnalyzerContext *ctx) {
   /* CPU-related patterns */
-  add_pattern(ctx, ".*cpu usage.*[9][0-9]%.*", "High CPU usage detected", "cpu",
-              4);
-  add_pattern(ctx, ".*load average:.*[5-9]\\.[0-9].*", "High load average",
-              "cpu", 3);
-  add_pattern(ctx, ".*process.*using excessive cpu.*",
-              "Process using excessive CPU", "cpu", 4);
+  pattern_detector_add(ctx, ".*cpu usage.*[9][0-9]%.*",
+                       "High CPU usage detected", "cpu", 4);
+  pattern_detector_add(ctx, ".*load average:.*[5-9]\\.[0-9].*",
+                       "High load average", "cpu", 3);
+  pattern_detector_add(ctx, ".*process.*using excessive cpu.*",
+                       "Process using excessive CPU", "cpu", 4);
 
   /* Memory-related patterns */
-  add_pattern(ctx, ".*out of memory.*", "Out of memory condition", "memory", 5);
-  add_pattern(ctx, ".*memory allocation failed.*", "Memory allocation failure",
-              "memory", 4);
-  add_pattern(ctx, ".*free memory: [0-9]+ KB.*", "Low free memory", "memory",
-              3);
-  add_pattern(ctx, ".*swap used: [8-9][0-9]%.*", "High swap usage", "memory",
-              4);
+  pattern_detector_add(ctx, ".*out of memory.*", "Out of memory condition",
+                       "memory", 5);
+  pattern_detector_add(ctx, ".*memory allocation failed.*",
+                       "Memory allocation failure", "memory", 4);
+  pattern_detector_add(ctx, ".*free memory: [0-9]+ KB.*", "Low free memory",
+                       "memory", 3);
+  pattern_detector_add(ctx, ".*swap used: [8-9][0-9]%.*", "High swap usage",
+                       "memory", 4);
 
   /* Disk-related patterns */
-  add_pattern(ctx, ".*disk full.*", "Disk full condition", "disk", 5);
-  add_pattern(ctx, ".*i/o error.*", "Disk I/O error", "disk", 4);
-  add_pattern(ctx, ".*device timeout.*", "Device timeout", "disk", 3);
-  add_pattern(ctx, ".*filesystem.*[9][0-9]%.*", "Filesystem near capacity",
-              "disk", 3);
+  pattern_detector_add(ctx, ".*disk full.*", "Disk full condition", "disk", 5);
+  pattern_detector_add(ctx, ".*i/o error.*", "Disk I/O error", "disk", 4);
+  pattern_detector_add(ctx, ".*device timeout.*", "Device timeout", "disk", 3);
+  pattern_detector_add(ctx, ".*filesystem.*[9][0-9]%.*",
+                       "Filesystem near capacity", "disk", 3);
 
   /* Network-related patterns */
-  add_pattern(ctx, ".*network unreachable.*", "Network unreachable", "network",
-              4);
-  add_pattern(ctx, ".*connection timed out.*", "Connection timeout", "network",
-              3);
-  add_pattern(ctx, ".*packet loss.*", "Network packet loss", "network", 3);
+  pattern_detector_add(ctx, ".*network unreachable.*", "Network unreachable",
+                       "network", 4);
+  pattern_detector_add(ctx, ".*connection timed out.*", "Connection timeout",
+                       "network", 3);
+  pattern_detector_add(ctx, ".*packet loss.*", "Network packet loss", "network",
+                       3);
 
   /* Process-related patterns */
-  add_pattern(ctx, ".*process.*killed.*", "Process killed", "process", 4);
-  add_pattern(ctx, ".*segmentation fault.*", "Segmentation fault", "process",
-              5);
-  add_pattern(ctx, ".*core dumped.*", "Core dumped", "process", 5);
-  add_pattern(ctx, ".*process.*not responding.*", "Process not responding",
-              "process", 4);
+  pattern_detector_add(ctx, ".*process.*killed.*", "Process killed", "process",
+                       4);
+  pattern_detector_add(ctx, ".*segmentation fault.*", "Segmentation fault",
+                       "process", 5);
+  pattern_detector_add(ctx, ".*core dumped.*", "Core dumped", "process", 5);
+  pattern_detector_add(ctx, ".*process.*not responding.*",
+                       "Process not responding", "process", 4);
 
   /* Database-related patterns */
-  add_pattern(ctx, ".*database connection failed.*",
-              "Database connection failure", "database", 4);
-  add_pattern(ctx, ".*query timeout.*", "Database query timeout", "database",
-              3);
-  add_pattern(ctx, ".*deadlock detected.*", "Database deadlock", "database", 4);
+  pattern_detector_add(ctx, ".*database connection failed.*",
+                       "Database connection failure", "database", 4);
+  pattern_detector_add(ctx, ".*query timeout.*", "Database query timeout",
+                       "database", 3);
+  pattern_detector_add(ctx, ".*deadlock detected.*", "Database deadlock",
+                       "database", 4);
 
   /* File descriptor related patterns */
-  add_pattern(ctx, ".*too many open files.*", "Too many open files",
-              "resources", 4);
-  add_pattern(ctx, ".*file descriptor.*limit.*",
-              "File descriptor limit reached", "resources", 4);
+  pattern_detector_add(ctx, ".*too many open files.*", "Too many open files",
+                       "resources", 4);
+  pattern_detector_add(ctx, ".*file descriptor.*limit.*",
+                       "File descriptor limit reached", "resources", 4);
 }
 
-bool pattern_detector_analyze(LogAnalyzerContext *ctx, LogEntry **entries,
-                              int entry_count) {
-  int i, j;
+/*
+ * With --patterns FILE the compiled set is kept in FILE.cache, keyed by
+ * the pattern table hash, so later runs over the same patterns load it
+ * instead of compiling. A stale or damaged cache is simply replaced.
+ */
+static PatternSet *compile_patterns(LogAnalyzerContext *ctx) {
+  char cache_path[MAX_PATH_LENGTH + 8];
+  PatternSet *set;
+  uint64_t key;
+
+  if (strlen(ctx->patterns_path) == 0)
+    return pattern_set_compile(ctx->patterns, ctx->pattern_count);
+
+  snprintf(cache_path, sizeof(cache_path), "%s.cache", ctx->patterns_path);
+  key = pattern_detector_hash(ctx);
+  set = pattern_set_load(cache_path, key, ctx->patterns, ctx->pattern_count);
+  if (set) {
+    if (ctx->verbose) printf("Loaded compiled patterns from %s\n", cache_path);
+    return set;
+  }
+
+  set = pattern_set_compile(ctx->patterns, ctx->pattern_count);
+  if (set && !pattern_set_save(set, key, cache_path) && ctx->verbose)
+    printf("Could not save compiled patterns to %s\n", cache_path);
+  return set;
+}
+
+bool pattern_detector_begin(LogAnalyzerContext *ctx) {
+  if (!ctx) return false;
+
+  /* A table filled in by the caller is used as it is */
+  if (ctx->pattern_count == 0) {
+    if (strlen(ctx->patterns_path) > 0) {
+      if (!log_patterns_load(ctx, ctx->patterns_path)) return false;
+    } else {
+      detect_common_patterns(ctx);
+    }
+  }
+
+  /* Compile every pattern once; the set lives as long as the context */
+  pattern_set_free(ctx->pattern_set);
+  ctx->pattern_set = compile_patterns(ctx);
+  if (!ctx->pattern_set) return false;
+  for (int i = 0; i < ctx->pattern_count; i++) {
+    if (!pattern_set_compiled(ctx->pattern_set, i))
+      fprintf(stderr, "Pattern does not compile and never matches: %s\n",
+              ctx->patterns[i].pattern);
+  }
+
+  free(ctx->match_buffer);
+  ctx->match_buffer = (int *)malloc((ctx->pattern_count + 1) * sizeof(int));
+  if (!ctx->match_buffer) return false;
+
+  log_template_miner_free(ctx->template_miner);
+  ctx->template_miner = log_template_miner_create(LOG_TEMPLATE_CAPACITY);
+  if (!ctx->template_miner) return false;
+
+  ctx->entry_count = 0;
+  ctx->line_count = 0;
+  memset(&ctx->time_range, 0, sizeof(LogTimeRange));
+  return true;
+}
+
+/* Counts a timestamped match in a pattern's histogram, creating it */
+static bool add_to_histogram(LogHistogram **histogram, time_t timestamp) {
+  if (!*histogram) *histogram = log_histogram_create();
+  return *histogram && log_histogram_add(*histogram, timestamp, 1);
+}
+
+/*
+ * Picks what --stats times on the line about to be read: its steps, or
+ * its pattern scan on a different line so the scan's own clock reads do
+ * not land in a step.
+ */
+static void sample_begin(LogStats *stats) {
+  long phase = stats->lines_read % LOG_STATS_SAMPLE;
+
+  stats->sampling = phase == 0;
+  stats->profiling = phase == LOG_STATS_SAMPLE / 2;
+  if (stats->sampling) stats->mark = log_stats_now();
+}
+
+/* Adds the time since the last step of a timed line to total */
+static void sample_step(LogStats *stats, double *total) {
+  if (stats->sampling) *total += log_stats_lap(&stats->mark);
+}
+
+static void count_line(LogStats *stats, const LogLine *line) {
+  stats->lines_read++;
+  stats->bytes_read += (long)line->length + 1;
+  if (line->length > MAX_LINE_LENGTH) stats->oversized_lines++;
+  if (stats->sampling) {
+    stats->sample.lines++;
+    sample_step(stats, &stats->sample.read_ns);
+  }
+}
+
+/* timestamp is NULL for lines that carry none */
+static bool process_message(LogAnalyzerContext *ctx, const char *message,
+                            size_t length, const time_t *timestamp) {
+  LogStats *stats;
   Pattern *pattern;
+  int j, match_count;
+  bool sampled;
 
-  if (!ctx || !entries || entry_count <= 0) return false;
+  if (!ctx || !ctx->pattern_set || !ctx->match_buffer) return false;
+  stats = ctx->stats;
+  sampled = stats && stats->sampling;
+
+  /* One pass over each message yields every pattern it matches */
+  if (stats && stats->profiling)
+    match_count = pattern_set_scan_timed(ctx->pattern_set, message, length,
+                                         ctx->match_buffer,
+                                         ctx->pattern_count);
+  else
+    match_count = pattern_set_scan(ctx->pattern_set, message, length,
+                                   ctx->match_buffer, ctx->pattern_count);
+  for (j = 0; j < match_count; j++) {
+    pattern = &ctx->patterns[ctx->match_buffer[j]];
+    pattern->frequency++;
+    if (timestamp && !add_to_histogram(&pattern->histogram, *timestamp))
+      return false;
+  }
+  if (sampled) sample_step(stats, &stats->sample.match_ns);
+
+  /* Every message is mined, so floods no pattern knows still show up */
+  if (!log_template_add(ctx->template_miner, message, length)) return false;
+  if (sampled) sample_step(stats, &stats->sample.mine_ns);
+
+  ctx->entry_count++;
+  return true;
+}
+
+/* Line times outside years 1970 to 9999 are misreads and are not used */
+static bool plausible(time_t timestamp) {
+  return timestamp >= LOG_TIME_MIN && timestamp <= LOG_TIME_MAX;
+}
+
+bool pattern_detector_process(LogAnalyzerContext *ctx, const LogEntry *entry) {
+  if (!ctx || !ctx->pattern_set) return false;
+  if (!entry || !entry->message) return true;
+
+  return process_message(ctx, entry->message, strlen(entry->message),
+                         entry->has_timestamp && plausible(entry->timestamp)
+                             ? &entry->timestamp
+                             : NULL);
+}
+
+/* Counts the line; returns whether it had a plausible time of its own */
+static bool note_line(long *line_count, LogTimeRange *range,
+                      const LogRecord *record) {
+  (*line_count)++;
+  if (!record->has_timestamp || !plausible(record->timestamp)) return false;
+
+  log_time_range_add(range, record->timestamp);
+  return true;
+}
+
+bool pattern_detector_process_record(LogAnalyzerContext *ctx,
+                                     const LogRecord *record) {
+  bool timed;
+
+  if (!ctx || !ctx->pattern_set) return false;
+  if (!record) return true;
+
+  timed = note_line(&ctx->line_count, &ctx->time_range, record);
+  if (record->message.offset == LOG_SPAN_NONE) {
+    if (ctx->stats) ctx->stats->lines_dropped++;
+    return true;
+  }
+
+  return process_message(ctx, record->line + record->message.offset,
+                         record->message.length,
+                         timed ? &record->timestamp : NULL);
+}
+
+static bool process_sequential(LogAnalyzerContext *ctx) {
+  LogStats *stats = ctx->stats;
+  LogLine line;
+  LogRecord record;
+
+  /* Lines are parsed in place and matched without being copied */
+  for (;;) {
+    if (stats) sample_begin(stats);
+    if (!log_collector_next_line(ctx, &line)) break;
+    if (stats) count_line(stats, &line);
+
+    if (!log_parser_parse_record(ctx, line.data, line.length, &record)) {
+      if (stats) stats->lines_dropped++;
+      continue;
+    }
+    if (stats) sample_step(stats, &stats->sample.parse_ns);
+    if (!pattern_detector_process_record(ctx, &record)) return false;
+  }
+  if (stats) stats->sampling = stats->profiling = false;
+  return !log_collector_failed(ctx);
+}
+
+static bool worker_scan_line(DetectorWorker *worker, const LogLine *line) {
+  const LogAnalyzerContext *ctx = worker->ctx;
+  LogStats *stats = worker->profile ? &worker->stats : NULL;
+  const char *message;
+  LogRecord record;
+  int j, index, match_count;
+  bool timed, sampled = false;
+
+  if (stats) {
+    count_line(stats, line);
+    sampled = stats->sampling;
+  }
+  if (!log_parser_parse_record_as(worker->format, &worker->timestamp_cache,
+                                  line->data, line->length, &record)) {
+    if (stats) stats->lines_dropped++;
+    return true;
+  }
+  if (sampled) sample_step(stats, &stats->sample.parse_ns);
+
+  timed = note_line(&worker->line_count, &worker->time_range, &record);
+  if (record.message.offset == LOG_SPAN_NONE) {
+    if (stats) stats->lines_dropped++;
+    return true;
+  }
+
+  message = record.line + record.message.offset;
+  if (stats && stats->profiling)
+    match_count = pattern_set_scan_timed(worker->pattern_set, message,
+                                         record.message.length,
+                                         worker->matches, ctx->pattern_count);
+  else
+    match_count = pattern_set_scan(worker->pattern_set, message,
+                                   record.message.length, worker->matches,
+                                   ctx->pattern_count);
+  for (j = 0; j < match_count; j++) {
+    index = worker->matches[j];
+    worker->frequencies[index]++;
+    if (timed &&
+        !add_to_histogram(&worker->histograms[index], record.timestamp))
+      return false;
+  }
+  if (sampled) sample_step(stats, &stats->sample.match_ns);
+
+  if (!log_template_add(worker->templates, message, record.message.length))
+    return false;
+  if (sampled) sample_step(stats, &stats->sample.mine_ns);
+  worker->entry_count++;
+  return true;
+}
+
+static void *worker_run(void *arg) {
+  DetectorWorker *worker = (DetectorWorker *)arg;
+  LogLine line;
+
+  for (;;) {
+    if (worker->profile) sample_begin(&worker->stats);
+    if (!log_chunk_next_line(&worker->chunk, &line)) break;
+    if (!worker_scan_line(worker, &line)) return NULL;
+  }
+
+  worker->success = true;
+  return NULL;
+}
+
+static int claim_input(InputQueue *queue) {
+  int index = -1;
+
+  pthread_mutex_lock(&queue->lock);
+  if (queue->next < queue->inputs->count) index = queue->next++;
+  pthread_mutex_unlock(&queue->lock);
+  return index;
+}
 
-  detect_common_patterns(ctx);
-  for (i = 0; i < entry_count; i++) {
-    if (!entries[i] || !entries[i]->message) continue;
+/* Records a file's sampled format; files that disagree make it mixed */
+static void note_format(InputQueue *queue, const LogFormat *format) {
+  pthread_mutex_lock(&queue->lock);
+  if (!queue->sampled) queue->format = format;
+  if (queue->format != format) queue->format = NULL;
+  queue->sampled = true;
+  pthread_mutex_unlock(&queue->lock);
+}
+
+/* Reads whole files until the queue is empty; a bad file is skipped */
+static void *file_worker_run(void *arg) {
+  DetectorWorker *worker = (DetectorWorker *)arg;
+  LogAnalyzerContext *file_ctx;
+  const char *path;
+  LogLine line;
+  int index;
+  bool success = true;
+
+  /* The collector only needs the path; workers already run in parallel */
+  file_ctx = (LogAnalyzerContext *)calloc(1, sizeof(LogAnalyzerContext));
+  if (!file_ctx) return NULL;
+  file_ctx->thread_count = 1;
+
+  while (success && (index = claim_input(worker->queue)) >= 0) {
+    path = worker->queue->inputs->paths[index];
+    strncpy(file_ctx->input_path, path, MAX_PATH_LENGTH - 1);
+    if (!log_collector_open_file(file_ctx)) {
+      fprintf(stderr, "Failed to open input file: %s\n", path);
+      pthread_mutex_lock(&worker->queue->lock);
+      worker->queue->failed_count++;
+      pthread_mutex_unlock(&worker->queue->lock);
+      continue;
+    }
+
+    /* Each file is sampled for a format of its own unless -f named one */
+    file_ctx->format = worker->ctx->format;
+    file_ctx->format_detected = false;
+    log_format_detect_input(file_ctx);
+    worker->format = file_ctx->format;
+    if (file_ctx->format_detected)
+      note_format(worker->queue, file_ctx->format);
 
-    for (j = 0; j < ctx->pattern_count; j++) {
-      pattern = &ctx->patterns[j];
-      if (string_matches_pattern(entries[i]->message, pattern->pattern))
-        pattern->frequency++;
+    /* Syslog years and the cached prefix belong to one file */
+    log_timestamp_cache_init(&worker->timestamp_cache);
+    while (success) {
+      if (worker->profile) sample_begin(&worker->stats);
+      if (!log_collector_next_line(file_ctx, &line)) break;
+      success = worker_scan_line(worker, &line);
     }
+
+    if (log_collector_failed(file_ctx)) {
+      fprintf(stderr, "Stopped early reading %s\n", path);
+      pthread_mutex_lock(&worker->queue->lock);
+      worker->queue->failed_count++;
+      pthread_mutex_unlock(&worker->queue->lock);
+    }
+    log_collector_close_file(file_ctx);
+  }
+
+  free(file_ctx);
+  worker->success = success;
+  return NULL;
+}
+
+static bool worker_init(DetectorWorker *worker, LogAnalyzerContext *ctx) {
+  size_t size = (size_t)ctx->pattern_count * sizeof(long);
+  void *frequencies;
+
+  /* Round up so the next worker's array starts on its own line */
+  size = (size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+  if (size == 0) size = CACHE_LINE_SIZE;
+  if (posix_memalign(&frequencies, CACHE_LINE_SIZE, size) != 0) return false;
+  memset(frequencies, 0, size);
+  worker->frequencies = (long *)frequencies;
+
+  worker->ctx = ctx;
+  worker->format = ctx->format;
+  worker->profile = ctx->stats != NULL;
+  log_timestamp_cache_init(&worker->timestamp_cache);
+  worker->pattern_set = pattern_set_clone(ctx->pattern_set, ctx->patterns);
+  worker->matches = (int *)malloc((ctx->pattern_count + 1) * sizeof(int));
+  worker->histograms =
+      (LogHistogram **)calloc(ctx->pattern_count + 1, sizeof(LogHistogram *));
+  worker->templates = log_template_miner_create(LOG_TEMPLATE_CAPACITY);
+  return worker->pattern_set && worker->matches && worker->histograms &&
+         worker->templates;
+}
+
+static void worker_free(DetectorWorker *worker) {
+  pattern_set_free(worker->pattern_set);
+  free(worker->matches);
+  free(worker->frequencies);
+  for (int j = 0; worker->histograms && j < worker->ctx->pattern_count; j++)
+    log_histogram_free(worker->histograms[j]);
+  free(worker->histograms);
+  log_template_miner_free(worker->templates);
+}
+
+/* Moves a worker's histogram into the pattern, or folds it in */
+static bool merge_histogram(Pattern *pattern, LogHistogram **histogram) {
+  if (!*histogram) return true;
+  if (!pattern->histogram) {
+    pattern->histogram = *histogram;
+    *histogram = NULL;
+    return true;
   }
+  return log_histogram_merge(pattern->histogram, *histogram);
+}
+
+/* Same for a worker's templates; the first worker's are usually moved */
+static bool merge_templates(LogTemplateMiner **into,
+                            LogTemplateMiner **templates) {
+  LogTemplateMiner *empty;
 
-  /* Sort */
-  for (i = 0; i < ctx->pattern_count - 1; i++) {
-    for (j = 0; j < ctx->pattern_count - 1; j++) {
-      if (ctx->patterns[j].frequency < ctx->patterns[j + 1].frequency) {
-        Pattern temp = ctx->patterns[j];
-        ctx->patterns[j] = ctx->patterns[j + 1];
-        ctx->patterns[j + 1] = temp;
+  if (log_template_count(*into) == 0) {
+    empty = *into;
+    *into = *templates;
+    *templates = empty;
+    return true;
+  }
+  return log_template_merge(*into, *templates);
+}
+
+static void merge_stats(LogStats *into, const LogStats *from) {
+  into->bytes_read += from->bytes_read;
+  into->lines_read += from->lines_read;
+  into->lines_dropped += from->lines_dropped;
+  into->oversized_lines += from->oversized_lines;
+  log_stats_add_sample(&into->sample, &from->sample);
+}
+
+/*
+ * Runs worker_count workers, either over chunks (one each) or over the
+ * input queue, and sums their results into the context.
+ */
+static bool run_workers(LogAnalyzerContext *ctx, LogChunk *chunks,
+                        InputQueue *queue, int worker_count) {
+  void *(*run)(void *) = queue ? file_worker_run : worker_run;
+  DetectorWorker *workers;
+  pthread_t *threads;
+  int i, j, started = 0;
+  bool success = true;
+
+  workers = (DetectorWorker *)calloc(worker_count, sizeof(DetectorWorker));
+  threads = (pthread_t *)calloc(worker_count, sizeof(pthread_t));
+  if (!workers || !threads) {
+    free(workers);
+    free(threads);
+    return false;
+  }
+
+  for (i = 0; i < worker_count && success; i++) {
+    if (chunks) workers[i].chunk = chunks[i];
+    workers[i].queue = queue;
+    success = worker_init(&workers[i], ctx);
+  }
+
+  /* A single worker runs on the calling thread */
+  if (success && worker_count == 1) {
+    run(&workers[0]);
+    success = workers[0].success;
+  }
+
+  for (i = 0; i < worker_count && worker_count > 1 && success; i++) {
+    if (pthread_create(&threads[i], NULL, run, &workers[i]) != 0) {
+      fprintf(stderr, "Failed to start worker thread\n");
+      success = false;
+      break;
+    }
+    started++;
+  }
+
+  for (i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+    success = success && workers[i].success;
+  }
+
+  if (success) {
+    for (i = 0; i < worker_count; i++) {
+      for (j = 0; j < ctx->pattern_count; j++) {
+        ctx->patterns[j].frequency += workers[i].frequencies[j];
+        success = merge_histogram(&ctx->patterns[j],
+                                  &workers[i].histograms[j]) &&
+                  success;
       }
+      success = merge_templates(&ctx->template_miner, &workers[i].templates) &&
+                success;
+      ctx->entry_count += workers[i].entry_count;
+      ctx->line_count += workers[i].line_count;
+      log_time_range_merge(&ctx->time_range, &workers[i].time_range);
+      pattern_set_merge_stats(ctx->pattern_set, workers[i].pattern_set);
+      if (ctx->stats) merge_stats(ctx->stats, &workers[i].stats);
     }
   }
+
+  for (i = 0; i < worker_count; i++) worker_free(&workers[i]);
+  free(workers);
+  free(threads);
+  return success;
+}
+
+/* Spreads several input files over up to thread_count workers */
+static bool process_files(LogAnalyzerContext *ctx) {
+  InputQueue queue;
+  int worker_count;
+  bool success;
+
+  memset(&queue, 0, sizeof(queue));
+  queue.inputs = &ctx->inputs;
+  pthread_mutex_init(&queue.lock, NULL);
+
+  worker_count = ctx->thread_count < ctx->inputs.count ? ctx->thread_count
+                                                       : ctx->inputs.count;
+  success = run_workers(ctx, NULL, &queue, worker_count);
+  pthread_mutex_destroy(&queue.lock);
+  if (queue.sampled) {
+    ctx->format = queue.format;
+    ctx->format_detected = true;
+  }
+
+  if (queue.failed_count > 0)
+    fprintf(stderr, "Skipped %d of %d input files\n", queue.failed_count,
+            ctx->inputs.count);
+  return success && queue.failed_count < ctx->inputs.count;
+}
+
+/*
+ * Reads the whole input. A mapped file is split across worker threads;
+ * several files are shared out to workers a file at a time. --pipeline
+ * instead overlaps reading, parsing and matching of a single input.
+ */
+bool pattern_detector_process_input(LogAnalyzerContext *ctx) {
+  LogChunk chunks[MAX_THREADS];
+  int chunk_count;
+
+  if (!ctx || !ctx->pattern_set) return false;
+  if (ctx->inputs.count > 1) return process_files(ctx);
+  if (!ctx->collector) return false;
+
+  /* Settled before any line is read, so every stage and worker agrees */
+  log_format_detect_input(ctx);
+  if (ctx->pipeline) return log_pipeline_run(ctx);
+  if (ctx->thread_count <= 1) return process_sequential(ctx);
+
+  chunk_count = log_collector_split(ctx, chunks, ctx->thread_count);
+  if (chunk_count == 0) return process_sequential(ctx);
+  return run_workers(ctx, chunks, NULL, chunk_count);
+}
+
+/* Fills each pattern's rate from its histogram and the run's time range */
+bool pattern_detector_summarize_rates(LogAnalyzerContext *ctx) {
+  for (int i = 0; ctx && i < ctx->pattern_count; i++) {
+    if (ctx->patterns[i].histogram &&
+        !log_histogram_summarize(ctx->patterns[i].histogram, &ctx->time_range,
+                                 &ctx->patterns[i].rate))
+      return false;
+  }
+  return ctx != NULL;
+}
+
+bool pattern_detector_finalize(LogAnalyzerContext *ctx) {
+  LogMatchProfile profile;
+  double ns;
+  int i;
+
+  if (!ctx || !ctx->pattern_set) return false;
+
+  free(ctx->match_buffer);
+  ctx->match_buffer = NULL;
+
+  pattern_set_profile(ctx->pattern_set, &profile);
+  if (ctx->stats) ctx->stats->match = profile;
+  for (i = 0; i < ctx->pattern_count; i++) {
+    if (!pattern_set_prefilter_stats(ctx->pattern_set, i,
+                                     &ctx->patterns[i].prefilter_hits,
+                                     &ctx->patterns[i].prefilter_confirmed))
+      ctx->patterns[i].prefilter_hits = -1;
+    ns = pattern_set_pattern_ns(ctx->pattern_set, i);
+    ctx->patterns[i].match_ns =
+        ns < 0 ? -1 : (profile.scans > 0 ? ns / profile.scans : 0);
+  }
+
+  if (!pattern_detector_summarize_rates(ctx)) return false;
+
+  pattern_detector_rank(ctx->patterns, ctx->pattern_count);
   return true;
 }
 
+/*
+ * Identifies the pattern table, so saved frequencies are only ever added
+ * to counts for the same patterns in the same order.
+ */
+uint64_t pattern_detector_hash(const LogAnalyzerContext *ctx) {
+  uint64_t hash = 14695981039346656037ull;
+  const unsigned char *bytes;
+
+  for (int i = 0; ctx && i < ctx->pattern_count; i++) {
+    bytes = (const unsigned char *)ctx->patterns[i].pattern;
+    do {
+      hash ^= *bytes;
+      hash *= 1099511628211ull;
+    } while (*bytes++ != '\0');
+  }
+  return hash;
+}
+
+/* Merges the sorted runs [from, middle) and [middle, to) into out */
+static void merge_runs(const Pattern *in, Pattern *out, int from, int middle,
+                       int to) {
+  int i = from, j = middle;
+
+  for (int k = from; k < to; k++) {
+    if (i < middle && (j >= to || in[i].frequency >= in[j].frequency))
+      out[k] = in[i++];
+    else
+      out[k] = in[j++];
+  }
+}
+
+/*
+ * Orders patterns by frequency, keeping table order among equals; a
+ * compiled set's indices no longer apply. A bottom-up merge sort, since
+ * pattern files can hold thousands of patterns.
+ */
+void pattern_detector_rank(Pattern *patterns, int pattern_count) {
+  Pattern *buffer, *in, *out, *swap;
+  int middle, to;
+
+  if (!patterns || pattern_count < 2) return;
+
+  buffer = (Pattern *)malloc(pattern_count * sizeof(Pattern));
+  if (!buffer) {
+    /* Insertion sort needs no memory and is as stable */
+    for (int i = 1; i < pattern_count; i++) {
+      Pattern temp = patterns[i];
+      int j = i;
+      for (; j > 0 && patterns[j - 1].frequency < temp.frequency; j--)
+        patterns[j] = patterns[j - 1];
+      patterns[j] = temp;
+    }
+    return;
+  }
+
+  in = patterns;
+  out = buffer;
+  for (int width = 1; width < pattern_count; width *= 2) {
+    for (int from = 0; from < pattern_count; from += 2 * width) {
+      middle = from + width < pattern_count ? from + width : pattern_count;
+      to = middle + width < pattern_count ? middle + width : pattern_count;
+      merge_runs(in, out, from, middle, to);
+    }
+    swap = in;
+    in = out;
+    out = swap;
+  }
+  if (in != patterns) memcpy(patterns, in, pattern_count * sizeof(Pattern));
+  free(buffer);
+}
+
+bool pattern_detector_analyze(LogAnalyzerContext *ctx, LogEntry **entries,
+                              int entry_count) {
+  if (!ctx || !entries || entry_count <= 0) return false;
+
+  if (!pattern_detector_begin(ctx)) return false;
+  for (int i = 0; i < entry_count; i++) {
+    if (!pattern_detector_process(ctx, entries[i])) return false;
+  }
+  return pattern_detector_finalize(ctx);
+}
+
 Pattern *pattern_detector_get_patterns(LogAnalyzerContext *ctx,
                                        int *pattern_count) {
   if (!ctx || !pattern_count) return NULL;
@@ -0,0 +1,151 @@
+#include "include/log_analyzer.h"
+
+/*
+ * The embedding API. A caller makes a context with log_analyzer_init(),
+ * sets its options, calls log_analyzer_begin(), pushes text in with
+ * log_analyzer_feed() as it arrives and calls log_analyzer_finish() once
+ * at the end. The results are then read with
+ * pattern_detector_get_patterns(),
+ * recommendation_generator_get_recommendations() and the report writers.
+ *
+ * All state lives in the context, so any number of contexts can run on
+ * separate threads at once; each context is used by one thread at a time.
+ */
+
+/*
+ * Resolves the format named at init, and loads and compiles the patterns
+ * and the rules that name them
+ */
+bool log_analyzer_begin(LogAnalyzerContext *ctx) {
+  return ctx && log_format_select(ctx) && pattern_detector_begin(ctx) &&
+         recommendation_generator_begin(ctx);
+}
+
+static bool feed_line(LogAnalyzerContext *ctx, const char *data,
+                      size_t length) {
+  LogRecord record;
+
+  if (ctx->stats) {
+    ctx->stats->lines_read++;
+    ctx->stats->bytes_read += (long)length + 1;
+  }
+  if (!log_parser_parse_record(ctx, data, length, &record)) {
+    if (ctx->stats) ctx->stats->lines_dropped++;
+    return true;
+  }
+  return pattern_detector_process_record(ctx, &record);
+}
+
+/* Appends to the partial line held between feeds */
+static bool hold(LogAnalyzerContext *ctx, const char *data, size_t length) {
+  size_t capacity;
+  char *buffer;
+
+  if (ctx->feed_length + length > ctx->feed_capacity) {
+    capacity = ctx->feed_capacity ? ctx->feed_capacity : 256;
+    while (capacity < ctx->feed_length + length) capacity *= 2;
+    buffer = (char *)realloc(ctx->feed_buffer, capacity);
+    if (!buffer) return false;
+    ctx->feed_buffer = buffer;
+    ctx->feed_capacity = capacity;
+  }
+  memcpy(ctx->feed_buffer + ctx->feed_length, data, length);
+  ctx->feed_length += length;
+  return true;
+}
+
+/*
+ * Samples the held lines for the format unless one was named, then
+ * matches every complete line among them
+ */
+static bool release_sample(LogAnalyzerContext *ctx) {
+  const char *data = ctx->feed_buffer, *end, *newline;
+
+  if (!ctx->format) {
+    ctx->format = log_format_detect(data, ctx->feed_length);
+    if (!ctx->format) ctx->format = log_format_find("generic");
+    ctx->format_detected = true;
+  }
+  if (ctx->feed_length == 0) return true;
+
+  end = data + ctx->feed_length;
+  while ((newline = (const char *)memchr(data, '\n', (size_t)(end - data)))) {
+    if (!feed_line(ctx, data, (size_t)(newline - data))) return false;
+    data = newline + 1;
+  }
+  ctx->feed_length = (size_t)(end - data);
+  memmove(ctx->feed_buffer, data, ctx->feed_length);
+  return true;
+}
+
+/*
+ * Until the format is known, text is held, up to the end of line
+ * LOG_FORMAT_SAMPLE, so that the sample does not depend on how the text
+ * was cut into feeds.
+ */
+static bool hold_sample(LogAnalyzerContext *ctx, const char *data,
+                        size_t length) {
+  const char *p = data, *end = data + length, *newline;
+
+  while (ctx->feed_lines < LOG_FORMAT_SAMPLE &&
+         (newline = (const char *)memchr(p, '\n', (size_t)(end - p)))) {
+    ctx->feed_lines++;
+    p = newline + 1;
+  }
+  if (ctx->feed_lines < LOG_FORMAT_SAMPLE) return hold(ctx, data, length);
+
+  if (!hold(ctx, data, (size_t)(p - data)) || !release_sample(ctx))
+    return false;
+  return log_analyzer_feed(ctx, p, (size_t)(end - p));
+}
+
+/*
+ * Takes any amount of text: single lines, many lines or a buffer cut
+ * anywhere. Complete lines are matched in place without being copied; a
+ * trailing partial line is held until its newline arrives or
+ * log_analyzer_finish() is called.
+ */
+bool log_analyzer_feed(LogAnalyzerContext *ctx, const char *data,
+                       size_t length) {
+  const char *end, *newline;
+  size_t held;
+
+  if (!ctx || !ctx->pattern_set || (!data && length > 0)) return false;
+  if (length == 0) return true;
+  if (!ctx->format) return hold_sample(ctx, data, length);
+  end = data + length;
+
+  if (ctx->feed_length > 0) {
+    newline = (const char *)memchr(data, '\n', length);
+    if (!hold(ctx, data, newline ? (size_t)(newline - data) : length))
+      return false;
+    if (!newline) return true;
+
+    held = ctx->feed_length;
+    ctx->feed_length = 0;
+    if (!feed_line(ctx, ctx->feed_buffer, held)) return false;
+    data = newline + 1;
+  }
+
+  while ((newline = (const char *)memchr(data, '\n', (size_t)(end - data)))) {
+    if (!feed_line(ctx, data, (size_t)(newline - data))) return false;
+    data = newline + 1;
+  }
+  return data == end || hold(ctx, data, (size_t)(end - data));
+}
+
+/* Matches a held partial line, then ranks and recommends */
+bool log_analyzer_finish(LogAnalyzerContext *ctx) {
+  size_t held;
+
+  if (!ctx || !ctx->pattern_set) return false;
+  if (!ctx->format && !release_sample(ctx)) return false;
+
+  if (ctx->feed_length > 0) {
+    held = ctx->feed_length;
+    ctx->feed_length = 0;
+    if (!feed_line(ctx, ctx->feed_buffer, held)) return false;
+  }
+  return pattern_detector_finalize(ctx) &&
+         recommendation_generator_analyze(ctx);
+}
@@ -0,0 +1,143 @@
+#include <errno.h>
+#include <signal.h>
+
+#include "include/log_analyzer.h"
+
+/* Set from the signal handler; signals are process-wide by nature */
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int signal_number) {
+  (void)signal_number;
+  stop_requested = 1;
+}
+
+static void install_signal_handlers(void) {
+  struct sigaction action;
+
+  /* No SA_RESTART, so a blocked poll() returns and the loop can exit */
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = request_stop;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+}
+
+static long now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+/*
+ * Feeds every complete line that has been appended since the last call.
+ * A file that starts out empty is sampled once its first lines arrive.
+ */
+static bool read_appended(LogAnalyzerContext *ctx) {
+  LogLine line;
+  LogRecord record;
+
+  log_format_detect_input(ctx);
+  while (log_collector_next_line(ctx, &line)) {
+    if (!log_parser_parse_record(ctx, line.data, line.length, &record))
+      continue;
+    if (!pattern_detector_process_record(ctx, &record)) return false;
+  }
+  return true;
+}
+
+/*
+ * Ranking reorders ctx->patterns, which would break the compiled set's
+ * indices, so summaries are written from a ranked copy of the context
+ * and its pattern table, with rates summarized as at the end of a run.
+ */
+static bool write_snapshot(const LogAnalyzerContext *ctx) {
+  LogAnalyzerContext *snapshot;
+  Pattern *patterns;
+  bool success;
+
+  snapshot = (LogAnalyzerContext *)malloc(sizeof(LogAnalyzerContext));
+  patterns = (Pattern *)malloc((ctx->pattern_count + 1) * sizeof(Pattern));
+  if (!snapshot || !patterns) {
+    free(snapshot);
+    free(patterns);
+    return false;
+  }
+
+  memcpy(snapshot, ctx, sizeof(LogAnalyzerContext));
+  if (ctx->pattern_count > 0)
+    memcpy(patterns, ctx->patterns, ctx->pattern_count * sizeof(Pattern));
+  snapshot->patterns = patterns;
+  snapshot->recommendations = NULL;
+  snapshot->recommendation_count = 0;
+  snapshot->recommendation_capacity = 0;
+  pattern_detector_rank(snapshot->patterns, snapshot->pattern_count);
+
+  success = pattern_detector_summarize_rates(snapshot) &&
+            recommendation_generator_analyze(snapshot) &&
+            report_generator_write_summary(snapshot);
+
+  recommendation_generator_clear(snapshot);
+  free(patterns);
+  free(snapshot);
+  return success;
+}
+
+/*
+ * Tail-style analysis: reads what is in the file, then sleeps on inotify
+ * and consumes only appended bytes. The summary is rewritten every
+ * follow_interval seconds when new entries arrived. SIGINT or SIGTERM
+ * ends the run with the usual final reports.
+ */
+bool log_follower_run(LogAnalyzerContext *ctx) {
+  long interval_ms, next_report, reported_count;
+  int ready;
+
+  if (!ctx || !log_collector_watch(ctx)) return false;
+
+  install_signal_handlers();
+  interval_ms = ctx->follow_interval * 1000L;
+
+  if (!read_appended(ctx) || !write_snapshot(ctx)) return false;
+  reported_count = ctx->entry_count;
+  next_report = now_ms() + interval_ms;
+
+  while (!stop_requested) {
+    long remaining = next_report - now_ms();
+
+    ready = log_collector_wait(ctx, remaining > 0 ? (int)remaining : 0);
+    if (ready < 0 && errno != EINTR) {
+      perror("Failed to wait for input");
+      break;
+    }
+
+    if (!read_appended(ctx)) return false;
+    if (log_collector_check_rotation(ctx) && !read_appended(ctx))
+      return false;
+
+    if (now_ms() >= next_report) {
+      if (ctx->entry_count != reported_count) {
+        if (!write_snapshot(ctx))
+          fprintf(stderr, "Failed to write summary report\n");
+        reported_count = ctx->entry_count;
+      }
+      next_report = now_ms() + interval_ms;
+    }
+  }
+
+  if (!read_appended(ctx)) return false;
+  log_collector_close_file(ctx);
+
+  if (strlen(ctx->partial_path) > 0 &&
+      !log_partial_save(ctx, ctx->partial_path))
+    fprintf(stderr, "Failed to save partial result %s\n", ctx->partial_path);
+
+  if (!pattern_detector_finalize(ctx) ||
+      !recommendation_generator_analyze(ctx))
+    return false;
+  if (!report_generator_write_summary(ctx))
+    fprintf(stderr, "Failed to write summary report\n");
+  if (!report_generator_write_detailed(ctx))
+    fprintf(stderr, "Failed to write detailed report\n");
+  return true;
+}
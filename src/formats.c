@@ -0,0 +1,956 @@
+#include "include/log_analyzer.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#endif
+
+/*
+ * Line formats with parsers of their own. Each parser checks the layout
+ * as it reads and gives up at the first byte that does not fit, so a
+ * stray line of another kind still gets the generic heuristics in
+ * parser.c. Unless -f names a format, the first LOG_FORMAT_SAMPLE lines
+ * of an input are offered to every parser before any line is analyzed;
+ * a format that reads nearly all of them then parses every line, with
+ * no per-line detection.
+ */
+
+#define DETECT_PERCENT 90 /* of the sampled lines a format must read */
+#define UTF8_BOM "\xEF\xBB\xBF"
+
+/* Record fields that JSON and logfmt members fill */
+enum { KEY_MESSAGE, KEY_LEVEL, KEY_TIME, KEY_SOURCE, KEY_PID, KEY_THREAD,
+       KEY_COUNT };
+
+/* The field a member name fills, or -1; a switch on the length is cheap */
+typedef int (*KeySlot)(const char *key, size_t length);
+
+#define NAMED(name) (memcmp(key, name, sizeof(name) - 1) == 0)
+
+static int common_key(const char *key, size_t length) {
+  switch (length) {
+    case 2:
+      if (NAMED("ts")) return KEY_TIME;
+      break;
+    case 3:
+      if (NAMED("msg") || NAMED("log")) return KEY_MESSAGE;
+      if (NAMED("lvl")) return KEY_LEVEL;
+      if (NAMED("app")) return KEY_SOURCE;
+      if (NAMED("pid")) return KEY_PID;
+      if (NAMED("tid")) return KEY_THREAD;
+      break;
+    case 4:
+      if (NAMED("time")) return KEY_TIME;
+      break;
+    case 5:
+      if (NAMED("level")) return KEY_LEVEL;
+      break;
+    case 6:
+      if (NAMED("logger") || NAMED("source")) return KEY_SOURCE;
+      if (NAMED("thread")) return KEY_THREAD;
+      break;
+    case 7:
+      if (NAMED("message")) return KEY_MESSAGE;
+      if (NAMED("service")) return KEY_SOURCE;
+      break;
+    case 8:
+      if (NAMED("severity") || NAMED("loglevel")) return KEY_LEVEL;
+      break;
+    case 9:
+      if (NAMED("timestamp")) return KEY_TIME;
+      if (NAMED("component")) return KEY_SOURCE;
+      if (NAMED("thread_id")) return KEY_THREAD;
+      break;
+    case 10:
+      if (NAMED("@timestamp")) return KEY_TIME;
+      break;
+  }
+  return -1;
+}
+
+/* journalctl -o json; __REALTIME_TIMESTAMP is in microseconds */
+static int journal_key(const char *key, size_t length) {
+  switch (length) {
+    case 3:
+      if (NAMED("TID")) return KEY_THREAD;
+      break;
+    case 4:
+      if (NAMED("_PID")) return KEY_PID;
+      break;
+    case 7:
+      if (NAMED("MESSAGE")) return KEY_MESSAGE;
+      break;
+    case 8:
+      if (NAMED("PRIORITY")) return KEY_LEVEL;
+      break;
+    case 17:
+      if (NAMED("SYSLOG_IDENTIFIER")) return KEY_SOURCE;
+      break;
+    case 20:
+      if (NAMED("__REALTIME_TIMESTAMP")) return KEY_TIME;
+      break;
+  }
+  return -1;
+}
+
+#undef NAMED
+
+/* The first value seen for each slot; strings exclude their quotes */
+typedef struct {
+  LogSpan values[KEY_COUNT];
+} KeyValues;
+
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+static const char *skip_space(const char *p, const char *end) {
+  while (p < end && is_space(*p)) p++;
+  return p;
+}
+
+static LogSpan make_span(const char *line, const char *start,
+                         const char *end) {
+  LogSpan span;
+  span.offset = (size_t)(start - line);
+  span.length = (size_t)(end - start);
+  return span;
+}
+
+static LogSpan no_span(void) {
+  LogSpan span;
+  span.offset = LOG_SPAN_NONE;
+  span.length = 0;
+  return span;
+}
+
+static bool has_span(LogSpan span) { return span.offset != LOG_SPAN_NONE; }
+
+/* Starts a record with nothing found; the parser fills in the rest */
+static void begin_record(LogTimestampCache *cache, const char *line,
+                         size_t length, LogRecord *record) {
+  if (cache->year == 0) log_timestamp_cache_init(cache);
+
+  record->line = line;
+  record->length = length;
+  record->timestamp = cache->now;
+  record->has_timestamp = false;
+  record->severity = -1;
+  record->message = make_span(line, line, line + length);
+  record->source = no_span();
+  record->process_id = no_span();
+  record->thread_id = no_span();
+  record->fields = no_span();
+}
+
+/* Without a level of its own, the message is classified as usual */
+static bool end_record(LogRecord *record) {
+  if (record->severity < 0)
+    record->severity = log_parser_classify_severity(
+        record->line + record->message.offset, record->message.length);
+  return true;
+}
+
+/* "<PRI>" of up to three digits; the severity is PRI modulo 8 */
+static const char *parse_priority(const char *p, const char *end,
+                                  int *severity) {
+  const char *digits;
+  int priority = 0;
+
+  if (p >= end || *p != '<') return NULL;
+  digits = ++p;
+  while (p < end && p - digits < 3 && is_digit(*p))
+    priority = priority * 10 + (*p++ - '0');
+  if (p == digits || p >= end || *p != '>' || priority > 191) return NULL;
+
+  *severity = priority % 8;
+  return p + 1;
+}
+
+/* Length of a "Mmm dd hh:mm:ss" stamp and its trailing space, or 0 */
+static size_t syslog_stamp_length(const char *p, const char *end) {
+  size_t n = 5;
+
+  if (end - p < 15 || p[0] < 'A' || p[0] > 'Z' || p[1] < 'a' ||
+      p[1] > 'z' || p[2] < 'a' || p[2] > 'z' || p[3] != ' ')
+    return 0;
+  if (p[4] == ' ' || (is_digit(p[4]) && is_digit(p[5]))) n = 6;
+  if (!is_digit(p[n - 1])) return 0;
+
+  if ((size_t)(end - p) < n + 10 || p[n] != ' ' || !is_digit(p[n + 1]) ||
+      !is_digit(p[n + 2]) || p[n + 3] != ':' || !is_digit(p[n + 4]) ||
+      !is_digit(p[n + 5]) || p[n + 6] != ':' || !is_digit(p[n + 7]) ||
+      !is_digit(p[n + 8]) || p[n + 9] != ' ')
+    return 0;
+  return n + 10;
+}
+
+/* "TAG:" or "TAG[PID]:" at p; returns the byte after the colon */
+static const char *parse_tag(LogRecord *record, const char *p,
+                             const char *end) {
+  const char *tag = p, *tag_end, *pid = NULL, *pid_end = NULL;
+
+  while (p < end && *p != '[' && *p != ':' && *p != ' ') p++;
+  if (p == tag || p >= end) return NULL;
+  tag_end = p;
+
+  if (*p == '[') {
+    pid = ++p;
+    while (p < end && *p != ']' && *p != ' ') p++;
+    if (p >= end || *p != ']') return NULL;
+    pid_end = p++;
+  }
+  if (p >= end || *p != ':') return NULL;
+
+  record->source = make_span(record->line, tag, tag_end);
+  if (pid) record->process_id = make_span(record->line, pid, pid_end);
+  return p + 1;
+}
+
+/* RFC3164: "[<PRI>]Mmm dd hh:mm:ss [HOST ]TAG[PID]: MSG" */
+static bool parse_rfc3164(LogTimestampCache *cache, const char *line,
+                          size_t length, LogRecord *record) {
+  const char *end = line + length, *p = line, *message;
+  int severity = -1;
+  size_t stamp;
+
+  if (length > 0 && *p == '<' && !(p = parse_priority(p, end, &severity)))
+    return false;
+  stamp = syslog_stamp_length(p, end);
+  if (stamp == 0) return false;
+
+  begin_record(cache, line, length, record);
+  record->has_timestamp =
+      log_timestamp_find(cache, p, (size_t)(end - p), &record->timestamp);
+  record->severity = severity;
+  p += stamp;
+
+  /* The host is left out of logs that never left the machine */
+  message = parse_tag(record, p, end);
+  if (!message) {
+    while (p < end && *p != ' ') p++;
+    if (p >= end || !(message = parse_tag(record, p + 1, end)))
+      return false;
+  }
+  if (message < end && *message == ' ') message++;
+  record->message = make_span(line, message, end);
+  return end_record(record);
+}
+
+/* Past one or more "[id name=\"value\" ...]" elements, or NULL */
+static const char *skip_structured_data(const char *p, const char *end) {
+  bool quoted;
+
+  if (p >= end || *p != '[') return NULL;
+  while (p < end && *p == '[') {
+    quoted = false;
+    for (p++; p < end; p++) {
+      if (quoted) {
+        if (*p == '\\' && p + 1 < end)
+          p++;
+        else if (*p == '"')
+          quoted = false;
+      } else if (*p == '"') {
+        quoted = true;
+      } else if (*p == ']') {
+        break;
+      }
+    }
+    if (p >= end) return NULL;
+    p++;
+  }
+  return p;
+}
+
+static bool is_nil(const char *start, const char *end) {
+  return end - start == 1 && *start == '-';
+}
+
+/* RFC5424: "<PRI>1 TIMESTAMP HOST APP PROCID MSGID SD [MSG]" */
+static bool parse_rfc5424(LogTimestampCache *cache, const char *line,
+                          size_t length, LogRecord *record) {
+  const char *end = line + length, *p, *start[5], *stop[5], *data = NULL,
+             *data_end = NULL;
+  int severity;
+
+  p = parse_priority(line, end, &severity);
+  if (!p || end - p < 2 || p[0] != '1' || p[1] != ' ') return false;
+  p += 2;
+
+  /* TIMESTAMP HOSTNAME APP-NAME PROCID MSGID, each "-" when absent */
+  for (int i = 0; i < 5; i++) {
+    start[i] = p;
+    while (p < end && *p != ' ') p++;
+    if (p == start[i] || p >= end) return false;
+    stop[i] = p++;
+  }
+  if (!is_nil(start[0], stop[0]) && !is_digit(*start[0])) return false;
+
+  if (p < end && *p == '-') {
+    p++;
+  } else {
+    data = p;
+    if (!(p = data_end = skip_structured_data(p, end))) return false;
+  }
+  if (p < end && *p++ != ' ') return false;
+
+  begin_record(cache, line, length, record);
+  record->severity = severity;
+  if (!is_nil(start[0], stop[0]))
+    record->has_timestamp =
+        log_timestamp_find(cache, start[0], (size_t)(stop[0] - start[0]),
+                           &record->timestamp);
+  if (!is_nil(start[2], stop[2]))
+    record->source = make_span(line, start[2], stop[2]);
+  if (!is_nil(start[3], stop[3]))
+    record->process_id = make_span(line, start[3], stop[3]);
+  if (data) record->fields = make_span(line, data, data_end);
+
+  if (end - p >= 3 && memcmp(p, UTF8_BOM, 3) == 0) p += 3;
+  record->message = make_span(line, p, end);
+  return end_record(record);
+}
+
+/*
+ * The closing quote of a string whose opening quote is just before p: the
+ * first quote not escaped by an odd run of backslashes
+ */
+static const char *string_end(const char *p, const char *end) {
+  const char *quote, *escape;
+
+  while ((quote = (const char *)memchr(p, '"', (size_t)(end - p)))) {
+    for (escape = quote; escape > p && escape[-1] == '\\'; escape--)
+      continue;
+    if ((quote - escape) % 2 == 0) return quote;
+    p = quote + 1;
+  }
+  return NULL;
+}
+
+#define JSON_BLOCK 64      /* bytes to a word of the index */
+#define JSON_MAX_BLOCKS 64 /* longer lines are read a byte at a time */
+
+/*
+ * Where a line's strings and nested values end, simdjson style: one bit
+ * per byte for the quotes that open and close strings and for the
+ * brackets outside them.
+ */
+typedef struct {
+  const char *line;
+  size_t length;
+  uint64_t quotes[JSON_MAX_BLOCKS];
+  uint64_t brackets[JSON_MAX_BLOCKS];
+} JsonIndex;
+
+#ifdef HAVE_X86_SIMD
+/* Fills one mask per kind of byte; bit i stands for byte i of the block */
+typedef void (*JsonBlockIndex)(const unsigned char *s, uint64_t *quote,
+                               uint64_t *backslash, uint64_t *bracket);
+
+/* Four compare results as one mask */
+__attribute__((target("sse2"))) static uint64_t bits_sse2(__m128i a,
+                                                          __m128i b,
+                                                          __m128i c,
+                                                          __m128i d) {
+  return (uint64_t)(unsigned)_mm_movemask_epi8(a) |
+         (uint64_t)(unsigned)_mm_movemask_epi8(b) << 16 |
+         (uint64_t)(unsigned)_mm_movemask_epi8(c) << 32 |
+         (uint64_t)(unsigned)_mm_movemask_epi8(d) << 48;
+}
+
+__attribute__((target("sse2"))) static __m128i brackets_sse2(__m128i v) {
+  __m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+
+  return _mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')),
+                      _mm_cmpeq_epi8(folded, _mm_set1_epi8('}')));
+}
+
+/*
+ * Quotes, backslashes and brackets in a block. Setting bit 5 turns '['
+ * and ']' into '{' and '}', so two compares find all four brackets.
+ */
+__attribute__((target("sse2"))) static void index_block_sse2(
+    const unsigned char *s, uint64_t *quote, uint64_t *backslash,
+    uint64_t *bracket) {
+  const __m128i quotes = _mm_set1_epi8('"');
+  const __m128i backslashes = _mm_set1_epi8('\\');
+  __m128i a = _mm_loadu_si128((const __m128i *)s);
+  __m128i b = _mm_loadu_si128((const __m128i *)(s + 16));
+  __m128i c = _mm_loadu_si128((const __m128i *)(s + 32));
+  __m128i d = _mm_loadu_si128((const __m128i *)(s + 48));
+
+  *quote = bits_sse2(_mm_cmpeq_epi8(a, quotes), _mm_cmpeq_epi8(b, quotes),
+                     _mm_cmpeq_epi8(c, quotes), _mm_cmpeq_epi8(d, quotes));
+  *backslash = bits_sse2(
+      _mm_cmpeq_epi8(a, backslashes), _mm_cmpeq_epi8(b, backslashes),
+      _mm_cmpeq_epi8(c, backslashes), _mm_cmpeq_epi8(d, backslashes));
+  *bracket = bits_sse2(brackets_sse2(a), brackets_sse2(b), brackets_sse2(c),
+                       brackets_sse2(d));
+}
+
+__attribute__((target("avx2"))) static uint64_t bits_avx2(__m256i a,
+                                                          __m256i b) {
+  return (uint64_t)(unsigned)_mm256_movemask_epi8(a) |
+         (uint64_t)(unsigned)_mm256_movemask_epi8(b) << 32;
+}
+
+__attribute__((target("avx2"))) static __m256i brackets_avx2(__m256i v) {
+  __m256i folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+
+  return _mm256_or_si256(_mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')),
+                         _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}')));
+}
+
+/* index_block_sse2() thirty-two bytes at a time */
+__attribute__((target("avx2"))) static void index_block_avx2(
+    const unsigned char *s, uint64_t *quote, uint64_t *backslash,
+    uint64_t *bracket) {
+  const __m256i quotes = _mm256_set1_epi8('"');
+  const __m256i backslashes = _mm256_set1_epi8('\\');
+  __m256i a = _mm256_loadu_si256((const __m256i *)s);
+  __m256i b = _mm256_loadu_si256((const __m256i *)(s + 32));
+
+  *quote = bits_avx2(_mm256_cmpeq_epi8(a, quotes),
+                     _mm256_cmpeq_epi8(b, quotes));
+  *backslash = bits_avx2(_mm256_cmpeq_epi8(a, backslashes),
+                         _mm256_cmpeq_epi8(b, backslashes));
+  *bracket = bits_avx2(brackets_avx2(a), brackets_avx2(b));
+}
+
+/*
+ * The bytes escaped by a backslash. *carry says the previous block ended
+ * in a backslash that escapes this block's first byte, and is set again
+ * for the next block.
+ */
+static uint64_t escaped_bytes(uint64_t backslash, bool *carry) {
+  uint64_t escaped = *carry ? 1 : 0, bit;
+
+  backslash &= ~escaped;
+  *carry = false;
+  while (backslash) {
+    bit = backslash & (0 - backslash);
+    if (bit >> 63)
+      *carry = true;
+    else
+      escaped |= bit << 1;
+    backslash &= ~(bit | bit << 1);
+  }
+  return escaped;
+}
+
+/* Bit i is set when an odd number of bits are set at or below it */
+static uint64_t prefix_xor(uint64_t bits) {
+  bits ^= bits << 1;
+  bits ^= bits << 2;
+  bits ^= bits << 4;
+  bits ^= bits << 8;
+  bits ^= bits << 16;
+  bits ^= bits << 32;
+  return bits;
+}
+
+/*
+ * Quotes not escaped by a backslash open and close strings, and a prefix
+ * XOR over them marks the bytes inside. False for lines too long to index
+ * and for a backslash outside a string, where the byte-at-a-time reading
+ * and the index could disagree.
+ */
+static ALWAYS_INLINE bool index_blocks(JsonIndex *index, const char *line,
+                                       size_t length,
+                                       JsonBlockIndex index_block) {
+  unsigned char padded[JSON_BLOCK];
+  const unsigned char *bytes;
+  uint64_t quote, backslash, bracket, quotes, strings, in_string = 0;
+  bool escape = false;
+  size_t block = 0;
+
+  if (length > JSON_MAX_BLOCKS * JSON_BLOCK) return false;
+  index->line = line;
+  index->length = length;
+  for (size_t base = 0; base < length; base += JSON_BLOCK, block++) {
+    bytes = (const unsigned char *)line + base;
+    if (length - base < JSON_BLOCK) {
+      memset(padded, ' ', sizeof(padded));
+      memcpy(padded, bytes, length - base);
+      bytes = padded;
+    }
+    index_block(bytes, &quote, &backslash, &bracket);
+
+    quotes = backslash || escape
+                 ? quote & ~escaped_bytes(backslash, &escape)
+                 : quote;
+    strings = prefix_xor(quotes) ^ in_string;
+    in_string = 0 - (strings >> 63);
+    if (backslash & ~strings) return false;
+    index->quotes[block] = quotes;
+    index->brackets[block] = bracket & ~strings;
+  }
+  return true;
+}
+
+/* index_blocks() built around each block indexer, which it inlines */
+__attribute__((target("sse2"))) static bool index_json_sse2(
+    JsonIndex *index, const char *line, size_t length) {
+  return index_blocks(index, line, length, index_block_sse2);
+}
+
+__attribute__((target("avx2"))) static bool index_json_avx2(
+    JsonIndex *index, const char *line, size_t length) {
+  return index_blocks(index, line, length, index_block_avx2);
+}
+
+/* libgcc fills in the CPU model before main; reading it is reentrant */
+static bool build_json_index(JsonIndex *index, const char *line,
+                             size_t length) {
+  if (__builtin_cpu_supports("avx2"))
+    return index_json_avx2(index, line, length);
+  if (__builtin_cpu_supports("sse2"))
+    return index_json_sse2(index, line, length);
+  return false;
+}
+#endif
+
+/* The first string quote at or after p, or NULL */
+static const char *index_quote(const JsonIndex *index, const char *p) {
+  size_t offset = (size_t)(p - index->line), block = offset / JSON_BLOCK;
+  size_t blocks = (index->length + JSON_BLOCK - 1) / JSON_BLOCK;
+  uint64_t bits;
+
+  if (offset >= index->length) return NULL;
+  bits = index->quotes[block] & (~0ull << (offset % JSON_BLOCK));
+  while (!bits) {
+    if (++block == blocks) return NULL;
+    bits = index->quotes[block];
+  }
+  return index->line + block * JSON_BLOCK + __builtin_ctzll(bits);
+}
+
+/* The bracket that closes the one at p, or NULL */
+static const char *index_bracket(const JsonIndex *index, const char *p) {
+  size_t offset = (size_t)(p - index->line), block = offset / JSON_BLOCK;
+  size_t blocks = (index->length + JSON_BLOCK - 1) / JSON_BLOCK;
+  uint64_t bits = index->brackets[block] & (~0ull << (offset % JSON_BLOCK));
+  const char *bracket;
+  int depth = 0;
+
+  for (;;) {
+    while (bits) {
+      bracket = index->line + block * JSON_BLOCK + __builtin_ctzll(bits);
+      bits &= bits - 1;
+      if ((*bracket | 0x20) == '{')
+        depth++;
+      else if (--depth == 0)
+        return bracket;
+    }
+    if (++block == blocks) return NULL;
+    bits = index->brackets[block];
+  }
+}
+
+/*
+ * The end of the JSON value at p, nested ones included; NULL if cut off.
+ * With an index, strings and nested values end where it says.
+ */
+static const char *json_value_end(const JsonIndex *index, const char *p,
+                                  const char *end) {
+  const char *start = p;
+  int depth = 0;
+
+  if (p >= end) return NULL;
+  if (*p == '"') {
+    p = index ? index_quote(index, p + 1) : string_end(p + 1, end);
+    return p ? p + 1 : NULL;
+  }
+  if (index && (*p == '{' || *p == '[')) {
+    p = index_bracket(index, p);
+    return p ? p + 1 : NULL;
+  }
+  if (*p == '{' || *p == '[') {
+    for (; p < end; p++) {
+      if (*p == '"') {
+        if (!(p = string_end(p + 1, end))) return NULL;
+      } else if (*p == '{' || *p == '[') {
+        depth++;
+      } else if ((*p == '}' || *p == ']') && --depth == 0) {
+        return p + 1;
+      }
+    }
+    return NULL;
+  }
+
+  /* Numbers, true, false and null run to the next delimiter */
+  while (p < end && *p != ',' && *p != '}' && *p != ']' && !is_space(*p)) {
+    /* The index took this quote for the start of a string */
+    if (index && *p == '"') return NULL;
+    p++;
+  }
+  return p == start ? NULL : p;
+}
+
+static void init_values(KeyValues *found) {
+  for (int i = 0; i < KEY_COUNT; i++) found->values[i] = no_span();
+}
+
+/* Keeps the value if the key names a slot that has none yet */
+static void note_value(const char *line, KeySlot slot_of, const char *key,
+                       const char *key_end, const char *value,
+                       const char *value_end, KeyValues *found) {
+  int slot = slot_of(key, (size_t)(key_end - key));
+
+  if (slot < 0 || has_span(found->values[slot])) return;
+  if (value < value_end && *value == '"') {
+    value++;
+    value_end--;
+  }
+  found->values[slot] = make_span(line, value, value_end);
+}
+
+/*
+ * Reads the object that makes up the line; object gets its span. Only the
+ * top-level members are walked; values are kept as views into the line
+ * and the ones no key names are skipped whole.
+ */
+static bool scan_json_with(const JsonIndex *index, const char *line,
+                           size_t length, KeySlot slot_of, KeyValues *found,
+                           LogSpan *object) {
+  const char *end = line + length, *p, *start, *key, *key_end, *value,
+             *value_end;
+
+  init_values(found);
+  start = p = skip_space(line, end);
+  if (p >= end || *p != '{') return false;
+  p = skip_space(p + 1, end);
+
+  while (p < end && *p != '}') {
+    if (*p != '"') return false;
+    key = p + 1;
+    key_end = index ? index_quote(index, key) : string_end(key, end);
+    if (!key_end) return false;
+    p = skip_space(key_end + 1, end);
+    if (p >= end || *p != ':') return false;
+    value = skip_space(p + 1, end);
+    if (!(value_end = json_value_end(index, value, end))) return false;
+    note_value(line, slot_of, key, key_end, value, value_end, found);
+
+    p = skip_space(value_end, end);
+    if (p < end && *p == ',') {
+      p = skip_space(p + 1, end);
+      if (p < end && *p == '}') return false;
+    } else if (p < end && *p != '}') {
+      return false;
+    }
+  }
+  if (p >= end || skip_space(p + 1, end) != end) return false;
+
+  *object = make_span(line, start, p + 1);
+  return true;
+}
+
+/*
+ * With SSE2 or AVX2, lines that look like objects are indexed first.
+ * Whatever the indexed reading rejects is read again byte by byte, which
+ * has the last word, so both accept the same lines.
+ */
+static bool scan_json(const char *line, size_t length, KeySlot slot_of,
+                      KeyValues *found, LogSpan *object) {
+#ifdef HAVE_X86_SIMD
+  const char *p = skip_space(line, line + length);
+  JsonIndex index;
+
+  if (p == line + length || *p != '{') return false;
+  if (build_json_index(&index, line, length) &&
+      scan_json_with(&index, line, length, slot_of, found, object))
+    return true;
+#endif
+  return scan_json_with(NULL, line, length, slot_of, found, object);
+}
+
+/*
+ * Reads a level as a name in any case, a syslog severity digit, or a
+ * bunyan/pino number (10 trace ... 60 fatal); -1 if it is none of these.
+ */
+static int value_severity(const char *text, size_t length) {
+  static const int numbered[] = {7, 7, 6, 4, 3, 0};
+
+  if (length == 1 && text[0] >= '0' && text[0] <= '7') return text[0] - '0';
+  if (length == 2 && text[0] >= '1' && text[0] <= '6' && text[1] == '0')
+    return numbered[text[0] - '1'];
+  return log_parser_level_severity(text, length);
+}
+
+/*
+ * A time as log_timestamp_find() reads text, or a number of epoch
+ * seconds, milliseconds, microseconds or nanoseconds; false if neither.
+ */
+static bool value_timestamp(LogTimestampCache *cache, const char *text,
+                            size_t length, time_t *timestamp) {
+  size_t digits = 0;
+  uint64_t value = 0; /* 19 digits, enough for nanoseconds, always fit */
+
+  while (digits < length && digits < 19 && is_digit(text[digits]))
+    value = value * 10 + (uint64_t)(text[digits++] - '0');
+  if (digits == 0 || (digits < length && text[digits] != '.'))
+    return log_timestamp_find(cache, text, length, timestamp);
+
+  for (; digits > 11; digits -= 3) value /= 1000;
+  *timestamp = (time_t)value;
+  return true;
+}
+
+/* Fills the record from the values a structured line named */
+static bool fill_record(LogTimestampCache *cache, const KeyValues *found,
+                        LogRecord *record) {
+  const LogSpan *values = found->values;
+  const char *line = record->line;
+
+  if (has_span(values[KEY_MESSAGE])) record->message = values[KEY_MESSAGE];
+  if (has_span(values[KEY_LEVEL]))
+    record->severity = value_severity(line + values[KEY_LEVEL].offset,
+                                      values[KEY_LEVEL].length);
+  if (has_span(values[KEY_TIME]))
+    record->has_timestamp =
+        value_timestamp(cache, line + values[KEY_TIME].offset,
+                        values[KEY_TIME].length, &record->timestamp);
+  record->source = values[KEY_SOURCE];
+  record->process_id = values[KEY_PID];
+  record->thread_id = values[KEY_THREAD];
+  return end_record(record);
+}
+
+/* One JSON object per line; the whole object is kept as the fields */
+static bool parse_json(LogTimestampCache *cache, const char *line,
+                       size_t length, LogRecord *record) {
+  KeyValues found;
+  LogSpan object;
+
+  if (!scan_json(line, length, common_key, &found, &object))
+    return false;
+  begin_record(cache, line, length, record);
+  record->fields = object;
+  return fill_record(cache, &found, record);
+}
+
+/* journalctl -o json, which always carries __REALTIME_TIMESTAMP */
+static bool parse_journald(LogTimestampCache *cache, const char *line,
+                           size_t length, LogRecord *record) {
+  KeyValues found;
+  LogSpan object;
+
+  if (!scan_json(line, length, journal_key, &found, &object) ||
+      !has_span(found.values[KEY_TIME]))
+    return false;
+  begin_record(cache, line, length, record);
+  record->fields = object;
+  return fill_record(cache, &found, record);
+}
+
+/*
+ * logfmt: "key=value key=\"quoted value\" flag ...". The line must start
+ * with a pair and hold at least two, which keeps prose with an "x=y" in
+ * it out.
+ */
+static bool scan_logfmt(const char *line, size_t length, KeyValues *found) {
+  const char *end = line + length, *p, *key, *key_end, *value, *value_end;
+  int pairs = 0;
+
+  init_values(found);
+  p = skip_space(line, end);
+  while (p < end) {
+    key = p;
+    while (p < end && (unsigned char)*p > ' ' && *p != '=' && *p != '"') p++;
+    key_end = p;
+    if (key_end == key) return false;
+
+    if (p < end && *p == '=') {
+      value = ++p;
+      if (p < end && *p == '"') {
+        if (!(p = string_end(p + 1, end))) return false;
+        p++;
+      } else {
+        while (p < end && (unsigned char)*p > ' ' && *p != '"') p++;
+      }
+      value_end = p;
+      note_value(line, common_key, key, key_end, value, value_end, found);
+      pairs++;
+    } else if (pairs == 0) {
+      return false;
+    }
+    if (p < end && !is_space(*p)) return false;
+    p = skip_space(p, end);
+  }
+  return pairs >= 2;
+}
+
+static bool parse_logfmt(LogTimestampCache *cache, const char *line,
+                         size_t length, LogRecord *record) {
+  KeyValues found;
+
+  if (!scan_logfmt(line, length, &found)) return false;
+  begin_record(cache, line, length, record);
+  record->fields = make_span(line, skip_space(line, line + length),
+                             line + length);
+  return fill_record(cache, &found, record);
+}
+
+/*
+ * Access logs: "HOST IDENT USER [DATE] \"REQUEST\" STATUS BYTES", which
+ * the combined format follows with the quoted referer and user agent.
+ * The message is the request, status and size; the rest are the fields.
+ */
+static bool parse_combined(LogTimestampCache *cache, const char *line,
+                           size_t length, LogRecord *record) {
+  const char *end = line + length, *p = line, *start, *host_end = line,
+             *stamp, *stamp_end, *request, *message_end;
+  int status;
+
+  for (int i = 0; i < 3; i++) {
+    start = p;
+    while (p < end && *p != ' ') p++;
+    if (p == start || p >= end) return false;
+    if (i == 0) host_end = p;
+    p++;
+  }
+
+  if (p >= end || *p != '[') return false;
+  stamp = ++p;
+  stamp_end = (const char *)memchr(p, ']', (size_t)(end - p));
+  if (!stamp_end || end - stamp_end < 3 || stamp_end[1] != ' ' ||
+      stamp_end[2] != '"')
+    return false;
+  request = stamp_end + 2;
+  if (!(p = string_end(request + 1, end))) return false;
+  p++;
+
+  if (end - p < 6 || p[0] != ' ' || !is_digit(p[1]) || !is_digit(p[2]) ||
+      !is_digit(p[3]) || p[4] != ' ')
+    return false;
+  status = (p[1] - '0') * 100 + (p[2] - '0') * 10 + (p[3] - '0');
+  p += 5;
+  start = p;
+  while (p < end && *p != ' ') p++;
+  if (p == start) return false;
+  message_end = p;
+
+  begin_record(cache, line, length, record);
+  record->has_timestamp = log_timestamp_find(
+      cache, stamp, (size_t)(stamp_end - stamp), &record->timestamp);
+  record->severity = status >= 500 ? 3 : status >= 400 ? 4 : 6;
+  record->source = make_span(line, line, host_end);
+  record->message = make_span(line, request, message_end);
+  p = skip_space(p, end);
+  if (p < end) record->fields = make_span(line, p, end);
+  return true;
+}
+
+/* In detection order: on a tie the earlier, stricter format wins */
+static const LogFormat formats[] = {
+    {"rfc5424", "RFC5424 syslog: <PRI>1 TIMESTAMP HOST APP PROCID MSGID SD",
+     parse_rfc5424},
+    {"syslog", "RFC3164 syslog: [<PRI>]Mmm dd hh:mm:ss HOST TAG[PID]: MSG",
+     parse_rfc3164},
+    {"journald", "journalctl -o json, one entry per line", parse_journald},
+    {"json", "JSON lines with msg, level, time, pid and thread members",
+     parse_json},
+    {"logfmt", "key=value pairs: ts=... level=... msg=\"...\"",
+     parse_logfmt},
+    {"combined", "nginx and Apache access logs, common or combined",
+     parse_combined},
+    {"generic", "anything else, read by the generic heuristics", NULL},
+};
+
+#define FORMAT_COUNT (int)(sizeof(formats) / sizeof(formats[0]))
+#define GENERIC (&formats[FORMAT_COUNT - 1])
+
+const LogFormat *log_format_find(const char *name) {
+  if (!name) return NULL;
+
+  for (int i = 0; i < FORMAT_COUNT; i++) {
+    if (strcmp(formats[i].name, name) == 0) return &formats[i];
+  }
+  return NULL;
+}
+
+void log_format_print_names(FILE *fp) {
+  fprintf(fp, "  %-10s %s\n", "auto",
+          "sample the first lines of each input (default)");
+  for (int i = 0; i < FORMAT_COUNT; i++)
+    fprintf(fp, "  %-10s %s\n", formats[i].name, formats[i].description);
+}
+
+/* Resolves -f; an empty name or "auto" leaves the format to sampling */
+bool log_format_select(LogAnalyzerContext *ctx) {
+  if (!ctx) return false;
+  if (ctx->log_format[0] == '\0' || strcmp(ctx->log_format, "auto") == 0)
+    return true;
+
+  ctx->format = log_format_find(ctx->log_format);
+  if (ctx->format) return true;
+
+  fprintf(stderr, "Unknown log format: %s\nKnown formats:\n",
+          ctx->log_format);
+  log_format_print_names(stderr);
+  return false;
+}
+
+/*
+ * Offers the first LOG_FORMAT_SAMPLE lines of data to every parser. The
+ * format that reads DETECT_PERCENT of the non-blank ones or more wins;
+ * otherwise the input is mixed or unknown and stays generic. NULL when
+ * there is no non-blank line to go on.
+ */
+const LogFormat *log_format_detect(const char *data, size_t length) {
+  LogTimestampCache cache;
+  LogRecord record;
+  LogChunk chunk;
+  LogLine line;
+  int hits[FORMAT_COUNT], lines = 0, sampled = 0, best = FORMAT_COUNT - 1;
+
+  if (!data) return NULL;
+
+  memset(hits, 0, sizeof(hits));
+  log_timestamp_cache_init(&cache);
+  chunk.data = data;
+  chunk.length = length;
+  chunk.offset = 0;
+  while (lines < LOG_FORMAT_SAMPLE && log_chunk_next_line(&chunk, &line)) {
+    lines++;
+    if (line.length == 0) continue;
+    sampled++;
+    for (int i = 0; i < FORMAT_COUNT - 1; i++) {
+      if (formats[i].parse(&cache, line.data, line.length, &record))
+        hits[i]++;
+    }
+  }
+  if (sampled == 0) return NULL;
+
+  for (int i = FORMAT_COUNT - 2; i >= 0; i--) {
+    if (hits[i] >= hits[best]) best = i;
+  }
+  return hits[best] * 100 >= sampled * DETECT_PERCENT ? &formats[best]
+                                                      : GENERIC;
+}
+
+/* Samples the collector's unread lines, unless the format is known */
+void log_format_detect_input(LogAnalyzerContext *ctx) {
+  const char *data;
+  size_t length;
+
+  if (!ctx || ctx->format || !log_collector_peek(ctx, &data, &length))
+    return;
+  ctx->format = log_format_detect(data, length);
+  ctx->format_detected = ctx->format != NULL;
+}
+
+/* The "Log Format" line of the reports */
+const char *log_format_describe(const LogAnalyzerContext *ctx, char *buffer,
+                                size_t size) {
+  if (!ctx) return "";
+  if (ctx->format && !ctx->format_detected) return ctx->format->name;
+  if (ctx->format) {
+    snprintf(buffer, size, "%s (auto-detected)", ctx->format->name);
+    return buffer;
+  }
+  return ctx->format_detected ? "mixed (auto-detected per file)"
+                              : "Auto-detected";
+}
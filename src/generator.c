@@ -1,14 +1,128 @@
+#include <ctype.h>
+
 #include "include/log_analyzer.h"
 
+#define RULE_WORDS(count) (((count) + 63) / 64)
+
+/*
+ * The built-in rules. Numbers are 1-based IDs in the built-in pattern
+ * table, so with a --patterns file only the rules keyed by category
+ * ("@category", or "*" for any pattern) apply.
+ */
+static const struct {
+  const char *patterns;
+  int priority;
+  float confidence;
+  const char *category;
+  const char *title;
+  const char *description;
+  const char *action;
+} builtin_rules[] = {
+    /* CPU: high usage (1) or load average (2) */
+    {"1,2", 4, 0.8f, "cpu", "Analyze CPU-intensive processes",
+     "The system is experiencing high CPU usage or load average.",
+     "Use 'top' or 'htop' to identify CPU-intensive processes. Consider "
+     "optimizing or throttling these processes."},
+    {"1,2", 3, 0.7f, "cpu", "Check for runaway processes",
+     "High CPU usage might be caused by runaway processes that need to be "
+     "terminated.",
+     "Use 'ps aux' to identify processes consuming excessive CPU and "
+     "consider terminating them if appropriate."},
+    {"1,2", 3, 0.6f, "cpu", "Consider resource limits",
+     "Setting resource limits can prevent processes from consuming "
+     "excessive CPU.",
+     "Use 'ulimit' or cgroups to set CPU limits for critical processes."},
+
+    /* Memory: out of memory (4), swap (7) */
+    {"@memory", 4, 0.8f, "memory", "Analyze memory usage",
+     "The system is experiencing memory-related issues.",
+     "Use 'free', 'vmstat', and 'ps' to analyze memory usage and identify "
+     "memory-intensive processes."},
+    {"4", 5, 0.9f, "memory", "Address out-of-memory conditions",
+     "The system's OOM (Out Of Memory) killer is being triggered.",
+     "Increase available memory, reduce memory usage, or adjust the OOM "
+     "killer settings using sysctl."},
+    {"7", 3, 0.7f, "memory", "Reduce swap usage",
+     "The system is using excessive swap space, which can degrade "
+     "performance.",
+     "Increase physical memory, decrease swappiness parameter, or optimize "
+     "applications to reduce memory footprint."},
+    {"@memory", 3, 0.6f, "memory", "Consider memory limits",
+     "Setting memory limits can prevent processes from consuming excessive "
+     "memory.",
+     "Use 'ulimit', cgroups, or container limits to restrict memory usage "
+     "for critical processes."},
+
+    /* Disk: full (8) or near capacity (11); I/O errors (9), timeouts (10) */
+    {"8,11", 4, 0.8f, "disk", "Free up disk space",
+     "The system is running low on disk space.",
+     "Use 'du' and 'df' to identify large files and directories. Consider "
+     "removing unnecessary files, archiving old data, or expanding "
+     "storage."},
+    {"8,11", 3, 0.7f, "disk", "Implement disk space monitoring",
+     "Regular monitoring of disk space can prevent unexpected disk full "
+     "conditions.",
+     "Set up monitoring with tools like Nagios, Zabbix, or custom scripts "
+     "with email alerts when disk usage exceeds thresholds."},
+    {"9,10", 5, 0.8f, "disk", "Check disk health",
+     "I/O errors or device timeouts may indicate disk hardware issues.",
+     "Use 'smartctl' to check disk health, run 'fsck' to check filesystem "
+     "integrity, and consider replacing the disk if hardware issues are "
+     "confirmed."},
+    {"9,10", 3, 0.6f, "disk", "Optimize I/O patterns",
+     "Excessive or poorly optimized I/O operations can lead to timeouts and "
+     "errors.",
+     "Use 'iotop' to identify I/O-intensive processes and optimize their "
+     "I/O patterns. Consider using buffers, caches, or asynchronous I/O."},
+
+    /* Network: connection timeouts (13), packet loss (14) */
+    {"@network", 4, 0.8f, "network", "Check network connectivity",
+     "The system is experiencing network connectivity issues.",
+     "Use 'ping', 'traceroute', and 'mtr' to diagnose network connectivity "
+     "problems. Check DNS resolution, firewalls, and routing."},
+    {"13", 3, 0.7f, "network", "Adjust connection timeouts",
+     "Connection timeouts may indicate network congestion or server "
+     "overload.",
+     "Consider increasing connection timeout settings, implementing retry "
+     "logic, or load balancing to reduce timeouts."},
+    {"14", 4, 0.7f, "network", "Address packet loss",
+     "Packet loss can degrade network performance and cause application "
+     "errors.",
+     "Check for network congestion, faulty hardware, or misconfigured "
+     "network equipment. Consider QoS settings to prioritize critical "
+     "traffic."},
+
+    /* Any match at all */
+    {"*", 2, 0.9f, "general", "Implement regular performance monitoring",
+     "Regular monitoring can help identify and address performance issues "
+     "before they become critical.",
+     "Set up monitoring tools like Prometheus, Grafana, or similar to track "
+     "system metrics and generate alerts."},
+    {"*", 2, 0.8f, "general", "Review system logs regularly",
+     "Regular log review can help identify recurring issues and patterns.",
+     "Implement log aggregation and analysis tools like ELK stack, Graylog, "
+     "or similar to centralize and analyze logs."},
+};
+
 static void add_recommendation(LogAnalyzerContext *ctx, const char *title,
                                const char *description, const char *action,
                                int priority, const char *category,
                                float confidence) {
-  Recommendation *rec;
-
-  if (!ctx || !title || ctx->recommendation_count >= MAX_RECOMMENDATIONS)
-    return;
-
+  Recommendation *rec, *recommendations;
+  int capacity;
+
+  if (!ctx || !title) return;
+
+  if (ctx->recommendation_count == ctx->recommendation_capacity) {
+    capacity = ctx->recommendation_capacity
+                   ? ctx->recommendation_capacity * 2
+                   : 32;
+    recommendations = (Recommendation *)realloc(
+        ctx->recommendations, capacity * sizeof(Recommendation));
+    if (!recommendations) return;
+    ctx->recommendations = recommendations;
+    ctx->recommendation_capacity = capacity;
+  }
   rec = &ctx->recommendations[ctx->recommendation_count];
 
   rec->title = strdup(title);
@@ -21,262 +135,348 @@ static void add_recommendation(LogAnalyzerContext *ctx, const char *title,
   ctx->recommendation_count++;
 }
 
-static void generate_cpu_recommendations(LogAnalyzerContext *ctx) {
-  int i;
-  Pattern *pattern;
-  bool high_cpu_usage = false;
-  bool high_load_average = false;
+/* Sets the bits of the patterns one term names; false if it names none */
+static bool resolve_term(const LogAnalyzerContext *ctx, const char *term,
+                         size_t length, uint64_t *bits) {
+  bool found = false;
+  long id;
 
-  /* Check CPU Patterns */
-  for (i = 0; i < ctx->pattern_count; i++) {
-    pattern = &ctx->patterns[i];
-    if (pattern->frequency <= 0) continue;
-
-    if (strcmp(pattern->category, "cpu") == 0) {
-      if (strstr(pattern->description, "High CPU Usage") != NULL) {
-        high_cpu_usage = true;
-      } else if (strstr(pattern->description, "High Load Average") != NULL) {
-        high_load_average = true;
+  if (length == 1 && term[0] == '*') {
+    for (int i = 0; i < ctx->pattern_count; i++)
+      bits[i / 64] |= 1ull << (i % 64);
+    return ctx->pattern_count > 0;
+  }
+
+  if (term[0] == '@') {
+    for (int i = 0; i < ctx->pattern_count; i++) {
+      const char *category = ctx->patterns[i].category;
+
+      if (strlen(category) == length - 1 &&
+          memcmp(category, term + 1, length - 1) == 0) {
+        id = ctx->patterns[i].id;
+        bits[id / 64] |= 1ull << (id % 64);
+        found = true;
       }
     }
+    return found;
   }
 
-  if (high_cpu_usage || high_load_average) {
-    add_recommendation(
-        ctx, "Analyze CPU-intensive processes",
-        "The system is experiencing high CPU usage or load average.",
-        "Use 'top' or 'htop' to identify CPU-intensive processes. Consider "
-        "optimizing or throttling these processes.",
-        4, "cpu", 0.8);
-
-    add_recommendation(ctx, "Check for runaway processes",
-                       "High CPU usage might be caused by runaway processes "
-                       "that need to be terminated.",
-                       "Use 'ps aux' to identify processes consuming excessive "
-                       "CPU and consider terminating them if appropriate.",
-                       3, "cpu", 0.7);
+  id = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (!isdigit((unsigned char)term[i]) || id > ctx->pattern_count)
+      return false;
+    id = id * 10 + (term[i] - '0');
+  }
+  if (length == 0 || id < 1 || id > ctx->pattern_count) return false;
+  bits[(id - 1) / 64] |= 1ull << ((id - 1) % 64);
+  return true;
+}
 
-    add_recommendation(
-        ctx, "Consider resource limits",
-        "Setting resource limits can prevent processes from consuming "
-        "excessive CPU.",
-        "Use 'ulimit' or cgroups to set CPU limits for critical processes.", 3,
-        "cpu", 0.6);
+/*
+ * Turns a comma-separated list of pattern IDs (1-based, in table order),
+ * @category names and "*" into a bitset over pattern IDs, which must
+ * hold RULE_WORDS(pattern_count) cleared words. Names are only looked at
+ * here, once per rule, never while rules are evaluated.
+ */
+bool recommendation_rule_resolve(const LogAnalyzerContext *ctx,
+                                 const char *patterns, uint64_t *bits) {
+  const char *term, *end;
+
+  if (!ctx || !patterns || !bits) return false;
+
+  for (term = patterns;; term = end + 1) {
+    while (*term == ' ') term++;
+    end = term + strcspn(term, ",");
+    if (!resolve_term(ctx, term, (size_t)(end - term), bits)) return false;
+    if (*end == '\0') return true;
   }
 }
 
-static void generate_memory_recommendations(LogAnalyzerContext *ctx) {
-  int i;
-  Pattern *pattern;
-  bool memory_issues = false;
-  bool oom_killer = false;
-  bool high_swap = false;
+/* Appends a copy of rule keyed by the pattern IDs set in bits */
+bool recommendation_rule_add(LogAnalyzerContext *ctx,
+                             const RecommendationRule *rule,
+                             const uint64_t *bits) {
+  RecommendationRule *added, *rules;
+  int words, capacity, count = 0;
+
+  if (!ctx || !rule || !bits) return false;
+
+  if (ctx->rule_count == ctx->rule_capacity) {
+    capacity = ctx->rule_capacity ? ctx->rule_capacity * 2 : 32;
+    rules = (RecommendationRule *)realloc(
+        ctx->rules, capacity * sizeof(RecommendationRule));
+    if (!rules) return false;
+    ctx->rules = rules;
+    ctx->rule_capacity = capacity;
+  }
+  added = &ctx->rules[ctx->rule_count];
+
+  /* Only the non-zero words are kept, so a rule costs what it names */
+  words = RULE_WORDS(ctx->pattern_count);
+  for (int w = 0; w < words; w++) count += bits[w] != 0;
+
+  *added = *rule;
+  added->title = strdup(rule->title);
+  added->description = strdup(rule->description);
+  added->action = strdup(rule->action);
+  added->category = strdup(rule->category);
+  added->masks = (RuleMask *)malloc((count + 1) * sizeof(RuleMask));
+  if (!added->title || !added->description || !added->action ||
+      !added->category || !added->masks) {
+    free(added->title);
+    free(added->description);
+    free(added->action);
+    free(added->category);
+    free(added->masks);
+    return false;
+  }
 
-  /* memory-related patterns */
-  for (i = 0; i < ctx->pattern_count; i++) {
-    pattern = &ctx->patterns[i];
+  added->mask_count = 0;
+  for (int w = 0; w < words; w++) {
+    if (bits[w] == 0) continue;
+    added->masks[added->mask_count].word = w;
+    added->masks[added->mask_count].bits = bits[w];
+    added->mask_count++;
+  }
 
-    if (pattern->frequency <= 0) {
-      continue;
-    }
+  ctx->rule_count++;
+  return true;
+}
 
-    if (strcmp(pattern->category, "memory") == 0) {
-      memory_issues = true;
+static bool names_pattern_ids(const char *patterns) {
+  return strpbrk(patterns, "0123456789") != NULL;
+}
 
-      if (strstr(pattern->description, "Out of memory") != NULL) {
-        oom_killer = true;
-      } else if (strstr(pattern->description, "High swap usage") != NULL) {
-        high_swap = true;
-      }
-    }
-  }
+static bool add_builtin_rules(LogAnalyzerContext *ctx) {
+  size_t count = sizeof(builtin_rules) / sizeof(builtin_rules[0]);
+  int words = RULE_WORDS(ctx->pattern_count);
+  RecommendationRule rule;
+  uint64_t *bits;
+  bool success = true;
 
-  if (memory_issues) {
-    add_recommendation(ctx, "Analyze memory usage",
-                       "The system is experiencing memory-related issues.",
-                       "Use 'free', 'vmstat', and 'ps' to analyze memory usage "
-                       "and identify memory-intensive processes.",
-                       4, "memory", 0.8);
-
-    if (oom_killer) {
-      add_recommendation(
-          ctx, "Address out-of-memory conditions",
-          "The system's OOM (Out Of Memory) killer is being triggered.",
-          "Increase available memory, reduce memory usage, or adjust the OOM "
-          "killer settings using sysctl.",
-          5, "memory", 0.9);
-    }
+  bits = (uint64_t *)malloc((words + 1) * sizeof(uint64_t));
+  if (!bits) return false;
 
-    if (high_swap) {
-      add_recommendation(
-          ctx, "Reduce swap usage",
-          "The system is using excessive swap space, which can degrade "
-          "performance.",
-          "Increase physical memory, decrease swappiness parameter, or "
-          "optimize applications to reduce memory footprint.",
-          3, "memory", 0.7);
-    }
+  for (size_t i = 0; i < count && success; i++) {
+    if (strlen(ctx->patterns_path) > 0 &&
+        names_pattern_ids(builtin_rules[i].patterns))
+      continue;
+    memset(bits, 0, (words + 1) * sizeof(uint64_t));
+    if (!recommendation_rule_resolve(ctx, builtin_rules[i].patterns, bits))
+      continue;
 
-    add_recommendation(ctx, "Consider memory limits",
-                       "Setting memory limits can prevent processes from "
-                       "consuming excessive memory.",
-                       "Use 'ulimit', cgroups, or container limits to restrict "
-                       "memory usage for critical processes.",
-                       3, "memory", 0.6);
+    memset(&rule, 0, sizeof(rule));
+    rule.title = (char *)builtin_rules[i].title;
+    rule.description = (char *)builtin_rules[i].description;
+    rule.action = (char *)builtin_rules[i].action;
+    rule.category = (char *)builtin_rules[i].category;
+    rule.priority = builtin_rules[i].priority;
+    rule.confidence = builtin_rules[i].confidence;
+    rule.min_matches = 1;
+    success = recommendation_rule_add(ctx, &rule, bits);
   }
-}
 
-static void generate_disk_recommendations(LogAnalyzerContext *ctx) {
-  int i;
-  Pattern *pattern;
-  bool disk_space_issues = false;
-  bool io_errors = false;
+  free(bits);
+  return success;
+}
 
-  /* disk-related patterns */
-  for (i = 0; i < ctx->pattern_count; i++) {
-    pattern = &ctx->patterns[i];
+/* Loads the rules, from --rules or built in; needs the pattern table */
+bool recommendation_generator_begin(LogAnalyzerContext *ctx) {
+  if (!ctx) return false;
 
-    if (pattern->frequency <= 0) {
-      continue;
-    }
+  /* Rules added by the caller are used as they are */
+  if (ctx->rule_count > 0) return true;
+  if (strlen(ctx->rules_path) > 0) return log_rules_load(ctx, ctx->rules_path);
+  return add_builtin_rules(ctx);
+}
 
-    if (strcmp(pattern->category, "disk") == 0) {
-      if (strstr(pattern->description, "Disk full") != NULL ||
-          strstr(pattern->description, "Filesystem near capacity") != NULL) {
-        disk_space_issues = true;
-      } else if (strstr(pattern->description, "I/O error") != NULL ||
-                 strstr(pattern->description, "Device timeout") != NULL) {
-        io_errors = true;
-      }
+/*
+ * Cheap rejection on the active bitset first; only rules with
+ * thresholds then visit the patterns that are active in them.
+ */
+static bool rule_fires(const RecommendationRule *rule, const uint64_t *active,
+                       const Pattern *const *by_id) {
+  bool counted = rule->min_matches > 1 || rule->min_rate > 0;
+  bool any = false;
+  long matches = 0;
+  double peak = 0;
+  uint64_t hits;
+  const Pattern *pattern;
+
+  for (int m = 0; m < rule->mask_count; m++) {
+    hits = active[rule->masks[m].word] & rule->masks[m].bits;
+    if (hits == 0) continue;
+    any = true;
+    if (!counted) break;
+
+    for (; hits; hits &= hits - 1) {
+      pattern = by_id[rule->masks[m].word * 64 + __builtin_ctzll(hits)];
+      matches += pattern->frequency;
+      if (pattern->rate.peak_rate > peak) peak = pattern->rate.peak_rate;
     }
   }
+  return any && (!counted || (matches >= rule->min_matches &&
+                              peak >= rule->min_rate));
+}
 
-  if (disk_space_issues) {
-    add_recommendation(
-        ctx, "Free up disk space", "The system is running low on disk space.",
-        "Use 'du' and 'df' to identify large files and directories. Consider "
-        "removing unnecessary files, archiving old data, or expanding storage.",
-        4, "disk", 0.8);
-
-    add_recommendation(
-        ctx, "Implement disk space monitoring",
-        "Regular monitoring of disk space can prevent unexpected disk full "
-        "conditions.",
-        "Set up monitoring with tools like Nagios, Zabbix, or custom scripts "
-        "with email alerts when disk usage exceeds thresholds.",
-        3, "disk", 0.7);
+static bool generate_rule_recommendations(LogAnalyzerContext *ctx) {
+  int words = RULE_WORDS(ctx->pattern_count);
+  const Pattern **by_id;
+  const RecommendationRule *rule;
+  uint64_t *active;
+  int id;
+
+  active = (uint64_t *)calloc(words + 1, sizeof(uint64_t));
+  by_id = (const Pattern **)malloc((ctx->pattern_count + 1) *
+                                   sizeof(const Pattern *));
+  if (!active || !by_id) {
+    free(active);
+    free(by_id);
+    return false;
   }
 
-  if (io_errors) {
-    add_recommendation(
-        ctx, "Check disk health",
-        "I/O errors or device timeouts may indicate disk hardware issues.",
-        "Use 'smartctl' to check disk health, run 'fsck' to check filesystem "
-        "integrity, and consider replacing the disk if hardware issues are "
-        "confirmed.",
-        5, "disk", 0.8);
+  /* Ranking has reordered the table; IDs still name the loaded order */
+  for (int i = 0; i < ctx->pattern_count; i++) {
+    id = ctx->patterns[i].id;
+    by_id[id] = &ctx->patterns[i];
+    if (ctx->patterns[i].frequency > 0)
+      active[id / 64] |= 1ull << (id % 64);
+  }
 
-    add_recommendation(
-        ctx, "Optimize I/O patterns",
-        "Excessive or poorly optimized I/O operations can lead to timeouts and "
-        "errors.",
-        "Use 'iotop' to identify I/O-intensive processes and optimize their "
-        "I/O patterns. Consider using buffers, caches, or asynchronous I/O.",
-        3, "disk", 0.6);
+  for (int r = 0; r < ctx->rule_count; r++) {
+    rule = &ctx->rules[r];
+    if (rule_fires(rule, active, by_id))
+      add_recommendation(ctx, rule->title, rule->description, rule->action,
+                         rule->priority, rule->category, rule->confidence);
   }
+
+  free(active);
+  free(by_id);
+  return true;
 }
 
-static void generate_network_recommendations(LogAnalyzerContext *ctx) {
+/*
+ * Totals hide whether matches were spread out or arrived in a storm, so
+ * patterns whose histogram shows a burst get a recommendation of their
+ * own, weighted by how far the peak stands above the mean rate.
+ */
+static void generate_burst_recommendations(LogAnalyzerContext *ctx) {
+  char title[256], description[512], when[64];
+  const LogRateSummary *rate;
+  double ratio;
+  struct tm tm;
   int i;
-  Pattern *pattern;
-  bool network_issues = false;
-  bool timeouts = false;
-  bool packet_loss = false;
 
-  /* network-related patterns */
   for (i = 0; i < ctx->pattern_count; i++) {
-    pattern = &ctx->patterns[i];
+    rate = &ctx->patterns[i].rate;
+    if (rate->burst_count == 0) continue;
+
+    ratio = rate->mean_rate > 0 ? rate->peak_rate / rate->mean_rate : 0;
+    if (!gmtime_r(&rate->bursts[0].start, &tm) ||
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M UTC", &tm) == 0)
+      snprintf(when, sizeof(when), "%lld", (long long)rate->bursts[0].start);
+
+    snprintf(title, sizeof(title), "Investigate bursts of %s",
+             ctx->patterns[i].description);
+    snprintf(description, sizeof(description),
+             "%s peaked at %.0f/min against a mean of %.3g/min; the largest "
+             "burst began %s with %ld matches.",
+             ctx->patterns[i].description, rate->peak_rate, rate->mean_rate,
+             when, rate->bursts[0].count);
+    add_recommendation(
+        ctx, title, description,
+        "Correlate the burst window with deployments, scheduled jobs and "
+        "traffic peaks; a short storm usually has a single trigger.",
+        ctx->patterns[i].severity < 5 ? ctx->patterns[i].severity : 5,
+        ctx->patterns[i].category,
+        ratio >= 100 ? 0.9f : ratio >= 10 ? 0.8f : 0.7f);
+  }
+}
 
-    if (pattern->frequency <= 0) {
-      continue;
-    }
+/*
+ * A single message shape that makes up a large share of the log costs
+ * disk and I/O whether or not any pattern flags it.
+ */
+static void generate_volume_recommendations(LogAnalyzerContext *ctx) {
+  LogTemplate templates[LOG_TEMPLATE_TOP];
+  char description[512];
+  double share;
+  int count;
+
+  count = log_template_top(ctx->template_miner, templates, LOG_TEMPLATE_TOP);
+  for (int i = 0; i < count && ctx->entry_count > 0; i++) {
+    share = 100.0 * templates[i].count / ctx->entry_count;
+    if (share < 20.0 || templates[i].count < 1000) break;
+
+    snprintf(description, sizeof(description),
+             "%.0f%% of all messages (%ld lines) have the form: %.300s",
+             share, templates[i].count, templates[i].text);
+    add_recommendation(
+        ctx, "Reduce the volume of a recurring message", description,
+        "Lower its log level, sample or rate-limit it at the source, or fix "
+        "the condition it keeps reporting.",
+        share >= 50.0 ? 4 : 3, "logging", share >= 50.0 ? 0.8f : 0.7f);
+  }
+}
 
-    if (strcmp(pattern->category, "network") == 0) {
-      network_issues = true;
+/* Merges the sorted runs [from, middle) and [middle, to) into out */
+static void merge_runs(const Recommendation *in, Recommendation *out,
+                       int from, int middle, int to) {
+  int i = from, j = middle;
 
-      if (strstr(pattern->description, "Connection timeout") != NULL) {
-        timeouts = true;
-      } else if (strstr(pattern->description, "packet loss") != NULL) {
-        packet_loss = true;
-      }
-    }
+  for (int k = from; k < to; k++) {
+    if (i < middle && (j >= to || in[i].priority >= in[j].priority))
+      out[k] = in[i++];
+    else
+      out[k] = in[j++];
   }
+}
 
-  if (network_issues) {
-    add_recommendation(
-        ctx, "Check network connectivity",
-        "The system is experiencing network connectivity issues.",
-        "Use 'ping', 'traceroute', and 'mtr' to diagnose network connectivity "
-        "problems. Check DNS resolution, firewalls, and routing.",
-        4, "network", 0.8);
-
-    if (timeouts) {
-      add_recommendation(
-          ctx, "Adjust connection timeouts",
-          "Connection timeouts may indicate network congestion or server "
-          "overload.",
-          "Consider increasing connection timeout settings, implementing retry "
-          "logic, or load balancing to reduce timeouts.",
-          3, "network", 0.7);
+/* Highest priority first, keeping generation order among equals */
+static void rank_recommendations(Recommendation *recs, int count) {
+  Recommendation *buffer, *in, *out, *swap;
+  int middle, to;
+
+  if (count < 2) return;
+
+  buffer = (Recommendation *)malloc(count * sizeof(Recommendation));
+  if (!buffer) {
+    for (int i = 1; i < count; i++) {
+      Recommendation temp = recs[i];
+      int j = i;
+      for (; j > 0 && recs[j - 1].priority < temp.priority; j--)
+        recs[j] = recs[j - 1];
+      recs[j] = temp;
     }
+    return;
+  }
 
-    if (packet_loss) {
-      add_recommendation(ctx, "Address packet loss",
-                         "Packet loss can degrade network performance and "
-                         "cause application errors.",
-                         "Check for network congestion, faulty hardware, or "
-                         "misconfigured network equipment. Consider QoS "
-                         "settings to prioritize critical traffic.",
-                         4, "network", 0.7);
+  in = recs;
+  out = buffer;
+  for (int width = 1; width < count; width *= 2) {
+    for (int from = 0; from < count; from += 2 * width) {
+      middle = from + width < count ? from + width : count;
+      to = middle + width < count ? middle + width : count;
+      merge_runs(in, out, from, middle, to);
     }
+    swap = in;
+    in = out;
+    out = swap;
   }
+  if (in != recs) memcpy(recs, in, count * sizeof(Recommendation));
+  free(buffer);
 }
 
 bool recommendation_generator_analyze(LogAnalyzerContext *ctx) {
   if (!ctx) return false;
 
-  generate_cpu_recommendations(ctx);
-  generate_memory_recommendations(ctx);
-  generate_disk_recommendations(ctx);
-  generate_network_recommendations(ctx);
-
-  if (ctx->pattern_count > 0 && ctx->patterns[0].frequency > 0) {
-    add_recommendation(ctx, "Implement regular performance monitoring",
-                       "Regular monitoring can help identify and address "
-                       "performance issues before they become critical.",
-                       "Set up monitoring tools like Prometheus, Grafana, or "
-                       "similar to track system metrics and generate alerts.",
-                       2, "general", 0.9);
-
-    add_recommendation(
-        ctx, "Review system logs regularly",
-        "Regular log review can help identify recurring issues and patterns.",
-        "Implement log aggregation and analysis tools like ELK stack, Graylog, "
-        "or similar to centralize and analyze logs.",
-        2, "general", 0.8);
-  }
-
-  for (int i = 0; i < ctx->recommendation_count - 1; i++) {
-    for (int j = 0; j < ctx->recommendation_count - i - 1; j++) {
-      if (ctx->recommendations[j].priority <
-          ctx->recommendations[j + 1].priority) {
-        Recommendation temp = ctx->recommendations[j];
-        ctx->recommendations[j] = ctx->recommendations[j + 1];
-        ctx->recommendations[j + 1] = temp;
-      }
-    }
-  }
+  if (ctx->rule_count == 0 && !recommendation_generator_begin(ctx))
+    return false;
+  if (!generate_rule_recommendations(ctx)) return false;
+  generate_burst_recommendations(ctx);
+  generate_volume_recommendations(ctx);
 
+  rank_recommendations(ctx->recommendations, ctx->recommendation_count);
   return true;
 }
 
@@ -287,3 +487,18 @@ Recommendation *recommendation_generator_get_recommendations(
   *recommendation_count = ctx->recommendation_count;
   return ctx->recommendations;
 }
+
+void recommendation_generator_clear(LogAnalyzerContext *ctx) {
+  if (!ctx) return;
+
+  for (int i = 0; i < ctx->recommendation_count; i++) {
+    free(ctx->recommendations[i].title);
+    free(ctx->recommendations[i].description);
+    free(ctx->recommendations[i].action);
+    free(ctx->recommendations[i].category);
+  }
+  free(ctx->recommendations);
+  ctx->recommendations = NULL;
+  ctx->recommendation_count = 0;
+  ctx->recommendation_capacity = 0;
+}
@@ -0,0 +1,221 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "include/log_analyzer.h"
+
+#define GZIP_INPUT_SIZE (256 * 1024)
+#define GZIP_BLOCK_SIZE (1024 * 1024)
+#define GZIP_SLOTS 2
+
+typedef struct {
+  char *data;
+  size_t length;
+  bool full;
+} GzipSlot;
+
+/*
+ * Inflates a gzip stream (concatenated members included) into reusable
+ * blocks. With a worker thread, two blocks alternate: the thread inflates
+ * into one while the caller parses the other.
+ */
+struct LogGzipReader {
+  int fd;
+  z_stream stream;
+  unsigned char *input;
+  bool input_done;
+  bool stream_done;
+  bool failed;
+
+  GzipSlot slots[GZIP_SLOTS];
+  int consume_index;
+  bool holding; /* the caller still uses slots[consume_index] */
+
+  bool threaded;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  bool stop;
+};
+
+bool log_gzip_is_compressed(int fd) {
+  unsigned char magic[2];
+
+  return pread(fd, magic, sizeof(magic), 0) == (ssize_t)sizeof(magic) &&
+         magic[0] == 0x1f && magic[1] == 0x8b;
+}
+
+/* Fills out with up to capacity bytes; 0 means end of input or failure */
+static size_t inflate_block(LogGzipReader *reader, char *out,
+                            size_t capacity) {
+  z_stream *stream = &reader->stream;
+  ssize_t n;
+  int ret;
+
+  stream->next_out = (unsigned char *)out;
+  stream->avail_out = (uInt)capacity;
+
+  while (stream->avail_out > 0 && !reader->stream_done && !reader->failed) {
+    if (stream->avail_in == 0 && !reader->input_done) {
+      n = read(reader->fd, reader->input, GZIP_INPUT_SIZE);
+      if (n < 0) {
+        perror("Error reading compressed input");
+        reader->failed = true;
+        break;
+      }
+      if (n == 0) reader->input_done = true;
+      stream->next_in = reader->input;
+      stream->avail_in = (uInt)n;
+    }
+    if (stream->avail_in == 0 && reader->input_done) {
+      fprintf(stderr, "Compressed input is truncated\n");
+      reader->stream_done = true;
+      break;
+    }
+
+    ret = inflate(stream, Z_NO_FLUSH);
+    if (ret == Z_STREAM_END) {
+      /* Another member may follow, as with `cat a.gz b.gz` */
+      if (stream->avail_in > 0 || !reader->input_done) {
+        inflateReset(stream);
+        if (stream->avail_in == 0) {
+          n = read(reader->fd, reader->input, GZIP_INPUT_SIZE);
+          if (n <= 0) {
+            reader->stream_done = true;
+            break;
+          }
+          stream->next_in = reader->input;
+          stream->avail_in = (uInt)n;
+        }
+      } else {
+        reader->stream_done = true;
+      }
+    } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      fprintf(stderr, "Corrupt compressed input: %s\n",
+              stream->msg ? stream->msg : "inflate failed");
+      reader->failed = true;
+    }
+  }
+
+  return capacity - stream->avail_out;
+}
+
+static void *inflate_thread(void *arg) {
+  LogGzipReader *reader = (LogGzipReader *)arg;
+  GzipSlot *slot;
+  int index = 0;
+  size_t length;
+
+  do {
+    slot = &reader->slots[index];
+
+    pthread_mutex_lock(&reader->lock);
+    while (slot->full && !reader->stop)
+      pthread_cond_wait(&reader->changed, &reader->lock);
+    pthread_mutex_unlock(&reader->lock);
+    if (reader->stop) break;
+
+    length = inflate_block(reader, slot->data, GZIP_BLOCK_SIZE);
+
+    /* An empty full slot tells the reader the stream has ended */
+    pthread_mutex_lock(&reader->lock);
+    slot->length = length;
+    slot->full = true;
+    pthread_cond_broadcast(&reader->changed);
+    pthread_mutex_unlock(&reader->lock);
+
+    index = (index + 1) % GZIP_SLOTS;
+  } while (length > 0);
+
+  return NULL;
+}
+
+LogGzipReader *log_gzip_open(int fd, bool threaded) {
+  LogGzipReader *reader = (LogGzipReader *)calloc(1, sizeof(LogGzipReader));
+  int slot_count = threaded ? GZIP_SLOTS : 1;
+
+  if (!reader) return NULL;
+  reader->fd = fd;
+  reader->input = (unsigned char *)malloc(GZIP_INPUT_SIZE);
+  for (int i = 0; i < slot_count; i++)
+    reader->slots[i].data = (char *)malloc(GZIP_BLOCK_SIZE);
+
+  /* 15 + 32: a full window, with gzip or zlib headers detected */
+  if (!reader->input || !reader->slots[0].data ||
+      (threaded && !reader->slots[1].data) ||
+      inflateInit2(&reader->stream, 15 + 32) != Z_OK) {
+    free(reader->input);
+    for (int i = 0; i < GZIP_SLOTS; i++) free(reader->slots[i].data);
+    free(reader);
+    return NULL;
+  }
+
+  if (threaded) {
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->changed, NULL);
+    reader->threaded =
+        pthread_create(&reader->thread, NULL, inflate_thread, reader) == 0;
+    if (!reader->threaded) {
+      pthread_mutex_destroy(&reader->lock);
+      pthread_cond_destroy(&reader->changed);
+    }
+  }
+  return reader;
+}
+
+/*
+ * Returns the next decompressed block. The previous block is released,
+ * so views into it must not outlive this call.
+ */
+bool log_gzip_read_block(LogGzipReader *reader, const char **data,
+                         size_t *length) {
+  GzipSlot *slot;
+
+  if (!reader || !data || !length) return false;
+
+  if (!reader->threaded) {
+    slot = &reader->slots[0];
+    slot->length = inflate_block(reader, slot->data, GZIP_BLOCK_SIZE);
+    *data = slot->data;
+    *length = slot->length;
+    return slot->length > 0;
+  }
+
+  pthread_mutex_lock(&reader->lock);
+  if (reader->holding) {
+    reader->slots[reader->consume_index].full = false;
+    reader->consume_index = (reader->consume_index + 1) % GZIP_SLOTS;
+    pthread_cond_broadcast(&reader->changed);
+  }
+  slot = &reader->slots[reader->consume_index];
+  while (!slot->full) pthread_cond_wait(&reader->changed, &reader->lock);
+  reader->holding = slot->length > 0;
+  pthread_mutex_unlock(&reader->lock);
+
+  *data = slot->data;
+  *length = slot->length;
+  return slot->length > 0;
+}
+
+bool log_gzip_failed(const LogGzipReader *reader) {
+  return reader && reader->failed;
+}
+
+void log_gzip_close(LogGzipReader *reader) {
+  if (!reader) return;
+
+  if (reader->threaded) {
+    pthread_mutex_lock(&reader->lock);
+    reader->stop = true;
+    pthread_cond_broadcast(&reader->changed);
+    pthread_mutex_unlock(&reader->lock);
+    pthread_join(reader->thread, NULL);
+    pthread_mutex_destroy(&reader->lock);
+    pthread_cond_destroy(&reader->changed);
+  }
+
+  inflateEnd(&reader->stream);
+  free(reader->input);
+  for (int i = 0; i < GZIP_SLOTS; i++) free(reader->slots[i].data);
+  free(reader);
+}
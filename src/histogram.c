@@ -0,0 +1,297 @@
+#include "include/log_analyzer.h"
+
+#define HISTOGRAM_INITIAL_SLOTS 64
+#define BURST_RATE_FACTOR 10 /* times the mean rate of the whole run */
+#define BURST_MIN_COUNT 5    /* matches in a bucket before it can burst */
+
+/*
+ * Match counts per time bucket, keyed by bucket index (timestamp divided
+ * by the width). Only buckets with matches are stored, in an open
+ * addressing table where a zero count marks a free slot; key and count
+ * share a slot so a probe touches one cache line. When more than
+ * LOG_HISTOGRAM_MAX_BUCKETS are in use, the width doubles and neighbours
+ * are folded together, which bounds memory for any length of input.
+ */
+typedef struct {
+  int64_t key;
+  long count;
+} HistogramSlot;
+
+struct LogHistogram {
+  int width;
+  HistogramSlot *slots;
+  size_t slot_count;
+  size_t used;
+  size_t last_slot; /* consecutive matches usually share a bucket */
+};
+
+static int64_t floor_div(int64_t value, int64_t divisor) {
+  int64_t quotient = value / divisor;
+
+  return (value % divisor != 0 && value < 0) ? quotient - 1 : quotient;
+}
+
+/* First second of a bucket; keys come from bounded timestamps */
+static time_t bucket_start(const LogHistogram *histogram, int64_t key) {
+  int64_t start;
+
+  if (__builtin_mul_overflow(key, (int64_t)histogram->width, &start))
+    return key < 0 ? LOG_TIME_MIN : (time_t)LOG_TIME_MAX;
+  return (time_t)start;
+}
+
+/*
+ * Keys are used as is: log time mostly moves forward, so neighbouring
+ * buckets land in neighbouring slots and stay in cache.
+ */
+static size_t hash_key(int64_t key, size_t slot_count) {
+  return (size_t)((uint64_t)key & (slot_count - 1));
+}
+
+static HistogramSlot *find_slot(const LogHistogram *histogram, int64_t key) {
+  size_t index = hash_key(key, histogram->slot_count);
+
+  while (histogram->slots[index].count != 0 &&
+         histogram->slots[index].key != key)
+    index = (index + 1) & (histogram->slot_count - 1);
+  return &histogram->slots[index];
+}
+
+/* Re-inserts every bucket into slot_count slots, dividing keys by scale */
+static bool rehash(LogHistogram *histogram, size_t slot_count, int scale) {
+  HistogramSlot *old = histogram->slots, *slot;
+  size_t old_count = histogram->slot_count;
+  int64_t key;
+
+  histogram->slots = (HistogramSlot *)calloc(slot_count,
+                                             sizeof(HistogramSlot));
+  if (!histogram->slots) {
+    histogram->slots = old;
+    return false;
+  }
+
+  histogram->slot_count = slot_count;
+  histogram->used = 0;
+  histogram->last_slot = 0;
+  for (size_t i = 0; i < old_count; i++) {
+    if (old[i].count == 0) continue;
+    key = floor_div(old[i].key, scale);
+    slot = find_slot(histogram, key);
+    if (slot->count == 0) {
+      slot->key = key;
+      histogram->used++;
+    }
+    slot->count += old[i].count;
+  }
+
+  free(old);
+  return true;
+}
+
+LogHistogram *log_histogram_create(void) {
+  LogHistogram *histogram = (LogHistogram *)calloc(1, sizeof(LogHistogram));
+
+  if (!histogram) return NULL;
+  histogram->width = LOG_HISTOGRAM_WIDTH;
+  histogram->slot_count = HISTOGRAM_INITIAL_SLOTS;
+  histogram->slots = (HistogramSlot *)calloc(HISTOGRAM_INITIAL_SLOTS,
+                                             sizeof(HistogramSlot));
+  if (!histogram->slots) {
+    free(histogram);
+    return NULL;
+  }
+  return histogram;
+}
+
+bool log_histogram_add(LogHistogram *histogram, time_t timestamp,
+                       long count) {
+  HistogramSlot *slot;
+  int64_t key;
+
+  if (!histogram || count <= 0) return false;
+  /* Misread times, as a merged partial file may hold, are not counted */
+  if (timestamp < LOG_TIME_MIN || timestamp > LOG_TIME_MAX) return true;
+
+  key = floor_div((int64_t)timestamp, histogram->width);
+  slot = &histogram->slots[histogram->last_slot];
+  if (slot->count != 0 && slot->key == key) {
+    slot->count += count;
+    return true;
+  }
+
+  slot = find_slot(histogram, key);
+  if (slot->count == 0) {
+    /* Widen before the cap is passed, grow before half the slots fill */
+    if (histogram->used >= LOG_HISTOGRAM_MAX_BUCKETS) {
+      if (!rehash(histogram, histogram->slot_count, 2)) return false;
+      histogram->width *= 2;
+      return log_histogram_add(histogram, timestamp, count);
+    }
+    if ((histogram->used + 1) * 2 > histogram->slot_count) {
+      if (!rehash(histogram, histogram->slot_count * 2, 1)) return false;
+      slot = find_slot(histogram, key);
+    }
+    slot->key = key;
+    histogram->used++;
+  }
+
+  slot->count += count;
+  histogram->last_slot = (size_t)(slot - histogram->slots);
+  return true;
+}
+
+/* Adds a bucket saved at another width, widening to match if needed */
+bool log_histogram_add_bucket(LogHistogram *histogram, int width,
+                              time_t start, long count) {
+  int scale = width / LOG_HISTOGRAM_WIDTH;
+
+  /* Widths only ever double from LOG_HISTOGRAM_WIDTH */
+  if (!histogram || scale < 1 || width % LOG_HISTOGRAM_WIDTH != 0 ||
+      (scale & (scale - 1)) != 0)
+    return false;
+
+  while (histogram->width < width) {
+    if (!rehash(histogram, histogram->slot_count, 2)) return false;
+    histogram->width *= 2;
+  }
+  return log_histogram_add(histogram, start, count);
+}
+
+bool log_histogram_merge(LogHistogram *into, const LogHistogram *from) {
+  size_t cursor = 0;
+  time_t start;
+  long count;
+
+  if (!into || !from) return false;
+
+  while (log_histogram_next_bucket(from, &cursor, &start, &count)) {
+    if (!log_histogram_add_bucket(into, from->width, start, count))
+      return false;
+  }
+  return true;
+}
+
+int log_histogram_width(const LogHistogram *histogram) {
+  return histogram ? histogram->width : 0;
+}
+
+size_t log_histogram_bucket_count(const LogHistogram *histogram) {
+  return histogram ? histogram->used : 0;
+}
+
+/* Walks the buckets in no particular order; start cursor at 0 */
+bool log_histogram_next_bucket(const LogHistogram *histogram, size_t *cursor,
+                               time_t *start, long *count) {
+  if (!histogram || !cursor) return false;
+
+  for (; *cursor < histogram->slot_count; (*cursor)++) {
+    if (histogram->slots[*cursor].count == 0) continue;
+    *start = bucket_start(histogram, histogram->slots[*cursor].key);
+    *count = histogram->slots[*cursor].count;
+    (*cursor)++;
+    return true;
+  }
+  return false;
+}
+
+static int compare_buckets(const void *a, const void *b) {
+  const HistogramSlot *left = (const HistogramSlot *)a;
+  const HistogramSlot *right = (const HistogramSlot *)b;
+
+  return (left->key > right->key) - (left->key < right->key);
+}
+
+/* Keeps the largest bursts, most matches first */
+static void record_burst(LogRateSummary *summary, const LogBurst *burst) {
+  int i;
+
+  if (summary->burst_count == LOG_MAX_BURSTS &&
+      summary->bursts[LOG_MAX_BURSTS - 1].count >= burst->count)
+    return;
+  if (summary->burst_count < LOG_MAX_BURSTS) summary->burst_count++;
+
+  for (i = summary->burst_count - 1;
+       i > 0 && summary->bursts[i - 1].count < burst->count; i--)
+    summary->bursts[i] = summary->bursts[i - 1];
+  summary->bursts[i] = *burst;
+}
+
+/*
+ * Derives rates from the histogram. The mean is taken over range, the
+ * span of the whole run, so a pattern that only fires in one storm has a
+ * low mean and its storm stands out as a burst: consecutive buckets at
+ * BURST_RATE_FACTOR times the mean and at least BURST_MIN_COUNT matches.
+ */
+bool log_histogram_summarize(const LogHistogram *histogram,
+                             const LogTimeRange *range,
+                             LogRateSummary *summary) {
+  HistogramSlot *buckets;
+  LogBurst burst;
+  double span_minutes, threshold;
+  size_t count = 0;
+  long total = 0, peak = 0;
+  bool in_burst = false;
+
+  if (!histogram || !summary) return false;
+  memset(summary, 0, sizeof(LogRateSummary));
+  if (histogram->used == 0) return true;
+
+  buckets = (HistogramSlot *)malloc(histogram->used * sizeof(HistogramSlot));
+  if (!buckets) return false;
+  for (size_t i = 0; i < histogram->slot_count; i++) {
+    if (histogram->slots[i].count == 0) continue;
+    buckets[count++] = histogram->slots[i];
+    total += histogram->slots[i].count;
+  }
+  qsort(buckets, count, sizeof(HistogramSlot), compare_buckets);
+
+  /* In double: a range of misread timestamps may span all of time_t */
+  if (range && range->valid)
+    span_minutes = ((double)range->last - (double)range->first + 1) / 60.0;
+  else
+    span_minutes =
+        ((double)buckets[count - 1].key - (double)buckets[0].key + 1) *
+        histogram->width / 60.0;
+  if (span_minutes < 1.0) span_minutes = 1.0;
+
+  summary->bucket_width = histogram->width;
+  summary->mean_rate = (double)total / span_minutes;
+  threshold = BURST_RATE_FACTOR * summary->mean_rate * histogram->width / 60;
+  if (threshold < BURST_MIN_COUNT) threshold = BURST_MIN_COUNT;
+
+  memset(&burst, 0, sizeof(burst));
+  for (size_t i = 0; i < count; i++) {
+    if (buckets[i].count > peak) {
+      peak = buckets[i].count;
+      summary->peak_start = bucket_start(histogram, buckets[i].key);
+    }
+
+    if ((double)buckets[i].count < threshold) {
+      if (in_burst) record_burst(summary, &burst);
+      in_burst = false;
+      continue;
+    }
+    if (in_burst && buckets[i].key == buckets[i - 1].key + 1) {
+      burst.end += histogram->width;
+      burst.count += buckets[i].count;
+      continue;
+    }
+    if (in_burst) record_burst(summary, &burst);
+    burst.start = bucket_start(histogram, buckets[i].key);
+    burst.end = burst.start + histogram->width;
+    burst.count = buckets[i].count;
+    in_burst = true;
+  }
+  if (in_burst) record_burst(summary, &burst);
+
+  summary->peak_rate = (double)peak * 60.0 / histogram->width;
+  free(buckets);
+  return true;
+}
+
+void log_histogram_free(LogHistogram *histogram) {
+  if (!histogram) return;
+
+  free(histogram->slots);
+  free(histogram);
+}
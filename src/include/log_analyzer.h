@@ -4,21 +4,38 @@
 /* Contstants */
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
 #include <time.h>
 
 #define MAX_LINE_LENGTH 4096
-#define MAX_PATTERNS 100
-#define MAX_RECOMMENDATIONS 50
 #define MAX_PATH_LENGTH 256
 #define MAX_FORMAT_LENGTH 128
+#define MAX_THREADS 256
+#define LOG_ARENA_BLOCK_SIZE (64 * 1024)
+#define LOG_TIMESTAMP_KEY_LENGTH 32
+#define LOG_SEVERITY_LEVELS 8
+#define LOG_STRING_NONE (-1)
+#define DEFAULT_FOLLOW_INTERVAL 5 /* seconds between follow-mode reports */
+#define LOG_HISTOGRAM_WIDTH 60          /* seconds per bucket to start with */
+#define LOG_HISTOGRAM_MAX_BUCKETS 16384 /* past this, buckets widen */
+#define LOG_TIME_MIN 0                  /* earlier line times are misreads */
+#define LOG_TIME_MAX 253402300799LL     /* 9999-12-31 23:59:59 UTC */
+#define LOG_MAX_BURSTS 3
+#define LOG_TEMPLATE_CAPACITY 1024 /* message templates tracked at once */
+#define LOG_TEMPLATE_TOP 10        /* templates listed in the report */
+#define LOG_STATS_SAMPLE 64 /* --stats times one line in this many */
+#define LOG_PIPELINE_STAGES 3 /* --pipeline: read, parse, match */
+#define LOG_FORMAT_SAMPLE 100  /* lines read to detect an input's format */
 
 typedef struct {
   char *raw_text;
   char *message;
   time_t timestamp;
+  bool has_timestamp;
   char *source;
   int severity;
   char *thread_id;
@@ -27,12 +44,150 @@ typedef struct {
 
 } LogEntry;
 
+/* A line borrowed from the collector, valid until the next read */
+typedef struct {
+  const char *data;
+  size_t length;
+} LogLine;
+
+/* A newline-aligned slice of mapped input, consumed line by line */
+typedef struct {
+  const char *data;
+  size_t length;
+  size_t offset;
+} LogChunk;
+
+#define LOG_SPAN_NONE ((size_t)-1)
+
+/* Byte range of a field within its line; offset is LOG_SPAN_NONE if absent */
+typedef struct {
+  size_t offset;
+  size_t length;
+} LogSpan;
+
+/* Zero-copy parse result; spans index into the line it was parsed from */
+typedef struct {
+  const char *line;
+  size_t length;
+  time_t timestamp;
+  bool has_timestamp; /* false: timestamp is the cache's start time */
+  int severity;
+  LogSpan message;
+  LogSpan source;
+  LogSpan process_id;
+  LogSpan thread_id;
+  LogSpan fields; /* a structured format's remaining fields, verbatim */
+} LogRecord;
+
+/* The last date-and-time prefix seen and the epoch second it maps to */
+typedef struct {
+  char key[LOG_TIMESTAMP_KEY_LENGTH];
+  size_t key_length;
+  time_t key_epoch;
+  bool key_iso; /* fractional seconds and offset may follow the key */
+  int year;     /* assumed for syslog timestamps, which carry none */
+  time_t now;   /* returned for lines without a timestamp */
+} LogTimestampCache;
+
+/*
+ * A line format with a parser of its own. parse fills the whole record
+ * and returns false when the line is not in the format, in which case the
+ * generic heuristics read it. The generic entry's parse is NULL.
+ */
+typedef struct {
+  const char *name;
+  const char *description;
+  bool (*parse)(LogTimestampCache *cache, const char *line, size_t length,
+                LogRecord *record);
+} LogFormat;
+
+/* Earliest and latest line timestamps; valid once one has been seen */
+typedef struct {
+  time_t first;
+  time_t last;
+  bool valid;
+} LogTimeRange;
+
+typedef struct LogStringTable LogStringTable;
+
+/* A tab-separated table file (patterns, rules) read a line at a time */
+typedef struct {
+  const char *path;
+  FILE *fp;
+  char *line;
+  size_t capacity;
+  long number; /* of the line last read, for messages */
+} LogTableReader;
+
+/* Input files after directories and globs are expanded */
+typedef struct {
+  char **paths;
+  off_t *sizes; /* estimated text bytes, used to schedule large files first */
+  int count;
+  int capacity;
+} LogInputList;
+
+/*
+ * Parsed entries stored column by column. Message i is
+ * text[message_offsets[i], message_offsets[i + 1]); source and process
+ * ids index the interning tables, LOG_STRING_NONE when absent.
+ */
+typedef struct {
+  long count;
+  long capacity;
+  time_t *timestamps;
+  unsigned char *severities;
+  int *source_ids;
+  int *process_ids;
+  size_t *message_offsets;
+  char *text;
+  size_t text_capacity;
+  LogStringTable *source_table;
+  LogStringTable *process_id_table;
+} LogColumns;
+
+typedef struct LogCollector LogCollector;
+typedef struct LogGzipReader LogGzipReader;
+typedef struct LogArena LogArena;
+typedef struct LogHistogram LogHistogram;
+typedef struct LogTemplateMiner LogTemplateMiner;
+
+/* A recurring message shape; variable tokens read <*> */
+typedef struct {
+  const char *text; /* owned by the miner */
+  long count;
+  long error; /* count may be over by up to this much */
+} LogTemplate;
+
+/* A run of consecutive histogram buckets well above the mean rate */
+typedef struct {
+  time_t start;
+  time_t end; /* exclusive */
+  long count;
+} LogBurst;
+
+/* Rates derived from a pattern's histogram once the input is read */
+typedef struct {
+  int bucket_width;  /* seconds; 0 if no match carried a timestamp */
+  double mean_rate;  /* matches per minute over the run's time range */
+  double peak_rate;  /* matches per minute in the busiest bucket */
+  time_t peak_start;
+  int burst_count;
+  LogBurst bursts[LOG_MAX_BURSTS]; /* most matches first */
+} LogRateSummary;
+
 typedef struct {
   char *pattern;
-  int frequency;
+  int id; /* position in the table as loaded; ranking keeps it */
+  long frequency;
   int severity;
   char *description;
   char *category;
+  long prefilter_hits; /* lines that passed the literal screen, -1 if none */
+  long prefilter_confirmed;
+  LogHistogram *histogram; /* timestamped matches, NULL until the first */
+  LogRateSummary rate;     /* filled in by pattern_detector_finalize() */
+  double match_ns; /* regexec() ns per timed scan; -1 if automaton-run */
 } Pattern;
 
 typedef struct {
@@ -44,15 +199,136 @@ typedef struct {
   float confidence;
 } Recommendation;
 
+/* One non-zero word of a bitset over pattern IDs */
+typedef struct {
+  int word;
+  uint64_t bits;
+} RuleMask;
+
+/*
+ * Fires when any of its patterns matched, together at least min_matches
+ * times, and one of them peaked at min_rate matches a minute or more.
+ */
+typedef struct {
+  char *title;
+  char *description;
+  char *action;
+  char *category;
+  int priority;
+  float confidence;
+  long min_matches;
+  double min_rate; /* 0 for no rate condition */
+  RuleMask *masks;
+  int mask_count;
+} RecommendationRule;
+
+/* Compiled form of the pattern table, built once per analysis run */
+typedef struct PatternSet PatternSet;
+
+/* Where timed pattern set scans spent their time, summed over scans */
+typedef struct {
+  long scans;
+  double prefilter_ns; /* the literal screen */
+  double automaton_ns; /* one pass for every pattern the automaton runs */
+  double regex_ns;     /* patterns left to regexec(), together */
+} LogMatchProfile;
+
+typedef enum {
+  LOG_STAGE_SETUP, /* opening the input and compiling the patterns */
+  LOG_STAGE_RESUME,
+  LOG_STAGE_DETECT, /* reading, parsing, matching and mining, interleaved */
+  LOG_STAGE_SAVE,   /* checkpoint and partial result */
+  LOG_STAGE_FINALIZE,
+  LOG_STAGE_RECOMMEND,
+  LOG_STAGE_REPORT,
+  LOG_STAGE_COUNT
+} LogStage;
+
+/* Per-line costs, summed over the lines that were timed */
+typedef struct {
+  long lines;
+  double read_ns;
+  double parse_ns;
+  double match_ns;
+  double mine_ns;
+} LogLineSample;
+
+/* A queue between two --pipeline stages; depth is sampled at each push */
+typedef struct {
+  long batches;
+  long depth_sum;
+  int max_depth;
+  long full_waits;  /* pushes that found it full: the consumer is behind */
+  long empty_waits; /* pops that found it empty: the producer is behind */
+} LogQueueStats;
+
+/*
+ * Counters for --stats. Stages are timed whole. Inside detection one
+ * line in LOG_STATS_SAMPLE is timed step by step and another has its
+ * pattern scan timed phase by phase, which keeps the clock out of the
+ * per-line path.
+ */
+typedef struct {
+  double created;
+  double stage_ns[LOG_STAGE_COUNT];
+  int stage; /* running now, LOG_STAGE_COUNT if none */
+  double stage_start;
+  long bytes_read;
+  long lines_read;
+  long lines_dropped; /* read but yielding no entry */
+  long oversized_lines; /* longer than MAX_LINE_LENGTH */
+  LogLineSample sample;
+  bool sampling;  /* the line being processed is timed step by step */
+  bool profiling; /* its pattern scan is timed instead */
+  double mark;    /* clock after the timed line's last step */
+  LogMatchProfile match;
+  bool pipelined; /* --pipeline ran; no line is timed step by step */
+  int queue_capacity;
+  LogQueueStats queues[LOG_PIPELINE_STAGES - 1]; /* into parse, match */
+  double wait_ns[LOG_PIPELINE_STAGES]; /* each stage held up by a queue */
+} LogStats;
+
 typedef struct {
-  char input_path[MAX_PATH_LENGTH];
+  char input_path[MAX_PATH_LENGTH]; /* the input when there is only one */
+  LogInputList inputs;
   char output_path[MAX_PATH_LENGTH];
-  char log_format[MAX_FORMAT_LENGTH];
+  char log_format[MAX_FORMAT_LENGTH]; /* -f name, empty or "auto" */
+  const LogFormat *format; /* named or sampled; NULL until known */
+  bool format_detected;    /* sampled; NULL format then means mixed */
   int verbose;
-  Pattern patterns[MAX_PATTERNS];
+  int thread_count;
+  bool follow;
+  int follow_interval;
+  bool pipeline; /* read, parse and match a single input on three threads */
+  char checkpoint_path[MAX_PATH_LENGTH]; /* --resume state, empty if none */
+  char partial_path[MAX_PATH_LENGTH];    /* --partial output, empty if none */
+  bool merge;       /* inputs are partial results, not logs */
+  long part_count;  /* runs folded in by merge, 0 for a direct run */
+  LogCollector *collector;
+  LogArena *entry_arena; /* owns every LogEntry and its strings */
+  LogTimestampCache timestamp_cache;
+  char patterns_path[MAX_PATH_LENGTH]; /* --patterns file, empty if none */
+  Pattern *patterns;
   int pattern_count;
-  Recommendation recommendations[MAX_RECOMMENDATIONS];
+  int pattern_capacity;
+  PatternSet *pattern_set;
+  int *match_buffer;
+  LogTemplateMiner *template_miner; /* every message, pattern or not */
+  LogStats *stats;                  /* NULL unless --stats was given */
+  long entry_count;
+  long line_count;
+  LogTimeRange time_range;
+  char rules_path[MAX_PATH_LENGTH]; /* --rules file, empty if none */
+  RecommendationRule *rules;
+  int rule_count;
+  int rule_capacity;
+  Recommendation *recommendations;
   int recommendation_count;
+  int recommendation_capacity;
+  char *feed_buffer; /* a partial line held by log_analyzer_feed() */
+  size_t feed_length;
+  size_t feed_capacity;
+  long feed_lines; /* complete lines held while the format is sampled */
 
 } LogAnalyzerContext;
 
@@ -61,20 +337,192 @@ LogAnalyzerContext *log_analyzer_init(const char *input_path,
                                       const char *format);
 void log_analyzer_cleanup(LogAnalyzerContext *ctx);
 
+/* Embedding: begin, feed text as it arrives, finish, then read results */
+bool log_analyzer_begin(LogAnalyzerContext *ctx);
+bool log_analyzer_feed(LogAnalyzerContext *ctx, const char *data,
+                       size_t length);
+bool log_analyzer_finish(LogAnalyzerContext *ctx);
+
 bool log_collector_open_file(LogAnalyzerContext *ctx);
+bool log_collector_next_line(LogAnalyzerContext *ctx, LogLine *line);
+bool log_collector_peek(LogAnalyzerContext *ctx, const char **data,
+                        size_t *length);
+bool log_collector_failed(const LogAnalyzerContext *ctx);
+int log_collector_split(LogAnalyzerContext *ctx, LogChunk *chunks,
+                        int max_chunks);
+bool log_chunk_next_line(LogChunk *chunk, LogLine *line);
 bool log_collector_read_line(LogAnalyzerContext *ctx, char *buffer,
                              size_t buffer_size);
 void log_collector_close_file(LogAnalyzerContext *ctx);
+off_t log_collector_offset(LogAnalyzerContext *ctx);
+bool log_collector_seek(LogAnalyzerContext *ctx, off_t offset);
+bool log_collector_watch(LogAnalyzerContext *ctx);
+int log_collector_wait(LogAnalyzerContext *ctx, int timeout_ms);
+bool log_collector_check_rotation(LogAnalyzerContext *ctx);
+
+bool log_gzip_is_compressed(int fd);
+LogGzipReader *log_gzip_open(int fd, bool threaded);
+bool log_gzip_read_block(LogGzipReader *reader, const char **data,
+                         size_t *length);
+bool log_gzip_failed(const LogGzipReader *reader);
+void log_gzip_close(LogGzipReader *reader);
+
+bool log_inputs_add(LogInputList *inputs, const char *argument);
+void log_inputs_sort_by_size(LogInputList *inputs);
+void log_inputs_free(LogInputList *inputs);
+
+bool log_follower_run(LogAnalyzerContext *ctx);
+bool log_pipeline_run(LogAnalyzerContext *ctx);
+
+bool log_partial_save(const LogAnalyzerContext *ctx, const char *path);
+bool log_partial_merge(LogAnalyzerContext *ctx, const char *path);
+
+LogStats *log_stats_create(void);
+double log_stats_now(void);
+double log_stats_lap(double *mark);
+void log_stats_enter(LogStats *stats, LogStage stage);
+void log_stats_add_sample(LogLineSample *into, const LogLineSample *from);
+bool log_stats_write(const LogAnalyzerContext *ctx, FILE *fp);
+void log_stats_free(LogStats *stats);
+long log_allocation_count(void);
+
+bool log_table_open(LogTableReader *reader, const char *path);
+bool log_table_next(LogTableReader *reader, char **fields, int field_count,
+                    bool *complete);
+bool log_table_close(LogTableReader *reader);
+bool log_patterns_load(LogAnalyzerContext *ctx, const char *path);
+bool log_rules_load(LogAnalyzerContext *ctx, const char *path);
+
+bool log_checkpoint_resume(LogAnalyzerContext *ctx);
+bool log_checkpoint_save(LogAnalyzerContext *ctx);
 
 LogEntry *log_parser_parse_line(LogAnalyzerContext *ctx, const char *line);
+bool log_parser_parse_record(LogAnalyzerContext *ctx, const char *line,
+                             size_t length, LogRecord *record);
+bool log_parser_parse_record_with_cache(const LogAnalyzerContext *ctx,
+                                        LogTimestampCache *cache,
+                                        const char *line, size_t length,
+                                        LogRecord *record);
+bool log_parser_parse_record_as(const LogFormat *format,
+                                LogTimestampCache *cache, const char *line,
+                                size_t length, LogRecord *record);
+int log_parser_classify_severity(const char *line, size_t length);
+int log_parser_level_severity(const char *level, size_t length);
 void log_parser_free_entry(LogEntry *entry);
+void log_parser_reset(LogAnalyzerContext *ctx);
+
+const LogFormat *log_format_find(const char *name);
+bool log_format_select(LogAnalyzerContext *ctx);
+const LogFormat *log_format_detect(const char *data, size_t length);
+void log_format_detect_input(LogAnalyzerContext *ctx);
+const char *log_format_describe(const LogAnalyzerContext *ctx, char *buffer,
+                                size_t size);
+void log_format_print_names(FILE *fp);
 
+void log_timestamp_cache_init(LogTimestampCache *cache);
+time_t log_timestamp_parse(LogTimestampCache *cache, const char *text,
+                           size_t length);
+bool log_timestamp_find(LogTimestampCache *cache, const char *text,
+                        size_t length, time_t *timestamp);
+void log_time_range_add(LogTimeRange *range, time_t timestamp);
+void log_time_range_merge(LogTimeRange *into, const LogTimeRange *from);
+
+LogHistogram *log_histogram_create(void);
+bool log_histogram_add(LogHistogram *histogram, time_t timestamp, long count);
+bool log_histogram_add_bucket(LogHistogram *histogram, int width,
+                              time_t start, long count);
+bool log_histogram_merge(LogHistogram *into, const LogHistogram *from);
+int log_histogram_width(const LogHistogram *histogram);
+size_t log_histogram_bucket_count(const LogHistogram *histogram);
+bool log_histogram_next_bucket(const LogHistogram *histogram, size_t *cursor,
+                               time_t *start, long *count);
+bool log_histogram_summarize(const LogHistogram *histogram,
+                             const LogTimeRange *range,
+                             LogRateSummary *summary);
+void log_histogram_free(LogHistogram *histogram);
+
+LogTemplateMiner *log_template_miner_create(int capacity);
+bool log_template_add(LogTemplateMiner *miner, const char *message,
+                      size_t length);
+bool log_template_add_counted(LogTemplateMiner *miner, const char *message,
+                              size_t length, long count, long error);
+bool log_template_merge(LogTemplateMiner *into, const LogTemplateMiner *from);
+int log_template_count(const LogTemplateMiner *miner);
+bool log_template_next(const LogTemplateMiner *miner, int *cursor,
+                       LogTemplate *out);
+int log_template_top(const LogTemplateMiner *miner, LogTemplate *out,
+                     int max);
+void log_template_miner_free(LogTemplateMiner *miner);
+
+LogStringTable *log_string_table_create(void);
+int log_string_table_intern(LogStringTable *table, const char *data,
+                            size_t length);
+const char *log_string_table_get(const LogStringTable *table, int id);
+int log_string_table_count(const LogStringTable *table);
+void log_string_table_free(LogStringTable *table);
+
+LogColumns *log_columns_create(void);
+bool log_columns_append(LogColumns *columns, const LogRecord *record);
+const char *log_columns_message(const LogColumns *columns, long row,
+                                size_t *length);
+void log_columns_count_severities(const LogColumns *columns,
+                                  long counts[LOG_SEVERITY_LEVELS]);
+void log_columns_count_by_source(const LogColumns *columns, long *counts);
+void log_columns_free(LogColumns *columns);
+
+LogArena *log_arena_create(size_t block_size);
+void *log_arena_alloc(LogArena *arena, size_t size);
+char *log_arena_strndup(LogArena *arena, const char *str, size_t length);
+void log_arena_reset(LogArena *arena);
+void log_arena_stats(const LogArena *arena, long *allocations,
+                     long *block_allocations);
+void log_arena_destroy(LogArena *arena);
+
+bool pattern_detector_add(LogAnalyzerContext *ctx, const char *pattern,
+                          const char *description, const char *category,
+                          int severity);
+
+/* Incremental detection: begin, process each entry, then finalize */
+bool pattern_detector_begin(LogAnalyzerContext *ctx);
+bool pattern_detector_process(LogAnalyzerContext *ctx, const LogEntry *entry);
+bool pattern_detector_process_record(LogAnalyzerContext *ctx,
+                                     const LogRecord *record);
+bool pattern_detector_process_input(LogAnalyzerContext *ctx);
+bool pattern_detector_summarize_rates(LogAnalyzerContext *ctx);
+bool pattern_detector_finalize(LogAnalyzerContext *ctx);
+void pattern_detector_rank(Pattern *patterns, int pattern_count);
+uint64_t pattern_detector_hash(const LogAnalyzerContext *ctx);
 bool pattern_detector_analyze(LogAnalyzerContext *ctx, LogEntry **entries,
                               int entry_count);
 Pattern *pattern_detector_get_patterns(LogAnalyzerContext *ctx,
                                        int *pattern_count);
 
+PatternSet *pattern_set_compile(const Pattern *patterns, int pattern_count);
+PatternSet *pattern_set_clone(const PatternSet *set, const Pattern *patterns);
+bool pattern_set_save(const PatternSet *set, uint64_t key, const char *path);
+PatternSet *pattern_set_load(const char *path, uint64_t key,
+                             const Pattern *patterns, int pattern_count);
+int pattern_set_scan(PatternSet *set, const char *string, size_t length,
+                     int *matches, int max_matches);
+int pattern_set_scan_timed(PatternSet *set, const char *string,
+                           size_t length, int *matches, int max_matches);
+void pattern_set_profile(const PatternSet *set, LogMatchProfile *profile);
+double pattern_set_pattern_ns(const PatternSet *set, int index);
+void pattern_set_merge_stats(PatternSet *into, const PatternSet *from);
+bool pattern_set_compiled(const PatternSet *set, int index);
+bool pattern_set_prefilter_stats(const PatternSet *set, int index, long *hits,
+                                 long *confirmed);
+size_t pattern_set_screen_length(const PatternSet *set);
+void pattern_set_free(PatternSet *set);
+
+bool recommendation_rule_resolve(const LogAnalyzerContext *ctx,
+                                 const char *patterns, uint64_t *bits);
+bool recommendation_rule_add(LogAnalyzerContext *ctx,
+                             const RecommendationRule *rule,
+                             const uint64_t *bits);
+bool recommendation_generator_begin(LogAnalyzerContext *ctx);
 bool recommendation_generator_analyze(LogAnalyzerContext *ctx);
+void recommendation_generator_clear(LogAnalyzerContext *ctx);
 Recommendation *recommendation_generator_get_recommendations(
     LogAnalyzerContext *ctx, int *recommendation_count);
 
@@ -26,6 +26,9 @@ LogAnalyzerContext *log_analyzer_init(const char *input_path,
   }
 
   ctx->verbose = 0;
+  ctx->thread_count = 1;
+  ctx->follow = false;
+  ctx->follow_interval = DEFAULT_FOLLOW_INTERVAL;
   ctx->pattern_count = 0;
   ctx->recommendation_count = 0;
 
@@ -35,29 +38,50 @@ LogAnalyzerContext *log_analyzer_init(const char *input_path,
 void log_analyzer_cleanup(LogAnalyzerContext *ctx) {
   if (!ctx) return;
 
+  log_collector_close_file(ctx);
+  log_arena_destroy(ctx->entry_arena);
+  log_inputs_free(&ctx->inputs);
+
   /* Memory for patterns */
   for (int i = 0; i < ctx->pattern_count; i++) {
     free(ctx->patterns[i].pattern);
     free(ctx->patterns[i].description);
     free(ctx->patterns[i].category);
+    log_histogram_free(ctx->patterns[i].histogram);
   }
+  free(ctx->patterns);
+  pattern_set_free(ctx->pattern_set);
+  free(ctx->match_buffer);
+  log_template_miner_free(ctx->template_miner);
+  log_stats_free(ctx->stats);
 
-  /* For memory for recommendations */
-  for (int i = 0; i < ctx->recommendation_count; i++) {
-    free(ctx->recommendations[i].title);
-    free(ctx->recommendations[i].description);
-    free(ctx->recommendations[i].action);
-    free(ctx->recommendations[i].category);
+  for (int i = 0; i < ctx->rule_count; i++) {
+    free(ctx->rules[i].title);
+    free(ctx->rules[i].description);
+    free(ctx->rules[i].action);
+    free(ctx->rules[i].category);
+    free(ctx->rules[i].masks);
   }
+  free(ctx->rules);
+  recommendation_generator_clear(ctx);
+  free(ctx->feed_buffer);
 
   free(ctx);
 }
 
 bool cli_parse_arguments(int argc, char **argv, LogAnalyzerContext *ctx) {
+  int first = 1;
+
   if (argc < 2) return false;
 
+  /* `merge` takes partial results in place of log files */
+  if (strcmp(argv[1], "merge") == 0) {
+    ctx->merge = true;
+    first = 2;
+  }
+
   /* Parse Command-line args */
-  for (int i = 0; i < argc; i++) {
+  for (int i = first; i < argc; i++) {
     if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
       strncpy(ctx->input_path, "--help", MAX_PATH_LENGTH - 1);
       return true;
@@ -75,26 +99,128 @@ bool cli_parse_arguments(int argc, char **argv, LogAnalyzerContext *ctx) {
     } else if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--format") == 0) {
       if (i + 1 < argc) {
         strncpy(ctx->log_format, argv[i + 1], MAX_FORMAT_LENGTH - 1);
+        if (!log_format_select(ctx)) return false;
+        i++;
+      } else {
+        fprintf(stderr, "Missing arguments for %s\n", argv[i]);
+        return false;
+      }
+    } else if (strcmp(argv[i], "-t") == 0 ||
+               strcmp(argv[i], "--threads") == 0) {
+      if (i + 1 < argc) {
+        ctx->thread_count = atoi(argv[i + 1]);
+        if (ctx->thread_count < 1 || ctx->thread_count > MAX_THREADS) {
+          fprintf(stderr, "Thread count must be between 1 and %d\n",
+                  MAX_THREADS);
+          return false;
+        }
+        i++;
+      } else {
+        fprintf(stderr, "Missing arguments for %s\n", argv[i]);
+        return false;
+      }
+    } else if (strcmp(argv[i], "-F") == 0 ||
+               strcmp(argv[i], "--follow") == 0) {
+      ctx->follow = true;
+    } else if (strcmp(argv[i], "--pipeline") == 0) {
+      ctx->pipeline = true;
+    } else if (strcmp(argv[i], "--interval") == 0) {
+      if (i + 1 < argc) {
+        ctx->follow_interval = atoi(argv[i + 1]);
+        if (ctx->follow_interval < 1) {
+          fprintf(stderr, "Report interval must be at least 1 second\n");
+          return false;
+        }
+        i++;
+      } else {
+        fprintf(stderr, "Missing arguments for %s\n", argv[i]);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--partial") == 0) {
+      if (i + 1 < argc) {
+        strncpy(ctx->partial_path, argv[i + 1], MAX_PATH_LENGTH - 1);
+        i++;
+      } else {
+        fprintf(stderr, "Missing arguments for %s\n", argv[i]);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--resume") == 0) {
+      if (i + 1 < argc) {
+        strncpy(ctx->checkpoint_path, argv[i + 1], MAX_PATH_LENGTH - 1);
         i++;
       } else {
         fprintf(stderr, "Missing arguments for %s\n", argv[i]);
         return false;
       }
+    } else if (strcmp(argv[i], "--patterns") == 0) {
+      if (i + 1 < argc) {
+        strncpy(ctx->patterns_path, argv[i + 1], MAX_PATH_LENGTH - 1);
+        i++;
+      } else {
+        fprintf(stderr, "Missing arguments for %s\n", argv[i]);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--rules") == 0) {
+      if (i + 1 < argc) {
+        strncpy(ctx->rules_path, argv[i + 1], MAX_PATH_LENGTH - 1);
+        i++;
+      } else {
+        fprintf(stderr, "Missing arguments for %s\n", argv[i]);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      if (!ctx->stats) ctx->stats = log_stats_create();
+      if (!ctx->stats) return false;
     } else if (strcmp(argv[i], "-v") == 0 ||
                strcmp(argv[i], "--verbose") == 0) {
       ctx->verbose++;
-    } else if (argv[i][0] == '-') {
+    } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
       fprintf(stderr, "Unknown option: %s\n", argv[i]);
       return false;
-    } else {
-      strncpy(ctx->input_path, argv[i], MAX_PATH_LENGTH - 1);
+    } else if (!log_inputs_add(&ctx->inputs, argv[i])) {
+      return false;
     }
   }
 
   /* Check if input file was specified */
-  if (strlen(ctx->input_path) == 0) {
+  if (ctx->inputs.count == 0) {
     fprintf(stderr, "No input file specified\n");
     return false;
   }
+  if (ctx->merge) {
+    if (ctx->follow || strlen(ctx->checkpoint_path) > 0) {
+      fprintf(stderr, "merge does not take --follow or --resume\n");
+      return false;
+    }
+    strncpy(ctx->input_path, ctx->inputs.paths[0], MAX_PATH_LENGTH - 1);
+  } else if (ctx->inputs.count == 1) {
+    strncpy(ctx->input_path, ctx->inputs.paths[0], MAX_PATH_LENGTH - 1);
+  } else {
+    for (int i = 0; i < ctx->inputs.count; i++) {
+      if (strcmp(ctx->inputs.paths[i], "-") == 0) {
+        fprintf(stderr, "stdin cannot be combined with other inputs\n");
+        return false;
+      }
+    }
+    if (ctx->follow || strlen(ctx->checkpoint_path) > 0) {
+      fprintf(stderr, "--follow and --resume take a single input file\n");
+      return false;
+    }
+    log_inputs_sort_by_size(&ctx->inputs);
+  }
+  if (ctx->pipeline &&
+      (ctx->merge || ctx->follow || ctx->inputs.count > 1)) {
+    fprintf(stderr, "--pipeline takes a single input and no --follow\n");
+    return false;
+  }
+  if (ctx->stats && ctx->follow) {
+    fprintf(stderr, "--stats does not apply to --follow\n");
+    return false;
+  }
+  if (strlen(ctx->checkpoint_path) > 0 &&
+      (strcmp(ctx->input_path, "-") == 0 || ctx->follow)) {
+    fprintf(stderr, "--resume needs a named input file and no --follow\n");
+    return false;
+  }
   return true;
 }
@@ -0,0 +1,147 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "include/log_analyzer.h"
+
+/* Typical ratio for text logs; only used to order work, never to size it */
+#define GZIP_SIZE_FACTOR 4
+
+static bool append_path(LogInputList *inputs, const char *path, off_t size) {
+  char **paths;
+  off_t *sizes;
+  int capacity;
+
+  if (strlen(path) >= MAX_PATH_LENGTH) {
+    fprintf(stderr, "Input path is too long: %s\n", path);
+    return false;
+  }
+
+  if (inputs->count == inputs->capacity) {
+    capacity = inputs->capacity ? inputs->capacity * 2 : 16;
+    paths = (char **)realloc(inputs->paths, capacity * sizeof(char *));
+    if (!paths) return false;
+    inputs->paths = paths;
+    sizes = (off_t *)realloc(inputs->sizes, capacity * sizeof(off_t));
+    if (!sizes) return false;
+    inputs->sizes = sizes;
+    inputs->capacity = capacity;
+  }
+
+  inputs->paths[inputs->count] = strdup(path);
+  if (!inputs->paths[inputs->count]) return false;
+  inputs->sizes[inputs->count] = size;
+  inputs->count++;
+  return true;
+}
+
+/* Estimated bytes of text in a regular file, scaling compressed ones up */
+static off_t estimate_size(const char *path, const struct stat *st) {
+  int fd = open(path, O_RDONLY);
+  bool compressed;
+
+  if (fd < 0) return st->st_size;
+  compressed = log_gzip_is_compressed(fd);
+  close(fd);
+  return compressed ? st->st_size * GZIP_SIZE_FACTOR : st->st_size;
+}
+
+static int skip_hidden(const struct dirent *entry) {
+  return entry->d_name[0] != '.';
+}
+
+/* Adds the regular files directly inside a directory, in name order */
+static bool add_directory(LogInputList *inputs, const char *directory) {
+  char path[MAX_PATH_LENGTH];
+  struct dirent **entries;
+  struct stat st;
+  bool success = true;
+  int count;
+
+  count = scandir(directory, &entries, skip_hidden, alphasort);
+  if (count < 0) {
+    perror(directory);
+    return false;
+  }
+
+  for (int i = 0; i < count; i++) {
+    if (success &&
+        snprintf(path, sizeof(path), "%s/%s", directory,
+                 entries[i]->d_name) < (int)sizeof(path) &&
+        stat(path, &st) == 0 && S_ISREG(st.st_mode))
+      success = append_path(inputs, path, estimate_size(path, &st));
+    free(entries[i]);
+  }
+  free(entries);
+  return success;
+}
+
+static bool add_path(LogInputList *inputs, const char *path) {
+  struct stat st;
+
+  if (strcmp(path, "-") == 0) return append_path(inputs, path, 0);
+
+  if (stat(path, &st) != 0) {
+    perror(path);
+    return false;
+  }
+  if (S_ISDIR(st.st_mode)) return add_directory(inputs, path);
+  return append_path(inputs, path,
+                     S_ISREG(st.st_mode) ? estimate_size(path, &st) : 0);
+}
+
+/*
+ * Adds a command-line input: a file, a directory (its regular files) or
+ * a quoted glob that the shell left alone.
+ */
+bool log_inputs_add(LogInputList *inputs, const char *argument) {
+  struct stat st;
+  glob_t matches;
+  bool success = true;
+
+  if (!inputs || !argument) return false;
+
+  if (strpbrk(argument, "*?[") == NULL || stat(argument, &st) == 0)
+    return add_path(inputs, argument);
+
+  if (glob(argument, 0, NULL, &matches) != 0) {
+    fprintf(stderr, "No input matches %s\n", argument);
+    return false;
+  }
+  for (size_t i = 0; i < matches.gl_pathc && success; i++)
+    success = add_path(inputs, matches.gl_pathv[i]);
+  globfree(&matches);
+  return success;
+}
+
+/* Largest first, so a big file is never the one left running alone */
+void log_inputs_sort_by_size(LogInputList *inputs) {
+  char *path;
+  off_t size;
+  int j;
+
+  if (!inputs) return;
+
+  /* Insertion sort keeps equal sizes in command-line order */
+  for (int i = 1; i < inputs->count; i++) {
+    path = inputs->paths[i];
+    size = inputs->sizes[i];
+    for (j = i; j > 0 && inputs->sizes[j - 1] < size; j--) {
+      inputs->paths[j] = inputs->paths[j - 1];
+      inputs->sizes[j] = inputs->sizes[j - 1];
+    }
+    inputs->paths[j] = path;
+    inputs->sizes[j] = size;
+  }
+}
+
+void log_inputs_free(LogInputList *inputs) {
+  if (!inputs) return;
+
+  for (int i = 0; i < inputs->count; i++) free(inputs->paths[i]);
+  free(inputs->paths);
+  free(inputs->sizes);
+  memset(inputs, 0, sizeof(LogInputList));
+}
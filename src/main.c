@@ -4,13 +4,9 @@
 #include "include/log_analyzer.h"
 
 #define VERSION "0.1.0"
-#define MAX_ENTRIES 10000
 
 int main(int argc, char **argv) {
   LogAnalyzerContext *ctx;
-  char line_buffer[MAX_LINE_LENGTH];
-  LogEntry **entries;
-  int entry_count = 0;
   bool success;
 
   /*Intialize the context with default values*/
@@ -36,61 +32,99 @@ int main(int argc, char **argv) {
     return EXIT_SUCCESS;
   }
 
-  if (!log_collector_open_file(ctx)) {
+  /* Several inputs are opened one by one by the detector's workers */
+  log_stats_enter(ctx->stats, LOG_STAGE_SETUP);
+  if (!ctx->merge && ctx->inputs.count == 1 &&
+      !log_collector_open_file(ctx)) {
     fprintf(stderr, "Failed to open input file: %s\n", ctx->input_path);
     log_analyzer_cleanup(ctx);
     return EXIT_FAILURE;
   }
 
-  entries = (LogEntry **)malloc(MAX_ENTRIES * sizeof(LogEntry *));
-  if (!entries) {
-    fprintf(stderr, "Failed to allocate memory for long entries\n");
+  if (!pattern_detector_begin(ctx)) {
+    fprintf(stderr, "Failed to initialize pattern detection\n");
     log_collector_close_file(ctx);
     log_analyzer_cleanup(ctx);
     return EXIT_FAILURE;
   }
 
-  printf("Reading log entries...\n");
-  while (log_collector_read_line(ctx, line_buffer, MAX_LINE_LENGTH) &&
-         entry_count < MAX_ENTRIES) {
-    entries[entry_count] = log_parser_parse_line(ctx, line_buffer);
-    if (entries[entry_count]) entry_count++;
+  /* Rules name patterns, so they are checked before any input is read */
+  if (!recommendation_generator_begin(ctx)) {
+    fprintf(stderr, "Failed to load recommendation rules\n");
+    log_collector_close_file(ctx);
+    log_analyzer_cleanup(ctx);
+    return EXIT_FAILURE;
+  }
+
+  if (ctx->follow) {
+    success = log_follower_run(ctx);
+    log_analyzer_cleanup(ctx);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  if (ctx->merge) {
+    /* Partial results stand in for the logs; no line is read again */
+    printf("Merging partial results...\n");
+    log_stats_enter(ctx->stats, LOG_STAGE_DETECT);
+    success = true;
+    for (int i = 0; i < ctx->inputs.count && success; i++)
+      success = log_partial_merge(ctx, ctx->inputs.paths[i]);
+    printf("Merged %ld runs with %ld log entries\n", ctx->part_count,
+           ctx->entry_count);
+  } else {
+    /* Without a usable checkpoint this is simply a full run */
+    log_stats_enter(ctx->stats, LOG_STAGE_RESUME);
+    if (strlen(ctx->checkpoint_path) > 0) log_checkpoint_resume(ctx);
+
+    printf("Reading log entries...\n");
+    log_stats_enter(ctx->stats, LOG_STAGE_DETECT);
+    success = pattern_detector_process_input(ctx);
+    printf("Read %ld log entries\n", ctx->entry_count);
+
+    log_stats_enter(ctx->stats, LOG_STAGE_SAVE);
+    if (success && strlen(ctx->checkpoint_path) > 0 &&
+        !log_checkpoint_save(ctx))
+      fprintf(stderr, "Failed to save checkpoint %s\n",
+              ctx->checkpoint_path);
   }
-  printf("Read %d log entries\n", entry_count);
+
+  if (success && strlen(ctx->partial_path) > 0 &&
+      !log_partial_save(ctx, ctx->partial_path))
+    fprintf(stderr, "Failed to save partial result %s\n", ctx->partial_path);
 
   log_collector_close_file(ctx);
 
   /* Patterns */
   printf("Analyzing Patterns...\n");
-  success = pattern_detector_analyze(ctx, entries, entry_count);
+  log_stats_enter(ctx->stats, LOG_STAGE_FINALIZE);
+  success = success && ctx->entry_count > 0 && pattern_detector_finalize(ctx);
   if (!success) {
     fprintf(stderr, "Pattern detection failed\n");
-    for (int i = 0; i < entry_count; i++) log_parser_free_entry(entries[i]);
-    free(entries);
     log_analyzer_cleanup(ctx);
     return EXIT_FAILURE;
   }
 
   /*Recommendations */
   printf("Generating recommendations...\n");
+  log_stats_enter(ctx->stats, LOG_STAGE_RECOMMEND);
   success = recommendation_generator_analyze(ctx);
   if (!success) {
     fprintf(stderr, "Recommendation generation failed\n");
-    for (int i = 0; i < entry_count; i++) log_parser_free_entry(entries[i]);
-    free(entries);
     log_analyzer_cleanup(ctx);
     return EXIT_FAILURE;
   }
   /* Write reports */
   printf("Writing reports...\n");
+  log_stats_enter(ctx->stats, LOG_STAGE_REPORT);
   success = report_generator_write_summary(ctx);
   if (!success) fprintf(stderr, "Failed to write summary report\n");
 
   success = report_generator_write_detailed(ctx);
   if (!success) fprintf(stderr, "Failed to write detailed report\n");
 
-  for (int i = 0; i < entry_count; i++) log_parser_free_entry(entries[i]);
-  free(entries);
+  /* On stderr, so it never mixes with a summary written to stdout */
+  log_stats_enter(ctx->stats, LOG_STAGE_COUNT);
+  if (ctx->stats) log_stats_write(ctx, stderr);
 
   log_analyzer_cleanup(ctx);
   return EXIT_SUCCESS;
@@ -102,16 +136,66 @@ void cli_print_help(void) {
   printf(
       "Log Analyzer - A tool for analyzing logs and recommending "
       "performance improvements\n\n");
-  printf("Usage: log_analyzer [OPTIONS] INPUT_FILE\n\n");
+  printf("Usage: log_analyzer [OPTIONS] INPUT_FILE...\n");
+  printf("       log_analyzer merge [OPTIONS] PARTIAL_FILE...\n");
+  printf("       (use - as INPUT_FILE to read from stdin; gzip files are "
+         "read directly;\n");
+  printf("       directories and quoted globs expand to the files in "
+         "them)\n\n");
   printf("Options:\n");
   printf("  -o, --output FILE     Write output to FILE (default: stdout)\n");
   printf(
-      "  -f, --format FORMAT   Specify the log format (default: "
-      "auto-detect)\n");
+      "  -f, --format FORMAT   Parse every line as FORMAT (default: auto, "
+      "see Formats)\n");
+  printf("  -t, --threads N       Analyze the input with N worker threads\n");
+  printf(
+      "  --pipeline            Read, parse and match a single input on "
+      "three threads\n"
+      "                        (for stdin, pipes and gzip, which cannot be "
+      "split)\n");
+  printf("  -F, --follow          Keep reading as INPUT_FILE grows\n");
+  printf(
+      "  --interval SECONDS    Rewrite the summary this often when following "
+      "(default: %d)\n",
+      DEFAULT_FOLLOW_INTERVAL);
+  printf("  --partial FILE        Also save mergeable counts to FILE\n");
+  printf(
+      "  --resume FILE         Continue from the checkpoint in FILE and "
+      "update it\n");
+  printf(
+      "  --patterns FILE       Match the patterns in FILE instead of the "
+      "built-in ones:\n"
+      "                        regex, description, category and severity "
+      "1-5 per line,\n"
+      "                        tab-separated; compiled once into "
+      "FILE.cache\n");
+  printf(
+      "  --rules FILE          Recommend from the rules in FILE instead of "
+      "the built-in ones:\n"
+      "                        pattern IDs (1-based), @category or *, "
+      "minimum matches,\n"
+      "                        minimum peak rate per minute, priority 1-5, "
+      "confidence,\n"
+      "                        category, title, description and action per "
+      "line, tab-separated\n");
+  printf(
+      "  --stats               Print stage timings and counters as JSON on "
+      "stderr\n");
   printf("  -v, --verbose         Increase verbosity\n");
   printf("  -h, --help            Display this help and exit\n");
   printf("  --version             Display version information and exit\n\n");
+  printf("Formats:\n");
+  log_format_print_names(stdout);
+  printf("\n");
   printf("Examples:\n");
   printf("  log_analyzer /var/log/syslog\n");
   printf("  log_analyzer -o recommendations.txt -f syslog /var/log/kern.log\n");
+  printf("  journalctl -o json | log_analyzer -f journald -\n");
+  printf("  log_analyzer -t 4 /var/log/syslog /var/log/syslog.*.gz\n");
+  printf("  log_analyzer --partial host1.part /var/log/syslog\n");
+  printf("  log_analyzer merge -o fleet.txt host*.part\n");
+  printf("  zcat big.log.gz | log_analyzer --pipeline --stats -\n");
+  printf("  log_analyzer --patterns /etc/log_analyzer.patterns app.log\n");
+  printf("  log_analyzer --patterns app.patterns --rules app.rules app.log\n");
+  printf("  log_analyzer --follow --interval 10 -o live.txt /var/log/syslog\n");
 }
@@ -0,0 +1,1864 @@
+#include <regex.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "include/log_analyzer.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+#ifdef __GNUC__
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+
+/*
+ * Every pattern that uses only the ERE subset below is compiled into one
+ * Thompson NFA; a DFA over the whole table is then built lazily while
+ * scanning, so each message is matched against all patterns in a single
+ * left-to-right pass. Anything outside the subset (anchors, intervals,
+ * POSIX classes, GNU escapes) falls back to regexec().
+ *
+ * Supported: literals, '\' escapes of punctuation, '.', bracket
+ * expressions with ranges and negation, groups, '|', '*', '+', '?'.
+ *
+ * Ahead of both engines sits a literal prefilter: the longest literal each
+ * pattern requires is fingerprinted by its rarest bytes, a vectorized scan
+ * finds positions whose fingerprint matches, and only patterns whose
+ * literal is confirmed there are evaluated. Most log lines contain none
+ * of the literals and skip matching entirely.
+ *
+ * Past MAX_PREFILTER_LITERALS literals one DFA over every pattern has too
+ * many states to cache, and the fingerprints match almost every byte.
+ * Such sets index each literal by a hash of its rarest INDEX_WINDOW
+ * bytes instead, and a pattern whose literal is found runs on its own
+ * over its part of the NFA. The DFA is left with the patterns that have
+ * no literal.
+ *
+ * The DFA cache is mutated while scanning, so a PatternSet must not be
+ * shared between threads.
+ */
+
+#define MAX_DFA_STATES 4096
+#define DFA_HASH_SIZE 8192 /* power of two, > 2 * MAX_DFA_STATES */
+
+/* Literal prefilter: bucketed fingerprints over each literal's prefix */
+#define FINGERPRINT_LENGTH 3
+#define PREFILTER_BUCKETS 8
+#define MAX_PREFILTER_LITERALS 64
+
+/* Below this the automaton alone is cheaper than screening first */
+#define PREFILTER_MIN_LENGTH 64
+
+/* Literal index for larger sets: a bit filter, then buckets to verify */
+#define INDEX_WINDOW 4
+#define INDEX_BITS 16
+
+enum { NODE_SPLIT, NODE_CLASS, NODE_MATCH };
+
+typedef struct {
+  int kind;
+  int out;
+  int out1;
+  int arg; /* class index for NODE_CLASS, pattern index for NODE_MATCH */
+} NfaNode;
+
+typedef struct {
+  int start;
+  int end; /* NODE_SPLIT with a dangling out */
+} Fragment;
+
+typedef struct {
+  int node_offset;
+  int node_count;
+  int accept_offset;
+  int accept_count;
+  unsigned hash;
+} DfaState;
+
+struct PatternSet;
+typedef bool (*LiteralScanFn)(struct PatternSet *set, const unsigned char *s,
+                              size_t len);
+
+struct PatternSet {
+  int count;
+  regex_t *regexes;
+  bool *compiled;
+  bool *in_dfa;
+  int *fallback; /* patterns the automaton cannot express */
+  int fallback_count;
+
+  /* Literal prefilter */
+  bool prefilter_enabled;
+  bool dfa_unscreened; /* some automaton pattern has no literal */
+  char **literals;
+  size_t *literal_lengths;
+  size_t *window_offsets; /* fingerprinted bytes within each literal */
+  unsigned char nibble_lo[FINGERPRINT_LENGTH][16];
+  unsigned char nibble_hi[FINGERPRINT_LENGTH][16];
+  unsigned char fingerprint[FINGERPRINT_LENGTH][256];
+  int bucket_start[PREFILTER_BUCKETS + 1];
+  int *bucket_patterns;
+  LiteralScanFn scan_literals;
+  unsigned *candidate;
+  long *prefilter_hits;
+  long *prefilter_confirmed;
+
+  /* Literal index, in place of the fingerprints for larger sets */
+  bool indexed;
+  uint64_t *index_filter; /* one bit per window hash */
+  int *index_start;       /* bucket h is index_patterns[index_start[h]..] */
+  int *index_patterns;
+  int *candidates; /* automaton patterns whose literal this scan found */
+  int candidate_count;
+
+  /* Time spent in pattern_set_scan_timed() calls */
+  LogMatchProfile profile;
+  double *regex_ns; /* per fallback pattern */
+
+  /* Combined NFA */
+  NfaNode *nodes;
+  int node_count;
+  int node_capacity;
+  uint32_t (*classes)[8];
+  int class_count;
+  int class_capacity;
+  int literal_classes[256]; /* shared one-byte classes, -1 until used */
+  int *start_nodes;
+  int start_count;
+  int *pattern_starts; /* start node of each pattern, -1 if none */
+  int *dfa_starts;     /* what the DFA runs: all starts, or the unindexed */
+  int dfa_start_count;
+
+  /* Input bytes collapsed to equivalence classes */
+  unsigned char byte_class[256];
+  unsigned char class_repr[256];
+  int alphabet_size;
+
+  /* Lazy DFA cache */
+  DfaState *states;
+  int state_count;
+  int *transitions;
+  int *hash_table;
+  int *set_pool;
+  int set_pool_len;
+  int set_pool_capacity;
+  int *accept_pool;
+  int accept_pool_len;
+  int accept_pool_capacity;
+  int start_state;
+
+  /* Scratch space */
+  int *scratch;
+  int *pending;
+  int *stack;
+  unsigned *mark;
+  unsigned mark_gen;
+  unsigned *seen;
+  unsigned scan_gen;
+  char *copy; /* NUL-terminated input for regexec() without REG_STARTEND */
+  size_t copy_capacity;
+};
+
+typedef struct {
+  PatternSet *set;
+  const char *p;
+  bool ok;
+} ReParser;
+
+static int new_node(PatternSet *set, int kind, int out, int out1, int arg) {
+  if (set->node_count == set->node_capacity) {
+    int capacity = set->node_capacity ? set->node_capacity * 2 : 256;
+    NfaNode *nodes =
+        (NfaNode *)realloc(set->nodes, capacity * sizeof(NfaNode));
+    if (!nodes) return -1;
+    set->nodes = nodes;
+    set->node_capacity = capacity;
+  }
+  set->nodes[set->node_count].kind = kind;
+  set->nodes[set->node_count].out = out;
+  set->nodes[set->node_count].out1 = out1;
+  set->nodes[set->node_count].arg = arg;
+  return set->node_count++;
+}
+
+static int new_class(PatternSet *set) {
+  if (set->class_count == set->class_capacity) {
+    int capacity = set->class_capacity ? set->class_capacity * 2 : 64;
+    uint32_t(*classes)[8] = (uint32_t(*)[8])realloc(
+        set->classes, capacity * sizeof(*set->classes));
+    if (!classes) return -1;
+    set->classes = classes;
+    set->class_capacity = capacity;
+  }
+  memset(set->classes[set->class_count], 0, sizeof(*set->classes));
+  return set->class_count++;
+}
+
+static void class_add(uint32_t *bits, unsigned char c) {
+  bits[c >> 5] |= 1u << (c & 31);
+}
+
+/* Literal bytes share one class each, which keeps the byte classes few */
+static int literal_class(PatternSet *set, unsigned char c) {
+  int cls = set->literal_classes[c];
+
+  if (cls >= 0) return cls;
+  cls = new_class(set);
+  if (cls < 0) return -1;
+  class_add(set->classes[cls], c);
+  set->literal_classes[c] = cls;
+  return cls;
+}
+
+static bool class_has(const uint32_t *bits, unsigned char c) {
+  return (bits[c >> 5] >> (c & 31)) & 1u;
+}
+
+/*
+ * Escaped ERE metacharacters stand for themselves; GNU regex gives other
+ * escapes (\<, \>, \`, \', \w ...) meanings the automaton does not have.
+ */
+static bool is_escapable(char c) {
+  return c != '\0' && strchr(".[]()*+?{}|^$\\/", c) != NULL;
+}
+
+static Fragment fragment_fail(ReParser *rp) {
+  Fragment f = {-1, -1};
+  rp->ok = false;
+  return f;
+}
+
+static Fragment fragment_class(ReParser *rp, int cls) {
+  Fragment f;
+  f.end = new_node(rp->set, NODE_SPLIT, -1, -1, 0);
+  f.start = new_node(rp->set, NODE_CLASS, f.end, -1, cls);
+  if (cls < 0 || f.end < 0 || f.start < 0) return fragment_fail(rp);
+  return f;
+}
+
+static Fragment parse_alternation(ReParser *rp);
+
+static Fragment parse_bracket(ReParser *rp) {
+  int cls = new_class(rp->set);
+  bool negate = false;
+  bool first = true;
+  unsigned char lo, hi;
+
+  if (cls < 0) return fragment_fail(rp);
+
+  if (*rp->p == '^') {
+    negate = true;
+    rp->p++;
+  }
+
+  while (*rp->p && (first || *rp->p != ']')) {
+    /* POSIX classes, collating symbols and equivalence classes */
+    if (rp->p[0] == '[' &&
+        (rp->p[1] == ':' || rp->p[1] == '.' || rp->p[1] == '='))
+      return fragment_fail(rp);
+
+    lo = (unsigned char)*rp->p++;
+    hi = lo;
+    if (rp->p[0] == '-' && rp->p[1] && rp->p[1] != ']') {
+      if (rp->p[1] == '[') return fragment_fail(rp);
+      hi = (unsigned char)rp->p[1];
+      rp->p += 2;
+    }
+    if (lo > hi) return fragment_fail(rp);
+    for (unsigned c = lo; c <= hi; c++)
+      class_add(rp->set->classes[cls], (unsigned char)c);
+    first = false;
+  }
+  if (*rp->p != ']') return fragment_fail(rp);
+  rp->p++;
+
+  if (negate) {
+    for (int i = 0; i < 8; i++)
+      rp->set->classes[cls][i] = ~rp->set->classes[cls][i];
+  }
+  rp->set->classes[cls][0] &= ~1u; /* NUL never reaches the matcher */
+
+  return fragment_class(rp, cls);
+}
+
+static Fragment parse_atom(ReParser *rp) {
+  Fragment f;
+  int cls;
+  char c = *rp->p;
+
+  switch (c) {
+    case '(':
+      rp->p++;
+      f = parse_alternation(rp);
+      if (!rp->ok || *rp->p != ')') return fragment_fail(rp);
+      rp->p++;
+      return f;
+    case '[':
+      rp->p++;
+      return parse_bracket(rp);
+    case '.':
+      rp->p++;
+      cls = new_class(rp->set);
+      if (cls < 0) return fragment_fail(rp);
+      memset(rp->set->classes[cls], 0xff, sizeof(*rp->set->classes));
+      rp->set->classes[cls][0] &= ~1u;
+      return fragment_class(rp, cls);
+    case '\\':
+      c = rp->p[1];
+      if (!is_escapable(c)) return fragment_fail(rp);
+      rp->p += 2;
+      break;
+    case '\0':
+    case '^':
+    case '$':
+    case '{':
+    case '}':
+    case '*':
+    case '+':
+    case '?':
+    case ')':
+    case '|':
+      return fragment_fail(rp);
+    default:
+      rp->p++;
+      break;
+  }
+
+  return fragment_class(rp, literal_class(rp->set, (unsigned char)c));
+}
+
+static Fragment parse_repeat(ReParser *rp) {
+  Fragment f = parse_atom(rp);
+  Fragment r;
+  int split;
+
+  while (rp->ok && (*rp->p == '*' || *rp->p == '+' || *rp->p == '?')) {
+    r.end = new_node(rp->set, NODE_SPLIT, -1, -1, 0);
+    split = new_node(rp->set, NODE_SPLIT, f.start, r.end, 0);
+    if (r.end < 0 || split < 0) return fragment_fail(rp);
+
+    switch (*rp->p) {
+      case '*':
+        rp->set->nodes[f.end].out = split;
+        r.start = split;
+        break;
+      case '+':
+        rp->set->nodes[f.end].out = split;
+        r.start = f.start;
+        break;
+      default:
+        rp->set->nodes[f.end].out = r.end;
+        r.start = split;
+        break;
+    }
+    rp->p++;
+    f = r;
+  }
+  return f;
+}
+
+static Fragment parse_concatenation(ReParser *rp) {
+  Fragment f = parse_repeat(rp);
+  Fragment next;
+
+  while (rp->ok && *rp->p && *rp->p != '|' && *rp->p != ')') {
+    next = parse_repeat(rp);
+    if (!rp->ok) break;
+    rp->set->nodes[f.end].out = next.start;
+    f.end = next.end;
+  }
+  return f;
+}
+
+static Fragment parse_alternation(ReParser *rp) {
+  Fragment f = parse_concatenation(rp);
+  Fragment next, r;
+
+  while (rp->ok && *rp->p == '|') {
+    rp->p++;
+    next = parse_concatenation(rp);
+    if (!rp->ok) break;
+    r.start = new_node(rp->set, NODE_SPLIT, f.start, next.start, 0);
+    r.end = new_node(rp->set, NODE_SPLIT, -1, -1, 0);
+    if (r.start < 0 || r.end < 0) return fragment_fail(rp);
+    rp->set->nodes[f.end].out = r.end;
+    rp->set->nodes[next.end].out = r.end;
+    f = r;
+  }
+  return f;
+}
+
+/*
+ * The scan is unanchored and only reports whether a pattern matched, so
+ * a leading or trailing ".*" adds nothing but extra live NFA states.
+ */
+static char *strip_outer_wildcards(const char *pattern) {
+  size_t len, escapes;
+  char *stripped;
+
+  while (strncmp(pattern, ".*", 2) == 0) pattern += 2;
+  len = strlen(pattern);
+  while (len >= 2 && pattern[len - 2] == '.' && pattern[len - 1] == '*') {
+    escapes = 0;
+    while (escapes < len - 2 && pattern[len - 3 - escapes] == '\\')
+      escapes++;
+    if (escapes % 2) break;
+    len -= 2;
+  }
+
+  stripped = (char *)malloc(len + 1);
+  if (!stripped) return NULL;
+  memcpy(stripped, pattern, len);
+  stripped[len] = '\0';
+  return stripped;
+}
+
+static bool compile_to_nfa(PatternSet *set, const char *pattern, int index) {
+  int saved_nodes = set->node_count;
+  int saved_classes = set->class_count;
+  char *core = strip_outer_wildcards(pattern);
+  ReParser rp;
+  Fragment f;
+  int match;
+
+  if (!core) return false;
+
+  rp.set = set;
+  rp.p = core;
+  rp.ok = true;
+
+  f = parse_alternation(&rp);
+  if (rp.ok && *rp.p == '\0') {
+    match = new_node(set, NODE_MATCH, -1, -1, index);
+    if (match >= 0) {
+      set->nodes[f.end].out = match;
+      set->start_nodes[set->start_count++] = f.start;
+      free(core);
+      return true;
+    }
+  }
+
+  free(core);
+  set->node_count = saved_nodes;
+  set->class_count = saved_classes;
+  for (int c = 0; c < 256; c++) {
+    if (set->literal_classes[c] >= saved_classes)
+      set->literal_classes[c] = -1;
+  }
+  return false;
+}
+
+/* The lowest byte of each class stands for it when stepping the DFA */
+static void build_class_repr(PatternSet *set) {
+  for (int c = 255; c >= 0; c--) set->class_repr[set->byte_class[c]] = c;
+}
+
+/* Split the byte range into classes no NFA transition distinguishes */
+static void build_byte_classes(PatternSet *set) {
+  unsigned char remap[256][2];
+  int next;
+
+  memset(set->byte_class, 0, sizeof(set->byte_class));
+  set->alphabet_size = 1;
+
+  for (int i = 0; i < set->class_count; i++) {
+    memset(remap, 0xff, sizeof(remap));
+    next = 0;
+    for (int c = 0; c < 256; c++) {
+      int side = class_has(set->classes[i], (unsigned char)c) ? 1 : 0;
+      int old = set->byte_class[c];
+      if (remap[old][side] == 0xff) remap[old][side] = (unsigned char)next++;
+      set->byte_class[c] = remap[old][side];
+    }
+    set->alphabet_size = next;
+  }
+
+  build_class_repr(set);
+}
+
+static void next_mark_generation(PatternSet *set) {
+  if (++set->mark_gen == 0) {
+    memset(set->mark, 0, set->node_count * sizeof(unsigned));
+    set->mark_gen = 1;
+  }
+}
+
+/* Append the epsilon closure of node to list, skipping marked nodes */
+static int add_closure(PatternSet *set, int node, int *list, int n) {
+  int top = 0;
+
+  if (set->mark[node] == set->mark_gen) return n;
+  set->mark[node] = set->mark_gen;
+  set->stack[top++] = node;
+
+  while (top > 0) {
+    NfaNode *x = &set->nodes[set->stack[--top]];
+    if (x->kind != NODE_SPLIT) {
+      list[n++] = (int)(x - set->nodes);
+      continue;
+    }
+    if (x->out1 >= 0 && set->mark[x->out1] != set->mark_gen) {
+      set->mark[x->out1] = set->mark_gen;
+      set->stack[top++] = x->out1;
+    }
+    if (x->out >= 0 && set->mark[x->out] != set->mark_gen) {
+      set->mark[x->out] = set->mark_gen;
+      set->stack[top++] = x->out;
+    }
+  }
+  return n;
+}
+
+static int compare_ints(const void *a, const void *b) {
+  int x = *(const int *)a;
+  int y = *(const int *)b;
+  return (x > y) - (x < y);
+}
+
+static unsigned hash_nodes(const int *nodes, int n) {
+  unsigned h = 2166136261u;
+  for (int i = 0; i < n; i++) h = (h ^ (unsigned)nodes[i]) * 16777619u;
+  return h;
+}
+
+static bool ensure_pool(int **pool, int *capacity, int needed) {
+  int *grown;
+  int new_capacity = *capacity ? *capacity : 1024;
+
+  if (needed <= *capacity) return true;
+  while (new_capacity < needed) new_capacity *= 2;
+  grown = (int *)realloc(*pool, new_capacity * sizeof(int));
+  if (!grown) return false;
+  *pool = grown;
+  *capacity = new_capacity;
+  return true;
+}
+
+static void flush_dfa(PatternSet *set) {
+  set->state_count = 0;
+  set->set_pool_len = 0;
+  set->accept_pool_len = 0;
+  for (int i = 0; i < DFA_HASH_SIZE; i++) set->hash_table[i] = -1;
+}
+
+static int insert_state(PatternSet *set, const int *nodes, int n,
+                        unsigned hash) {
+  DfaState *state;
+  int accepts = 0;
+  int slot;
+
+  for (int i = 0; i < n; i++)
+    if (set->nodes[nodes[i]].kind == NODE_MATCH) accepts++;
+
+  if (!ensure_pool(&set->set_pool, &set->set_pool_capacity,
+                   set->set_pool_len + n) ||
+      !ensure_pool(&set->accept_pool, &set->accept_pool_capacity,
+                   set->accept_pool_len + accepts))
+    return -1;
+
+  state = &set->states[set->state_count];
+  state->hash = hash;
+  state->node_offset = set->set_pool_len;
+  state->node_count = n;
+  state->accept_offset = set->accept_pool_len;
+  state->accept_count = accepts;
+
+  if (n > 0)
+    memcpy(set->set_pool + set->set_pool_len, nodes, n * sizeof(int));
+  set->set_pool_len += n;
+  for (int i = 0; i < n; i++) {
+    if (set->nodes[nodes[i]].kind == NODE_MATCH)
+      set->accept_pool[set->accept_pool_len++] = set->nodes[nodes[i]].arg;
+  }
+
+  for (int i = 0; i < set->alphabet_size; i++)
+    set->transitions[set->state_count * set->alphabet_size + i] = -1;
+
+  slot = hash & (DFA_HASH_SIZE - 1);
+  while (set->hash_table[slot] >= 0) slot = (slot + 1) & (DFA_HASH_SIZE - 1);
+  set->hash_table[slot] = set->state_count;
+
+  return set->state_count++;
+}
+
+static int find_or_insert_state(PatternSet *set, const int *nodes, int n) {
+  unsigned hash = hash_nodes(nodes, n);
+  int slot = hash & (DFA_HASH_SIZE - 1);
+  DfaState *state;
+
+  while (set->hash_table[slot] >= 0) {
+    state = &set->states[set->hash_table[slot]];
+    if (state->hash == hash && state->node_count == n &&
+        memcmp(set->set_pool + state->node_offset, nodes, n * sizeof(int)) ==
+            0)
+      return set->hash_table[slot];
+    slot = (slot + 1) & (DFA_HASH_SIZE - 1);
+  }
+
+  return insert_state(set, nodes, n, hash);
+}
+
+/* Unanchored start: every pattern may begin at any position */
+static int start_set(PatternSet *set, int *list) {
+  int n = 0;
+
+  for (int i = 0; i < set->dfa_start_count; i++)
+    n = add_closure(set, set->dfa_starts[i], list, n);
+  return n;
+}
+
+static int reset_dfa(PatternSet *set) {
+  int n;
+
+  flush_dfa(set);
+  next_mark_generation(set);
+  n = start_set(set, set->scratch);
+  qsort(set->scratch, n, sizeof(int), compare_ints);
+  set->start_state = find_or_insert_state(set, set->scratch, n);
+  return set->start_state;
+}
+
+static int dfa_step(PatternSet *set, int from, int symbol) {
+  const DfaState *state = &set->states[from];
+  const int *nodes = set->set_pool + state->node_offset;
+  unsigned char c = set->class_repr[symbol];
+  int n = 0;
+  int to;
+
+  next_mark_generation(set);
+  for (int i = 0; i < state->node_count; i++) {
+    const NfaNode *x = &set->nodes[nodes[i]];
+    if (x->kind == NODE_CLASS && class_has(set->classes[x->arg], c))
+      n = add_closure(set, x->out, set->scratch, n);
+  }
+  for (int i = 0; i < set->dfa_start_count; i++)
+    n = add_closure(set, set->dfa_starts[i], set->scratch, n);
+  qsort(set->scratch, n, sizeof(int), compare_ints);
+
+  if (set->state_count == MAX_DFA_STATES) {
+    /* Cache full: start over, keeping only the start state */
+    memcpy(set->pending, set->scratch, n * sizeof(int));
+    if (reset_dfa(set) < 0) return -1;
+    return find_or_insert_state(set, set->pending, n);
+  }
+
+  to = find_or_insert_state(set, set->scratch, n);
+  if (to >= 0) set->transitions[from * set->alphabet_size + symbol] = to;
+  return to;
+}
+
+/* Skip a bracket expression; p points just past the opening '[' */
+static const char *skip_bracket(const char *p) {
+  if (*p == '^') p++;
+  if (*p == ']') p++;
+  while (*p && *p != ']') {
+    if (p[0] == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+      char kind = p[1];
+      p += 2;
+      while (*p && !(p[0] == kind && p[1] == ']')) p++;
+      if (!*p) return NULL;
+      p += 2;
+      continue;
+    }
+    p++;
+  }
+  return *p ? p + 1 : NULL;
+}
+
+/* Skip a group; p points just past the opening '(' */
+static const char *skip_group(const char *p) {
+  int depth = 1;
+
+  while (*p && depth > 0) {
+    if (*p == '\\') {
+      if (!p[1]) return NULL;
+      p += 2;
+      continue;
+    }
+    if (*p == '[') {
+      p = skip_bracket(p + 1);
+      if (!p) return NULL;
+      continue;
+    }
+    if (*p == '(') depth++;
+    if (*p == ')') depth--;
+    p++;
+  }
+  return depth == 0 ? p : NULL;
+}
+
+/*
+ * Longest run of characters that every match of pattern must contain,
+ * or NULL when there is none (top-level alternation, no plain literals).
+ * Anything unfamiliar ends the current run, so the result is conservative.
+ */
+static char *required_literal(const char *pattern, size_t *literal_length) {
+  size_t capacity = strlen(pattern) + 1;
+  char *run = (char *)malloc(capacity);
+  char *best = (char *)malloc(capacity);
+  size_t run_len = 0, best_len = 0;
+  const char *p = pattern;
+
+  if (!run || !best) goto fail;
+
+  while (*p) {
+    bool literal = false;
+    bool optional = false;
+    bool repeated = false;
+    char c = *p;
+
+    switch (c) {
+      case '\\':
+        if (!p[1]) goto fail;
+        literal = is_escapable(p[1]);
+        c = p[1];
+        p += 2;
+        break;
+      case '[':
+        p = skip_bracket(p + 1);
+        if (!p) goto fail;
+        break;
+      case '(':
+        p = skip_group(p + 1);
+        if (!p) goto fail;
+        break;
+      case '|':
+      case ')':
+        goto fail;
+      case '.':
+      case '^':
+      case '$':
+      case '*':
+      case '+':
+      case '?':
+      case '{':
+        p++;
+        break;
+      default:
+        literal = true;
+        p++;
+        break;
+    }
+
+    while (*p == '*' || *p == '+' || *p == '?' || *p == '{') {
+      repeated = true;
+      if (*p != '+') optional = true;
+      if (*p == '{') {
+        p = strchr(p, '}');
+        if (!p) goto fail;
+      }
+      p++;
+    }
+
+    if (literal && !optional) run[run_len++] = c;
+    if (!literal || repeated) {
+      if (run_len > best_len) {
+        memcpy(best, run, run_len);
+        best_len = run_len;
+      }
+      run_len = 0;
+    }
+  }
+  if (run_len > best_len) {
+    memcpy(best, run, run_len);
+    best_len = run_len;
+  }
+
+  free(run);
+  if (best_len == 0) {
+    free(best);
+    return NULL;
+  }
+  best[best_len] = '\0';
+  *literal_length = best_len;
+  return best;
+
+fail:
+  free(run);
+  free(best);
+  return NULL;
+}
+
+/* Patterns in buckets whose fingerprint window is confirmed at pos */
+static bool verify_candidates(PatternSet *set, const unsigned char *s,
+                              size_t len, size_t pos, unsigned buckets) {
+  bool dfa_candidate = false;
+
+  while (buckets) {
+    int bucket = __builtin_ctz(buckets);
+    buckets &= buckets - 1;
+
+    for (int i = set->bucket_start[bucket]; i < set->bucket_start[bucket + 1];
+         i++) {
+      int index = set->bucket_patterns[i];
+      size_t literal_length = set->literal_lengths[index];
+      size_t offset = set->window_offsets[index];
+
+      if (set->candidate[index] == set->scan_gen) continue;
+      if (pos < offset || pos - offset + literal_length > len ||
+          memcmp(s + pos - offset, set->literals[index], literal_length) != 0)
+        continue;
+
+      set->candidate[index] = set->scan_gen;
+      set->prefilter_hits[index]++;
+      if (set->in_dfa[index]) dfa_candidate = true;
+    }
+  }
+  return dfa_candidate;
+}
+
+static bool scan_literals_scalar(PatternSet *set, const unsigned char *s,
+                                 size_t len, size_t pos) {
+  bool dfa_candidate = false;
+
+  for (; pos + FINGERPRINT_LENGTH <= len; pos++) {
+    unsigned buckets = set->fingerprint[0][s[pos]] &
+                       set->fingerprint[1][s[pos + 1]] &
+                       set->fingerprint[2][s[pos + 2]];
+    if (buckets && verify_candidates(set, s, len, pos, buckets))
+      dfa_candidate = true;
+  }
+  return dfa_candidate;
+}
+
+#ifdef HAVE_X86_SIMD
+/*
+ * Shuffle-based fingerprinting: each input byte is split into nibbles
+ * that index 16-entry tables of bucket bits, and the results for the
+ * first FINGERPRINT_LENGTH literal bytes are ANDed together.
+ */
+__attribute__((target("ssse3"))) static bool scan_block_ssse3(
+    PatternSet *set, const unsigned char *s, size_t len, size_t pos,
+    unsigned skip, const __m128i *lo, const __m128i *hi) {
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  __m128i hit = _mm_set1_epi8(-1);
+  unsigned char lanes[16];
+  unsigned mask;
+  bool dfa_candidate = false;
+
+  for (int j = 0; j < FINGERPRINT_LENGTH; j++) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + pos + j));
+    __m128i l = _mm_shuffle_epi8(lo[j], _mm_and_si128(v, nibble));
+    __m128i h =
+        _mm_shuffle_epi8(hi[j], _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+    hit = _mm_and_si128(hit, _mm_and_si128(l, h));
+  }
+
+  mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(hit, _mm_setzero_si128()));
+  mask = ~mask & (0xffffu << skip) & 0xffffu;
+  if (!mask) return false;
+
+  _mm_storeu_si128((__m128i *)lanes, hit);
+  while (mask) {
+    int k = __builtin_ctz(mask);
+    mask &= mask - 1;
+    if (verify_candidates(set, s, len, pos + k, lanes[k]))
+      dfa_candidate = true;
+  }
+  return dfa_candidate;
+}
+
+__attribute__((target("ssse3"))) static bool scan_literals_ssse3(
+    PatternSet *set, const unsigned char *s, size_t len) {
+  const size_t span = FINGERPRINT_LENGTH - 1 + 16;
+  __m128i lo[FINGERPRINT_LENGTH], hi[FINGERPRINT_LENGTH];
+  bool dfa_candidate = false;
+  size_t pos = 0;
+
+  if (len < span) return scan_literals_scalar(set, s, len, 0);
+
+  for (int j = 0; j < FINGERPRINT_LENGTH; j++) {
+    lo[j] = _mm_loadu_si128((const __m128i *)set->nibble_lo[j]);
+    hi[j] = _mm_loadu_si128((const __m128i *)set->nibble_hi[j]);
+  }
+
+  for (; pos + span <= len; pos += 16) {
+    if (scan_block_ssse3(set, s, len, pos, 0, lo, hi)) dfa_candidate = true;
+  }
+
+  /* Overlap the last block with the previous one instead of a scalar tail */
+  if (pos + FINGERPRINT_LENGTH <= len &&
+      scan_block_ssse3(set, s, len, len - span,
+                       (unsigned)(pos - (len - span)), lo, hi))
+    dfa_candidate = true;
+  return dfa_candidate;
+}
+
+__attribute__((target("avx2"))) static bool scan_block_avx2(
+    PatternSet *set, const unsigned char *s, size_t len, size_t pos,
+    unsigned skip, const __m256i *lo, const __m256i *hi) {
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  __m256i hit = _mm256_set1_epi8(-1);
+  unsigned char lanes[32];
+  unsigned mask;
+  bool dfa_candidate = false;
+
+  for (int j = 0; j < FINGERPRINT_LENGTH; j++) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(s + pos + j));
+    __m256i l = _mm256_shuffle_epi8(lo[j], _mm256_and_si256(v, nibble));
+    __m256i h = _mm256_shuffle_epi8(
+        hi[j], _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+    hit = _mm256_and_si256(hit, _mm256_and_si256(l, h));
+  }
+
+  mask = ~(unsigned)_mm256_movemask_epi8(
+      _mm256_cmpeq_epi8(hit, _mm256_setzero_si256()));
+  if (skip) mask &= ~0u << skip;
+  if (!mask) return false;
+
+  _mm256_storeu_si256((__m256i *)lanes, hit);
+  while (mask) {
+    int k = __builtin_ctz(mask);
+    mask &= mask - 1;
+    if (verify_candidates(set, s, len, pos + k, lanes[k]))
+      dfa_candidate = true;
+  }
+  return dfa_candidate;
+}
+
+__attribute__((target("avx2"))) static bool scan_literals_avx2(
+    PatternSet *set, const unsigned char *s, size_t len) {
+  const size_t span = FINGERPRINT_LENGTH - 1 + 32;
+  __m256i lo[FINGERPRINT_LENGTH], hi[FINGERPRINT_LENGTH];
+  bool dfa_candidate = false;
+  size_t pos = 0;
+
+  if (len < span) return scan_literals_ssse3(set, s, len);
+
+  for (int j = 0; j < FINGERPRINT_LENGTH; j++) {
+    lo[j] = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)set->nibble_lo[j]));
+    hi[j] = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i *)set->nibble_hi[j]));
+  }
+
+  for (; pos + span <= len; pos += 32) {
+    if (scan_block_avx2(set, s, len, pos, 0, lo, hi)) dfa_candidate = true;
+  }
+
+  if (pos + FINGERPRINT_LENGTH <= len &&
+      scan_block_avx2(set, s, len, len - span, (unsigned)(pos - (len - span)),
+                      lo, hi))
+    dfa_candidate = true;
+  return dfa_candidate;
+}
+#endif
+
+static bool scan_literals_portable(PatternSet *set, const unsigned char *s,
+                                   size_t len) {
+  return scan_literals_scalar(set, s, len, 0);
+}
+
+static unsigned window_hash(const unsigned char *window) {
+  uint32_t word;
+
+  memcpy(&word, window, INDEX_WINDOW);
+  return (word * 2654435761u) >> (32 - INDEX_BITS);
+}
+
+/* Confirms the literals whose window hashes like each position's */
+static bool scan_literals_indexed(PatternSet *set, const unsigned char *s,
+                                  size_t len) {
+  set->candidate_count = 0;
+
+  for (size_t pos = 0; pos + INDEX_WINDOW <= len; pos++) {
+    unsigned hash = window_hash(s + pos);
+
+    if (!((set->index_filter[hash >> 6] >> (hash & 63)) & 1)) continue;
+    for (int i = set->index_start[hash]; i < set->index_start[hash + 1];
+         i++) {
+      int index = set->index_patterns[i];
+      size_t literal_length = set->literal_lengths[index];
+      size_t offset = set->window_offsets[index];
+
+      if (set->candidate[index] == set->scan_gen) continue;
+      if (pos < offset || pos - offset + literal_length > len ||
+          memcmp(s + pos - offset, set->literals[index], literal_length) != 0)
+        continue;
+
+      set->candidate[index] = set->scan_gen;
+      set->prefilter_hits[index]++;
+      if (set->in_dfa[index])
+        set->candidates[set->candidate_count++] = index;
+    }
+  }
+  return set->candidate_count > 0;
+}
+
+/* Bytes roughly from most to least common in log text */
+static const char common_bytes[] =
+    " etaoinsrlcdumhpfg0123456789.:-/_=[]bvwykxjqzETAOINSRLCDUMHPFGBVWYKXJQZ";
+
+static int byte_rarity(unsigned char c) {
+  const char *at = c ? strchr(common_bytes, c) : NULL;
+  return at ? (int)(at - common_bytes) : (int)sizeof(common_bytes);
+}
+
+/* Offset of the width bytes of the literal least likely to occur in logs */
+static size_t rarest_window(const char *literal, size_t literal_length,
+                            size_t width) {
+  size_t best = 0;
+  int best_score = -1;
+
+  for (size_t k = 0; k + width <= literal_length; k++) {
+    int score = 0;
+    for (size_t j = 0; j < width; j++)
+      score += byte_rarity((unsigned char)literal[k + j]);
+    if (score > best_score) {
+      best_score = score;
+      best = k;
+    }
+  }
+  return best;
+}
+
+static LiteralScanFn select_literal_scan(void) {
+#ifdef HAVE_X86_SIMD
+  /* libgcc fills in the CPU model before main; reading it is reentrant */
+  if (__builtin_cpu_supports("avx2")) return scan_literals_avx2;
+  if (__builtin_cpu_supports("ssse3")) return scan_literals_ssse3;
+#endif
+  return scan_literals_portable;
+}
+
+/*
+ * Indexes every literal of at least INDEX_WINDOW bytes; patterns with a
+ * shorter one or none are left to the DFA, or to regexec() on every
+ * line if they are fallbacks.
+ */
+static bool build_index(PatternSet *set) {
+  int buckets = 1 << INDEX_BITS, indexed = 0;
+  unsigned hash;
+  int *fill;
+
+  set->index_filter = (uint64_t *)calloc(buckets / 64, sizeof(uint64_t));
+  set->index_start = (int *)calloc(buckets + 1, sizeof(int));
+  set->index_patterns = (int *)malloc((set->count + 1) * sizeof(int));
+  fill = (int *)malloc((buckets + 1) * sizeof(int));
+  if (!set->index_filter || !set->index_start || !set->index_patterns ||
+      !fill) {
+    free(fill);
+    return false;
+  }
+
+  set->dfa_start_count = 0;
+  set->dfa_unscreened = false;
+  for (int i = 0; i < set->count; i++) {
+    if (set->literals[i] && set->literal_lengths[i] < INDEX_WINDOW) {
+      free(set->literals[i]);
+      set->literals[i] = NULL;
+    }
+    if (!set->literals[i]) {
+      if (set->in_dfa[i])
+        set->dfa_starts[set->dfa_start_count++] = set->pattern_starts[i];
+      continue;
+    }
+    set->window_offsets[i] = rarest_window(
+        set->literals[i], set->literal_lengths[i], INDEX_WINDOW);
+    set->index_start[window_hash((const unsigned char *)set->literals[i] +
+                                 set->window_offsets[i]) + 1]++;
+    indexed++;
+  }
+
+  for (int h = 0; h < buckets; h++)
+    set->index_start[h + 1] += set->index_start[h];
+  memcpy(fill, set->index_start, (buckets + 1) * sizeof(int));
+  for (int i = 0; i < set->count; i++) {
+    if (!set->literals[i]) continue;
+    hash = window_hash((const unsigned char *)set->literals[i] +
+                       set->window_offsets[i]);
+    set->index_patterns[fill[hash]++] = i;
+    set->index_filter[hash >> 6] |= 1ull << (hash & 63);
+  }
+
+  free(fill);
+  set->indexed = indexed > 0;
+  set->prefilter_enabled = set->indexed;
+  set->scan_literals = scan_literals_indexed;
+  return true;
+}
+
+static bool build_prefilter(PatternSet *set, const Pattern *patterns) {
+  int screened = 0;
+  int bucket_fill[PREFILTER_BUCKETS + 1];
+  int *bucket_of = (int *)malloc((set->count + 1) * sizeof(int));
+
+  if (!bucket_of) return false;
+
+  for (int i = 0; i < set->count; i++) {
+    bucket_of[i] = -1;
+    if (!set->compiled[i]) continue;
+
+    set->literals[i] =
+        required_literal(patterns[i].pattern, &set->literal_lengths[i]);
+    if (set->literals[i] && set->literal_lengths[i] < FINGERPRINT_LENGTH) {
+      free(set->literals[i]);
+      set->literals[i] = NULL;
+    }
+    if (!set->literals[i]) {
+      if (set->in_dfa[i]) set->dfa_unscreened = true;
+      continue;
+    }
+    set->window_offsets[i] =
+        rarest_window(set->literals[i], set->literal_lengths[i],
+                      FINGERPRINT_LENGTH);
+    bucket_of[i] = screened++ % PREFILTER_BUCKETS;
+  }
+
+  /* Past this many literals every bucket matches almost every byte */
+  if (screened > MAX_PREFILTER_LITERALS) {
+    free(bucket_of);
+    return build_index(set);
+  }
+  if (screened == 0) {
+    free(bucket_of);
+    return true; /* left disabled */
+  }
+
+  set->bucket_patterns = (int *)malloc(screened * sizeof(int));
+  if (!set->bucket_patterns) {
+    free(bucket_of);
+    return false;
+  }
+
+  memset(set->bucket_start, 0, sizeof(set->bucket_start));
+  for (int i = 0; i < set->count; i++) {
+    if (bucket_of[i] >= 0) set->bucket_start[bucket_of[i] + 1]++;
+  }
+  for (int b = 0; b < PREFILTER_BUCKETS; b++)
+    set->bucket_start[b + 1] += set->bucket_start[b];
+  memcpy(bucket_fill, set->bucket_start, sizeof(bucket_fill));
+
+  for (int i = 0; i < set->count; i++) {
+    unsigned bit;
+    if (bucket_of[i] < 0) continue;
+
+    set->bucket_patterns[bucket_fill[bucket_of[i]]++] = i;
+    bit = 1u << bucket_of[i];
+    for (int j = 0; j < FINGERPRINT_LENGTH; j++) {
+      unsigned char c =
+          (unsigned char)set->literals[i][set->window_offsets[i] + j];
+      set->fingerprint[j][c] |= (unsigned char)bit;
+      set->nibble_lo[j][c & 0x0f] |= (unsigned char)bit;
+      set->nibble_hi[j][c >> 4] |= (unsigned char)bit;
+    }
+  }
+
+  free(bucket_of);
+  set->scan_literals = select_literal_scan();
+  set->prefilter_enabled = true;
+  return true;
+}
+
+/* The per-pattern arrays of a set for pattern_count patterns */
+static PatternSet *new_set(int pattern_count) {
+  PatternSet *set = (PatternSet *)calloc(1, sizeof(PatternSet));
+
+  if (!set) return NULL;
+
+  set->count = pattern_count;
+  set->regexes = (regex_t *)calloc(pattern_count + 1, sizeof(regex_t));
+  set->compiled = (bool *)calloc(pattern_count + 1, sizeof(bool));
+  set->in_dfa = (bool *)calloc(pattern_count + 1, sizeof(bool));
+  set->fallback = (int *)calloc(pattern_count + 1, sizeof(int));
+  set->start_nodes = (int *)calloc(pattern_count + 1, sizeof(int));
+  set->seen = (unsigned *)calloc(pattern_count + 1, sizeof(unsigned));
+  set->literals = (char **)calloc(pattern_count + 1, sizeof(char *));
+  set->literal_lengths = (size_t *)calloc(pattern_count + 1, sizeof(size_t));
+  set->window_offsets = (size_t *)calloc(pattern_count + 1, sizeof(size_t));
+  set->candidate = (unsigned *)calloc(pattern_count + 1, sizeof(unsigned));
+  set->prefilter_hits = (long *)calloc(pattern_count + 1, sizeof(long));
+  set->prefilter_confirmed =
+      (long *)calloc(pattern_count + 1, sizeof(long));
+  set->regex_ns = (double *)calloc(pattern_count + 1, sizeof(double));
+  set->candidates = (int *)calloc(pattern_count + 1, sizeof(int));
+  set->pattern_starts = (int *)calloc(pattern_count + 1, sizeof(int));
+  set->dfa_starts = (int *)calloc(pattern_count + 1, sizeof(int));
+  if (!set->regexes || !set->compiled || !set->in_dfa || !set->fallback ||
+      !set->start_nodes || !set->seen || !set->literals ||
+      !set->literal_lengths || !set->window_offsets || !set->candidate ||
+      !set->prefilter_hits || !set->prefilter_confirmed || !set->regex_ns ||
+      !set->candidates || !set->pattern_starts || !set->dfa_starts) {
+    pattern_set_free(set);
+    return NULL;
+  }
+  return set;
+}
+
+/*
+ * Compiles the regexes of a set whose NFA is already in place: only the
+ * patterns the automaton cannot run keep one.
+ */
+static void compile_fallbacks(PatternSet *set, const Pattern *patterns) {
+  for (int i = 0; i < set->count; i++) {
+    if (!set->compiled[i] || set->in_dfa[i]) continue;
+    if (regcomp(&set->regexes[i], patterns[i].pattern,
+                REG_EXTENDED | REG_NOSUB) != 0) {
+      set->compiled[i] = false;
+      continue;
+    }
+    set->fallback[set->fallback_count++] = i;
+  }
+}
+
+/* The prefilter and an empty DFA cache; frees the set on failure */
+static PatternSet *finish_set(PatternSet *set, const Pattern *patterns) {
+  /* Starts are in pattern order; the DFA runs them all unless indexed */
+  for (int i = 0, k = 0; i < set->count; i++)
+    set->pattern_starts[i] = set->in_dfa[i] ? set->start_nodes[k++] : -1;
+  memcpy(set->dfa_starts, set->start_nodes, set->start_count * sizeof(int));
+  set->dfa_start_count = set->start_count;
+
+  if (!build_prefilter(set, patterns)) {
+    pattern_set_free(set);
+    return NULL;
+  }
+
+  set->states = (DfaState *)malloc(MAX_DFA_STATES * sizeof(DfaState));
+  set->transitions =
+      (int *)malloc(MAX_DFA_STATES * set->alphabet_size * sizeof(int));
+  set->hash_table = (int *)malloc(DFA_HASH_SIZE * sizeof(int));
+  set->scratch = (int *)malloc((set->node_count + 1) * sizeof(int));
+  set->pending = (int *)malloc((set->node_count + 1) * sizeof(int));
+  set->stack = (int *)malloc((set->node_count + 1) * sizeof(int));
+  set->mark = (unsigned *)calloc(set->node_count + 1, sizeof(unsigned));
+  if (!set->states || !set->transitions || !set->hash_table ||
+      !set->scratch || !set->pending || !set->stack || !set->mark ||
+      reset_dfa(set) < 0) {
+    pattern_set_free(set);
+    return NULL;
+  }
+
+  return set;
+}
+
+PatternSet *pattern_set_compile(const Pattern *patterns, int pattern_count) {
+  PatternSet *set;
+
+  if (!patterns || pattern_count < 0) return NULL;
+
+  set = new_set(pattern_count);
+  if (!set) return NULL;
+  memset(set->literal_classes, 0xff, sizeof(set->literal_classes));
+
+  /*
+   * A pattern that fails to compile never matches, as before. The
+   * automaton runs the rest where it can, so their regexes are only
+   * compiled to check them and are freed straight away.
+   */
+  for (int i = 0; i < pattern_count; i++) {
+    if (!patterns[i].pattern ||
+        regcomp(&set->regexes[i], patterns[i].pattern,
+                REG_EXTENDED | REG_NOSUB) != 0)
+      continue;
+    set->compiled[i] = true;
+    set->in_dfa[i] = compile_to_nfa(set, patterns[i].pattern, i);
+    if (set->in_dfa[i])
+      regfree(&set->regexes[i]);
+    else
+      set->fallback[set->fallback_count++] = i;
+  }
+
+  build_byte_classes(set);
+  return finish_set(set, patterns);
+}
+
+/* Room for an NFA of known size, which is then filled in directly */
+static bool reserve_nfa(PatternSet *set, int node_count, int class_count) {
+  set->nodes = (NfaNode *)malloc((node_count + 1) * sizeof(NfaNode));
+  set->classes =
+      (uint32_t(*)[8])malloc((class_count + 1) * sizeof(*set->classes));
+  if (!set->nodes || !set->classes) return false;
+  set->node_count = set->node_capacity = node_count;
+  set->class_count = set->class_capacity = class_count;
+  return true;
+}
+
+/*
+ * A set for another thread: the NFA is copied, so only the fallback
+ * regexes are compiled again, and the copy starts with an empty DFA
+ * cache. patterns must be the table set was compiled from.
+ */
+PatternSet *pattern_set_clone(const PatternSet *set, const Pattern *patterns) {
+  PatternSet *copy;
+
+  if (!set || !patterns) return NULL;
+
+  copy = new_set(set->count);
+  if (!copy) return NULL;
+
+  memcpy(copy->compiled, set->compiled, set->count * sizeof(bool));
+  memcpy(copy->in_dfa, set->in_dfa, set->count * sizeof(bool));
+  memcpy(copy->start_nodes, set->start_nodes, set->start_count * sizeof(int));
+  copy->start_count = set->start_count;
+  if (!reserve_nfa(copy, set->node_count, set->class_count)) {
+    pattern_set_free(copy);
+    return NULL;
+  }
+  memcpy(copy->nodes, set->nodes, set->node_count * sizeof(NfaNode));
+  memcpy(copy->classes, set->classes,
+         set->class_count * sizeof(*set->classes));
+  memcpy(copy->byte_class, set->byte_class, sizeof(set->byte_class));
+  memcpy(copy->class_repr, set->class_repr, sizeof(set->class_repr));
+  copy->alphabet_size = set->alphabet_size;
+
+  compile_fallbacks(copy, patterns);
+  return finish_set(copy, patterns);
+}
+
+/*
+ * A compiled set saved for later runs, in a fixed little-endian layout:
+ *
+ *    0  magic "LOGAPSET"          8 bytes
+ *    8  version                   u32
+ *   12  pattern count             u32
+ *   16  key                       u64   (the caller's pattern table hash)
+ *   24  node count                u32
+ *   28  class count               u32
+ *   32  start count               u32
+ *   36  alphabet size             u32
+ *   40  byte classes              256 bytes
+ *  296  flags                     u8 per pattern (bit 0: compiles,
+ *                                 bit 1: run by the automaton)
+ *    …  nodes                     u32 kind, out, out1, arg each
+ *    …  classes                   8 u32 each
+ *    …  start nodes               u32 each
+ *    …  checksum of all of the above u64
+ *
+ * That is everything compiling derives from the pattern strings, so a
+ * loaded set only compiles the fallback regexes. The prefilter is cheap
+ * to rebuild from the literals and the DFA cache starts empty as usual.
+ */
+#define SET_CACHE_MAGIC "LOGAPSET"
+#define SET_CACHE_VERSION 2
+#define SET_CACHE_HEADER_SIZE 296
+#define SET_COMPILED 1u
+#define SET_IN_DFA 2u
+
+static void put_u32(unsigned char *out, uint32_t value) {
+  for (int i = 0; i < 4; i++) out[i] = (unsigned char)(value >> (8 * i));
+}
+
+static void put_u64(unsigned char *out, uint64_t value) {
+  for (int i = 0; i < 8; i++) out[i] = (unsigned char)(value >> (8 * i));
+}
+
+/* Loads are whole words, as a cache is decoded on every start */
+static uint32_t get_u32(const unsigned char *in) {
+  uint32_t value;
+
+  memcpy(&value, in, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap32(value);
+#endif
+  return value;
+}
+
+static uint64_t get_u64(const unsigned char *in) {
+  uint64_t value;
+
+  memcpy(&value, in, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap64(value);
+#endif
+  return value;
+}
+
+/*
+ * FNV-1a taken a word at a time, since caches run to megabytes and are
+ * checked on every start. Each step is a bijection, so any one changed
+ * word changes the result.
+ */
+static uint64_t checksum(const unsigned char *data, size_t length) {
+  uint64_t hash = 14695981039346656037ull;
+  size_t i = 0;
+
+  for (; i + 8 <= length; i += 8) {
+    hash ^= get_u64(data + i);
+    hash *= 1099511628211ull;
+  }
+  for (; i < length; i++) {
+    hash ^= data[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+/*
+ * Writes set to path for pattern_set_load() with the same key. Quiet on
+ * failure, since a run without a cache only compiles again.
+ */
+bool pattern_set_save(const PatternSet *set, uint64_t key, const char *path) {
+  char temp_path[MAX_PATH_LENGTH + 32];
+  unsigned char *data, *out;
+  size_t size, body;
+  bool success;
+  FILE *fp;
+  int fd;
+
+  if (!set || !path) return false;
+
+  body = SET_CACHE_HEADER_SIZE + (size_t)set->count +
+         (size_t)set->node_count * 16 + (size_t)set->class_count * 32 +
+         (size_t)set->start_count * 4;
+  size = body + 8;
+  data = (unsigned char *)malloc(size);
+  if (!data) return false;
+
+  memcpy(data, SET_CACHE_MAGIC, 8);
+  put_u32(data + 8, SET_CACHE_VERSION);
+  put_u32(data + 12, (uint32_t)set->count);
+  put_u64(data + 16, key);
+  put_u32(data + 24, (uint32_t)set->node_count);
+  put_u32(data + 28, (uint32_t)set->class_count);
+  put_u32(data + 32, (uint32_t)set->start_count);
+  put_u32(data + 36, (uint32_t)set->alphabet_size);
+  memcpy(data + 40, set->byte_class, 256);
+
+  out = data + SET_CACHE_HEADER_SIZE;
+  for (int i = 0; i < set->count; i++)
+    *out++ = (unsigned char)((set->compiled[i] ? SET_COMPILED : 0) |
+                             (set->in_dfa[i] ? SET_IN_DFA : 0));
+  for (int i = 0; i < set->node_count; i++, out += 16) {
+    put_u32(out, (uint32_t)set->nodes[i].kind);
+    put_u32(out + 4, (uint32_t)set->nodes[i].out);
+    put_u32(out + 8, (uint32_t)set->nodes[i].out1);
+    put_u32(out + 12, (uint32_t)set->nodes[i].arg);
+  }
+  for (int i = 0; i < set->class_count; i++) {
+    for (int j = 0; j < 8; j++, out += 4) put_u32(out, set->classes[i][j]);
+  }
+  for (int i = 0; i < set->start_count; i++, out += 4)
+    put_u32(out, (uint32_t)set->start_nodes[i]);
+  put_u64(data + body, checksum(data, body));
+
+  /*
+   * Writers that overlap, in other runs or other contexts of this one,
+   * each get their own file; the last rename wins.
+   */
+  snprintf(temp_path, sizeof(temp_path), "%s.XXXXXX", path);
+  fd = mkstemp(temp_path);
+  fp = fd >= 0 ? fdopen(fd, "wb") : NULL;
+  if (fd >= 0 && !fp) {
+    close(fd);
+    remove(temp_path);
+  }
+  success = fp != NULL;
+  if (fp) {
+    fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    success = fwrite(data, 1, size, fp) == size;
+    success = fclose(fp) == 0 && success && rename(temp_path, path) == 0;
+    if (!success) remove(temp_path);
+  }
+
+  free(data);
+  return success;
+}
+
+/* Reads a whole file; NULL if it is missing or cannot be read */
+static unsigned char *read_cache(const char *path, size_t *size) {
+  unsigned char *data = NULL;
+  struct stat st;
+  FILE *fp;
+
+  fp = fopen(path, "rb");
+  if (!fp) return NULL;
+  if (fstat(fileno(fp), &st) == 0 && st.st_size > 0) {
+    *size = (size_t)st.st_size;
+    data = (unsigned char *)malloc(*size);
+    if (data && fread(data, 1, *size, fp) != *size) {
+      free(data);
+      data = NULL;
+    }
+  }
+  fclose(fp);
+  return data;
+}
+
+/* A node's links and argument point inside the loaded set */
+static bool node_valid(const PatternSet *set, const NfaNode *node) {
+  /* Only a MATCH node ends a path; every other one leads on */
+  if (node->out < (node->kind == NODE_MATCH ? -1 : 0) ||
+      node->out >= set->node_count || node->out1 < -1 ||
+      node->out1 >= set->node_count)
+    return false;
+  switch (node->kind) {
+    case NODE_SPLIT:
+      return true;
+    case NODE_CLASS:
+      return node->arg >= 0 && node->arg < set->class_count;
+    case NODE_MATCH:
+      return node->arg >= 0 && node->arg < set->count &&
+             set->in_dfa[node->arg];
+    default:
+      return false;
+  }
+}
+
+/* Fills set from a checked cache file; false if any part is out of range */
+static bool read_set(PatternSet *set, const unsigned char *in) {
+  unsigned flags;
+  int starts = 0;
+
+  for (int i = 0; i < set->count; i++) {
+    flags = *in++;
+    set->compiled[i] = (flags & SET_COMPILED) != 0;
+    set->in_dfa[i] = (flags & SET_IN_DFA) != 0;
+    if (set->in_dfa[i] && !set->compiled[i]) return false;
+    if (set->in_dfa[i]) starts++;
+  }
+  if (starts != set->start_count) return false;
+  for (int i = 0; i < set->node_count; i++, in += 16) {
+    set->nodes[i].kind = (int)get_u32(in);
+    set->nodes[i].out = (int)get_u32(in + 4);
+    set->nodes[i].out1 = (int)get_u32(in + 8);
+    set->nodes[i].arg = (int)get_u32(in + 12);
+    if (!node_valid(set, &set->nodes[i])) return false;
+  }
+  for (int i = 0; i < set->class_count; i++) {
+    for (int j = 0; j < 8; j++, in += 4) set->classes[i][j] = get_u32(in);
+  }
+  for (int i = 0; i < set->start_count; i++, in += 4) {
+    set->start_nodes[i] = (int)get_u32(in);
+    if (set->start_nodes[i] < 0 || set->start_nodes[i] >= set->node_count)
+      return false;
+  }
+  for (int c = 0; c < 256; c++) {
+    if (set->byte_class[c] >= set->alphabet_size) return false;
+  }
+  build_class_repr(set);
+  return true;
+}
+
+/*
+ * The set pattern_set_save() wrote for the same key and patterns, or
+ * NULL if path is missing, damaged, from another version or made for
+ * other patterns; the caller then compiles as usual.
+ */
+PatternSet *pattern_set_load(const char *path, uint64_t key,
+                             const Pattern *patterns, int pattern_count) {
+  size_t size = 0, body;
+  uint32_t node_count, class_count, start_count, alphabet_size;
+  unsigned char *data;
+  PatternSet *set = NULL;
+
+  if (!path || !patterns || pattern_count < 0) return NULL;
+
+  data = read_cache(path, &size);
+  if (!data) return NULL;
+  if (size < SET_CACHE_HEADER_SIZE + 8 ||
+      memcmp(data, SET_CACHE_MAGIC, 8) != 0 ||
+      get_u32(data + 8) != SET_CACHE_VERSION ||
+      get_u32(data + 12) != (uint32_t)pattern_count ||
+      get_u64(data + 16) != key ||
+      get_u64(data + size - 8) != checksum(data, size - 8)) {
+    free(data);
+    return NULL;
+  }
+
+  /* Every count must fit the file before it sizes anything */
+  node_count = get_u32(data + 24);
+  class_count = get_u32(data + 28);
+  start_count = get_u32(data + 32);
+  alphabet_size = get_u32(data + 36);
+  body = size - 8 - SET_CACHE_HEADER_SIZE;
+  if (node_count > body / 16 || class_count > body / 32 ||
+      start_count > (uint32_t)pattern_count || alphabet_size < 1 ||
+      alphabet_size > 256 ||
+      body != (size_t)pattern_count + (size_t)node_count * 16 +
+                  (size_t)class_count * 32 + (size_t)start_count * 4) {
+    free(data);
+    return NULL;
+  }
+
+  set = new_set(pattern_count);
+  if (set && reserve_nfa(set, (int)node_count, (int)class_count)) {
+    set->start_count = (int)start_count;
+    set->alphabet_size = (int)alphabet_size;
+    memcpy(set->byte_class, data + 40, 256);
+    if (read_set(set, data + SET_CACHE_HEADER_SIZE)) {
+      free(data);
+      compile_fallbacks(set, patterns);
+      return finish_set(set, patterns);
+    }
+  }
+
+  free(data);
+  pattern_set_free(set);
+  return NULL;
+}
+
+static int record_match(PatternSet *set, int index, int *matches, int found,
+                        int max_matches) {
+  if (set->seen[index] == set->scan_gen) return found;
+  set->seen[index] = set->scan_gen;
+  if (found < max_matches) matches[found++] = index;
+  return found;
+}
+
+static int record_accepts(PatternSet *set, int state, int *matches,
+                          int found, int max_matches) {
+  const DfaState *s = &set->states[state];
+  for (int i = 0; i < s->accept_count; i++)
+    found = record_match(set, set->accept_pool[s->accept_offset + i], matches,
+                         found, max_matches);
+  return found;
+}
+
+static bool regexec_bounded(PatternSet *set, int index, const char *string,
+                            size_t length) {
+#ifdef REG_STARTEND
+  regmatch_t range[1];
+
+  (void)set;
+  range[0].rm_so = 0;
+  range[0].rm_eo = (regoff_t)length;
+  return regexec(&set->regexes[index], string, 1, range, REG_STARTEND) == 0;
+#else
+  if (length + 1 > set->copy_capacity) {
+    char *grown = (char *)realloc(set->copy, length + 1);
+    if (!grown) return false;
+    set->copy = grown;
+    set->copy_capacity = length + 1;
+  }
+  memcpy(set->copy, string, length);
+  set->copy[length] = '\0';
+  return regexec(&set->regexes[index], set->copy, 0, NULL, 0) == 0;
+#endif
+}
+
+/*
+ * Runs one pattern on its own, stepping the set of NFA nodes it can be
+ * in; indexed sets do this for each pattern whose literal was found.
+ */
+static bool pattern_matches(PatternSet *set, int index,
+                            const unsigned char *s, size_t length) {
+  int start = set->pattern_starts[index];
+  int *current = set->scratch, *next = set->pending, *swap;
+  int n, m;
+
+  next_mark_generation(set);
+  n = add_closure(set, start, current, 0);
+  for (size_t pos = 0;; pos++) {
+    for (int i = 0; i < n; i++) {
+      if (set->nodes[current[i]].kind == NODE_MATCH) return true;
+    }
+    if (pos == length) return false;
+
+    /* Unanchored, so the pattern may also begin at the next byte */
+    next_mark_generation(set);
+    m = 0;
+    for (int i = 0; i < n; i++) {
+      const NfaNode *x = &set->nodes[current[i]];
+      if (x->kind == NODE_CLASS && class_has(set->classes[x->arg], s[pos]))
+        m = add_closure(set, x->out, next, m);
+    }
+    n = add_closure(set, start, next, m);
+    swap = current;
+    current = next;
+    next = swap;
+  }
+}
+
+/*
+ * When timed, a lap is taken after each phase and each regexec() call.
+ * Both entry points below pass a constant, so the untimed scan compiles
+ * without the checks.
+ */
+static ALWAYS_INLINE int scan(PatternSet *set, const char *string,
+                              size_t length, int *matches, int max_matches,
+                              bool timed) {
+  const unsigned char *p = (const unsigned char *)string;
+  const unsigned char *end = p + length;
+  bool screened = false;
+  bool run_dfa = true;
+  int found = 0;
+  int state, next;
+  double mark = 0, lap;
+
+  if (!set || !string || !matches) return 0;
+  if (timed) mark = log_stats_now();
+
+  if (++set->scan_gen == 0) {
+    memset(set->seen, 0, set->count * sizeof(unsigned));
+    memset(set->candidate, 0, set->count * sizeof(unsigned));
+    set->scan_gen = 1;
+  }
+
+  /* Indexed patterns are not in the DFA, so their screen always runs */
+  if (set->prefilter_enabled &&
+      (set->indexed || length >= PREFILTER_MIN_LENGTH ||
+       set->fallback_count > 0)) {
+    screened = true;
+    run_dfa = set->scan_literals(set, p, length) || set->dfa_unscreened ||
+              set->indexed;
+  }
+  if (timed) set->profile.prefilter_ns += log_stats_lap(&mark);
+
+  if (run_dfa && set->dfa_start_count > 0) {
+    state = set->start_state;
+    if (set->states[state].accept_count)
+      found = record_accepts(set, state, matches, found, max_matches);
+
+    for (; p < end; p++) {
+      int symbol = set->byte_class[*p];
+      next = set->transitions[state * set->alphabet_size + symbol];
+      if (next < 0) {
+        next = dfa_step(set, state, symbol);
+        if (next < 0) break;
+      }
+      state = next;
+      if (set->states[state].accept_count)
+        found = record_accepts(set, state, matches, found, max_matches);
+    }
+  }
+  if (set->indexed) {
+    for (int i = 0; i < set->candidate_count; i++) {
+      if (pattern_matches(set, set->candidates[i],
+                          (const unsigned char *)string, length))
+        found = record_match(set, set->candidates[i], matches, found,
+                             max_matches);
+    }
+  }
+  if (timed) {
+    set->profile.automaton_ns += log_stats_lap(&mark);
+    set->profile.scans++;
+  }
+
+  for (int i = 0; i < set->fallback_count; i++) {
+    int index = set->fallback[i];
+    if (screened && set->literals[index] &&
+        set->candidate[index] != set->scan_gen)
+      continue;
+    if (regexec_bounded(set, index, string, length))
+      found = record_match(set, index, matches, found, max_matches);
+    if (timed) {
+      lap = log_stats_lap(&mark);
+      set->regex_ns[index] += lap;
+      set->profile.regex_ns += lap;
+    }
+  }
+
+  if (screened) {
+    for (int i = 0; i < found; i++) {
+      if (set->candidate[matches[i]] == set->scan_gen)
+        set->prefilter_confirmed[matches[i]]++;
+    }
+  }
+
+  return found;
+}
+
+int pattern_set_scan(PatternSet *set, const char *string, size_t length,
+                     int *matches, int max_matches) {
+  return scan(set, string, length, matches, max_matches, false);
+}
+
+/* Same as pattern_set_scan(), adding where the time went to the profile */
+int pattern_set_scan_timed(PatternSet *set, const char *string,
+                           size_t length, int *matches, int max_matches) {
+  return scan(set, string, length, matches, max_matches, true);
+}
+
+/* Fold the per-pattern counters of another set over the same table */
+void pattern_set_merge_stats(PatternSet *into, const PatternSet *from) {
+  if (!into || !from || into->count != from->count) return;
+
+  for (int i = 0; i < into->count; i++) {
+    into->prefilter_hits[i] += from->prefilter_hits[i];
+    into->prefilter_confirmed[i] += from->prefilter_confirmed[i];
+    into->regex_ns[i] += from->regex_ns[i];
+  }
+  into->profile.scans += from->profile.scans;
+  into->profile.prefilter_ns += from->profile.prefilter_ns;
+  into->profile.automaton_ns += from->profile.automaton_ns;
+  into->profile.regex_ns += from->profile.regex_ns;
+}
+
+void pattern_set_profile(const PatternSet *set, LogMatchProfile *profile) {
+  if (!profile) return;
+
+  if (set)
+    *profile = set->profile;
+  else
+    memset(profile, 0, sizeof(LogMatchProfile));
+}
+
+/* Timed regexec() time of one pattern; -1 if the automaton runs it */
+double pattern_set_pattern_ns(const PatternSet *set, int index) {
+  if (!set || index < 0 || index >= set->count || set->in_dfa[index])
+    return -1;
+  return set->regex_ns[index];
+}
+
+/* Whether pattern index is a valid regex; one that is not never matches */
+bool pattern_set_compiled(const PatternSet *set, int index) {
+  return set && index >= 0 && index < set->count && set->compiled[index];
+}
+
+bool pattern_set_prefilter_stats(const PatternSet *set, int index, long *hits,
+                                 long *confirmed) {
+  if (!set || index < 0 || index >= set->count) return false;
+  if (!set->prefilter_enabled || !set->literals[index]) return false;
+
+  if (hits) *hits = set->prefilter_hits[index];
+  if (confirmed) *confirmed = set->prefilter_confirmed[index];
+  return true;
+}
+
+/* Shortest line the literal screen runs on, so its counters cover; 0: all */
+size_t pattern_set_screen_length(const PatternSet *set) {
+  if (!set || set->indexed || set->fallback_count > 0) return 0;
+  return PREFILTER_MIN_LENGTH;
+}
+
+void pattern_set_free(PatternSet *set) {
+  if (!set) return;
+
+  /* Only fallbacks hold a compiled regex */
+  if (set->regexes && set->fallback) {
+    for (int i = 0; i < set->fallback_count; i++)
+      regfree(&set->regexes[set->fallback[i]]);
+  }
+  free(set->regexes);
+  if (set->literals) {
+    for (int i = 0; i < set->count; i++) free(set->literals[i]);
+  }
+  free(set->compiled);
+  free(set->in_dfa);
+  free(set->fallback);
+  free(set->literals);
+  free(set->literal_lengths);
+  free(set->window_offsets);
+  free(set->bucket_patterns);
+  free(set->candidate);
+  free(set->prefilter_hits);
+  free(set->prefilter_confirmed);
+  free(set->regex_ns);
+  free(set->index_filter);
+  free(set->index_start);
+  free(set->index_patterns);
+  free(set->candidates);
+  free(set->pattern_starts);
+  free(set->dfa_starts);
+  free(set->nodes);
+  free(set->classes);
+  free(set->start_nodes);
+  free(set->states);
+  free(set->transitions);
+  free(set->hash_table);
+  free(set->set_pool);
+  free(set->accept_pool);
+  free(set->scratch);
+  free(set->pending);
+  free(set->stack);
+  free(set->mark);
+  free(set->seen);
+  free(set->copy);
+  free(set);
+}
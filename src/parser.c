@@ -5,213 +5,371 @@
 
 #include "include/log_analyzer.h"
 
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define HAVE_SSE2 1
+#endif
+
 #define _POSIX_C_SOURCE 200809L
 
-static char *trim_whitespace(char *str) {
-  char *end;
-
-  while (isspace((unsigned char)*str)) str++;
-  if (*str == 0) return str;
-
-  end = str + strlen(str) - 1;
-  while (end > str && isspace((unsigned char)*end)) end--;
-
-  *(end + 1) = 0;
-  return str;
-}
-
-static time_t extract_timestamp(const char *line) {
-  struct tm tm_time;
-  char month_str[4];
-  char *timestamp_str = strdup(line);
-  char *end_ptr;
-
-  memset(&tm_time, 0, sizeof(struct tm));
-
-  if (sscanf(timestamp_str, "%3s %d %d:%d:%d", month_str, &tm_time.tm_mday,
-             &tm_time.tm_hour, &tm_time.tm_min, &tm_time.tm_sec) == 5) {
-    if (strcmp(month_str, "Jan") == 0)
-      tm_time.tm_mon = 0;
-    else if (strcmp(month_str, "Feb") == 0)
-      tm_time.tm_mon = 1;
-    else if (strcmp(month_str, "Mar") == 0)
-      tm_time.tm_mon = 2;
-    else if (strcmp(month_str, "Apr") == 0)
-      tm_time.tm_mon = 3;
-    else if (strcmp(month_str, "May") == 0)
-      tm_time.tm_mon = 4;
-    else if (strcmp(month_str, "Jun") == 0)
-      tm_time.tm_mon = 5;
-    else if (strcmp(month_str, "Jul") == 0)
-      tm_time.tm_mon = 6;
-    else if (strcmp(month_str, "Aug") == 0)
-      tm_time.tm_mon = 7;
-    else if (strcmp(month_str, "Sep") == 0)
-      tm_time.tm_mon = 8;
-    else if (strcmp(month_str, "Oct") == 0)
-      tm_time.tm_mon = 9;
-    else if (strcmp(month_str, "Nov") == 0)
-      tm_time.tm_mon = 10;
-    else if (strcmp(month_str, "Dec") == 0)
-      tm_time.tm_mon = 11;
-
-    tm_time.tm_year = time(NULL) / 31536000 + 70;
-    free(timestamp_str);
-    return mktime(&tm_time);
+/* Bounded strstr: the line need not be NUL-terminated */
+static const char *find_bytes(const char *line, size_t length,
+                              const char *needle) {
+  size_t n = strlen(needle);
+  const char *p = line;
+  const char *end = line + length;
+
+  while ((size_t)(end - p) >= n) {
+    p = (const char *)memchr(p, needle[0], (size_t)(end - p) - n + 1);
+    if (!p) return NULL;
+    if (memcmp(p, needle, n) == 0) return p;
+    p++;
+  }
+  return NULL;
+}
+
+#define SEVERITY_DEFAULT 6 /* information */
+#define SEVERITY_TOKEN_MAX 11
+
+/* Severity of a whole-word level keyword, or -1 */
+static int keyword_severity(const char *token, size_t length) {
+#define IS(word) \
+  (length == sizeof(word) - 1 && memcmp(token, word, length) == 0)
+  switch (token[0]) {
+    case 'A':
+      return IS("ALERT") ? 1 : -1;
+    case 'C':
+      return IS("CRIT") || IS("CRITICAL") ? 2 : -1;
+    case 'D':
+      return IS("DEBUG") ? 7 : -1;
+    case 'E':
+      if (IS("EMERG") || IS("EMERGENCY")) return 0;
+      return IS("ERR") || IS("ERROR") ? 3 : -1;
+    case 'F':
+    case 'f':
+      return IS("FATAL") || IS("fatal") ? 0 : -1;
+    case 'I':
+    case 'i':
+      return IS("INFO") || IS("INFORMATION") || IS("information") ? 6 : -1;
+    case 'N':
+      return IS("NOTICE") ? 5 : -1;
+    case 'T':
+      return IS("TRACE") ? 7 : -1;
+    case 'W':
+      return IS("WARN") || IS("WARNING") ? 4 : -1;
+    default:
+      return -1;
   }
+#undef IS
+}
+
+/* Severity of a level name in any case ("warn", "Error"), or -1 */
+int log_parser_level_severity(const char *level, size_t length) {
+  char upper[SEVERITY_TOKEN_MAX];
+
+  if (!level || length == 0 || length > sizeof(upper)) return -1;
+  for (size_t i = 0; i < length; i++)
+    upper[i] = (char)toupper((unsigned char)level[i]);
+  return keyword_severity(upper, length);
+}
+
+/* The value of a JSON "level": "..." field, or -1 */
+static int json_field_severity(const char *token, size_t length,
+                               const char *line, const char *end) {
+  const char *p = token + length, *value;
+
+  if (token == line || token[-1] != '"' || p >= end || *p != '"') return -1;
+  if (!(length == 5 && memcmp(token, "level", 5) == 0) &&
+      !(length == 3 && memcmp(token, "lvl", 3) == 0) &&
+      !(length == 8 && memcmp(token, "severity", 8) == 0) &&
+      !(length == 8 && memcmp(token, "loglevel", 8) == 0))
+    return -1;
+
+  p++;
+  while (p < end && (*p == ' ' || *p == '\t')) p++;
+  if (p >= end || *p++ != ':') return -1;
+  while (p < end && (*p == ' ' || *p == '\t')) p++;
+  if (p >= end || *p++ != '"') return -1;
+
+  value = p;
+  while (p < end && isalpha((unsigned char)*p)) p++;
+  return log_parser_level_severity(value, (size_t)(p - value));
+}
+
+/* A syslog "<PRI>" prefix encodes facility * 8 + severity */
+static int syslog_priority_severity(const char *line, size_t length) {
+  int priority = 0;
+  size_t i = 1;
 
-  if (sscanf(timestamp_str, "d-%d-%dT%d:%d:%d", &tm_time.tm_year,
-             &tm_time.tm_mon, &tm_time.tm_mday, &tm_time.tm_hour,
-             &tm_time.tm_min, &tm_time.tm_sec) == 6) {
-    tm_time.tm_year -= 1900;
-    tm_time.tm_mon--;
+  if (length < 3 || line[0] != '<') return -1;
+  for (; i < length && i <= 3 && isdigit((unsigned char)line[i]); i++)
+    priority = priority * 10 + (line[i] - '0');
+  if (i == 1 || i >= length || line[i] != '>' || priority > 191) return -1;
+  return priority % 8;
+}
+
+static bool is_letter(unsigned char c) {
+  return (unsigned)((c | 0x20) - 'a') < 26;
+}
 
-    free(timestamp_str);
-    return mktime(&tm_time);
+/* Level keywords start upper case, bar "fatal" and "information" */
+static bool is_keyword_initial(unsigned char c) {
+  return (c >= 'A' && c <= 'Z') || c == 'f' || c == 'i';
+}
+
+/*
+ * Matches the word starting at `word` and folds it into *found. Returns
+ * true once the answer is final: a JSON level field or the top severity.
+ */
+static bool match_word(const unsigned char *word, const unsigned char *line,
+                       const unsigned char *end, int *found) {
+  const unsigned char *p = word;
+  size_t length;
+  int value;
+
+  while (p < end && is_letter(*p) && p - word <= SEVERITY_TOKEN_MAX) p++;
+  length = (size_t)(p - word);
+  if (length < 3 || length > SEVERITY_TOKEN_MAX) return false;
+
+  if (*word == 'l' || *word == 's') {
+    value = json_field_severity((const char *)word, length,
+                                (const char *)line, (const char *)end);
+    if (value < 0) return false;
+    *found = value;
+    return true;
   }
 
-  long timestamp = strtol(timestamp_str, &end_ptr, 10);
-  if (end_ptr != timestamp_str) {
-    free(timestamp_str);
-    return (time_t)timestamp;
+  value = keyword_severity((const char *)word, length);
+  if (value >= 0 && (*found < 0 || value < *found)) *found = value;
+  return *found == 0;
+}
+
+/* A word that may be a level keyword, or a quoted JSON field name */
+static bool is_candidate(const unsigned char *s, size_t pos) {
+  if (!is_letter(s[pos]) || (pos > 0 && is_letter(s[pos - 1]))) return false;
+  if (is_keyword_initial(s[pos])) return true;
+  return (s[pos] == 'l' || s[pos] == 's') && pos > 0 && s[pos - 1] == '"';
+}
+
+#ifdef HAVE_SSE2
+/* Bit i is set when byte i of the block is within [low, low + span] */
+static unsigned range_mask_sse2(__m128i v, char low, char span) {
+  __m128i offset = _mm_sub_epi8(v, _mm_set1_epi8(low));
+  return (unsigned)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(span)), offset));
+}
+
+static unsigned byte_mask_sse2(__m128i v, char c) {
+  return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+}
+
+/* Bit i is set when a candidate word starts at byte i of the block */
+static unsigned candidate_mask_sse2(const unsigned char *s, size_t pos) {
+  __m128i v = _mm_loadu_si128((const __m128i *)(s + pos));
+  unsigned letters, upper, starts, quoted;
+  unsigned carry = pos > 0 && is_letter(s[pos - 1]) ? 1u : 0u;
+  unsigned quote = pos > 0 && s[pos - 1] == '"' ? 1u : 0u;
+
+  letters = range_mask_sse2(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 25);
+  upper = range_mask_sse2(v, 'A', 25);
+  starts = letters & ~((letters << 1) | carry) & 0xffffu;
+  quoted = (byte_mask_sse2(v, 'l') | byte_mask_sse2(v, 's')) &
+           ((byte_mask_sse2(v, '"') << 1) | quote);
+
+  return starts & (upper | byte_mask_sse2(v, 'f') | byte_mask_sse2(v, 'i') |
+                   quoted);
+}
+#endif
+
+/*
+ * One pass over the line, matching whole words only. The most severe
+ * keyword wins; a syslog priority or a JSON level field is authoritative.
+ * With SSE2, candidate words are found sixteen bytes at a time.
+ */
+int log_parser_classify_severity(const char *line, size_t length) {
+  const unsigned char *s = (const unsigned char *)line;
+  const unsigned char *end = s + length;
+  int found = -1, value;
+  size_t pos = 0;
+
+  if (!line) return SEVERITY_DEFAULT;
+
+  value = syslog_priority_severity(line, length);
+  if (value >= 0) return value;
+
+#ifdef HAVE_SSE2
+  for (; pos + 16 <= length; pos += 16) {
+    unsigned candidates = candidate_mask_sse2(s, pos);
+
+    while (candidates) {
+      int k = __builtin_ctz(candidates);
+      candidates &= candidates - 1;
+      if (match_word(s + pos + k, s, end, &found)) return found;
+    }
   }
+#endif
 
-  free(timestamp_str);
-  return time(NULL);
-}
-
-static int extract_severity(const char *line) {
-  if (strstr(line, "EMERGENCY") || strstr(line, "EMERG") ||
-      strstr(line, "fatal"))
-    return 0;
-  else if (strstr(line, "ALERT"))
-    return 1;
-  else if (strstr(line, "CRITICAL") || strstr(line, "CRIT"))
-    return 2;
-  else if (strstr(line, "ERROR") || strstr(line, "ERR"))
-    return 3;
-  else if (strstr(line, "WARNING") || strstr(line, "WARN"))
-    return 4;
-  else if (strstr(line, "NOTICE"))
-    return 5;
-  else if (strstr(line, "INFO") || strstr(line, "information"))
-    return 6;
-  else if (strstr(line, "DEBUG"))
-    return 7;
-
-  return 6;  // default (information)
-}
-
-static char *extract_source(const char *line) {
+  for (; pos < length; pos++) {
+    if (is_candidate(s, pos) && match_word(s + pos, s, end, &found))
+      return found;
+  }
+
+  return found >= 0 ? found : SEVERITY_DEFAULT;
+}
+
+static LogSpan make_span(const char *line, const char *start,
+                         const char *end) {
+  LogSpan span;
+  span.offset = (size_t)(start - line);
+  span.length = (size_t)(end - start);
+  return span;
+}
+
+static LogSpan no_span(void) {
+  LogSpan span;
+  span.offset = LOG_SPAN_NONE;
+  span.length = 0;
+  return span;
+}
+
+static LogSpan extract_source(const char *line, size_t length) {
   const char *start, *end;
-  char *source;
-  size_t length;
 
-  if (line[0] == '[') {
+  if (length > 0 && line[0] == '[') {
     start = line + 1;
-    end = strchr(start, ']');
-    if (end) {
-      length = end - start;
-      source = (char *)malloc(length + 1);
-      strncpy(source, start, length);
-      source[length] = '\0';
-      return source;
-    }
+    end = (const char *)memchr(start, ']', length - 1);
+    if (end) return make_span(line, start, end);
   }
 
-  end = strchr(line, ':');
-  if (end) {
-    length = end - line;
-    if (length > 0 && length < 32) {
-      source = (char *)malloc(length + 1);
-      strncpy(source, line, length);
-      source[length] = '\0';
-      return source;
-    }
-  }
+  end = (const char *)memchr(line, ':', length);
+  if (end && end > line && end - line < 32) return make_span(line, line, end);
 
-  source = strdup("unknown");
-  return source;
+  return no_span();
 }
 
-static char *extract_process_id(const char *line) {
+static LogSpan extract_process_id(const char *line, size_t length) {
   const char *start, *end;
-  char *pid;
-  size_t length;
+  const char *line_end = line + length;
 
-  start = strchr(line, '[');
+  start = (const char *)memchr(line, '[', length);
   if (start) {
     start++;
-    end = strchr(start, ']');
-    if (end) {
-      length = end - start;
-      pid = (char *)malloc(length + 1);
-      strncpy(pid, start, length);
-      pid[length] = '\0';
-      return pid;
-    }
+    end = (const char *)memchr(start, ']', (size_t)(line_end - start));
+    if (end) return make_span(line, start, end);
   }
 
-  start = strstr(line, "PID ");
+  start = find_bytes(line, length, "PID ");
   if (start) {
     start += 4;
     end = start;
-    while (isdigit(*end)) end++;
-
-    if (end > start) {
-      length = end - start;
-      pid = (char *)malloc(length + 1);
-      strncpy(pid, start, length);
-      pid[length] = '\0';
-      return pid;
-    }
+    while (end < line_end && isdigit((unsigned char)*end)) end++;
+
+    if (end > start) return make_span(line, start, end);
   }
 
-  return NULL;
+  return no_span();
+}
+
+/*
+ * Lines go to the format's own parser when there is one; lines it does
+ * not recognize, and every line of an unknown format, get the generic
+ * heuristics below.
+ */
+bool log_parser_parse_record_as(const LogFormat *format,
+                                LogTimestampCache *cache, const char *line,
+                                size_t length, LogRecord *record) {
+  const char *nul, *message_start;
+
+  if (!cache || !line || !record) return false;
+
+  /* Like the C-string parser, stop at an embedded NUL */
+  nul = (const char *)memchr(line, '\0', length);
+  if (nul) length = (size_t)(nul - line);
+
+  if (format && format->parse && format->parse(cache, line, length, record))
+    return true;
+
+  record->line = line;
+  record->length = length;
+  record->has_timestamp =
+      log_timestamp_find(cache, line, length, &record->timestamp);
+  record->severity = log_parser_classify_severity(line, length);
+  record->source = extract_source(line, length);
+  record->process_id = extract_process_id(line, length);
+  record->thread_id = no_span();
+  record->fields = no_span();
+
+  message_start = find_bytes(line, length, ": ");
+  if (message_start)
+    record->message = make_span(line, message_start + 2, line + length);
+  else
+    record->message = make_span(line, line, line + length);
+
+  return true;
+}
+
+/* Worker threads pass a cache of their own; the context is only read */
+bool log_parser_parse_record_with_cache(const LogAnalyzerContext *ctx,
+                                        LogTimestampCache *cache,
+                                        const char *line, size_t length,
+                                        LogRecord *record) {
+  if (!ctx) return false;
+
+  return log_parser_parse_record_as(ctx->format, cache, line, length, record);
 }
 
+bool log_parser_parse_record(LogAnalyzerContext *ctx, const char *line,
+                             size_t length, LogRecord *record) {
+  if (!ctx) return false;
+
+  return log_parser_parse_record_with_cache(ctx, &ctx->timestamp_cache, line,
+                                            length, record);
+}
+
+static char *span_dup(LogArena *arena, const LogRecord *record,
+                      LogSpan span) {
+  if (span.offset == LOG_SPAN_NONE) return NULL;
+
+  return log_arena_strndup(arena, record->line + span.offset, span.length);
+}
+
+/* Entries stay valid until the next log_parser_reset() on their context */
 LogEntry *log_parser_parse_line(LogAnalyzerContext *ctx, const char *line) {
+  LogArena *arena;
   LogEntry *entry;
-  char *message_start;
-  size_t message_length;
+  LogRecord record;
 
   if (!ctx || !line) return NULL;
+  if (!log_parser_parse_record(ctx, line, strlen(line), &record)) return NULL;
+
+  if (!ctx->entry_arena) {
+    ctx->entry_arena = log_arena_create(LOG_ARENA_BLOCK_SIZE);
+    if (!ctx->entry_arena) return NULL;
+  }
+  arena = ctx->entry_arena;
 
-  entry = (LogEntry *)malloc(sizeof(LogEntry));
+  entry = (LogEntry *)log_arena_alloc(arena, sizeof(LogEntry));
   if (!entry) return NULL;
 
   memset(entry, 0, sizeof(LogEntry));
-  entry->raw_text = strdup(line);
-  entry->timestamp = extract_timestamp(line);
-  entry->severity = extract_severity(line);
-  entry->source = extract_source(line);
-  entry->process_id = extract_process_id(line);
-
-  message_start = strstr(line, ": ");
-  if (message_start) {
-    message_start += 2;
-    message_length = strlen(message_start);
-    entry->message = (char *)malloc(message_length + 1);
-    strcpy(entry->message, message_start);
-  } else {
-    entry->message = strdup(line);
-  }
-
-  entry->thread_id = NULL;
-  entry->additional_fields = NULL;
+  entry->raw_text = log_arena_strndup(arena, line, record.length);
+  entry->timestamp = record.timestamp;
+  entry->has_timestamp = record.has_timestamp;
+  entry->severity = record.severity;
+  entry->source = record.source.offset != LOG_SPAN_NONE
+                      ? span_dup(arena, &record, record.source)
+                      : log_arena_strndup(arena, "unknown", 7);
+  entry->process_id = span_dup(arena, &record, record.process_id);
+  entry->message = span_dup(arena, &record, record.message);
+  entry->thread_id = span_dup(arena, &record, record.thread_id);
+  entry->additional_fields = span_dup(arena, &record, record.fields);
 
   return entry;
 }
 
-void log_parser_free_entry(LogEntry *entry) {
-  if (!entry) return;
-
-  free(entry->raw_text);
-  free(entry->message);
-  free(entry->source);
-  free(entry->process_id);
-  free(entry->thread_id);
-  free(entry->additional_fields);
+/* Entries are owned by the context's arena and released together */
+void log_parser_free_entry(LogEntry *entry) { (void)entry; }
 
-  free(entry);
+void log_parser_reset(LogAnalyzerContext *ctx) {
+  if (ctx) log_arena_reset(ctx->entry_arena);
 }
@@ -0,0 +1,373 @@
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "include/log_analyzer.h"
+
+#define PARTIAL_MAGIC "LOGAPART"
+#define PARTIAL_VERSION 3
+#define PARTIAL_HEADER_SIZE 72
+#define PARTIAL_HAS_TIME_RANGE 1u
+
+/*
+ * A partial result is the detection state of one run, before ranking,
+ * in a fixed little-endian layout:
+ *
+ *    0  magic "LOGAPART"          8 bytes
+ *    8  version                   u32
+ *   12  pattern count             u32
+ *   16  pattern table hash        u64
+ *   24  runs folded into it       u64
+ *   32  lines read                u64
+ *   40  entries with a message    u64
+ *   48  flags                     u32   (bit 0: time range is set)
+ *   52  reserved, zero            u32
+ *   56  first timestamp           i64
+ *   64  last timestamp            i64
+ *   72  frequencies               u64 per pattern, in table order
+ *    …  per pattern, in table order:
+ *         histogram width         u32   (seconds, 0 without a histogram)
+ *         bucket count            u32
+ *         buckets                 i64 start, u64 count each
+ *    …  template count            u32
+ *    …  per template:
+ *         count, error            u64, u64
+ *         text length             u32
+ *         text                    bytes, no terminator
+ *    …  FNV-1a of all of the above u64
+ *
+ * Merging adds the counts of parts made with the same pattern table, so
+ * its cost is linear in the number of parts and the buckets and
+ * templates they hold.
+ */
+
+static void put_u32(unsigned char *out, uint32_t value) {
+  for (int i = 0; i < 4; i++) out[i] = (unsigned char)(value >> (8 * i));
+}
+
+static void put_u64(unsigned char *out, uint64_t value) {
+  for (int i = 0; i < 8; i++) out[i] = (unsigned char)(value >> (8 * i));
+}
+
+static uint32_t get_u32(const unsigned char *in) {
+  uint32_t value = 0;
+
+  for (int i = 3; i >= 0; i--) value = (value << 8) | in[i];
+  return value;
+}
+
+static uint64_t get_u64(const unsigned char *in) {
+  uint64_t value = 0;
+
+  for (int i = 7; i >= 0; i--) value = (value << 8) | in[i];
+  return value;
+}
+
+static uint64_t checksum(const unsigned char *data, size_t length) {
+  uint64_t hash = 14695981039346656037ull;
+
+  for (size_t i = 0; i < length; i++) {
+    hash ^= data[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+/* Bytes of the histogram section for one pattern */
+static size_t histogram_size(const LogHistogram *histogram) {
+  return 8 + log_histogram_bucket_count(histogram) * 16;
+}
+
+static unsigned char *put_histogram(unsigned char *out,
+                                    const LogHistogram *histogram) {
+  size_t cursor = 0;
+  time_t start;
+  long count;
+
+  put_u32(out, (uint32_t)log_histogram_width(histogram));
+  put_u32(out + 4, (uint32_t)log_histogram_bucket_count(histogram));
+  out += 8;
+  while (log_histogram_next_bucket(histogram, &cursor, &start, &count)) {
+    put_u64(out, (uint64_t)(int64_t)start);
+    put_u64(out + 8, (uint64_t)count);
+    out += 16;
+  }
+  return out;
+}
+
+static size_t templates_size(const LogTemplateMiner *miner) {
+  LogTemplate template;
+  size_t size = 4;
+  int cursor = 0;
+
+  while (log_template_next(miner, &cursor, &template))
+    size += 20 + strlen(template.text);
+  return size;
+}
+
+static unsigned char *put_templates(unsigned char *out,
+                                    const LogTemplateMiner *miner) {
+  LogTemplate template;
+  size_t length;
+  int cursor = 0;
+
+  put_u32(out, (uint32_t)log_template_count(miner));
+  out += 4;
+  while (log_template_next(miner, &cursor, &template)) {
+    length = strlen(template.text);
+    put_u64(out, (uint64_t)template.count);
+    put_u64(out + 8, (uint64_t)template.error);
+    put_u32(out + 16, (uint32_t)length);
+    memcpy(out + 20, template.text, length);
+    out += 20 + length;
+  }
+  return out;
+}
+
+/* Writes the context's counts to path; call before ranking */
+bool log_partial_save(const LogAnalyzerContext *ctx, const char *path) {
+  char temp_path[MAX_PATH_LENGTH + 8];
+  unsigned char *data, *out;
+  size_t size, body;
+  bool success;
+  FILE *fp;
+
+  if (!ctx || !path) return false;
+
+  body = PARTIAL_HEADER_SIZE + (size_t)ctx->pattern_count * 8;
+  for (int i = 0; i < ctx->pattern_count; i++)
+    body += histogram_size(ctx->patterns[i].histogram);
+  body += templates_size(ctx->template_miner);
+  size = body + 8;
+  data = (unsigned char *)calloc(1, size);
+  if (!data) return false;
+
+  memcpy(data, PARTIAL_MAGIC, 8);
+  put_u32(data + 8, PARTIAL_VERSION);
+  put_u32(data + 12, (uint32_t)ctx->pattern_count);
+  put_u64(data + 16, pattern_detector_hash(ctx));
+  put_u64(data + 24, (uint64_t)(ctx->merge ? ctx->part_count : 1));
+  put_u64(data + 32, (uint64_t)ctx->line_count);
+  put_u64(data + 40, (uint64_t)ctx->entry_count);
+  if (ctx->time_range.valid) {
+    put_u32(data + 48, PARTIAL_HAS_TIME_RANGE);
+    put_u64(data + 56, (uint64_t)(int64_t)ctx->time_range.first);
+    put_u64(data + 64, (uint64_t)(int64_t)ctx->time_range.last);
+  }
+  out = data + PARTIAL_HEADER_SIZE;
+  for (int i = 0; i < ctx->pattern_count; i++, out += 8)
+    put_u64(out, (uint64_t)ctx->patterns[i].frequency);
+  for (int i = 0; i < ctx->pattern_count; i++)
+    out = put_histogram(out, ctx->patterns[i].histogram);
+  put_templates(out, ctx->template_miner);
+  put_u64(data + body, checksum(data, body));
+
+  /* Same temp-and-rename as checkpoints, so readers never see half */
+  snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+  fp = fopen(temp_path, "wb");
+  if (!fp) {
+    perror("Failed to write partial result");
+    free(data);
+    return false;
+  }
+  success = fwrite(data, 1, size, fp) == size;
+  success = fclose(fp) == 0 && success && rename(temp_path, path) == 0;
+  if (!success) {
+    perror("Failed to write partial result");
+    remove(temp_path);
+  }
+
+  free(data);
+  return success;
+}
+
+/* Reads a whole file; NULL if it cannot be read */
+static unsigned char *read_partial(const char *path, size_t *size) {
+  unsigned char *data = NULL;
+  struct stat st;
+  FILE *fp;
+
+  fp = fopen(path, "rb");
+  if (!fp) {
+    perror(path);
+    return NULL;
+  }
+  if (fstat(fileno(fp), &st) == 0 && st.st_size > 0) {
+    *size = (size_t)st.st_size;
+    data = (unsigned char *)malloc(*size);
+    if (data && fread(data, 1, *size, fp) != *size) {
+      free(data);
+      data = NULL;
+    }
+  }
+  fclose(fp);
+  return data;
+}
+
+/*
+ * Checks that the histogram sections fit in [start, end), that every
+ * width is one a histogram can take (60 seconds, doubled k times) and
+ * that every bucket holds a positive count. Returns the end of the
+ * sections, or NULL.
+ */
+static const unsigned char *histograms_fit(const unsigned char *start,
+                                           const unsigned char *end,
+                                           int pattern_count) {
+  uint32_t width, scale;
+  uint64_t buckets;
+
+  for (int i = 0; i < pattern_count; i++) {
+    if (end - start < 8) return NULL;
+    width = get_u32(start);
+    buckets = get_u32(start + 4);
+    scale = width / LOG_HISTOGRAM_WIDTH;
+    if (buckets > (uint64_t)(end - start - 8) / 16) return NULL;
+    if (buckets > 0 && (width % LOG_HISTOGRAM_WIDTH != 0 || scale == 0 ||
+                        scale > INT_MAX / LOG_HISTOGRAM_WIDTH ||
+                        (scale & (scale - 1)) != 0))
+      return NULL;
+    start += 8;
+    for (uint64_t j = 0; j < buckets; j++, start += 16)
+      if (get_u64(start + 8) == 0 || get_u64(start + 8) > LONG_MAX)
+        return NULL;
+  }
+  return start;
+}
+
+/* Checks that the template section exactly fills [start, end) */
+static bool templates_fit(const unsigned char *start,
+                          const unsigned char *end) {
+  uint32_t count, length;
+
+  if (!start || end - start < 4) return false;
+  count = get_u32(start);
+  start += 4;
+  while (count-- > 0) {
+    if (end - start < 20) return false;
+    length = get_u32(start + 16);
+    if (get_u64(start) == 0 || get_u64(start) > LONG_MAX ||
+        get_u64(start + 8) > LONG_MAX || length == 0 ||
+        length > (size_t)(end - start - 20) ||
+        memchr(start + 20, '\n', length) != NULL)
+      return false;
+    start += 20 + length;
+  }
+  return start == end;
+}
+
+static bool merge_templates(LogTemplateMiner *miner, const unsigned char *in) {
+  uint32_t count = get_u32(in), length;
+  bool success = true;
+
+  for (in += 4; count-- > 0 && success; in += 20 + length) {
+    length = get_u32(in + 16);
+    success = log_template_add_counted(miner, (const char *)in + 20, length,
+                                       (long)get_u64(in),
+                                       (long)get_u64(in + 8));
+  }
+  return success;
+}
+
+/* Adds one pattern's saved histogram; returns the next section */
+static const unsigned char *merge_histogram(Pattern *pattern,
+                                            const unsigned char *in,
+                                            bool *success) {
+  int width = (int)get_u32(in);
+  uint32_t buckets = get_u32(in + 4);
+  const unsigned char *next = in + 8 + (size_t)buckets * 16;
+
+  if (buckets == 0 || !*success) return next;
+  if (!pattern->histogram) pattern->histogram = log_histogram_create();
+  *success = pattern->histogram != NULL;
+
+  in += 8;
+  for (uint32_t i = 0; i < buckets && *success; i++, in += 16)
+    *success = log_histogram_add_bucket(pattern->histogram, width,
+                                        (time_t)(int64_t)get_u64(in),
+                                        (long)get_u64(in + 8));
+  return next;
+}
+
+/* Whether adding value to *total stays within a long */
+static bool fits(long total, uint64_t value) {
+  return value <= (uint64_t)(LONG_MAX - total);
+}
+
+/*
+ * Adds the counts in a partial result to the context. The context is
+ * left untouched if the file is damaged or from another pattern table.
+ */
+bool log_partial_merge(LogAnalyzerContext *ctx, const char *path) {
+  size_t size = 0, body, histograms;
+  unsigned char *data;
+  const unsigned char *frequencies, *in;
+  uint64_t runs, lines, entries;
+  LogTimeRange range;
+  bool valid;
+
+  if (!ctx || !path) return false;
+
+  data = read_partial(path, &size);
+  if (!data) {
+    fprintf(stderr, "Cannot read partial result: %s\n", path);
+    return false;
+  }
+
+  histograms = PARTIAL_HEADER_SIZE + (size_t)ctx->pattern_count * 8;
+  body = size - 8;
+  if (size < histograms + 8 || memcmp(data, PARTIAL_MAGIC, 8) != 0 ||
+      get_u32(data + 8) != PARTIAL_VERSION ||
+      get_u64(data + body) != checksum(data, body)) {
+    fprintf(stderr, "Not a valid partial result: %s\n", path);
+    free(data);
+    return false;
+  }
+  if (get_u32(data + 12) != (uint32_t)ctx->pattern_count ||
+      get_u64(data + 16) != pattern_detector_hash(ctx)) {
+    fprintf(stderr, "Partial result was made with other patterns: %s\n",
+            path);
+    free(data);
+    return false;
+  }
+  if (!templates_fit(histograms_fit(data + histograms, data + body,
+                                    ctx->pattern_count),
+                     data + body)) {
+    fprintf(stderr, "Not a valid partial result: %s\n", path);
+    free(data);
+    return false;
+  }
+
+  runs = get_u64(data + 24);
+  lines = get_u64(data + 32);
+  entries = get_u64(data + 40);
+  frequencies = data + PARTIAL_HEADER_SIZE;
+  valid = fits(ctx->part_count, runs) && fits(ctx->line_count, lines) &&
+          fits(ctx->entry_count, entries);
+  for (int i = 0; valid && i < ctx->pattern_count; i++)
+    valid = fits(ctx->patterns[i].frequency, get_u64(frequencies + i * 8));
+  if (!valid) {
+    fprintf(stderr, "Counts overflow when merging %s\n", path);
+    free(data);
+    return false;
+  }
+
+  ctx->part_count += (long)runs;
+  ctx->line_count += (long)lines;
+  ctx->entry_count += (long)entries;
+  for (int i = 0; i < ctx->pattern_count; i++)
+    ctx->patterns[i].frequency += (long)get_u64(frequencies + i * 8);
+
+  range.valid = (get_u32(data + 48) & PARTIAL_HAS_TIME_RANGE) != 0;
+  range.first = (time_t)(int64_t)get_u64(data + 56);
+  range.last = (time_t)(int64_t)get_u64(data + 64);
+  log_time_range_merge(&ctx->time_range, &range);
+
+  valid = true;
+  in = data + histograms;
+  for (int i = 0; i < ctx->pattern_count; i++)
+    in = merge_histogram(&ctx->patterns[i], in, &valid);
+  valid = valid && merge_templates(ctx->template_miner, in);
+  if (!valid) fprintf(stderr, "Out of memory merging %s\n", path);
+
+  free(data);
+  return valid;
+}
@@ -0,0 +1,117 @@
+#include <errno.h>
+
+#include "include/log_analyzer.h"
+
+#define PATTERN_FIELDS 4
+
+/*
+ * Pattern files hold one pattern per line as four tab-separated fields:
+ *
+ *   regex <TAB> description <TAB> category <TAB> severity
+ *
+ * The regex is POSIX extended, as in the built-in table, and severity
+ * runs from 1 to 5. Blank lines and lines starting with '#' are skipped.
+ * There is no limit on the number of patterns.
+ */
+
+bool log_table_open(LogTableReader *reader, const char *path) {
+  memset(reader, 0, sizeof(LogTableReader));
+  reader->path = path;
+  reader->fp = fopen(path, "r");
+  if (!reader->fp) perror(path);
+  return reader->fp != NULL;
+}
+
+/* Splits line in place at tabs; false unless it has exactly count fields */
+static bool split_fields(char *line, char **fields, int count) {
+  int found = 0;
+
+  fields[found++] = line;
+  for (char *p = line; *p; p++) {
+    if (*p != '\t') continue;
+    if (found == count) return false;
+    *p = '\0';
+    fields[found++] = p + 1;
+  }
+  return found == count;
+}
+
+/*
+ * Reads the next line that is neither blank nor a '#' comment and splits
+ * it into fields; complete says whether it had exactly field_count of
+ * them. False at the end of the file.
+ */
+bool log_table_next(LogTableReader *reader, char **fields, int field_count,
+                    bool *complete) {
+  ssize_t length;
+  char *line;
+
+  while ((length = getline(&reader->line, &reader->capacity,
+                           reader->fp)) >= 0) {
+    line = reader->line;
+    reader->number++;
+    while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+      line[--length] = '\0';
+    if (length == 0 || line[0] == '#') continue;
+
+    *complete = split_fields(line, fields, field_count);
+    return true;
+  }
+  return false;
+}
+
+/* Closes the file; false, after saying why, if reading it failed */
+bool log_table_close(LogTableReader *reader) {
+  bool success = !ferror(reader->fp);
+
+  if (!success) perror(reader->path);
+  free(reader->line);
+  fclose(reader->fp);
+  return success;
+}
+
+static bool parse_severity(const char *text, int *severity) {
+  char *end;
+  long value;
+
+  errno = 0;
+  value = strtol(text, &end, 10);
+  if (errno != 0 || end == text || *end != '\0' || value < 1 || value > 5)
+    return false;
+  *severity = (int)value;
+  return true;
+}
+
+/* Appends the patterns in path to the table; false if any line is bad */
+bool log_patterns_load(LogAnalyzerContext *ctx, const char *path) {
+  char *fields[PATTERN_FIELDS];
+  LogTableReader reader;
+  int severity, loaded = 0;
+  bool success = true, complete;
+
+  if (!ctx || !path || !log_table_open(&reader, path)) return false;
+
+  while (success && log_table_next(&reader, fields, PATTERN_FIELDS,
+                                   &complete)) {
+    if (!complete || fields[0][0] == '\0' ||
+        !parse_severity(fields[3], &severity)) {
+      fprintf(stderr,
+              "%s:%ld: expected regex, description, category and severity "
+              "1-5 separated by tabs\n",
+              path, reader.number);
+      success = false;
+    } else if (!pattern_detector_add(ctx, fields[0], fields[1], fields[2],
+                                     severity)) {
+      fprintf(stderr, "Out of memory loading patterns from %s\n", path);
+      success = false;
+    } else {
+      loaded++;
+    }
+  }
+  success = log_table_close(&reader) && success;
+  if (success && loaded == 0) {
+    fprintf(stderr, "No patterns in %s\n", path);
+    success = false;
+  }
+  return success;
+}
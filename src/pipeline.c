@@ -0,0 +1,349 @@
+#include <pthread.h>
+#include <sched.h>
+
+#include "include/log_analyzer.h"
+
+#define CACHE_LINE_SIZE 64
+#define PIPE_BATCH_LINES 256
+#define PIPE_BATCH_BYTES (64 * 1024) /* text per batch before it is sent */
+#define PIPE_QUEUE_DEPTH 8           /* batches queued between two stages */
+#define PIPE_BATCHES (2 * PIPE_QUEUE_DEPTH + 3) /* queued, or one per stage */
+#define PIPE_RING_SLOTS 32 /* a power of two no smaller than PIPE_BATCHES */
+
+/*
+ * --pipeline runs reading, parsing and matching on three threads, for
+ * input that cannot be split into byte ranges (stdin, pipes, gzip).
+ * Lines travel in batches through bounded single-producer,
+ * single-consumer rings:
+ *
+ *   reader -> to_parse -> parser -> to_match -> matcher (calling thread)
+ *      ^                                              |
+ *      +------------------- free <-------------------+
+ *
+ * The pool of PIPE_BATCHES is the backpressure: a stage that gets ahead
+ * finds the ring to the next one full and waits. Lines reach the
+ * matcher in input order, so results equal a sequential run's.
+ */
+
+/* Copies of the lines of one read, then the records parsed from them */
+typedef struct {
+  char *text;
+  size_t length;
+  size_t capacity;
+  size_t offsets[PIPE_BATCH_LINES];
+  size_t lengths[PIPE_BATCH_LINES];
+  int line_count;
+  LogRecord records[PIPE_BATCH_LINES];
+  int record_count;
+} PipeBatch;
+
+/*
+ * Each side writes only its own cache line: the producer its tail and
+ * the push counts, the consumer its head and the empty waits. A NULL
+ * item marks the end of the input.
+ */
+typedef struct {
+  size_t tail;
+  LogQueueStats pushes;
+  char producer_pad[CACHE_LINE_SIZE];
+  size_t head;
+  long empty_waits;
+  char consumer_pad[CACHE_LINE_SIZE];
+  size_t capacity;
+  void *slots[PIPE_RING_SLOTS];
+} PipeRing;
+
+typedef struct {
+  PipeRing to_parse;
+  PipeRing to_match;
+  PipeRing free;
+  LogAnalyzerContext *ctx;
+  PipeBatch *batches;
+  LogTimestampCache timestamp_cache; /* the parser's */
+  int stop;                          /* set by a stage that failed */
+  bool read_success;
+  bool parse_success;
+  LogStats counts; /* the reader's and parser's, stored as they finish */
+  double wait_ns[LOG_PIPELINE_STAGES];
+} Pipeline;
+
+/* Yields to the other stages first, then sleeps longer the longer it waits */
+static void back_off(int *round) {
+  struct timespec delay;
+
+  if (*round < 16) {
+    sched_yield();
+  } else {
+    delay.tv_sec = 0;
+    delay.tv_nsec = 1000L << (*round < 26 ? *round - 16 : 10);
+    nanosleep(&delay, NULL);
+  }
+  (*round)++;
+}
+
+static bool stopped(Pipeline *pipe) {
+  return __atomic_load_n(&pipe->stop, __ATOMIC_ACQUIRE) != 0;
+}
+
+static void stop(Pipeline *pipe) {
+  __atomic_store_n(&pipe->stop, 1, __ATOMIC_RELEASE);
+}
+
+/* Waits while the ring is full; false if another stage failed meanwhile */
+static bool ring_push(Pipeline *pipe, PipeRing *ring, void *item,
+                      double *wait_ns) {
+  size_t tail = ring->tail;
+  size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  double start;
+  int round = 0;
+
+  if (tail - head == ring->capacity) {
+    ring->pushes.full_waits++;
+    start = log_stats_now();
+    while (tail - head == ring->capacity) {
+      if (stopped(pipe)) return false;
+      back_off(&round);
+      head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    }
+    *wait_ns += log_stats_now() - start;
+  }
+
+  ring->slots[tail % PIPE_RING_SLOTS] = item;
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+  ring->pushes.batches++;
+  ring->pushes.depth_sum += (long)(tail + 1 - head);
+  if ((int)(tail + 1 - head) > ring->pushes.max_depth)
+    ring->pushes.max_depth = (int)(tail + 1 - head);
+  return true;
+}
+
+/* Waits while the ring is empty; false if another stage failed meanwhile */
+static bool ring_pop(Pipeline *pipe, PipeRing *ring, void **item,
+                     double *wait_ns) {
+  size_t head = ring->head;
+  size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  double start;
+  int round = 0;
+
+  if (tail == head) {
+    ring->empty_waits++;
+    start = log_stats_now();
+    while (tail == head) {
+      if (stopped(pipe)) return false;
+      back_off(&round);
+      tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    }
+    *wait_ns += log_stats_now() - start;
+  }
+
+  *item = ring->slots[head % PIPE_RING_SLOTS];
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+/* Copies a borrowed line into the batch, which outlives the next read */
+static bool batch_add(PipeBatch *batch, const LogLine *line) {
+  size_t capacity;
+  char *text;
+
+  if (batch->length + line->length > batch->capacity) {
+    capacity = batch->capacity;
+    while (capacity < batch->length + line->length) capacity *= 2;
+    text = (char *)realloc(batch->text, capacity);
+    if (!text) return false;
+    batch->text = text;
+    batch->capacity = capacity;
+  }
+  memcpy(batch->text + batch->length, line->data, line->length);
+  batch->offsets[batch->line_count] = batch->length;
+  batch->lengths[batch->line_count] = line->length;
+  batch->length += line->length;
+  batch->line_count++;
+  return true;
+}
+
+/* Line counts stay in locals until the end; the stages share pipe */
+static void *read_stage(void *arg) {
+  Pipeline *pipe = (Pipeline *)arg;
+  double *wait_ns = &pipe->wait_ns[0];
+  long lines = 0, bytes = 0, oversized = 0;
+  PipeBatch *batch;
+  LogLine line;
+  bool more = true;
+  void *item;
+
+  while (more) {
+    if (!ring_pop(pipe, &pipe->free, &item, wait_ns)) break;
+    batch = (PipeBatch *)item;
+    batch->length = 0;
+    batch->line_count = 0;
+
+    while (batch->line_count < PIPE_BATCH_LINES &&
+           batch->length < PIPE_BATCH_BYTES &&
+           (more = log_collector_next_line(pipe->ctx, &line))) {
+      if (!batch_add(batch, &line)) {
+        stop(pipe);
+        break;
+      }
+      lines++;
+      bytes += (long)line.length + 1;
+      if (line.length > MAX_LINE_LENGTH) oversized++;
+    }
+    if (stopped(pipe) || (batch->line_count > 0 &&
+                          !ring_push(pipe, &pipe->to_parse, batch, wait_ns)))
+      break;
+  }
+
+  pipe->read_success =
+      !more && ring_push(pipe, &pipe->to_parse, NULL, wait_ns);
+  pipe->counts.lines_read = lines;
+  pipe->counts.bytes_read = bytes;
+  pipe->counts.oversized_lines = oversized;
+  return NULL;
+}
+
+static void *parse_stage(void *arg) {
+  Pipeline *pipe = (Pipeline *)arg;
+  double *wait_ns = &pipe->wait_ns[1];
+  long dropped = 0;
+  PipeBatch *batch;
+  LogRecord *record;
+  void *item;
+
+  for (;;) {
+    if (!ring_pop(pipe, &pipe->to_parse, &item, wait_ns)) break;
+    batch = (PipeBatch *)item;
+    if (!batch) {
+      pipe->parse_success =
+          ring_push(pipe, &pipe->to_match, NULL, wait_ns);
+      break;
+    }
+
+    batch->record_count = 0;
+    for (int i = 0; i < batch->line_count; i++) {
+      record = &batch->records[batch->record_count];
+      if (log_parser_parse_record_with_cache(
+              pipe->ctx, &pipe->timestamp_cache,
+              batch->text + batch->offsets[i], batch->lengths[i], record))
+        batch->record_count++;
+      else
+        dropped++;
+    }
+    if (!ring_push(pipe, &pipe->to_match, batch, wait_ns)) break;
+  }
+
+  pipe->counts.lines_dropped = dropped;
+  return NULL;
+}
+
+/* The last stage, on the calling thread, which owns the results */
+static bool match_stage(Pipeline *pipe) {
+  double *wait_ns = &pipe->wait_ns[2];
+  LogStats *stats = pipe->ctx->stats;
+  PipeBatch *batch;
+  long matched = 0;
+  void *item;
+
+  for (;;) {
+    if (!ring_pop(pipe, &pipe->to_match, &item, wait_ns)) return false;
+    batch = (PipeBatch *)item;
+    if (!batch) return true;
+
+    for (int i = 0; i < batch->record_count; i++, matched++) {
+      if (stats)
+        stats->profiling = matched % LOG_STATS_SAMPLE == LOG_STATS_SAMPLE / 2;
+      if (!pattern_detector_process_record(pipe->ctx, &batch->records[i]))
+        return false;
+    }
+    if (!ring_push(pipe, &pipe->free, batch, wait_ns)) return false;
+  }
+}
+
+static Pipeline *pipeline_create(LogAnalyzerContext *ctx) {
+  Pipeline *pipe;
+  void *memory;
+
+  if (posix_memalign(&memory, CACHE_LINE_SIZE, sizeof(Pipeline)) != 0)
+    return NULL;
+  pipe = (Pipeline *)memory;
+  memset(pipe, 0, sizeof(Pipeline));
+  pipe->ctx = ctx;
+  pipe->to_parse.capacity = PIPE_QUEUE_DEPTH;
+  pipe->to_match.capacity = PIPE_QUEUE_DEPTH;
+  pipe->free.capacity = PIPE_BATCHES;
+
+  pipe->batches = (PipeBatch *)calloc(PIPE_BATCHES, sizeof(PipeBatch));
+  if (!pipe->batches) {
+    free(pipe);
+    return NULL;
+  }
+  /* Every batch starts out free; the caller checks they all were made */
+  for (int i = 0; i < PIPE_BATCHES; i++) {
+    pipe->batches[i].capacity = PIPE_BATCH_BYTES + MAX_LINE_LENGTH;
+    pipe->batches[i].text = (char *)malloc(pipe->batches[i].capacity);
+    if (!pipe->batches[i].text) break;
+    pipe->free.slots[pipe->free.tail++] = &pipe->batches[i];
+  }
+  return pipe;
+}
+
+static void pipeline_free(Pipeline *pipe) {
+  for (int i = 0; i < PIPE_BATCHES; i++) free(pipe->batches[i].text);
+  free(pipe->batches);
+  free(pipe);
+}
+
+/* Adds the stages' counts to --stats once the threads are joined */
+static void report_stats(const Pipeline *pipe, LogStats *stats) {
+  stats->pipelined = true;
+  stats->queue_capacity = PIPE_QUEUE_DEPTH;
+  stats->lines_read += pipe->counts.lines_read;
+  stats->bytes_read += pipe->counts.bytes_read;
+  stats->oversized_lines += pipe->counts.oversized_lines;
+  stats->lines_dropped += pipe->counts.lines_dropped;
+  stats->queues[0] = pipe->to_parse.pushes;
+  stats->queues[0].empty_waits = pipe->to_parse.empty_waits;
+  stats->queues[1] = pipe->to_match.pushes;
+  stats->queues[1].empty_waits = pipe->to_match.empty_waits;
+  for (int i = 0; i < LOG_PIPELINE_STAGES; i++)
+    stats->wait_ns[i] = pipe->wait_ns[i];
+}
+
+bool log_pipeline_run(LogAnalyzerContext *ctx) {
+  pthread_t reader, parser;
+  bool reading = false, parsing = false, success;
+  Pipeline *pipe;
+
+  if (!ctx || !ctx->collector || !ctx->pattern_set) return false;
+
+  pipe = pipeline_create(ctx);
+  if (!pipe) return false;
+  success = pipe->free.tail == PIPE_BATCHES;
+
+  /* Lines without a timestamp get the same start time in both stages */
+  if (ctx->timestamp_cache.year == 0)
+    log_timestamp_cache_init(&ctx->timestamp_cache);
+  pipe->timestamp_cache = ctx->timestamp_cache;
+
+  if (success) {
+    reading = pthread_create(&reader, NULL, read_stage, pipe) == 0;
+    parsing = reading && pthread_create(&parser, NULL, parse_stage, pipe) == 0;
+    success = parsing;
+    if (!success) fprintf(stderr, "Failed to start pipeline threads\n");
+  }
+
+  if (success) success = match_stage(pipe);
+  if (!success) stop(pipe);
+  if (parsing) pthread_join(parser, NULL);
+  if (reading) pthread_join(reader, NULL);
+  success = success && pipe->read_success && pipe->parse_success;
+
+  ctx->timestamp_cache = pipe->timestamp_cache;
+  if (ctx->stats) {
+    ctx->stats->profiling = false;
+    report_stats(pipe, ctx->stats);
+  }
+  pipeline_free(pipe);
+  return success && !log_collector_failed(ctx);
+}
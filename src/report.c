@@ -18,7 +18,99 @@ static void close_output_file(FILE *fp) {
   if (fp && fp != stdout) fclose(fp);
 }
 
+static void format_time(time_t timestamp, char *buffer, size_t size) {
+  struct tm tm;
+
+  if (!gmtime_r(&timestamp, &tm) ||
+      strftime(buffer, size, "%Y-%m-%d %H:%M:%S UTC", &tm) == 0)
+    snprintf(buffer, size, "%lld", (long long)timestamp);
+}
+
+/* How much log the frequencies below were counted over */
+static void write_coverage(FILE *fp, const LogAnalyzerContext *ctx) {
+  char first[64], last[64];
+
+  fprintf(fp, "Lines Read: %ld (%ld with a message)\n", ctx->line_count,
+          ctx->entry_count);
+  if (ctx->time_range.valid) {
+    format_time(ctx->time_range.first, first, sizeof(first));
+    format_time(ctx->time_range.last, last, sizeof(last));
+    fprintf(fp, "Time Range: %s to %s\n", first, last);
+  }
+}
+
+/* Lines that passed the literal screen, which skips short lines */
+static void write_prefilter(FILE *fp, const LogAnalyzerContext *ctx,
+                            const Pattern *pattern) {
+  size_t length = pattern_set_screen_length(ctx->pattern_set);
+
+  if (length > 0)
+    fprintf(fp,
+            "  Prefilter Hits (lines of %zu+ bytes): %ld (confirmed: %ld)\n",
+            length, pattern->prefilter_hits, pattern->prefilter_confirmed);
+  else
+    fprintf(fp, "  Prefilter Hits: %ld (confirmed: %ld)\n",
+            pattern->prefilter_hits, pattern->prefilter_confirmed);
+}
+
+/* Rates from the pattern's histogram; nothing if no match had a time */
+static void write_rates(FILE *fp, const Pattern *pattern) {
+  const LogRateSummary *rate = &pattern->rate;
+  char start[64], end[64];
+
+  if (rate->bucket_width == 0) return;
+
+  format_time(rate->peak_start, start, sizeof(start));
+  fprintf(fp, "  Peak Rate: %.1f/min at %s (mean %.3g/min, %d s buckets)\n",
+          rate->peak_rate, start, rate->mean_rate, rate->bucket_width);
+  for (int i = 0; i < rate->burst_count; i++) {
+    format_time(rate->bursts[i].start, start, sizeof(start));
+    format_time(rate->bursts[i].end, end, sizeof(end));
+    fprintf(fp, "  Burst: %s to %s, %ld matches\n", start, end,
+            rate->bursts[i].count);
+  }
+}
+
+/* Share of all messages, in percent */
+static double message_share(const LogAnalyzerContext *ctx, long count) {
+  return ctx->entry_count > 0 ? 100.0 * count / ctx->entry_count : 0.0;
+}
+
+/* Mined templates, most frequent first, whether or not a pattern knows them */
+static void write_templates(FILE *fp, const LogAnalyzerContext *ctx,
+                            bool summary) {
+  LogTemplate templates[LOG_TEMPLATE_TOP];
+  int count = log_template_top(ctx->template_miner, templates,
+                               summary ? 5 : LOG_TEMPLATE_TOP);
+
+  if (count == 0) return;
+  if (summary) {
+    fprintf(fp, "Top Message Templates:\n");
+    fprintf(fp, "-----------------------------------------------\n");
+    for (int i = 0; i < count; i++)
+      fprintf(fp, "[%d] %.70s%s (Count: %ld, %.1f%%)\n", i + 1,
+              templates[i].text, strlen(templates[i].text) > 70 ? "..." : "",
+              templates[i].count, message_share(ctx, templates[i].count));
+    fprintf(fp, "\n");
+    return;
+  }
+
+  fprintf(fp, "============================================================\n");
+  fprintf(fp, "                  RECURRING MESSAGE TEMPLATES               \n");
+  fprintf(fp,
+          "============================================================\n\n");
+  for (int i = 0; i < count; i++) {
+    fprintf(fp, "Template %d:\n", i + 1);
+    fprintf(fp, "  Count: %ld (%.1f%% of messages)\n", templates[i].count,
+            message_share(ctx, templates[i].count));
+    if (templates[i].error > 0)
+      fprintf(fp, "  Count Error: up to %ld\n", templates[i].error);
+    fprintf(fp, "  Text: %s\n\n", templates[i].text);
+  }
+}
+
 bool report_generator_write_summary(LogAnalyzerContext *ctx) {
+  char format[MAX_FORMAT_LENGTH];
   FILE *fp;
   int i;
 
@@ -31,9 +123,14 @@ bool report_generator_write_summary(LogAnalyzerContext *ctx) {
   fprintf(fp,
           "============================================================\n\n");
 
-  fprintf(fp, "Input file: %s\n", ctx->input_path);
+  if (ctx->merge)
+    fprintf(fp, "Merged runs: %ld\n", ctx->part_count);
+  else if (ctx->inputs.count > 1)
+    fprintf(fp, "Input files: %d\n", ctx->inputs.count);
+  else
+    fprintf(fp, "Input file: %s\n", ctx->input_path);
   fprintf(fp, "Log Format: %s\n\n",
-          strlen(ctx->log_format) > 0 ? ctx->log_format : "Auto-detected");
+          log_format_describe(ctx, format, sizeof(format)));
 
   if (ctx->pattern_count > 0) {
     fprintf(fp, "Top Patterns Detected:\n");
@@ -41,7 +138,7 @@ bool report_generator_write_summary(LogAnalyzerContext *ctx) {
 
     for (i = 0; i < ctx->pattern_count && i < 5; i++) {
       if (ctx->patterns[i].frequency > 0) {
-        fprintf(fp, "[%d] %s (Frequency: %d, Severity: %d)\n", i + 1,
+        fprintf(fp, "[%d] %s (Frequency: %ld, Severity: %d)\n", i + 1,
                 ctx->patterns[i].description, ctx->patterns[i].frequency,
                 ctx->patterns[i].severity);
       }
@@ -50,6 +147,7 @@ bool report_generator_write_summary(LogAnalyzerContext *ctx) {
   } else {
     fprintf(fp, "No significant patterns detected.\n\n");
   }
+  write_templates(fp, ctx, true);
 
   if (ctx->recommendation_count > 0) {
     fprintf(fp, "Top Recommendations:\n");
@@ -73,6 +171,7 @@ bool report_generator_write_summary(LogAnalyzerContext *ctx) {
 }
 
 bool report_generator_write_detailed(LogAnalyzerContext *ctx) {
+  char format[MAX_FORMAT_LENGTH];
   FILE *fp;
   int i;
   char detailed_path[MAX_PATH_LENGTH + 16];
@@ -95,9 +194,19 @@ bool report_generator_write_detailed(LogAnalyzerContext *ctx) {
   fprintf(fp,
           "============================================================\n\n");
 
-  fprintf(fp, "Input File: %s\n", ctx->input_path);
-  fprintf(fp, "Log Format: %s\n\n",
-          strlen(ctx->log_format) > 0 ? ctx->log_format : "Auto-detected");
+  if (ctx->merge) fprintf(fp, "Merged Runs: %ld\n", ctx->part_count);
+  if (ctx->inputs.count > 1) {
+    fprintf(fp, ctx->merge ? "Partial Results:\n" : "Input Files:\n");
+    for (i = 0; i < ctx->inputs.count; i++)
+      fprintf(fp, "  %s\n", ctx->inputs.paths[i]);
+  } else {
+    fprintf(fp, ctx->merge ? "Partial Result: %s\n" : "Input File: %s\n",
+            ctx->input_path);
+  }
+  fprintf(fp, "Log Format: %s\n",
+          log_format_describe(ctx, format, sizeof(format)));
+  write_coverage(fp, ctx);
+  fprintf(fp, "\n");
 
   fprintf(fp, "============================================================\n");
   fprintf(fp, "                      DETECTED PATTERNS                     \n");
@@ -106,18 +215,23 @@ bool report_generator_write_detailed(LogAnalyzerContext *ctx) {
 
   if (ctx->pattern_count > 0) {
     for (i = 0; i < ctx->pattern_count; i++) {
-      if (ctx->patterns[i].frequency > 0) {
+      if (ctx->patterns[i].frequency > 0 ||
+          (ctx->verbose && ctx->patterns[i].prefilter_hits > 0)) {
         fprintf(fp, "Pattern %d:\n", i + 1);
         fprintf(fp, "  Description: %s\n", ctx->patterns[i].description);
         fprintf(fp, "  Category: %s\n", ctx->patterns[i].category);
         fprintf(fp, "  Severity: %d\n", ctx->patterns[i].severity);
-        fprintf(fp, "  Frequency: %d\n", ctx->patterns[i].frequency);
+        fprintf(fp, "  Frequency: %ld\n", ctx->patterns[i].frequency);
+        write_rates(fp, &ctx->patterns[i]);
+        if (ctx->verbose && ctx->patterns[i].prefilter_hits >= 0)
+          write_prefilter(fp, ctx, &ctx->patterns[i]);
         fprintf(fp, "  Regular Expression: %s\n\n", ctx->patterns[i].pattern);
       }
     }
   } else {
     fprintf(fp, "No significant patterns detected.\n\n");
   }
+  write_templates(fp, ctx, false);
 
   fprintf(fp, "============================================================\n");
   fprintf(fp, "                     RECOMMENDATIONS                        \n");
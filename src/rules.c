@@ -0,0 +1,106 @@
+#include <errno.h>
+
+#include "include/log_analyzer.h"
+
+#define RULE_FIELDS 9
+
+/*
+ * Rule files hold one recommendation rule per line as nine tab-separated
+ * fields:
+ *
+ *   patterns <TAB> min matches <TAB> min rate <TAB> priority <TAB>
+ *   confidence <TAB> category <TAB> title <TAB> description <TAB> action
+ *
+ * patterns is a comma-separated list of pattern IDs, which number the
+ * pattern table from 1 in the order it was loaded, @category for every
+ * pattern in a category, or * for any pattern. The rule fires when one
+ * of them matched, at least min matches times between them, and one of
+ * them peaked at min rate matches a minute or more (0 for no limit).
+ * Priority runs from 1 to 5 and confidence from 0 to 1. Blank lines and
+ * lines starting with '#' are skipped; there is no limit on the rules.
+ */
+
+static bool parse_number(const char *text, double min, double max,
+                         double *value) {
+  char *end;
+
+  errno = 0;
+  *value = strtod(text, &end);
+  return errno == 0 && end != text && *end == '\0' && *value >= min &&
+         *value <= max;
+}
+
+/* Fills rule from the numeric and text fields; false if one is bad */
+static bool parse_rule(char *fields[RULE_FIELDS], RecommendationRule *rule) {
+  double matches, rate, priority, confidence;
+
+  if (!parse_number(fields[1], 1, 1e18, &matches) ||
+      matches != (long)matches || !parse_number(fields[2], 0, 1e18, &rate) ||
+      !parse_number(fields[3], 1, 5, &priority) ||
+      priority != (int)priority ||
+      !parse_number(fields[4], 0, 1, &confidence) || fields[6][0] == '\0')
+    return false;
+
+  memset(rule, 0, sizeof(RecommendationRule));
+  rule->min_matches = (long)matches;
+  rule->min_rate = rate;
+  rule->priority = (int)priority;
+  rule->confidence = (float)confidence;
+  rule->category = fields[5];
+  rule->title = fields[6];
+  rule->description = fields[7];
+  rule->action = fields[8];
+  return true;
+}
+
+/* Appends the rules in path; needs the pattern table the rules name */
+bool log_rules_load(LogAnalyzerContext *ctx, const char *path) {
+  char *fields[RULE_FIELDS];
+  LogTableReader reader;
+  size_t words;
+  int loaded = 0;
+  RecommendationRule rule;
+  uint64_t *bits;
+  bool success = true, complete;
+
+  if (!ctx || !path) return false;
+
+  words = (size_t)(ctx->pattern_count + 63) / 64 + 1;
+  bits = (uint64_t *)malloc(words * sizeof(uint64_t));
+  if (!bits) return false;
+  if (!log_table_open(&reader, path)) {
+    free(bits);
+    return false;
+  }
+
+  while (success &&
+         log_table_next(&reader, fields, RULE_FIELDS, &complete)) {
+    memset(bits, 0, words * sizeof(uint64_t));
+    if (!complete || !parse_rule(fields, &rule)) {
+      fprintf(stderr,
+              "%s:%ld: expected patterns, minimum matches, minimum rate, "
+              "priority 1-5, confidence 0-1, category, title, description "
+              "and action separated by tabs\n",
+              path, reader.number);
+      success = false;
+    } else if (!recommendation_rule_resolve(ctx, fields[0], bits)) {
+      fprintf(stderr,
+              "%s:%ld: %s names no pattern; IDs run from 1 to %d\n", path,
+              reader.number, fields[0], ctx->pattern_count);
+      success = false;
+    } else if (!recommendation_rule_add(ctx, &rule, bits)) {
+      fprintf(stderr, "Out of memory loading rules from %s\n", path);
+      success = false;
+    } else {
+      loaded++;
+    }
+  }
+  success = log_table_close(&reader) && success;
+  if (success && loaded == 0) {
+    fprintf(stderr, "No rules in %s\n", path);
+    success = false;
+  }
+
+  free(bits);
+  return success;
+}
@@ -0,0 +1,196 @@
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include "include/log_analyzer.h"
+
+static const char *const stage_names[LOG_STAGE_COUNT] = {
+    "setup", "resume", "detect", "save", "finalize", "recommend", "report"};
+
+/* What one clock read adds to a lap; measured once per process */
+static double clock_cost;
+static pthread_once_t clock_calibrated = PTHREAD_ONCE_INIT;
+
+/* The least gap between back-to-back reads is about one read's cost */
+static void calibrate_clock(void) {
+  double gap, best = 0, previous = log_stats_now(), now;
+
+  for (int i = 0; i < 64; i++) {
+    now = log_stats_now();
+    gap = now - previous;
+    if (i == 0 || gap < best) best = gap;
+    previous = now;
+  }
+  clock_cost = best;
+}
+
+LogStats *log_stats_create(void) {
+  LogStats *stats = (LogStats *)calloc(1, sizeof(LogStats));
+
+  if (!stats) return NULL;
+  pthread_once(&clock_calibrated, calibrate_clock);
+  stats->created = log_stats_now();
+  stats->stage = LOG_STAGE_COUNT;
+  return stats;
+}
+
+double log_stats_now(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+/* ns since *mark, less the clock's own cost; moves *mark to now */
+double log_stats_lap(double *mark) {
+  double now = log_stats_now(), lap = now - *mark - clock_cost;
+
+  *mark = now;
+  return lap > 0 ? lap : 0;
+}
+
+/* Ends the running stage, if any, and starts stage; LOG_STAGE_COUNT ends */
+void log_stats_enter(LogStats *stats, LogStage stage) {
+  double now;
+
+  if (!stats) return;
+
+  now = log_stats_now();
+  if (stats->stage < LOG_STAGE_COUNT)
+    stats->stage_ns[stats->stage] += now - stats->stage_start;
+  stats->stage = stage;
+  stats->stage_start = now;
+}
+
+void log_stats_add_sample(LogLineSample *into, const LogLineSample *from) {
+  into->lines += from->lines;
+  into->read_ns += from->read_ns;
+  into->parse_ns += from->parse_ns;
+  into->match_ns += from->match_ns;
+  into->mine_ns += from->mine_ns;
+}
+
+static long peak_rss_kb(void) {
+  struct rusage usage;
+
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024; /* bytes there, kilobytes elsewhere */
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+static void write_string(FILE *fp, const char *text) {
+  fputc('"', fp);
+  for (const unsigned char *p = (const unsigned char *)text; p && *p; p++) {
+    if (*p == '"' || *p == '\\')
+      fprintf(fp, "\\%c", *p);
+    else if (*p < 0x20)
+      fprintf(fp, "\\u%04x", *p);
+    else
+      fputc(*p, fp);
+  }
+  fputc('"', fp);
+}
+
+static double per(double total, long count) {
+  return count > 0 ? total / count : 0;
+}
+
+/*
+ * Where each --pipeline stage waited. A queue kept near capacity with
+ * full waits has a slow consumer; one kept near empty, a slow producer.
+ */
+static void write_pipeline(FILE *fp, const LogStats *stats) {
+  static const char *const stage_names[LOG_PIPELINE_STAGES] = {
+      "read", "parse", "match"};
+  const LogQueueStats *queue;
+
+  fprintf(fp, "  \"pipeline\": {\"queue_capacity\": %d, \"wait_ns\": {",
+          stats->queue_capacity);
+  for (int i = 0; i < LOG_PIPELINE_STAGES; i++)
+    fprintf(fp, "%s\"%s\": %.0f", i > 0 ? ", " : "", stage_names[i],
+            stats->wait_ns[i]);
+  fprintf(fp, "},\n    \"queues\": [");
+  for (int i = 0; i < LOG_PIPELINE_STAGES - 1; i++) {
+    queue = &stats->queues[i];
+    fprintf(fp,
+            "%s\n      {\"from\": \"%s\", \"to\": \"%s\", \"batches\": %ld, "
+            "\"mean_depth\": %.2f, \"max_depth\": %d, \"full_waits\": %ld, "
+            "\"empty_waits\": %ld}",
+            i > 0 ? "," : "", stage_names[i], stage_names[i + 1],
+            queue->batches, per((double)queue->depth_sum, queue->batches),
+            queue->max_depth, queue->full_waits, queue->empty_waits);
+  }
+  fprintf(fp, "]},\n");
+}
+
+/*
+ * One JSON object. Stage times are wall-clock ns. line_ns are the mean
+ * cost of one line's steps over the timed lines, and match_ns splits
+ * the match step; per pattern, match_ns is null for patterns the
+ * automaton runs, since they share its single pass.
+ */
+bool log_stats_write(const LogAnalyzerContext *ctx, FILE *fp) {
+  const LogStats *stats;
+  const LogLineSample *sample;
+  const LogMatchProfile *match;
+  const Pattern *pattern;
+  long allocations;
+
+  if (!ctx || !ctx->stats || !fp) return false;
+  stats = ctx->stats;
+  sample = &stats->sample;
+  match = &stats->match;
+
+  fprintf(fp, "{\n  \"threads\": %d,\n  \"stages_ns\": {", ctx->thread_count);
+  for (int i = 0; i < LOG_STAGE_COUNT; i++)
+    fprintf(fp, "\"%s\": %.0f, ", stage_names[i], stats->stage_ns[i]);
+  fprintf(fp, "\"total\": %.0f},\n", log_stats_now() - stats->created);
+
+  fprintf(fp, "  \"bytes_read\": %ld,\n", stats->bytes_read);
+  fprintf(fp, "  \"lines_read\": %ld,\n", stats->lines_read);
+  fprintf(fp, "  \"lines_dropped\": %ld,\n", stats->lines_dropped);
+  fprintf(fp, "  \"oversized_lines\": %ld,\n", stats->oversized_lines);
+  fprintf(fp, "  \"entries\": %ld,\n", ctx->entry_count);
+  allocations = log_allocation_count();
+  if (allocations < 0) /* only counted in builds that opt in */
+    fprintf(fp, "  \"allocations\": null,\n");
+  else
+    fprintf(fp, "  \"allocations\": %ld,\n", allocations);
+  fprintf(fp, "  \"peak_rss_kb\": %ld,\n", peak_rss_kb());
+
+  fprintf(fp, "  \"sampled_lines\": %ld,\n", sample->lines);
+  fprintf(fp,
+          "  \"line_ns\": {\"read\": %.1f, \"parse\": %.1f, \"match\": %.1f, "
+          "\"mine\": %.1f},\n",
+          per(sample->read_ns, sample->lines),
+          per(sample->parse_ns, sample->lines),
+          per(sample->match_ns, sample->lines),
+          per(sample->mine_ns, sample->lines));
+  fprintf(fp,
+          "  \"match_ns\": {\"prefilter\": %.1f, \"automaton\": %.1f, "
+          "\"regex\": %.1f},\n",
+          per(match->prefilter_ns, match->scans),
+          per(match->automaton_ns, match->scans),
+          per(match->regex_ns, match->scans));
+
+  if (stats->pipelined) write_pipeline(fp, stats);
+
+  fprintf(fp, "  \"patterns\": [");
+  for (int i = 0; i < ctx->pattern_count; i++) {
+    pattern = &ctx->patterns[i];
+    fprintf(fp, "%s\n    {\"description\": ", i > 0 ? "," : "");
+    write_string(fp, pattern->description);
+    fprintf(fp, ", \"matches\": %ld, \"engine\": \"%s\", \"match_ns\": ",
+            pattern->frequency, pattern->match_ns < 0 ? "automaton" : "regex");
+    if (pattern->match_ns < 0)
+      fprintf(fp, "null}");
+    else
+      fprintf(fp, "%.1f}", pattern->match_ns);
+  }
+  fprintf(fp, "%s]\n}\n", ctx->pattern_count > 0 ? "\n  " : "");
+  return fflush(fp) == 0;
+}
+
+void log_stats_free(LogStats *stats) { free(stats); }
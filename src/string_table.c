@@ -0,0 +1,143 @@
+#include <stdint.h>
+
+#include "include/log_analyzer.h"
+
+#define STRING_TABLE_INITIAL_SLOTS 256
+
+/*
+ * Interns strings to dense ids. Bytes live in an arena, ids index the
+ * strings array, and lookup is open addressing over a power-of-two slot
+ * table that stores id + 1 (0 marks an empty slot).
+ */
+struct LogStringTable {
+  LogArena *arena;
+  const char **strings;
+  size_t *lengths;
+  uint32_t *hashes;
+  int count;
+  int capacity;
+
+  int *slots;
+  size_t slot_count;
+};
+
+static uint32_t hash_bytes(const char *data, size_t length) {
+  uint32_t hash = 2166136261u;
+
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (unsigned char)data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static bool grow_slots(LogStringTable *table) {
+  size_t slot_count = table->slot_count * 2;
+  int *slots = (int *)calloc(slot_count, sizeof(int));
+
+  if (!slots) return false;
+  for (int id = 0; id < table->count; id++) {
+    size_t slot = table->hashes[id] & (slot_count - 1);
+    while (slots[slot]) slot = (slot + 1) & (slot_count - 1);
+    slots[slot] = id + 1;
+  }
+
+  free(table->slots);
+  table->slots = slots;
+  table->slot_count = slot_count;
+  return true;
+}
+
+static bool grow_strings(LogStringTable *table) {
+  int capacity = table->capacity ? table->capacity * 2 : 64;
+  const char **strings;
+  size_t *lengths;
+  uint32_t *hashes;
+
+  strings = (const char **)realloc((void *)table->strings,
+                                   capacity * sizeof(const char *));
+  if (!strings) return false;
+  table->strings = strings;
+
+  lengths = (size_t *)realloc(table->lengths, capacity * sizeof(size_t));
+  if (!lengths) return false;
+  table->lengths = lengths;
+
+  hashes = (uint32_t *)realloc(table->hashes, capacity * sizeof(uint32_t));
+  if (!hashes) return false;
+  table->hashes = hashes;
+
+  table->capacity = capacity;
+  return true;
+}
+
+LogStringTable *log_string_table_create(void) {
+  LogStringTable *table =
+      (LogStringTable *)calloc(1, sizeof(LogStringTable));
+
+  if (!table) return NULL;
+  table->arena = log_arena_create(0);
+  table->slots = (int *)calloc(STRING_TABLE_INITIAL_SLOTS, sizeof(int));
+  table->slot_count = STRING_TABLE_INITIAL_SLOTS;
+  if (!table->arena || !table->slots) {
+    log_string_table_free(table);
+    return NULL;
+  }
+  return table;
+}
+
+int log_string_table_intern(LogStringTable *table, const char *data,
+                            size_t length) {
+  uint32_t hash;
+  size_t slot;
+  char *copy;
+  int id;
+
+  if (!table || !data) return LOG_STRING_NONE;
+
+  /* Keep the load factor at or under one half */
+  if ((size_t)(table->count + 1) * 2 > table->slot_count && !grow_slots(table))
+    return LOG_STRING_NONE;
+
+  hash = hash_bytes(data, length);
+  slot = hash & (table->slot_count - 1);
+  while (table->slots[slot]) {
+    id = table->slots[slot] - 1;
+    if (table->hashes[id] == hash && table->lengths[id] == length &&
+        memcmp(table->strings[id], data, length) == 0)
+      return id;
+    slot = (slot + 1) & (table->slot_count - 1);
+  }
+
+  if (table->count == table->capacity && !grow_strings(table))
+    return LOG_STRING_NONE;
+  copy = log_arena_strndup(table->arena, data, length);
+  if (!copy) return LOG_STRING_NONE;
+
+  id = table->count++;
+  table->strings[id] = copy;
+  table->lengths[id] = length;
+  table->hashes[id] = hash;
+  table->slots[slot] = id + 1;
+  return id;
+}
+
+const char *log_string_table_get(const LogStringTable *table, int id) {
+  if (!table || id < 0 || id >= table->count) return NULL;
+  return table->strings[id];
+}
+
+int log_string_table_count(const LogStringTable *table) {
+  return table ? table->count : 0;
+}
+
+void log_string_table_free(LogStringTable *table) {
+  if (!table) return;
+
+  log_arena_destroy(table->arena);
+  free((void *)table->strings);
+  free(table->lengths);
+  free(table->hashes);
+  free(table->slots);
+  free(table);
+}
@@ -0,0 +1,540 @@
+#include "include/log_analyzer.h"
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define HAVE_SSE2 1
+#endif
+
+#define TEMPLATE_MAX_TOKENS 64
+#define TEMPLATE_SIMILARITY 0.5  /* share of equal tokens to join a template */
+#define TEMPLATE_WILDCARD "<*>"
+
+/*
+ * A template and its token hashes. Variable positions hold the hash of
+ * TEMPLATE_WILDCARD, the same hash a masked token gets, so a message
+ * compares against a template one word per token.
+ */
+typedef struct {
+  uint64_t group;   /* token count and leading tokens */
+  uint64_t *tokens; /* token_count hashes, followed in the block by text */
+  char *text;
+  int token_count;
+  long count;
+  long error;     /* count may be over by up to this much */
+  int next;       /* next cluster in the same bucket, -1 at the end */
+  int heap_index; /* position in the count heap */
+} TemplateCluster;
+
+/*
+ * Online template mining in the manner of Drain: messages are split on
+ * whitespace, tokens with digits or a leading '/' (numbers, hex, IPs,
+ * ids, paths) are masked, and the token count plus the first two
+ * tokens select a group, the leaf of Drain's depth-4 tree. Within the
+ * group the most similar template takes the message and turns the tokens
+ * that differ into wildcards.
+ *
+ * At most `capacity` templates are kept. Once that many exist, a min-heap
+ * on count makes room the SpaceSaving way: a new template replaces the
+ * least counted one and inherits its count as error, so a template's
+ * count is never under its true count and any template that occurs more
+ * often than one message in `capacity` is kept.
+ */
+struct LogTemplateMiner {
+  TemplateCluster *clusters;
+  int cluster_count;
+  int capacity;
+  int *buckets; /* cluster chains by group, -1 if empty */
+  size_t bucket_mask;
+  int *heap; /* cluster indices, a min-heap once the miner is full */
+  uint64_t wildcard;
+};
+
+/* Scratch form of one message, kept on the stack */
+typedef struct {
+  const char *starts[TEMPLATE_MAX_TOKENS];
+  size_t lengths[TEMPLATE_MAX_TOKENS];
+  uint64_t hashes[TEMPLATE_MAX_TOKENS];
+  int count;
+} TokenList;
+
+/*
+ * Bit maps over a message: which bytes separate tokens and which are
+ * digits. Bytes past the end count as separators, so the last token
+ * always has an end within the map.
+ */
+typedef struct {
+  uint64_t separators[MAX_LINE_LENGTH / 64 + 1];
+  uint64_t digits[MAX_LINE_LENGTH / 64 + 1];
+} ByteClasses;
+
+/* Control characters separate tokens too, so templates hold no newline */
+static bool is_separator(unsigned char c) { return c <= ' '; }
+
+static bool is_digit(unsigned char c) { return (unsigned)(c - '0') < 10u; }
+
+#ifdef HAVE_SSE2
+/* Bit i is set when byte i of the block is within [low, low + span] */
+static unsigned range_mask_sse2(__m128i v, char low, char span) {
+  __m128i offset = _mm_sub_epi8(v, _mm_set1_epi8(low));
+  return (unsigned)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(span)), offset));
+}
+#endif
+
+/* ORs up to 64 bits into a bit map at pos */
+static void set_bits(uint64_t *bits, size_t pos, uint64_t mask) {
+  bits[pos / 64] |= mask << (pos % 64);
+  if (pos % 64 != 0 && mask >> (64 - pos % 64) != 0)
+    bits[pos / 64 + 1] |= mask >> (64 - pos % 64);
+}
+
+/*
+ * Classifies the message sixteen bytes at a time where SSE2 allows; the
+ * last partial block is an overlapping load ending at the last byte.
+ */
+static void classify(const unsigned char *text, size_t length,
+                     ByteClasses *classes) {
+  size_t pos = 0, words = length / 64 + 1;
+
+  memset(classes->separators, 0, words * sizeof(uint64_t));
+  memset(classes->digits, 0, words * sizeof(uint64_t));
+  classes->separators[length / 64] = ~0ull << (length % 64);
+
+#ifdef HAVE_SSE2
+  for (; pos + 16 <= length; pos += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(text + pos));
+
+    set_bits(classes->separators, pos, range_mask_sse2(v, 0, ' '));
+    set_bits(classes->digits, pos, range_mask_sse2(v, '0', 9));
+  }
+  if (pos < length && length >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(text + length - 16));
+    int skip = (int)(16 - (length - pos));
+
+    set_bits(classes->separators, pos, range_mask_sse2(v, 0, ' ') >> skip);
+    set_bits(classes->digits, pos, range_mask_sse2(v, '0', 9) >> skip);
+    pos = length;
+  }
+#endif
+
+  for (; pos < length; pos++) {
+    set_bits(classes->separators, pos, is_separator(text[pos]));
+    set_bits(classes->digits, pos, is_digit(text[pos]));
+  }
+}
+
+/* Whether any bit in [start, end) is set; end is past start */
+static bool any_bit(const uint64_t *bits, size_t start, size_t end) {
+  size_t first = start / 64, last = (end - 1) / 64;
+  uint64_t head = bits[first] & (~0ull << (start % 64));
+  uint64_t tail = ~0ull >> (63 - (end - 1) % 64);
+
+  if (first == last) return (head & tail) != 0;
+  if (head != 0) return true;
+  for (size_t i = first + 1; i < last; i++)
+    if (bits[i] != 0) return true;
+  return (bits[last] & tail) != 0;
+}
+
+/* Eight bytes as a little-endian word */
+static uint64_t load_word(const char *p) {
+  uint64_t word;
+
+  memcpy(&word, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  word = __builtin_bswap64(word);
+#endif
+  return word;
+}
+
+static uint64_t mix(uint64_t hash, uint64_t word) {
+  hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+  return hash ^ (hash >> 32);
+}
+
+/*
+ * Hashes message[start, end) a word at a time. The last few bytes come
+ * from one load that stays inside the message, masked or shifted down to
+ * the token, so most tokens cost a single load.
+ */
+static uint64_t hash_token(const char *message, size_t length, size_t start,
+                           size_t end) {
+  uint64_t hash = 0x9e3779b97f4a7c15ull ^ (end - start), word = 0;
+  size_t pos = start, rest;
+
+  for (; pos + 8 <= end; pos += 8) hash = mix(hash, load_word(message + pos));
+  rest = end - pos;
+  if (rest == 0) return hash;
+
+  if (pos + 8 <= length) {
+    word = load_word(message + pos) & (~0ull >> (8 * (8 - rest)));
+  } else if (end >= 8) {
+    word = load_word(message + end - 8) >> (8 * (8 - rest));
+  } else {
+    for (size_t i = 0; i < rest; i++)
+      word |= (uint64_t)(unsigned char)message[pos + i] << (8 * i);
+  }
+  return mix(hash, word);
+}
+
+static uint64_t group_key(const TokenList *tokens) {
+  uint64_t key = (uint64_t)tokens->count * 0x9e3779b97f4a7c15ull;
+
+  for (int i = 0; i < 2 && i < tokens->count; i++)
+    key = (key ^ tokens->hashes[i]) * 0xc4ceb9fe1a85ec53ull;
+  return key ^ (key >> 29);
+}
+
+/*
+ * Token starts are separator-to-other edges in the bit map and ends are
+ * the reverse, so each token costs a pair of bit scans, not a byte loop.
+ */
+static void tokenize(const LogTemplateMiner *miner, const char *message,
+                     size_t length, TokenList *tokens) {
+  ByteClasses classes;
+  uint64_t separators, edges, previous = 1; /* before byte 0: a separator */
+  size_t pos, start = 0, words = length / 64 + 1;
+  int count = 0;
+
+  classify((const unsigned char *)message, length, &classes);
+
+  for (size_t w = 0; w < words && count < TEMPLATE_MAX_TOKENS; w++) {
+    separators = classes.separators[w];
+    edges = separators ^ ((separators << 1) | previous);
+    previous = separators >> 63;
+
+    while (edges != 0 && count < TEMPLATE_MAX_TOKENS) {
+      pos = w * 64 + (size_t)__builtin_ctzll(edges);
+      edges &= edges - 1;
+      if (!(separators >> (pos % 64) & 1)) {
+        start = pos;
+        continue;
+      }
+
+      tokens->starts[count] = message + start;
+      tokens->lengths[count] = pos - start;
+      tokens->hashes[count] =
+          message[start] == '/' || any_bit(classes.digits, start, pos)
+              ? miner->wildcard
+              : hash_token(message, length, start, pos);
+      count++;
+    }
+  }
+  tokens->count = count;
+}
+
+static bool heap_less(const LogTemplateMiner *miner, int a, int b) {
+  return miner->clusters[miner->heap[a]].count <
+         miner->clusters[miner->heap[b]].count;
+}
+
+static void heap_swap(LogTemplateMiner *miner, int a, int b) {
+  int cluster = miner->heap[a];
+
+  miner->heap[a] = miner->heap[b];
+  miner->heap[b] = cluster;
+  miner->clusters[miner->heap[a]].heap_index = a;
+  miner->clusters[miner->heap[b]].heap_index = b;
+}
+
+/* Counts only grow, so a cluster only ever moves away from the root */
+static void heap_sift_down(LogTemplateMiner *miner, int index) {
+  int child;
+
+  for (;;) {
+    child = 2 * index + 1;
+    if (child >= miner->cluster_count) return;
+    if (child + 1 < miner->cluster_count && heap_less(miner, child + 1, child))
+      child++;
+    if (!heap_less(miner, child, index)) return;
+    heap_swap(miner, index, child);
+    index = child;
+  }
+}
+
+/* Writes the template text for tokens; returns its length */
+static size_t render(const TokenList *tokens, const uint64_t *hashes,
+                     uint64_t wildcard, char *out) {
+  size_t length = 0;
+
+  for (int i = 0; i < tokens->count; i++) {
+    if (i > 0) out[length++] = ' ';
+    if (hashes[i] == wildcard) {
+      memcpy(out + length, TEMPLATE_WILDCARD, 3);
+      length += 3;
+    } else {
+      memcpy(out + length, tokens->starts[i], tokens->lengths[i]);
+      length += tokens->lengths[i];
+    }
+  }
+  out[length] = '\0';
+  return length;
+}
+
+/*
+ * Gives a cluster the tokens and text of a message. The cluster's old
+ * block, if any, is freed afterwards, since tokens may point into it.
+ */
+static bool set_template(LogTemplateMiner *miner, TemplateCluster *cluster,
+                         const TokenList *tokens, const uint64_t *hashes) {
+  size_t text_size = 1;
+  uint64_t *block;
+
+  for (int i = 0; i < tokens->count; i++)
+    text_size += (hashes[i] == miner->wildcard ? 3 : tokens->lengths[i]) + 1;
+
+  block = (uint64_t *)malloc(tokens->count * sizeof(uint64_t) + text_size);
+  if (!block) return false;
+  memcpy(block, hashes, tokens->count * sizeof(uint64_t));
+  render(tokens, hashes, miner->wildcard, (char *)(block + tokens->count));
+
+  free(cluster->tokens);
+  cluster->tokens = block;
+  cluster->text = (char *)(block + tokens->count);
+  cluster->token_count = tokens->count;
+  return true;
+}
+
+/* Re-reads a cluster's own text as tokens, to rewrite some of them */
+static void template_tokens(const TemplateCluster *cluster,
+                            TokenList *tokens) {
+  const char *text = cluster->text;
+
+  tokens->count = cluster->token_count;
+  for (int i = 0; i < cluster->token_count; i++) {
+    tokens->starts[i] = text;
+    tokens->lengths[i] = strcspn(text, " ");
+    tokens->hashes[i] = cluster->tokens[i];
+    text += tokens->lengths[i] + 1;
+  }
+}
+
+/* Turns the positions where the message differs into wildcards */
+static bool generalize(LogTemplateMiner *miner, TemplateCluster *cluster,
+                       const TokenList *message) {
+  uint64_t hashes[TEMPLATE_MAX_TOKENS];
+  TokenList tokens;
+  bool changed = false;
+
+  for (int i = 0; i < cluster->token_count; i++) {
+    hashes[i] = cluster->tokens[i];
+    if (hashes[i] != message->hashes[i]) {
+      hashes[i] = miner->wildcard;
+      changed = true;
+    }
+  }
+  if (!changed) return true;
+
+  template_tokens(cluster, &tokens);
+  return set_template(miner, cluster, &tokens, hashes);
+}
+
+/* The most similar template in the message's group, or -1 */
+static int find_cluster(const LogTemplateMiner *miner, uint64_t group,
+                        const TokenList *tokens) {
+  const TemplateCluster *cluster;
+  int best = -1, best_same = -1, same;
+
+  for (int index = miner->buckets[group & miner->bucket_mask]; index >= 0;
+       index = cluster->next) {
+    cluster = &miner->clusters[index];
+    if (cluster->group != group) continue;
+
+    same = 0;
+    for (int i = 0; i < tokens->count; i++)
+      same += cluster->tokens[i] == tokens->hashes[i];
+    if (same == tokens->count) return index;
+    if (same > best_same) {
+      best = index;
+      best_same = same;
+    }
+  }
+  return best >= 0 && best_same >= TEMPLATE_SIMILARITY * tokens->count
+             ? best
+             : -1;
+}
+
+static void unlink_cluster(LogTemplateMiner *miner, int index) {
+  int *link = &miner->buckets[miner->clusters[index].group &
+                              miner->bucket_mask];
+
+  while (*link != index) link = &miner->clusters[*link].next;
+  *link = miner->clusters[index].next;
+}
+
+/* Starts a template, evicting the least counted one when full */
+static bool add_cluster(LogTemplateMiner *miner, uint64_t group,
+                        const TokenList *tokens, long count, long error) {
+  TemplateCluster *cluster;
+  int index, heap_index;
+
+  if (miner->cluster_count < miner->capacity) {
+    index = miner->cluster_count;
+    cluster = &miner->clusters[index];
+    if (!set_template(miner, cluster, tokens, tokens->hashes)) return false;
+    heap_index = miner->cluster_count++;
+    miner->heap[heap_index] = index;
+    cluster->heap_index = heap_index;
+  } else {
+    /* Full: the heap is in order and its root is the least counted */
+    index = miner->heap[0];
+    cluster = &miner->clusters[index];
+    if (!set_template(miner, cluster, tokens, tokens->hashes)) return false;
+    unlink_cluster(miner, index);
+    error += cluster->count;
+    count += cluster->count;
+    heap_index = 0;
+  }
+
+  cluster->group = group;
+  cluster->count = count;
+  cluster->error = error;
+  cluster->next = miner->buckets[group & miner->bucket_mask];
+  miner->buckets[group & miner->bucket_mask] = index;
+
+  /* Nothing is evicted before the miner fills, so order the heap then */
+  if (miner->cluster_count < miner->capacity) return true;
+  if (heap_index == 0) {
+    heap_sift_down(miner, 0);
+  } else {
+    for (int i = miner->cluster_count / 2 - 1; i >= 0; i--)
+      heap_sift_down(miner, i);
+  }
+  return true;
+}
+
+LogTemplateMiner *log_template_miner_create(int capacity) {
+  LogTemplateMiner *miner;
+  size_t bucket_count = 1;
+
+  if (capacity <= 0) return NULL;
+  miner = (LogTemplateMiner *)calloc(1, sizeof(LogTemplateMiner));
+  if (!miner) return NULL;
+
+  while (bucket_count < (size_t)capacity * 2) bucket_count *= 2;
+  miner->capacity = capacity;
+  miner->bucket_mask = bucket_count - 1;
+  miner->wildcard = hash_token(TEMPLATE_WILDCARD, 3, 0, 3);
+  miner->clusters =
+      (TemplateCluster *)calloc(capacity, sizeof(TemplateCluster));
+  miner->heap = (int *)malloc(capacity * sizeof(int));
+  miner->buckets = (int *)malloc(bucket_count * sizeof(int));
+  if (!miner->clusters || !miner->heap || !miner->buckets) {
+    log_template_miner_free(miner);
+    return NULL;
+  }
+  for (size_t i = 0; i < bucket_count; i++) miner->buckets[i] = -1;
+  return miner;
+}
+
+/*
+ * Counts `count` occurrences of a message (or of a template, whose
+ * wildcards mask like numbers do). Only the first MAX_LINE_LENGTH bytes
+ * and TEMPLATE_MAX_TOKENS tokens are looked at.
+ */
+bool log_template_add_counted(LogTemplateMiner *miner, const char *message,
+                              size_t length, long count, long error) {
+  TokenList tokens;
+  TemplateCluster *cluster;
+  uint64_t group;
+  int index;
+
+  if (!miner || !message || count <= 0) return false;
+  if (length > MAX_LINE_LENGTH) length = MAX_LINE_LENGTH;
+
+  tokenize(miner, message, length, &tokens);
+  if (tokens.count == 0) return true;
+  group = group_key(&tokens);
+
+  index = find_cluster(miner, group, &tokens);
+  if (index < 0) return add_cluster(miner, group, &tokens, count, error);
+
+  cluster = &miner->clusters[index];
+  if (!generalize(miner, cluster, &tokens)) return false;
+  cluster->count += count;
+  cluster->error += error;
+  if (miner->cluster_count == miner->capacity)
+    heap_sift_down(miner, cluster->heap_index);
+  return true;
+}
+
+bool log_template_add(LogTemplateMiner *miner, const char *message,
+                      size_t length) {
+  return log_template_add_counted(miner, message, length, 1, 0);
+}
+
+/* Folds another miner's templates in; errors add up */
+bool log_template_merge(LogTemplateMiner *into, const LogTemplateMiner *from) {
+  const TemplateCluster *cluster;
+
+  if (!into || !from) return false;
+
+  for (int i = 0; i < from->cluster_count; i++) {
+    cluster = &from->clusters[i];
+    if (!log_template_add_counted(into, cluster->text, strlen(cluster->text),
+                                  cluster->count, cluster->error))
+      return false;
+  }
+  return true;
+}
+
+int log_template_count(const LogTemplateMiner *miner) {
+  return miner ? miner->cluster_count : 0;
+}
+
+/* Walks the templates in no particular order; start cursor at 0 */
+bool log_template_next(const LogTemplateMiner *miner, int *cursor,
+                       LogTemplate *out) {
+  const TemplateCluster *cluster;
+
+  if (!miner || !cursor || !out || *cursor < 0 ||
+      *cursor >= miner->cluster_count)
+    return false;
+
+  cluster = &miner->clusters[(*cursor)++];
+  out->text = cluster->text;
+  out->count = cluster->count;
+  out->error = cluster->error;
+  return true;
+}
+
+static int compare_templates(const void *a, const void *b) {
+  const LogTemplate *left = (const LogTemplate *)a;
+  const LogTemplate *right = (const LogTemplate *)b;
+
+  if (left->count != right->count) return left->count < right->count ? 1 : -1;
+  return strcmp(left->text, right->text);
+}
+
+/*
+ * Fills out with up to max templates, most counted first. The texts
+ * belong to the miner and change as it counts more messages.
+ */
+int log_template_top(const LogTemplateMiner *miner, LogTemplate *out,
+                     int max) {
+  LogTemplate *all;
+  int count = 0, cursor = 0;
+
+  if (!miner || !out || max <= 0 || miner->cluster_count == 0) return 0;
+
+  all = (LogTemplate *)malloc(miner->cluster_count * sizeof(LogTemplate));
+  if (!all) return 0;
+  while (log_template_next(miner, &cursor, &all[count])) count++;
+  qsort(all, count, sizeof(LogTemplate), compare_templates);
+
+  if (count > max) count = max;
+  memcpy(out, all, count * sizeof(LogTemplate));
+  free(all);
+  return count;
+}
+
+void log_template_miner_free(LogTemplateMiner *miner) {
+  if (!miner) return;
+
+  for (int i = 0; miner->clusters && i < miner->capacity; i++)
+    free(miner->clusters[i].tokens);
+  free(miner->clusters);
+  free(miner->heap);
+  free(miner->buckets);
+  free(miner);
+}
@@ -0,0 +1,290 @@
+#include <ctype.h>
+
+#include "include/log_analyzer.h"
+
+/*
+ * Allocation-free timestamp parsing. Epoch seconds are computed
+ * arithmetically in UTC; zone-less timestamps are taken as UTC and the
+ * offsets of ISO-8601 and web server (CLF) timestamps are applied. The
+ * date-and-time prefix of the last parsed line is cached, so a run of
+ * lines from the same second costs one memcmp.
+ */
+
+#define SYSLOG_TIMESTAMP_MIN_LENGTH 14 /* "Mar 4 15:48:28" */
+#define ISO_TIMESTAMP_LENGTH 19        /* "2024-03-04T15:48:28" */
+#define CLF_TIMESTAMP_LENGTH 20        /* "04/Mar/2024:15:48:28" */
+#define CLF_ZONE_LENGTH 6              /* " -0700" */
+#define EPOCH_MIN_DIGITS 9             /* 1973-03-03 in seconds */
+#define EPOCH_MAX_DIGITS 13            /* milliseconds */
+
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+static bool parse_digits(const char *text, int count, int *value) {
+  int result = 0;
+
+  for (int i = 0; i < count; i++) {
+    if (!is_digit(text[i])) return false;
+    result = result * 10 + (text[i] - '0');
+  }
+  *value = result;
+  return true;
+}
+
+/* Days since 1970-01-01 in the proleptic Gregorian calendar */
+static long days_from_civil(long year, int month, int day) {
+  long era, year_of_era, day_of_year, day_of_era;
+
+  year -= month <= 2;
+  era = (year >= 0 ? year : year - 399) / 400;
+  year_of_era = year - era * 400;
+  day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  day_of_era =
+      year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+  return era * 146097 + day_of_era - 719468;
+}
+
+static time_t make_epoch(long year, int month, int day, int hour, int minute,
+                         int second) {
+  return (time_t)(days_from_civil(year, month, day) * 86400L + hour * 3600L +
+                  minute * 60L + second);
+}
+
+static bool valid_time(int month, int day, int hour, int minute, int second) {
+  return month >= 1 && month <= 12 && day >= 1 && day <= 31 && hour <= 23 &&
+         minute <= 59 && second <= 60;
+}
+
+/* 1-12 for an English month abbreviation, 0 otherwise */
+static int month_from_name(const char *name) {
+  switch (name[0]) {
+    case 'J':
+      if (name[1] == 'a' && name[2] == 'n') return 1;
+      if (name[1] == 'u' && name[2] == 'n') return 6;
+      if (name[1] == 'u' && name[2] == 'l') return 7;
+      return 0;
+    case 'F':
+      return name[1] == 'e' && name[2] == 'b' ? 2 : 0;
+    case 'M':
+      if (name[1] == 'a' && name[2] == 'r') return 3;
+      if (name[1] == 'a' && name[2] == 'y') return 5;
+      return 0;
+    case 'A':
+      if (name[1] == 'p' && name[2] == 'r') return 4;
+      if (name[1] == 'u' && name[2] == 'g') return 8;
+      return 0;
+    case 'S':
+      return name[1] == 'e' && name[2] == 'p' ? 9 : 0;
+    case 'O':
+      return name[1] == 'c' && name[2] == 't' ? 10 : 0;
+    case 'N':
+      return name[1] == 'o' && name[2] == 'v' ? 11 : 0;
+    case 'D':
+      return name[1] == 'e' && name[2] == 'c' ? 12 : 0;
+    default:
+      return 0;
+  }
+}
+
+static void remember(LogTimestampCache *cache, const char *text,
+                     size_t key_length, time_t epoch, bool iso) {
+  memcpy(cache->key, text, key_length);
+  cache->key_length = key_length;
+  cache->key_epoch = epoch;
+  cache->key_iso = iso;
+}
+
+/* RFC3164: "Mmm dd hh:mm:ss", the day space- or zero-padded */
+static bool parse_syslog(LogTimestampCache *cache, const char *text,
+                         size_t length, time_t *timestamp) {
+  int month, day, hour, minute, second;
+  size_t pos = 4;
+
+  if (length < SYSLOG_TIMESTAMP_MIN_LENGTH || text[3] != ' ') return false;
+  month = month_from_name(text);
+  if (month == 0) return false;
+
+  if (text[pos] == ' ') pos++;
+  if (!is_digit(text[pos])) return false;
+  day = text[pos++] - '0';
+  if (pos < length && is_digit(text[pos])) day = day * 10 + text[pos++] - '0';
+
+  if (pos + 9 > length || text[pos] != ' ' ||
+      !parse_digits(text + pos + 1, 2, &hour) || text[pos + 3] != ':' ||
+      !parse_digits(text + pos + 4, 2, &minute) || text[pos + 6] != ':' ||
+      !parse_digits(text + pos + 7, 2, &second) ||
+      !valid_time(month, day, hour, minute, second))
+    return false;
+
+  /* The format carries no year; assume the current one */
+  *timestamp = make_epoch(cache->year, month, day, hour, minute, second);
+  remember(cache, text, pos + 9, *timestamp, false);
+  return true;
+}
+
+/* Skips fractional seconds and applies a "Z", "+hh:mm" or "-hhmm" suffix */
+static time_t apply_iso_suffix(const char *text, size_t length, size_t pos,
+                               time_t timestamp) {
+  int hours, minutes;
+  int sign;
+
+  if (pos < length && (text[pos] == '.' || text[pos] == ',')) {
+    pos++;
+    while (pos < length && is_digit(text[pos])) pos++;
+  }
+  if (pos >= length || (text[pos] != '+' && text[pos] != '-'))
+    return timestamp;
+
+  sign = text[pos] == '+' ? 1 : -1;
+  pos++;
+  if (pos + 2 > length || !parse_digits(text + pos, 2, &hours))
+    return timestamp;
+  pos += 2;
+  if (pos < length && text[pos] == ':') pos++;
+  if (pos + 2 > length || !parse_digits(text + pos, 2, &minutes))
+    minutes = 0;
+
+  return timestamp - sign * (time_t)(hours * 3600 + minutes * 60);
+}
+
+/* ISO-8601 / RFC3339: "YYYY-MM-DD[T ]hh:mm:ss[.frac][Z|(+|-)hh[:]mm]" */
+static bool parse_iso(LogTimestampCache *cache, const char *text,
+                      size_t length, time_t *timestamp) {
+  int year, month, day, hour, minute, second;
+
+  if (length < ISO_TIMESTAMP_LENGTH || !parse_digits(text, 4, &year) ||
+      text[4] != '-' || !parse_digits(text + 5, 2, &month) || text[7] != '-' ||
+      !parse_digits(text + 8, 2, &day) ||
+      (text[10] != 'T' && text[10] != 't' && text[10] != ' ') ||
+      !parse_digits(text + 11, 2, &hour) || text[13] != ':' ||
+      !parse_digits(text + 14, 2, &minute) || text[16] != ':' ||
+      !parse_digits(text + 17, 2, &second) ||
+      !valid_time(month, day, hour, minute, second))
+    return false;
+
+  *timestamp = make_epoch(year, month, day, hour, minute, second);
+  remember(cache, text, ISO_TIMESTAMP_LENGTH, *timestamp, true);
+  *timestamp = apply_iso_suffix(text, length, ISO_TIMESTAMP_LENGTH, *timestamp);
+  return true;
+}
+
+/* Common Log Format: "dd/Mmm/yyyy:hh:mm:ss[ (+|-)hhmm]", as web servers log */
+static bool parse_clf(LogTimestampCache *cache, const char *text,
+                      size_t length, time_t *timestamp) {
+  int year, month, day, hour, minute, second, hours, minutes;
+  size_t key_length = CLF_TIMESTAMP_LENGTH;
+
+  if (length < CLF_TIMESTAMP_LENGTH || !parse_digits(text, 2, &day) ||
+      text[2] != '/' || text[6] != '/' ||
+      (month = month_from_name(text + 3)) == 0 ||
+      !parse_digits(text + 7, 4, &year) || text[11] != ':' ||
+      !parse_digits(text + 12, 2, &hour) || text[14] != ':' ||
+      !parse_digits(text + 15, 2, &minute) || text[17] != ':' ||
+      !parse_digits(text + 18, 2, &second) ||
+      !valid_time(month, day, hour, minute, second))
+    return false;
+
+  *timestamp = make_epoch(year, month, day, hour, minute, second);
+
+  /* The zone is part of the cached key, so a hit needs no more work */
+  if (length >= CLF_TIMESTAMP_LENGTH + CLF_ZONE_LENGTH && text[20] == ' ' &&
+      (text[21] == '+' || text[21] == '-') &&
+      parse_digits(text + 22, 2, &hours) &&
+      parse_digits(text + 24, 2, &minutes)) {
+    *timestamp -= (text[21] == '+' ? 1 : -1) *
+                  (time_t)(hours * 3600 + minutes * 60);
+    key_length += CLF_ZONE_LENGTH;
+  }
+  remember(cache, text, key_length, *timestamp, false);
+  return true;
+}
+
+/*
+ * Leading epoch seconds (9 or 10 digits) or milliseconds (11 to 13),
+ * ending at a delimiter. Shorter numbers are counts, ports or addresses
+ * ("3 workers died", "127.0.0.1 - -") and are not timestamps.
+ */
+static bool parse_epoch(const char *text, size_t length, time_t *timestamp) {
+  size_t pos = 0, digits;
+  long long value = 0;
+
+  while (pos < length && isspace((unsigned char)text[pos])) pos++;
+  for (digits = 0; pos < length && is_digit(text[pos]); pos++, digits++) {
+    if (digits == EPOCH_MAX_DIGITS) return false;
+    value = value * 10 + (text[pos] - '0');
+  }
+  if (digits < EPOCH_MIN_DIGITS ||
+      (pos < length && isalnum((unsigned char)text[pos])))
+    return false;
+
+  *timestamp = (time_t)(digits > 10 ? value / 1000 : value);
+  return true;
+}
+
+void log_timestamp_cache_init(LogTimestampCache *cache) {
+  struct tm now;
+
+  if (!cache) return;
+
+  memset(cache, 0, sizeof(LogTimestampCache));
+  cache->now = time(NULL);
+  cache->year = gmtime_r(&cache->now, &now) ? now.tm_year + 1900 : 1970;
+}
+
+/*
+ * Whether text starts with a timestamp; *timestamp is set to it, or to the
+ * cache's start time when there is none.
+ */
+bool log_timestamp_find(LogTimestampCache *cache, const char *text,
+                        size_t length, time_t *timestamp) {
+  if (!cache || !text) {
+    *timestamp = 0;
+    return false;
+  }
+  if (cache->year == 0) log_timestamp_cache_init(cache);
+
+  if (cache->key_length > 0 && length >= cache->key_length &&
+      memcmp(text, cache->key, cache->key_length) == 0) {
+    *timestamp = cache->key_iso
+                     ? apply_iso_suffix(text, length, cache->key_length,
+                                        cache->key_epoch)
+                     : cache->key_epoch;
+    return true;
+  }
+
+  if (parse_syslog(cache, text, length, timestamp) ||
+      parse_iso(cache, text, length, timestamp) ||
+      parse_clf(cache, text, length, timestamp) ||
+      parse_epoch(text, length, timestamp))
+    return true;
+
+  *timestamp = cache->now;
+  return false;
+}
+
+time_t log_timestamp_parse(LogTimestampCache *cache, const char *text,
+                           size_t length) {
+  time_t timestamp;
+
+  log_timestamp_find(cache, text, length, &timestamp);
+  return timestamp;
+}
+
+void log_time_range_add(LogTimeRange *range, time_t timestamp) {
+  if (!range) return;
+
+  if (!range->valid) {
+    range->first = range->last = timestamp;
+    range->valid = true;
+  } else if (timestamp < range->first) {
+    range->first = timestamp;
+  } else if (timestamp > range->last) {
+    range->last = timestamp;
+  }
+}
+
+void log_time_range_merge(LogTimeRange *into, const LogTimeRange *from) {
+  if (!into || !from || !from->valid) return;
+
+  log_time_range_add(into, from->first);
+  log_time_range_add(into, from->last);
+}